@@ -1,71 +1,207 @@
+#include <string.h>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
 #include "crypto.h"
 #include "aes_locl.h"
 
 void aes128_key_expansion(Octet *ekey, const Octet *key){
-	Octet rc = 0x01;
-	Octet t;
-	int i;
+	OP_COUNT(OP_AES_KEY, 1);
 
+#if defined(AES_NI)
+	if (aes_ni_available()) {
+		aes128_ni_key_expansion(ekey, key);
+		return;
+	}
+#endif
+#if defined(AES_COMPACT)
+	/* Round keys are computed during encryption and decryption. */
 	aes_strcpy(ekey, key, AES128_KEY_BYTES);
+#else
+	aes_key_expansion(ekey, key);
+#endif
+#if defined(AES_TTABLE) || defined(AES_NI)
+	aes_inv_key(ekey + AES128_RKEY_BYTES, ekey, AES128_RKEY_BYTES);
+#endif
+}
 
-	for (i = AES128_KEY_BYTES; i < AES128_EKEY_BYTES; i += 4) {
-		ekey[i + 0] = ekey[i - 4];
-		ekey[i + 1] = ekey[i - 3];
-		ekey[i + 2] = ekey[i - 2];
-		ekey[i + 3] = ekey[i - 1];
-
-		if ((i & 0x0F) == 0) {
-			sub_word(ekey + i);
-			t = ekey[i + 0];
-			ekey[i + 0] = ekey[i + 1] ^ rc;
-			ekey[i + 1] = ekey[i + 2];
-			ekey[i + 2] = ekey[i + 3];
-			ekey[i + 3] = t;
-			MUL_BY_X(rc);
-		}
+void aes128_encrypt(Octet *out, const Octet *in, const Octet *ekey){
+#if defined(AES_NI)
+	if (aes_ni_available()) {
+		aes128_ni_encrypt(out, in, ekey);
+		return;
+	}
+#endif
+#if defined(AES_BITSLICE)
+	aes_bs_encrypt(out, in, 1, ekey, AES128_RKEY_BYTES);
+#elif defined(AES_TTABLE)
+	aes_ttable_encrypt(out, in, ekey, AES128_RKEY_BYTES);
+#elif defined(AES_COMPACT)
+	aes_compact_encrypt(out, in, ekey);
+#else
+	aes_encrypt(out, in, ekey, AES128_RKEY_BYTES);
+#endif
+}
 
-		ekey[i + 0] ^= ekey[i - 16];
-		ekey[i + 1] ^= ekey[i - 15];
-		ekey[i + 2] ^= ekey[i - 14];
-		ekey[i + 3] ^= ekey[i - 13];
+void aes128_decrypt(Octet *out, const Octet *in, const Octet *ekey){
+#if defined(AES_NI)
+	if (aes_ni_available()) {
+		aes128_ni_decrypt(out, in, ekey);
+		return;
 	}
+#endif
+#if defined(AES_BITSLICE)
+	aes_bs_decrypt(out, in, 1, ekey, AES128_RKEY_BYTES);
+#elif defined(AES_TTABLE)
+	aes_ttable_decrypt(out, in, ekey + AES128_RKEY_BYTES, AES128_RKEY_BYTES);
+#elif defined(AES_COMPACT)
+	Octet lkey[AES128_KEY_BYTES];
+
+	aes_compact_last_key(lkey, ekey);
+	aes_compact_decrypt(out, in, lkey);
+	memset(lkey, 0, sizeof(lkey));
+#else
+	aes_decrypt(out, in, ekey, AES128_RKEY_BYTES);
+#endif
 }
 
-void aes128_encrypt(Octet *out, const Octet *in, const Octet *ekey){
-	aes_encrypt(out, in, ekey, AES128_EKEY_BYTES);
+void aes128_encrypt_blocks(Octet *out, const Octet *in, int blocks, const Octet *ekey){
+#if defined(AES_NI)
+	if (aes_ni_available()) {
+		aes128_ni_encrypt_blocks(out, in, blocks, ekey);
+		return;
+	}
+#endif
+#if defined(AES_BITSLICE)
+	aes_bs_encrypt(out, in, blocks, ekey, AES128_RKEY_BYTES);
+#else
+	for (; blocks > 0; blocks--) {
+		aes128_encrypt(out, in, ekey);
+		in += 16;
+		out += 16;
+	}
+#endif
 }
 
-void aes128_decrypt(Octet *out, const Octet *in, const Octet *ekey){
-	aes_decrypt(out, in, ekey, AES128_EKEY_BYTES);
+void aes128_decrypt_blocks(Octet *out, const Octet *in, int blocks, const Octet *ekey){
+#if defined(AES_NI)
+	if (aes_ni_available()) {
+		aes128_ni_decrypt_blocks(out, in, blocks, ekey);
+		return;
+	}
+#endif
+#if defined(AES_BITSLICE)
+	aes_bs_decrypt(out, in, blocks, ekey, AES128_RKEY_BYTES);
+#elif defined(AES_COMPACT)
+	/* Forward pass of key schedule once for all blocks. */
+	Octet lkey[AES128_KEY_BYTES];
+
+	aes_compact_last_key(lkey, ekey);
+
+	for (; blocks > 0; blocks--) {
+		aes_compact_decrypt(out, in, lkey);
+		in += 16;
+		out += 16;
+	}
+
+	memset(lkey, 0, sizeof(lkey));
+#else
+	for (; blocks > 0; blocks--) {
+		aes128_decrypt(out, in, ekey);
+		in += 16;
+		out += 16;
+	}
+#endif
 }
 
 static void aes128_xor_block(Octet *dst, const Octet *src){
-	for (int i = 0; i < 16; i++) {
-		dst[i] ^= src[i];
-	}
+	uint64_t d[2], t[2];
+
+	/* Two words instead of 16 octets (memcpy is free of alignment). */
+	memcpy(d, dst, 16);
+	memcpy(t, src, 16);
+	d[0] ^= t[0];
+	d[1] ^= t[1];
+	memcpy(dst, d, 16);
 }
 
 static void aes128_mov_block(Octet *dst, const Octet *src){
+	memcpy(dst, src, 16);
+}
+
+static void aes128_zeroize_block(Octet *dst){
+	volatile Octet *p = dst;
+
 	for (int i = 0; i < 16; i++) {
-		dst[i] = src[i];
+		p[i] = 0;
 	}
 }
 
-int aes128_cbc_encrypt(Octet *out, const Octet *in, int len, const Octet* iv, const Octet *ekey){
-	Octet buf[16] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-	int retLen = 0;
-
-	aes128_xor_block(buf, iv);
+/* CBC encryption of whole blocks, chaining value in buf. */
+static void aes128_cbc_encrypt_blocks(Octet *out, const Octet *in, int blocks, Octet *buf, const Octet *ekey){
+#if defined(AES_NI)
+	if (aes_ni_available()) {
+		aes128_ni_cbc_encrypt(out, in, blocks, buf, ekey);
+		return;
+	}
+#endif
 
-	while (len >= 16) {
+	while (blocks-- > 0) {
 		aes128_xor_block(buf, in);
-		in += 16;
-		len -= 16;
 		aes128_encrypt(buf, buf, ekey);
 		aes128_mov_block(out, buf);
+		in += 16;
 		out += 16;
-		retLen += 16;
 	}
+}
+
+/* Number of blocks decrypted at once by aes128_decrypt_blocks() in CBC. */
+#define AES128_CBC_PAR_BLOCKS 8
+
+/* CBC decryption of whole blocks, chaining value in buf. Blocks are independent. */
+static void aes128_cbc_decrypt_blocks(Octet *out, const Octet *in, int blocks, Octet *buf, const Octet *ekey){
+	Octet tmp[AES128_CBC_PAR_BLOCKS*16];
+	int n, j;
+
+#if defined(AES_NI)
+	if (aes_ni_available()) {
+		aes128_ni_cbc_decrypt(out, in, blocks, buf, ekey);
+		return;
+	}
+#endif
+
+	for (; blocks > 0; blocks -= n) {
+		n = blocks < AES128_CBC_PAR_BLOCKS ? blocks : AES128_CBC_PAR_BLOCKS;
+		aes128_decrypt_blocks(tmp, in, n, ekey);
+		aes128_xor_block(tmp, buf);
+
+		for (j = 1; j < n; j++)
+			aes128_xor_block(tmp + 16*j, in + 16*(j - 1));
+
+		/* Input is read before output is written, so out may be in. */
+		aes128_mov_block(buf, in + 16*(n - 1));
+
+		for (j = 0; j < n; j++)
+			aes128_mov_block(out + 16*j, tmp + 16*j);
+
+		in += 16*n;
+		out += 16*n;
+	}
+}
+
+int aes128_cbc_encrypt(Octet *out, const Octet *in, int len, const Octet* iv, const Octet *ekey){
+	Octet buf[16] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+	int retLen = 0;
+
+	aes128_xor_block(buf, iv);
+
+	retLen = len & ~15;
+	aes128_cbc_encrypt_blocks(out, in, len / 16, buf, ekey);
+	in += retLen;
+	out += retLen;
+	len -= retLen;
 
 	Octet pad = (Octet)(16 - len);
 
@@ -84,30 +220,292 @@ int aes128_cbc_encrypt(Octet *out, const Octet *in, int len, const Octet* iv, co
 	return retLen;
 }
 
+/* Inputs of at least this many octets per thread are decrypted by several threads. */
+#define AES128_CBC_MT_BYTES (1 << 18)
+/* Maximum number of threads of CBC decryption. */
+#define AES128_CBC_MAX_THREADS 16
+
+/* Number of threads of CBC decryption (0 - number of CPUs). */
+static int aes128_cbc_threads = 0;
+
+void aes128_cbc_set_threads(int threads){
+	aes128_cbc_threads = threads;
+}
+
+/*
+ * CBC decryption of whole blocks split into segments for threads. Chaining
+ * value of every segment is the last ciphertext block of previous one, so
+ * they are copied before anything is written (out may be in).
+ */
+static void aes128_cbc_decrypt_mt(Octet *out, const Octet *in, int blocks, Octet *buf, const Octet *ekey){
+	Octet ivs[AES128_CBC_MAX_THREADS][16];
+	std::thread pool[AES128_CBC_MAX_THREADS];
+	int threads = aes128_cbc_threads > 0 ? aes128_cbc_threads : (int)std::thread::hardware_concurrency();
+	int per, t;
+
+	if (threads > AES128_CBC_MAX_THREADS)
+		threads = AES128_CBC_MAX_THREADS;
+	if (threads > blocks / (AES128_CBC_MT_BYTES / 16))
+		threads = blocks / (AES128_CBC_MT_BYTES / 16);
+
+	if (threads <= 1) {
+		aes128_cbc_decrypt_blocks(out, in, blocks, buf, ekey);
+		return;
+	}
+
+	per = blocks / threads;
+	aes128_mov_block(ivs[0], buf);
+
+	for (t = 1; t < threads; t++)
+		aes128_mov_block(ivs[t], in + 16*(t*per - 1));
+
+	aes128_mov_block(buf, in + 16*(blocks - 1));
+
+	for (t = 1; t < threads; t++) {
+		int n = t < threads - 1 ? per : blocks - t*per;
+
+		pool[t] = std::thread(aes128_cbc_decrypt_blocks, out + 16*t*per, in + 16*t*per, n, ivs[t], ekey);
+	}
+
+	aes128_cbc_decrypt_blocks(out, in, per, ivs[0], ekey);
+
+	for (t = 1; t < threads; t++)
+		pool[t].join();
+}
+
+/* 0xFF if a < b, 0x00 otherwise (|a|, |b| < 2^30), without branches. */
+static Octet aes128_ct_lt(int a, int b){
+	return (Octet)(0 - ((unsigned int)(a - b) >> 31));
+}
+
 int aes128_cbc_decrypt(Octet *out, const Octet *in, int len, const Octet* iv, const Octet *ekey){
 	Octet buf[16] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 	Octet tmp[16];
+	Octet pad, bad, keep;
 	int retLen = 0;
 
+	/* Length is public: only whole blocks can be decrypted. */
+	if (len <= 0 || (len & 15) != 0)
+		return -1;
+
 	aes128_xor_block(buf, iv);
 
-	while (len > 16) {
-		aes128_decrypt(tmp, in, ekey);
-		aes128_xor_block(tmp, buf);
-		aes128_mov_block(out, tmp);
-		aes128_mov_block(buf, in);
-		in += 16;
-		len -= 16;
-		out += 16;
-		retLen += 16;
-	}
+	retLen = len - 16;
+	aes128_cbc_decrypt_mt(out, in, retLen / 16, buf, ekey);
+	in += retLen;
+	out += retLen;
 
 	aes128_decrypt(tmp, in, ekey);
 	aes128_xor_block(tmp, buf);
 
-	for (int i = 0; i < 16-tmp[15]; i++) {
+	/*
+	 * Padding (1..16 octets of value pad) is checked in constant time:
+	 * every octet of last block is examined whatever pad is.
+	 */
+	pad = tmp[15];
+	bad = (Octet)(aes128_ct_lt(pad, 1) | aes128_ct_lt(16, pad));
+
+	for (int i = 0; i < 16; i++) {
+		bad |= (Octet)(~aes128_ct_lt(i, 16 - pad) & (tmp[i] ^ pad));
+	}
+
+	/* Non-zero octet becomes 0xFF. */
+	bad = aes128_ct_lt(0, bad);
+
+	/* Only plaintext octets are written, none of last block if padding is bad. */
+	keep = (Octet)(16 - pad) & (Octet)~bad;
+
+	for (int i = 0; i < keep; i++) {
 		out[i] = tmp[i];
 	}
 
-	return retLen + 16 - tmp[15];
+	aes128_zeroize_block(tmp);
+
+	return (retLen + 16 - pad) | -(int)(bad & 1);
+}
+
+void aes128_cbc_mac(Octet *mac, const Octet *in, int len, const Octet *ekey){
+	Octet buf[16] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+	while (len > 0) {
+		for (int i = 0; i < 16 && i < len; i++) {
+			buf[i] ^= in[i];
+		}
+
+		aes128_encrypt(buf, buf, ekey);
+		in += 16;
+		len -= 16;
+	}
+
+	aes128_mov_block(mac, buf);
+}
+
+/* Number of counter blocks encrypted at once by aes128_encrypt_blocks() in CTR. */
+#define AES128_CTR_PAR_BLOCKS 8
+
+/* Counter as 128-bit big-endian number is increased by one. */
+static void aes128_ctr_inc(Octet *ctr){
+	for (int i = 15; i >= 0; i--) {
+		if (++ctr[i] != 0)
+			break;
+	}
+}
+
+void aes128_ctr_init(Aes128Ctr *ctx, const Octet *iv){
+	aes128_mov_block(ctx->counter, iv);
+	ctx->used = 16;
+}
+
+void aes128_ctr_xcrypt(Aes128Ctr *ctx, Octet *out, const Octet *in, int len, const Octet *ekey){
+	Octet ks[AES128_CTR_PAR_BLOCKS*16];
+	int n, i;
+
+	/* Rest of key stream block of previous call. */
+	for (; ctx->used < 16 && len > 0; len--)
+		*out++ = *in++ ^ ctx->stream[ctx->used++];
+
+	/* Whole blocks: counter blocks are independent, so they are encrypted together. */
+	while (len >= 16) {
+		n = len / 16 < AES128_CTR_PAR_BLOCKS ? len / 16 : AES128_CTR_PAR_BLOCKS;
+
+		for (i = 0; i < n; i++) {
+			aes128_mov_block(ks + 16*i, ctx->counter);
+			aes128_ctr_inc(ctx->counter);
+		}
+
+		aes128_encrypt_blocks(ks, ks, n, ekey);
+
+		for (i = 0; i < 16*n; i++)
+			out[i] = in[i] ^ ks[i];
+
+		in += 16*n;
+		out += 16*n;
+		len -= 16*n;
+	}
+
+	if (len > 0) {
+		aes128_encrypt(ctx->stream, ctx->counter, ekey);
+		aes128_ctr_inc(ctx->counter);
+
+		for (ctx->used = 0; ctx->used < len; ctx->used++)
+			out[ctx->used] = in[ctx->used] ^ ctx->stream[ctx->used];
+	}
+}
+
+/* Number of streams interleaved by aes128_cbc_encrypt_multi(). */
+#define AES128_CBC_LANES 8
+
+/* Keys of streams prepared for encryption of one block of every stream. */
+typedef struct Aes128Lanes_st {
+	const Octet *ekeys[AES128_CBC_LANES];
+#if defined(AES_BITSLICE)
+	AesBsKeys planes;
+#endif
+} Aes128Lanes;
+
+static void aes128_lanes_init(Aes128Lanes *l, int lanes){
+#if defined(AES_BITSLICE)
+#if defined(AES_NI)
+	if (aes_ni_available())
+		return;
+#endif
+	aes_bs_round_keys_lanes(&l->planes, l->ekeys, lanes, AES128_RKEY_BYTES);
+#else
+	(void)l;
+	(void)lanes;
+#endif
+}
+
+/* Block k is encrypted under key of stream k. */
+static void aes128_encrypt_lanes(Octet *x, int lanes, const Aes128Lanes *l){
+#if defined(AES_NI)
+	if (aes_ni_available()) {
+		aes128_ni_encrypt_lanes(x, x, lanes, l->ekeys);
+		return;
+	}
+#endif
+#if defined(AES_BITSLICE)
+	aes_bs_encrypt_lanes(x, x, lanes, &l->planes, AES128_RKEY_BYTES);
+#else
+	for (int k = 0; k < lanes; k++) {
+		aes128_encrypt(x + 16*k, x + 16*k, l->ekeys[k]);
+	}
+#endif
+}
+
+/* Number of ciphertext blocks of job (padding always adds octets). */
+static int aes128_cbc_job_blocks(const Aes128CbcJob *job){
+	return job->len / 16 + 1;
+}
+
+/* XOR of plaintext block j of job (last one padded) into x. */
+static void aes128_cbc_job_xor(Octet *x, const Aes128CbcJob *job, int j){
+	const Octet *in = job->in + 16*j;
+	int rest = job->len - 16*j;
+
+	if (rest >= 16) {
+		aes128_xor_block(x, in);
+		return;
+	}
+
+	for (int i = 0; i < rest; i++) {
+		x[i] ^= in[i];
+	}
+
+	for (int i = rest; i < 16; i++) {
+		x[i] ^= (Octet)(16 - rest);
+	}
+}
+
+/* Up to AES128_CBC_LANES jobs in lock step: one block of every job per step. */
+static void aes128_cbc_encrypt_group(Aes128CbcJob *const *jobs, int lanes){
+	Octet x[AES128_CBC_LANES*16];
+	Aes128Lanes l;
+	int steps = 0;
+	int j, k;
+
+	/* Idle lanes have no key. */
+	for (k = 0; k < AES128_CBC_LANES; k++) {
+		l.ekeys[k] = k < lanes ? jobs[k]->ekey : 0;
+	}
+
+	for (k = 0; k < lanes; k++) {
+		aes128_mov_block(x + 16*k, jobs[k]->iv);
+		jobs[k]->outLen = 16*aes128_cbc_job_blocks(jobs[k]);
+		steps = std::max(steps, aes128_cbc_job_blocks(jobs[k]));
+	}
+
+	aes128_lanes_init(&l, lanes);
+
+	/* Finished streams keep encrypting their last block, output is not stored. */
+	for (j = 0; j < steps; j++) {
+		for (k = 0; k < lanes; k++) {
+			if (j < aes128_cbc_job_blocks(jobs[k]))
+				aes128_cbc_job_xor(x + 16*k, jobs[k], j);
+		}
+
+		aes128_encrypt_lanes(x, lanes, &l);
+
+		for (k = 0; k < lanes; k++) {
+			if (j < aes128_cbc_job_blocks(jobs[k]))
+				aes128_mov_block(jobs[k]->out + 16*j, x + 16*k);
+		}
+	}
+}
+
+void aes128_cbc_encrypt_multi(Aes128CbcJob *jobs, int count){
+	std::vector<Aes128CbcJob *> order(count);
+
+	for (int i = 0; i < count; i++) {
+		order[i] = jobs + i;
+	}
+
+	/* Jobs of similar length share group, so lanes are rarely idle. */
+	std::stable_sort(order.begin(), order.end(), [](const Aes128CbcJob *a, const Aes128CbcJob *b) {
+		return a->len < b->len;
+	});
+
+	for (int i = 0; i < count; i += AES128_CBC_LANES) {
+		aes128_cbc_encrypt_group(order.data() + i, std::min(AES128_CBC_LANES, count - i));
+	}
 }
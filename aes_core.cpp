@@ -1,7 +1,9 @@
+#include <string.h>
+
 #include "crypto.h"
 #include "aes_locl.h"
 
-static const Octet sbox_tbl[256] =
+static constexpr Octet sbox_tbl[256] =
 {
 	0x63, 0x7C, 0x77, 0x7B, 0xF2, 0x6B, 0x6F, 0xC5,
 	0x30, 0x01, 0x67, 0x2B, 0xFE, 0xD7, 0xAB, 0x76,
@@ -37,7 +39,7 @@ static const Octet sbox_tbl[256] =
 	0x41, 0x99, 0x2D, 0x0F, 0xB0, 0x54, 0xBB, 0x16
 };
 
-static const Octet isbox_tbl[256] =
+static constexpr Octet isbox_tbl[256] =
 {
 	0x52, 0x09, 0x6A, 0xD5, 0x30, 0x36, 0xA5, 0x38,
 	0xBF, 0x40, 0xA3, 0x9E, 0x81, 0xF3, 0xD7, 0xFB,
@@ -230,16 +232,58 @@ void aes_strcpy(Octet *dst, const Octet *src, int n){
 	}
 }
 
+#if defined(AES_BITSLICE)
+static void aes_bs_sub_word(Octet *word);
+#endif
+
 void sub_word(Octet *word){
+#if defined(AES_BITSLICE)
+	/* Key expansion without table lookups as well. */
+	aes_bs_sub_word(word);
+	return;
+#endif
+
 	word[0] = Sbox(word[0]);
 	word[1] = Sbox(word[1]);
 	word[2] = Sbox(word[2]);
 	word[3] = Sbox(word[3]);
 }
 
+void aes_key_expansion(Octet *ekey, const Octet *key){
+	Octet rc = 0x01;
+	Octet t;
+	int i;
+
+	aes_strcpy(ekey, key, AES_BLOCK_BYTES);
+
+	for (i = AES_BLOCK_BYTES; i < 11*AES_BLOCK_BYTES; i += 4) {
+		ekey[i + 0] = ekey[i - 4];
+		ekey[i + 1] = ekey[i - 3];
+		ekey[i + 2] = ekey[i - 2];
+		ekey[i + 3] = ekey[i - 1];
+
+		if ((i & 0x0F) == 0) {
+			sub_word(ekey + i);
+			t = ekey[i + 0];
+			ekey[i + 0] = ekey[i + 1] ^ rc;
+			ekey[i + 1] = ekey[i + 2];
+			ekey[i + 2] = ekey[i + 3];
+			ekey[i + 3] = t;
+			MUL_BY_X(rc);
+		}
+
+		ekey[i + 0] ^= ekey[i - 16];
+		ekey[i + 1] ^= ekey[i - 15];
+		ekey[i + 2] ^= ekey[i - 14];
+		ekey[i + 3] ^= ekey[i - 13];
+	}
+}
+
 void aes_encrypt(Octet *out, const Octet *in, const Octet *ekey, int ekey_bytes){
 	int i;
 
+	OP_COUNT(OP_AES_BLOCK, 1);
+
 	ekey_bytes -= AES_BLOCK_BYTES;
 
 	aes_strcpy(out, in, AES_BLOCK_BYTES);
@@ -258,9 +302,27 @@ void aes_encrypt(Octet *out, const Octet *in, const Octet *ekey, int ekey_bytes)
 	add_round_key(out, ekey + ekey_bytes);
 }
 
+void aes_inv_key(Octet *dkey, const Octet *ekey, int ekey_bytes){
+	int i;
+
+	ekey_bytes -= AES_BLOCK_BYTES;
+
+	aes_strcpy(dkey, ekey + ekey_bytes, AES_BLOCK_BYTES);
+
+	for (i = AES_BLOCK_BYTES; i < ekey_bytes; i += AES_BLOCK_BYTES)
+	{
+		aes_strcpy(dkey + i, ekey + ekey_bytes - i, AES_BLOCK_BYTES);
+		inv_mix_columns(dkey + i);
+	}
+
+	aes_strcpy(dkey + ekey_bytes, ekey, AES_BLOCK_BYTES);
+}
+
 void aes_decrypt(Octet *out, const Octet *in, const Octet *ekey, int ekey_bytes){
 	int i;
 
+	OP_COUNT(OP_AES_BLOCK, 1);
+
 	ekey_bytes -= AES_BLOCK_BYTES;
 
 	aes_strcpy(out, in, AES_BLOCK_BYTES);
@@ -278,3 +340,704 @@ void aes_decrypt(Octet *out, const Octet *in, const Octet *ekey, int ekey_bytes)
 	inv_sub_bytes(out);
 	add_round_key(out, ekey);
 }
+
+#if defined(AES_COMPACT)
+
+/*
+ * Round keys on the fly: only the current round key (16 octets) is kept.
+ * Round key i + 1 follows from round key i and the round constant, and
+ * the step can be undone, so decryption walks the schedule backwards from
+ * the last round key.
+ */
+
+static void aes_compact_next_key(Octet *rk, Octet rc){
+	Octet w[4] = {rk[13], rk[14], rk[15], rk[12]};
+	int i;
+
+	sub_word(w);
+	w[0] ^= rc;
+
+	for (i = 0; i < 4; i++)
+		rk[i] ^= w[i];
+	for (i = 4; i < 16; i++)
+		rk[i] ^= rk[i - 4];
+}
+
+static void aes_compact_prev_key(Octet *rk, Octet rc){
+	Octet w[4];
+	int i;
+
+	for (i = 15; i >= 4; i--)
+		rk[i] ^= rk[i - 4];
+
+	w[0] = rk[13];
+	w[1] = rk[14];
+	w[2] = rk[15];
+	w[3] = rk[12];
+	sub_word(w);
+	w[0] ^= rc;
+
+	for (i = 0; i < 4; i++)
+		rk[i] ^= w[i];
+}
+
+/* Round constant of previous round (division by x). */
+static Octet aes_compact_prev_rc(Octet rc){
+	return (rc & 1) ? (Octet)(((rc ^ 0x1B) >> 1) | 0x80) : (Octet)(rc >> 1);
+}
+
+void aes_compact_last_key(Octet *lkey, const Octet *key){
+	Octet rc = 0x01;
+	int i;
+
+	aes_strcpy(lkey, key, AES_BLOCK_BYTES);
+
+	for (i = 0; i < AES_COMPACT_ROUNDS; i++) {
+		aes_compact_next_key(lkey, rc);
+		MUL_BY_X(rc);
+	}
+}
+
+void aes_compact_encrypt(Octet *out, const Octet *in, const Octet *key){
+	Octet rk[AES_BLOCK_BYTES];
+	Octet rc = 0x01;
+	int i;
+
+	OP_COUNT(OP_AES_BLOCK, 1);
+
+	aes_strcpy(rk, key, AES_BLOCK_BYTES);
+	aes_strcpy(out, in, AES_BLOCK_BYTES);
+	add_round_key(out, rk);
+
+	for (i = 1; i < AES_COMPACT_ROUNDS; i++)
+	{
+		aes_compact_next_key(rk, rc);
+		MUL_BY_X(rc);
+		sub_bytes(out);
+		shift_rows(out);
+		mix_columns(out);
+		add_round_key(out, rk);
+	}
+
+	aes_compact_next_key(rk, rc);
+	sub_bytes(out);
+	shift_rows(out);
+	add_round_key(out, rk);
+
+	memset(rk, 0, sizeof(rk));
+}
+
+void aes_compact_decrypt(Octet *out, const Octet *in, const Octet *lkey){
+	Octet rk[AES_BLOCK_BYTES];
+	Octet rc = 0x36;
+	int i;
+
+	OP_COUNT(OP_AES_BLOCK, 1);
+
+	aes_strcpy(rk, lkey, AES_BLOCK_BYTES);
+	aes_strcpy(out, in, AES_BLOCK_BYTES);
+	add_round_key(out, rk);
+
+	for (i = 1; i < AES_COMPACT_ROUNDS; i++)
+	{
+		aes_compact_prev_key(rk, rc);
+		rc = aes_compact_prev_rc(rc);
+		inv_shift_rows(out);
+		inv_sub_bytes(out);
+		add_round_key(out, rk);
+		inv_mix_columns(out);
+	}
+
+	aes_compact_prev_key(rk, rc);
+	inv_shift_rows(out);
+	inv_sub_bytes(out);
+	add_round_key(out, rk);
+
+	memset(rk, 0, sizeof(rk));
+}
+
+#endif /* AES_COMPACT */
+
+#if defined(AES_TTABLE)
+
+/*
+ * T-tables: SubBytes, ShiftRows and MixColumns of single round are done
+ * by four lookups of 32-bit words per column. Columns are kept as
+ * big-endian words (row 0 in the most significant octet). Tables are
+ * generated from S-boxes at compile time, so they live in rodata.
+ */
+
+struct AesTTables {
+	Word Te[4][256];
+	Word Td[4][256];
+};
+
+static constexpr Octet aes_gf_mul(Octet a, Octet b){
+	Octet r = 0;
+
+	while (b) {
+		if (b & 1)
+			r ^= a;
+		a = (Octet)((a << 1) ^ ((a & 0x80) ? 0x1B : 0));
+		b >>= 1;
+	}
+
+	return r;
+}
+
+static constexpr Word aes_word(Octet b0, Octet b1, Octet b2, Octet b3){
+	return ((Word)b0 << 24) | ((Word)b1 << 16) | ((Word)b2 << 8) | (Word)b3;
+}
+
+static constexpr Word aes_ror8(Word w){
+	return (w >> 8) | (w << 24);
+}
+
+static constexpr AesTTables aes_ttables_make(){
+	AesTTables t = {};
+
+	for (int x = 0; x < 256; x++) {
+		Octet s = sbox_tbl[x];
+		Octet si = isbox_tbl[x];
+
+		t.Te[0][x] = aes_word(aes_gf_mul(s, 2), s, s, aes_gf_mul(s, 3));
+		t.Td[0][x] = aes_word(aes_gf_mul(si, 14), aes_gf_mul(si, 9), aes_gf_mul(si, 13), aes_gf_mul(si, 11));
+
+		for (int j = 1; j < 4; j++) {
+			t.Te[j][x] = aes_ror8(t.Te[j - 1][x]);
+			t.Td[j][x] = aes_ror8(t.Td[j - 1][x]);
+		}
+	}
+
+	return t;
+}
+
+static constexpr AesTTables aes_tt = aes_ttables_make();
+
+#define Te0 aes_tt.Te[0]
+#define Te1 aes_tt.Te[1]
+#define Te2 aes_tt.Te[2]
+#define Te3 aes_tt.Te[3]
+#define Td0 aes_tt.Td[0]
+#define Td1 aes_tt.Td[1]
+#define Td2 aes_tt.Td[2]
+#define Td3 aes_tt.Td[3]
+
+#define GETU32(p) aes_word((p)[0], (p)[1], (p)[2], (p)[3])
+#define PUTU32(p, w) { \
+	(p)[0] = (Octet)((w) >> 24); (p)[1] = (Octet)((w) >> 16); \
+	(p)[2] = (Octet)((w) >> 8); (p)[3] = (Octet)(w); }
+
+void aes_ttable_encrypt(Octet *out, const Octet *in, const Octet *ekey, int ekey_bytes){
+	const Octet *rk = ekey;
+	const Octet *last = ekey + ekey_bytes - AES_BLOCK_BYTES;
+	Word s0, s1, s2, s3;
+	Word t0, t1, t2, t3;
+
+	OP_COUNT(OP_AES_BLOCK, 1);
+
+	s0 = GETU32(in + 0) ^ GETU32(rk + 0);
+	s1 = GETU32(in + 4) ^ GETU32(rk + 4);
+	s2 = GETU32(in + 8) ^ GETU32(rk + 8);
+	s3 = GETU32(in + 12) ^ GETU32(rk + 12);
+
+	for (rk += AES_BLOCK_BYTES; rk < last; rk += AES_BLOCK_BYTES) {
+		t0 = Te0[s0 >> 24] ^ Te1[(s1 >> 16) & 0xFF] ^ Te2[(s2 >> 8) & 0xFF] ^ Te3[s3 & 0xFF] ^ GETU32(rk + 0);
+		t1 = Te0[s1 >> 24] ^ Te1[(s2 >> 16) & 0xFF] ^ Te2[(s3 >> 8) & 0xFF] ^ Te3[s0 & 0xFF] ^ GETU32(rk + 4);
+		t2 = Te0[s2 >> 24] ^ Te1[(s3 >> 16) & 0xFF] ^ Te2[(s0 >> 8) & 0xFF] ^ Te3[s1 & 0xFF] ^ GETU32(rk + 8);
+		t3 = Te0[s3 >> 24] ^ Te1[(s0 >> 16) & 0xFF] ^ Te2[(s1 >> 8) & 0xFF] ^ Te3[s2 & 0xFF] ^ GETU32(rk + 12);
+		s0 = t0;
+		s1 = t1;
+		s2 = t2;
+		s3 = t3;
+	}
+
+	t0 = aes_word(Sbox(s0 >> 24), Sbox((s1 >> 16) & 0xFF), Sbox((s2 >> 8) & 0xFF), Sbox(s3 & 0xFF)) ^ GETU32(rk + 0);
+	t1 = aes_word(Sbox(s1 >> 24), Sbox((s2 >> 16) & 0xFF), Sbox((s3 >> 8) & 0xFF), Sbox(s0 & 0xFF)) ^ GETU32(rk + 4);
+	t2 = aes_word(Sbox(s2 >> 24), Sbox((s3 >> 16) & 0xFF), Sbox((s0 >> 8) & 0xFF), Sbox(s1 & 0xFF)) ^ GETU32(rk + 8);
+	t3 = aes_word(Sbox(s3 >> 24), Sbox((s0 >> 16) & 0xFF), Sbox((s1 >> 8) & 0xFF), Sbox(s2 & 0xFF)) ^ GETU32(rk + 12);
+
+	PUTU32(out + 0, t0);
+	PUTU32(out + 4, t1);
+	PUTU32(out + 8, t2);
+	PUTU32(out + 12, t3);
+}
+
+void aes_ttable_decrypt(Octet *out, const Octet *in, const Octet *dkey, int dkey_bytes){
+	const Octet *rk = dkey;
+	const Octet *last = dkey + dkey_bytes - AES_BLOCK_BYTES;
+	Word s0, s1, s2, s3;
+	Word t0, t1, t2, t3;
+
+	OP_COUNT(OP_AES_BLOCK, 1);
+
+	s0 = GETU32(in + 0) ^ GETU32(rk + 0);
+	s1 = GETU32(in + 4) ^ GETU32(rk + 4);
+	s2 = GETU32(in + 8) ^ GETU32(rk + 8);
+	s3 = GETU32(in + 12) ^ GETU32(rk + 12);
+
+	for (rk += AES_BLOCK_BYTES; rk < last; rk += AES_BLOCK_BYTES) {
+		t0 = Td0[s0 >> 24] ^ Td1[(s3 >> 16) & 0xFF] ^ Td2[(s2 >> 8) & 0xFF] ^ Td3[s1 & 0xFF] ^ GETU32(rk + 0);
+		t1 = Td0[s1 >> 24] ^ Td1[(s0 >> 16) & 0xFF] ^ Td2[(s3 >> 8) & 0xFF] ^ Td3[s2 & 0xFF] ^ GETU32(rk + 4);
+		t2 = Td0[s2 >> 24] ^ Td1[(s1 >> 16) & 0xFF] ^ Td2[(s0 >> 8) & 0xFF] ^ Td3[s3 & 0xFF] ^ GETU32(rk + 8);
+		t3 = Td0[s3 >> 24] ^ Td1[(s2 >> 16) & 0xFF] ^ Td2[(s1 >> 8) & 0xFF] ^ Td3[s0 & 0xFF] ^ GETU32(rk + 12);
+		s0 = t0;
+		s1 = t1;
+		s2 = t2;
+		s3 = t3;
+	}
+
+	t0 = aes_word(InvSbox(s0 >> 24), InvSbox((s3 >> 16) & 0xFF), InvSbox((s2 >> 8) & 0xFF), InvSbox(s1 & 0xFF)) ^ GETU32(rk + 0);
+	t1 = aes_word(InvSbox(s1 >> 24), InvSbox((s0 >> 16) & 0xFF), InvSbox((s3 >> 8) & 0xFF), InvSbox(s2 & 0xFF)) ^ GETU32(rk + 4);
+	t2 = aes_word(InvSbox(s2 >> 24), InvSbox((s1 >> 16) & 0xFF), InvSbox((s0 >> 8) & 0xFF), InvSbox(s3 & 0xFF)) ^ GETU32(rk + 8);
+	t3 = aes_word(InvSbox(s3 >> 24), InvSbox((s2 >> 16) & 0xFF), InvSbox((s1 >> 8) & 0xFF), InvSbox(s0 & 0xFF)) ^ GETU32(rk + 12);
+
+	PUTU32(out + 0, t0);
+	PUTU32(out + 4, t1);
+	PUTU32(out + 8, t2);
+	PUTU32(out + 12, t3);
+}
+
+#endif /* AES_TTABLE */
+
+#if defined(AES_BITSLICE)
+
+/*
+ * Bitsliced AES (constant time): 8 blocks are kept in 8 vectors of 16
+ * octets. Vector b holds bit b of every octet of state: octet p of vector
+ * b has bit k set iff bit b of octet p of block k is set. S-box is the
+ * Boyar-Peralta circuit (113 gates) evaluated on whole vectors, ShiftRows
+ * permutes octets of vector, MixColumns rotates octets inside columns.
+ * There are no table lookups and no branches on data.
+ */
+
+typedef Octet AesBsVec __attribute__((vector_size(16)));
+typedef Word AesBsWords __attribute__((vector_size(16)));
+
+#define AES_BS_LANES 8
+
+#if defined(__x86_64__) || defined(__i386__)
+/* With SSSE3 ShiftRows is single PSHUFB: variant is chosen when program is loaded. */
+#define AES_BS_CLONES __attribute__((target_clones("ssse3", "default")))
+#else
+#define AES_BS_CLONES
+#endif
+
+template <typename T> static inline void aes_bs_sbox(T *q){
+	T x0, x1, x2, x3, x4, x5, x6, x7;
+	T y1, y2, y3, y4, y5, y6, y7, y8, y9;
+	T y10, y11, y12, y13, y14, y15, y16, y17, y18, y19;
+	T y20, y21;
+	T z0, z1, z2, z3, z4, z5, z6, z7, z8, z9;
+	T z10, z11, z12, z13, z14, z15, z16, z17;
+	T t0, t1, t2, t3, t4, t5, t6, t7, t8, t9;
+	T t10, t11, t12, t13, t14, t15, t16, t17, t18, t19;
+	T t20, t21, t22, t23, t24, t25, t26, t27, t28, t29;
+	T t30, t31, t32, t33, t34, t35, t36, t37, t38, t39;
+	T t40, t41, t42, t43, t44, t45, t46, t47, t48, t49;
+	T t50, t51, t52, t53, t54, t55, t56, t57, t58, t59;
+	T t60, t61, t62, t63, t64, t65, t66, t67;
+	T s0, s1, s2, s3, s4, s5, s6, s7;
+
+	x0 = q[7];
+	x1 = q[6];
+	x2 = q[5];
+	x3 = q[4];
+	x4 = q[3];
+	x5 = q[2];
+	x6 = q[1];
+	x7 = q[0];
+
+	/* Top linear transformation. */
+	y14 = x3 ^ x5;
+	y13 = x0 ^ x6;
+	y9 = x0 ^ x3;
+	y8 = x0 ^ x5;
+	t0 = x1 ^ x2;
+	y1 = t0 ^ x7;
+	y4 = y1 ^ x3;
+	y12 = y13 ^ y14;
+	y2 = y1 ^ x0;
+	y5 = y1 ^ x6;
+	y3 = y5 ^ y8;
+	t1 = x4 ^ y12;
+	y15 = t1 ^ x5;
+	y20 = t1 ^ x1;
+	y6 = y15 ^ x7;
+	y10 = y15 ^ t0;
+	y11 = y20 ^ y9;
+	y7 = x7 ^ y11;
+	y17 = y10 ^ y11;
+	y19 = y10 ^ y8;
+	y16 = t0 ^ y11;
+	y21 = y13 ^ y16;
+	y18 = x0 ^ y16;
+
+	/* Non-linear section (inversion in GF(2^4) tower field). */
+	t2 = y12 & y15;
+	t3 = y3 & y6;
+	t4 = t3 ^ t2;
+	t5 = y4 & x7;
+	t6 = t5 ^ t2;
+	t7 = y13 & y16;
+	t8 = y5 & y1;
+	t9 = t8 ^ t7;
+	t10 = y2 & y7;
+	t11 = t10 ^ t7;
+	t12 = y9 & y11;
+	t13 = y14 & y17;
+	t14 = t13 ^ t12;
+	t15 = y8 & y10;
+	t16 = t15 ^ t12;
+	t17 = t4 ^ t14;
+	t18 = t6 ^ t16;
+	t19 = t9 ^ t14;
+	t20 = t11 ^ t16;
+	t21 = t17 ^ y20;
+	t22 = t18 ^ y19;
+	t23 = t19 ^ y21;
+	t24 = t20 ^ y18;
+
+	t25 = t21 ^ t22;
+	t26 = t21 & t23;
+	t27 = t24 ^ t26;
+	t28 = t25 & t27;
+	t29 = t28 ^ t22;
+	t30 = t23 ^ t24;
+	t31 = t22 ^ t26;
+	t32 = t31 & t30;
+	t33 = t32 ^ t24;
+	t34 = t23 ^ t33;
+	t35 = t27 ^ t33;
+	t36 = t24 & t35;
+	t37 = t36 ^ t34;
+	t38 = t27 ^ t36;
+	t39 = t29 & t38;
+	t40 = t25 ^ t39;
+
+	t41 = t40 ^ t37;
+	t42 = t29 ^ t33;
+	t43 = t29 ^ t40;
+	t44 = t33 ^ t37;
+	t45 = t42 ^ t41;
+	z0 = t44 & y15;
+	z1 = t37 & y6;
+	z2 = t33 & x7;
+	z3 = t43 & y16;
+	z4 = t40 & y1;
+	z5 = t29 & y7;
+	z6 = t42 & y11;
+	z7 = t45 & y17;
+	z8 = t41 & y10;
+	z9 = t44 & y12;
+	z10 = t37 & y3;
+	z11 = t33 & y4;
+	z12 = t43 & y13;
+	z13 = t40 & y5;
+	z14 = t29 & y2;
+	z15 = t42 & y9;
+	z16 = t45 & y14;
+	z17 = t41 & y8;
+
+	/* Bottom linear transformation. */
+	t46 = z15 ^ z16;
+	t47 = z10 ^ z11;
+	t48 = z5 ^ z13;
+	t49 = z9 ^ z10;
+	t50 = z2 ^ z12;
+	t51 = z2 ^ z5;
+	t52 = z7 ^ z8;
+	t53 = z0 ^ z3;
+	t54 = z6 ^ z7;
+	t55 = z16 ^ z17;
+	t56 = z12 ^ t48;
+	t57 = t50 ^ t53;
+	t58 = z4 ^ t46;
+	t59 = z3 ^ t54;
+	t60 = t46 ^ t57;
+	t61 = z14 ^ t57;
+	t62 = t52 ^ t58;
+	t63 = t49 ^ t58;
+	t64 = z4 ^ t59;
+	t65 = t61 ^ t62;
+	t66 = z1 ^ t63;
+	s0 = t59 ^ t63;
+	s6 = t56 ^ ~t62;
+	s7 = t48 ^ ~t60;
+	t67 = t64 ^ t65;
+	s3 = t53 ^ t66;
+	s4 = t51 ^ t66;
+	s5 = t47 ^ t65;
+	s1 = t64 ^ ~s3;
+	s2 = t55 ^ ~t67;
+
+	q[7] = s0;
+	q[6] = s1;
+	q[5] = s2;
+	q[4] = s3;
+	q[3] = s4;
+	q[2] = s5;
+	q[1] = s6;
+	q[0] = s7;
+}
+
+/* Inverse S-box: S^-1(y) = A^-1(S(A^-1(y + 0x63)) + 0x63), A - affine map of S-box. */
+template <typename T> static inline void aes_bs_inv_affine(T *q){
+	T q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+	T q4 = q[4], q5 = q[5], q6 = q[6], q7 = q[7];
+
+	q[0] = ~(q2 ^ q5 ^ q7);
+	q[1] = q3 ^ q6 ^ q0;
+	q[2] = ~(q4 ^ q7 ^ q1);
+	q[3] = q5 ^ q0 ^ q2;
+	q[4] = q6 ^ q1 ^ q3;
+	q[5] = q7 ^ q2 ^ q4;
+	q[6] = q0 ^ q3 ^ q5;
+	q[7] = q1 ^ q4 ^ q6;
+}
+
+template <typename T> static inline void aes_bs_inv_sbox(T *q){
+	aes_bs_inv_affine(q);
+	aes_bs_sbox(q);
+	aes_bs_inv_affine(q);
+}
+
+static void aes_bs_sub_word(Octet *word){
+	Word q[8];
+	int b, k;
+
+	for (b = 0; b < 8; b++) {
+		q[b] = 0;
+		for (k = 0; k < 4; k++)
+			q[b] |= (Word)((word[k] >> b) & 1) << k;
+	}
+
+	aes_bs_sbox(q);
+
+	for (k = 0; k < 4; k++) {
+		word[k] = 0;
+		for (b = 0; b < 8; b++)
+			word[k] |= (Octet)(((q[b] >> k) & 1) << b);
+	}
+}
+
+static inline void aes_bs_swapmove(AesBsVec &a, AesBsVec &b, Octet mask, int n){
+	AesBsVec t = ((a >> n) ^ b) & mask;
+
+	b ^= t;
+	a ^= t << n;
+}
+
+/* Transposition of 8x8 bit matrices (one per octet position): blocks <-> bit planes. */
+static inline void aes_bs_transpose(AesBsVec *q){
+	aes_bs_swapmove(q[0], q[1], 0x55, 1);
+	aes_bs_swapmove(q[2], q[3], 0x55, 1);
+	aes_bs_swapmove(q[4], q[5], 0x55, 1);
+	aes_bs_swapmove(q[6], q[7], 0x55, 1);
+
+	aes_bs_swapmove(q[0], q[2], 0x33, 2);
+	aes_bs_swapmove(q[1], q[3], 0x33, 2);
+	aes_bs_swapmove(q[4], q[6], 0x33, 2);
+	aes_bs_swapmove(q[5], q[7], 0x33, 2);
+
+	aes_bs_swapmove(q[0], q[4], 0x0F, 4);
+	aes_bs_swapmove(q[1], q[5], 0x0F, 4);
+	aes_bs_swapmove(q[2], q[6], 0x0F, 4);
+	aes_bs_swapmove(q[3], q[7], 0x0F, 4);
+}
+
+/* Round keys are the same for all blocks: every bit becomes 0x00 or 0xFF. */
+static void aes_bs_round_keys(AesBsVec *rk, const Octet *ekey, int rounds){
+	AesBsVec k;
+	int i, b;
+
+	for (i = 0; i <= rounds; i++) {
+		memcpy(&k, ekey + i*AES_BLOCK_BYTES, AES_BLOCK_BYTES);
+		for (b = 0; b < 8; b++)
+			rk[8*i + b] = -((k >> b) & 1);
+	}
+}
+
+static inline void aes_bs_add_round_key(AesBsVec *q, const AesBsVec *rk){
+	for (int b = 0; b < 8; b++)
+		q[b] ^= rk[b];
+}
+
+static inline void aes_bs_shift_rows(AesBsVec *q){
+	const AesBsVec m = {0, 5, 10, 15, 4, 9, 14, 3, 8, 13, 2, 7, 12, 1, 6, 11};
+
+	for (int b = 0; b < 8; b++)
+		q[b] = __builtin_shuffle(q[b], m);
+}
+
+static inline void aes_bs_inv_shift_rows(AesBsVec *q){
+	const AesBsVec m = {0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3};
+
+	for (int b = 0; b < 8; b++)
+		q[b] = __builtin_shuffle(q[b], m);
+}
+
+/* Octet r of every column gets octet r + n/8 of the same column. */
+static inline AesBsVec aes_bs_rot(AesBsVec v, int n){
+	AesBsWords w = (AesBsWords)v;
+
+	return (AesBsVec)((w >> n) | (w << (32 - n)));
+}
+
+/* Multiplication by x in GF(2^8) of bit planes. */
+static inline void aes_bs_xtime(AesBsVec *x, const AesBsVec *t){
+	x[0] = t[7];
+	x[1] = t[0] ^ t[7];
+	x[2] = t[1];
+	x[3] = t[2] ^ t[7];
+	x[4] = t[3] ^ t[7];
+	x[5] = t[4];
+	x[6] = t[5];
+	x[7] = t[6];
+}
+
+/* a' = 2a + 3a1 + a2 + a3 = x(a + a1) + a1 + a2 + a3, where ai - octet i rows below. */
+static inline void aes_bs_mix_columns(AesBsVec *q){
+	AesBsVec t[8];
+	AesBsVec x[8];
+	int b;
+
+	for (b = 0; b < 8; b++) {
+		AesBsVec a1 = aes_bs_rot(q[b], 8);
+
+		t[b] = q[b] ^ a1;
+		q[b] = a1 ^ aes_bs_rot(t[b], 16);
+	}
+
+	aes_bs_xtime(x, t);
+
+	for (b = 0; b < 8; b++)
+		q[b] ^= x[b];
+}
+
+/* InvMixColumns(a) = MixColumns(a + x^2(a + a2)). */
+static inline void aes_bs_inv_mix_columns(AesBsVec *q){
+	AesBsVec t[8];
+	AesBsVec x[8];
+	int b;
+
+	for (b = 0; b < 8; b++)
+		t[b] = q[b] ^ aes_bs_rot(q[b], 16);
+
+	aes_bs_xtime(x, t);
+	aes_bs_xtime(t, x);
+
+	for (b = 0; b < 8; b++)
+		q[b] ^= t[b];
+
+	aes_bs_mix_columns(q);
+}
+
+static void aes_bs_load(AesBsVec *q, const Octet *in, int blocks){
+	memset(q, 0, AES_BS_LANES*sizeof(AesBsVec));
+	memcpy(q, in, blocks*AES_BLOCK_BYTES);
+	aes_bs_transpose(q);
+}
+
+static void aes_bs_store(Octet *out, AesBsVec *q, int blocks){
+	aes_bs_transpose(q);
+	memcpy(out, q, blocks*AES_BLOCK_BYTES);
+}
+
+static inline void aes_bs_encrypt_planes(AesBsVec *q, const AesBsVec *rk, int rounds){
+	int i;
+
+	aes_bs_add_round_key(q, rk);
+
+	for (i = 1; i < rounds; i++) {
+		aes_bs_sbox(q);
+		aes_bs_shift_rows(q);
+		aes_bs_mix_columns(q);
+		aes_bs_add_round_key(q, rk + 8*i);
+	}
+
+	aes_bs_sbox(q);
+	aes_bs_shift_rows(q);
+	aes_bs_add_round_key(q, rk + 8*rounds);
+}
+
+AES_BS_CLONES void aes_bs_encrypt(Octet *out, const Octet *in, int blocks, const Octet *ekey, int ekey_bytes){
+	int rounds = ekey_bytes / AES_BLOCK_BYTES - 1;
+	AesBsVec rk[8*15];
+	AesBsVec q[8];
+	int n;
+
+	OP_COUNT(OP_AES_BLOCK, blocks);
+
+	aes_bs_round_keys(rk, ekey, rounds);
+
+	for (; blocks > 0; blocks -= n) {
+		n = blocks < AES_BS_LANES ? blocks : AES_BS_LANES;
+		aes_bs_load(q, in, n);
+		aes_bs_encrypt_planes(q, rk, rounds);
+		aes_bs_store(out, q, n);
+
+		in += n*AES_BLOCK_BYTES;
+		out += n*AES_BLOCK_BYTES;
+	}
+}
+
+/* Round keys of lane k are transposed like blocks of data. */
+void aes_bs_round_keys_lanes(AesBsKeys *keys, const Octet *const *ekeys, int lanes, int ekey_bytes){
+	AesBsVec *rk = (AesBsVec *)keys->planes;
+	int rounds = ekey_bytes / AES_BLOCK_BYTES - 1;
+	int i, k;
+
+	for (i = 0; i <= rounds; i++) {
+		AesBsVec *q = rk + 8*i;
+
+		memset(q, 0, AES_BS_LANES*sizeof(AesBsVec));
+		for (k = 0; k < lanes; k++)
+			memcpy(q + k, ekeys[k] + i*AES_BLOCK_BYTES, AES_BLOCK_BYTES);
+		aes_bs_transpose(q);
+	}
+}
+
+AES_BS_CLONES void aes_bs_encrypt_lanes(Octet *out, const Octet *in, int lanes, const AesBsKeys *keys, int ekey_bytes){
+	AesBsVec q[8];
+
+	OP_COUNT(OP_AES_BLOCK, lanes);
+
+	aes_bs_load(q, in, lanes);
+	aes_bs_encrypt_planes(q, (const AesBsVec *)keys->planes, ekey_bytes / AES_BLOCK_BYTES - 1);
+	aes_bs_store(out, q, lanes);
+}
+
+AES_BS_CLONES void aes_bs_decrypt(Octet *out, const Octet *in, int blocks, const Octet *ekey, int ekey_bytes){
+	int rounds = ekey_bytes / AES_BLOCK_BYTES - 1;
+	AesBsVec rk[8*15];
+	AesBsVec q[8];
+	int i, n;
+
+	OP_COUNT(OP_AES_BLOCK, blocks);
+
+	aes_bs_round_keys(rk, ekey, rounds);
+
+	for (; blocks > 0; blocks -= n) {
+		n = blocks < AES_BS_LANES ? blocks : AES_BS_LANES;
+		aes_bs_load(q, in, n);
+		aes_bs_add_round_key(q, rk + 8*rounds);
+
+		for (i = rounds - 1; i > 0; i--) {
+			aes_bs_inv_shift_rows(q);
+			aes_bs_inv_sbox(q);
+			aes_bs_add_round_key(q, rk + 8*i);
+			aes_bs_inv_mix_columns(q);
+		}
+
+		aes_bs_inv_shift_rows(q);
+		aes_bs_inv_sbox(q);
+		aes_bs_add_round_key(q, rk);
+		aes_bs_store(out, q, n);
+
+		in += n*AES_BLOCK_BYTES;
+		out += n*AES_BLOCK_BYTES;
+	}
+}
+
+#endif /* AES_BITSLICE */
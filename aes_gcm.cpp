@@ -0,0 +1,393 @@
+#include <string.h>
+
+#include "crypto.h"
+#include "aes_locl.h"
+
+#if defined(AES_NI)
+#include <immintrin.h>
+#endif
+
+/*
+ * GHASH multiplies by H in GF(2^128) with bit-reflected polynomial
+ * x^128 + x^7 + x^2 + x + 1. Field elements are kept as two big-endian
+ * 64-bit halves (hi holds the first 8 octets of block).
+ */
+
+static uint64_t gcm_load64(const Octet *p){
+	uint64_t v = 0;
+
+	for (int i = 0; i < 8; i++) {
+		v = (v << 8) | p[i];
+	}
+
+	return v;
+}
+
+static void gcm_store64(Octet *p, uint64_t v){
+	for (int i = 7; i >= 0; i--) {
+		p[i] = (Octet)v;
+		v >>= 8;
+	}
+}
+
+/*
+ * Portable GHASH: 4-bit table of multiples of H (Shoup). Htable[i] = i*H,
+ * 16 entries of 16 octets. Lookups depend on data, so this is not
+ * constant time.
+ */
+
+#define GCM_PACK(x) ((uint64_t)(x) << 48)
+
+static const uint64_t gcm_rem_4bit[16] = {
+	GCM_PACK(0x0000), GCM_PACK(0x1C20), GCM_PACK(0x3840), GCM_PACK(0x2460),
+	GCM_PACK(0x7080), GCM_PACK(0x6CA0), GCM_PACK(0x48C0), GCM_PACK(0x54E0),
+	GCM_PACK(0xE100), GCM_PACK(0xFD20), GCM_PACK(0xD940), GCM_PACK(0xC560),
+	GCM_PACK(0x9180), GCM_PACK(0x8DA0), GCM_PACK(0xA9C0), GCM_PACK(0xB5E0)
+};
+
+static void gcm_init_4bit(uint64_t htable[16][2], const Octet *H){
+	uint64_t hi = gcm_load64(H);
+	uint64_t lo = gcm_load64(H + 8);
+	int i, j;
+
+	htable[0][0] = 0;
+	htable[0][1] = 0;
+	htable[8][0] = hi;
+	htable[8][1] = lo;
+
+	/* Multiplication by x is shift right in reflected order. */
+	for (i = 4; i > 0; i >>= 1) {
+		uint64_t t = 0xE100000000000000ULL & (0 - (lo & 1));
+
+		lo = (hi << 63) | (lo >> 1);
+		hi = (hi >> 1) ^ t;
+		htable[i][0] = hi;
+		htable[i][1] = lo;
+	}
+
+	for (i = 2; i < 16; i <<= 1) {
+		for (j = 1; j < i; j++) {
+			htable[i + j][0] = htable[i][0] ^ htable[j][0];
+			htable[i + j][1] = htable[i][1] ^ htable[j][1];
+		}
+	}
+}
+
+static void gcm_gmult_4bit(Octet *X, const uint64_t htable[16][2]){
+	uint64_t hi, lo, rem;
+	int nlo, nhi;
+	int cnt = 15;
+
+	nlo = X[15];
+	nhi = nlo >> 4;
+	nlo &= 0x0F;
+	hi = htable[nlo][0];
+	lo = htable[nlo][1];
+
+	for (;;) {
+		rem = lo & 0x0F;
+		lo = (hi << 60) | (lo >> 4);
+		hi = (hi >> 4) ^ gcm_rem_4bit[rem];
+		hi ^= htable[nhi][0];
+		lo ^= htable[nhi][1];
+
+		if (--cnt < 0)
+			break;
+
+		nlo = X[cnt];
+		nhi = nlo >> 4;
+		nlo &= 0x0F;
+
+		rem = lo & 0x0F;
+		lo = (hi << 60) | (lo >> 4);
+		hi = (hi >> 4) ^ gcm_rem_4bit[rem];
+		hi ^= htable[nlo][0];
+		lo ^= htable[nlo][1];
+	}
+
+	gcm_store64(X, hi);
+	gcm_store64(X + 8, lo);
+}
+
+static void gcm_ghash_4bit(Octet *X, const uint64_t htable[16][2], const Octet *in, int blocks){
+	for (; blocks > 0; blocks--) {
+		for (int i = 0; i < 16; i++) {
+			X[i] ^= in[i];
+		}
+
+		gcm_gmult_4bit(X, htable);
+		in += 16;
+	}
+}
+
+#if defined(AES_NI)
+
+/*
+ * GHASH with PCLMULQDQ (Gueron, Kounavis: Intel carry-less multiplication
+ * instruction and its usage for computing the GCM mode). Blocks are
+ * byte-reversed, products are shifted left by one bit instead of bit
+ * reflection. Eight blocks are multiplied by H^8, ..., H, and the sum of
+ * 256-bit products is reduced once.
+ */
+#define GCM_CLMUL_TARGET __attribute__((target("pclmul,ssse3")))
+
+/* Number of blocks per reduction (powers of H kept in table). */
+#define GCM_CLMUL_BLOCKS 8
+
+GCM_CLMUL_TARGET static inline __m128i gcm_bswap(__m128i x){
+	return _mm_shuffle_epi8(x, _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+}
+
+/* 256-bit product a*b as (hi, lo), added to accumulators. */
+GCM_CLMUL_TARGET static inline void gcm_clmul_acc(__m128i a, __m128i b, __m128i *lo, __m128i *mid, __m128i *hi){
+	*lo = _mm_xor_si128(*lo, _mm_clmulepi64_si128(a, b, 0x00));
+	*hi = _mm_xor_si128(*hi, _mm_clmulepi64_si128(a, b, 0x11));
+	*mid = _mm_xor_si128(*mid, _mm_clmulepi64_si128(a, b, 0x10));
+	*mid = _mm_xor_si128(*mid, _mm_clmulepi64_si128(a, b, 0x01));
+}
+
+/* Shift of 256-bit (hi, lo) left by one bit and reduction modulo polynomial. */
+GCM_CLMUL_TARGET static inline __m128i gcm_clmul_reduce(__m128i lo, __m128i mid, __m128i hi){
+	__m128i t7, t8, t9, t2, t4, t5;
+
+	lo = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+	hi = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+
+	t7 = _mm_srli_epi32(lo, 31);
+	t8 = _mm_srli_epi32(hi, 31);
+	lo = _mm_slli_epi32(lo, 1);
+	hi = _mm_slli_epi32(hi, 1);
+	t9 = _mm_srli_si128(t7, 12);
+	t8 = _mm_slli_si128(t8, 4);
+	t7 = _mm_slli_si128(t7, 4);
+	lo = _mm_or_si128(lo, t7);
+	hi = _mm_or_si128(hi, t8);
+	hi = _mm_or_si128(hi, t9);
+
+	t7 = _mm_slli_epi32(lo, 31);
+	t8 = _mm_slli_epi32(lo, 30);
+	t9 = _mm_slli_epi32(lo, 25);
+	t7 = _mm_xor_si128(t7, t8);
+	t7 = _mm_xor_si128(t7, t9);
+	t8 = _mm_srli_si128(t7, 4);
+	t7 = _mm_slli_si128(t7, 12);
+	lo = _mm_xor_si128(lo, t7);
+
+	t2 = _mm_srli_epi32(lo, 1);
+	t4 = _mm_srli_epi32(lo, 2);
+	t5 = _mm_srli_epi32(lo, 7);
+	t2 = _mm_xor_si128(t2, t4);
+	t2 = _mm_xor_si128(t2, t5);
+	t2 = _mm_xor_si128(t2, t8);
+	lo = _mm_xor_si128(lo, t2);
+
+	return _mm_xor_si128(hi, lo);
+}
+
+GCM_CLMUL_TARGET static inline __m128i gcm_clmul_mul(__m128i a, __m128i b){
+	__m128i lo = _mm_setzero_si128();
+	__m128i mid = _mm_setzero_si128();
+	__m128i hi = _mm_setzero_si128();
+
+	gcm_clmul_acc(a, b, &lo, &mid, &hi);
+
+	return gcm_clmul_reduce(lo, mid, hi);
+}
+
+/* Powers H, H^2, ..., H^8 (byte-reversed) in htable[0..7]. */
+GCM_CLMUL_TARGET static void gcm_init_clmul(uint64_t htable[16][2], const Octet *H){
+	__m128i h = gcm_bswap(_mm_loadu_si128((const __m128i *)H));
+	__m128i p = h;
+
+	for (int i = 0; i < GCM_CLMUL_BLOCKS; i++) {
+		_mm_storeu_si128((__m128i *)htable[i], p);
+		p = gcm_clmul_mul(p, h);
+	}
+}
+
+GCM_CLMUL_TARGET static void gcm_ghash_clmul(Octet *X, const uint64_t htable[16][2], const Octet *in, int blocks){
+	__m128i h[GCM_CLMUL_BLOCKS];
+	__m128i y = gcm_bswap(_mm_loadu_si128((const __m128i *)X));
+	int i;
+
+	for (i = 0; i < GCM_CLMUL_BLOCKS; i++) {
+		h[i] = _mm_loadu_si128((const __m128i *)htable[i]);
+	}
+
+	/* Y = (Y + X1)*H^8 + X2*H^7 + ... + X8*H, single reduction. */
+	for (; blocks >= GCM_CLMUL_BLOCKS; blocks -= GCM_CLMUL_BLOCKS) {
+		__m128i lo = _mm_setzero_si128();
+		__m128i mid = _mm_setzero_si128();
+		__m128i hi = _mm_setzero_si128();
+		__m128i x = _mm_xor_si128(y, gcm_bswap(_mm_loadu_si128((const __m128i *)in)));
+
+		gcm_clmul_acc(x, h[GCM_CLMUL_BLOCKS - 1], &lo, &mid, &hi);
+
+		for (i = 1; i < GCM_CLMUL_BLOCKS; i++) {
+			x = gcm_bswap(_mm_loadu_si128((const __m128i *)(in + 16*i)));
+			gcm_clmul_acc(x, h[GCM_CLMUL_BLOCKS - 1 - i], &lo, &mid, &hi);
+		}
+
+		y = gcm_clmul_reduce(lo, mid, hi);
+		in += 16*GCM_CLMUL_BLOCKS;
+	}
+
+	for (; blocks > 0; blocks--) {
+		y = gcm_clmul_mul(_mm_xor_si128(y, gcm_bswap(_mm_loadu_si128((const __m128i *)in))), h[0]);
+		in += 16;
+	}
+
+	_mm_storeu_si128((__m128i *)X, gcm_bswap(y));
+}
+
+#endif /* AES_NI */
+
+static void gcm_ghash(Aes128Gcm *ctx, const Octet *in, int blocks){
+#if defined(AES_NI)
+	if (aes_clmul_available()) {
+		gcm_ghash_clmul(ctx->X, ctx->htable, in, blocks);
+		return;
+	}
+#endif
+	gcm_ghash_4bit(ctx->X, ctx->htable, in, blocks);
+}
+
+/* Data into GHASH, partial block is kept in buf. */
+static void gcm_update(Aes128Gcm *ctx, const Octet *in, int len){
+	int n;
+
+	if (ctx->bufLen > 0) {
+		for (; ctx->bufLen < 16 && len > 0; len--)
+			ctx->buf[ctx->bufLen++] = *in++;
+
+		if (ctx->bufLen < 16)
+			return;
+
+		gcm_ghash(ctx, ctx->buf, 1);
+		ctx->bufLen = 0;
+	}
+
+	n = len / 16;
+	gcm_ghash(ctx, in, n);
+	in += 16*n;
+	len -= 16*n;
+
+	for (; len > 0; len--)
+		ctx->buf[ctx->bufLen++] = *in++;
+}
+
+/* Partial block is padded with zeros. */
+static void gcm_flush(Aes128Gcm *ctx){
+	if (ctx->bufLen > 0) {
+		memset(ctx->buf + ctx->bufLen, 0, 16 - ctx->bufLen);
+		gcm_ghash(ctx, ctx->buf, 1);
+		ctx->bufLen = 0;
+	}
+}
+
+void aes128_gcm_init(Aes128Gcm *ctx, const Octet *iv, const Octet *ekey){
+	Octet block[16] = {0};
+
+	/* H = E(K, 0). */
+	aes128_encrypt(block, block, ekey);
+
+#if defined(AES_NI)
+	if (aes_clmul_available())
+		gcm_init_clmul(ctx->htable, block);
+	else
+#endif
+	gcm_init_4bit(ctx->htable, block);
+
+	/* J0 = IV || 0^31 || 1, tag mask E(K, J0), data from J0 + 1. */
+	memcpy(block, iv, AES128_GCM_IV_BYTES);
+	block[12] = 0;
+	block[13] = 0;
+	block[14] = 0;
+	block[15] = 1;
+	aes128_encrypt(ctx->mask, block, ekey);
+	block[15] = 2;
+	aes128_ctr_init(&ctx->ctr, block);
+
+	memset(ctx->X, 0, sizeof(ctx->X));
+	ctx->bufLen = 0;
+	ctx->aadLen = 0;
+	ctx->textLen = 0;
+	ctx->text = 0;
+}
+
+void aes128_gcm_aad(Aes128Gcm *ctx, const Octet *aad, int len){
+	gcm_update(ctx, aad, len);
+	ctx->aadLen += len;
+}
+
+/* Octets encrypted and hashed together, while they are in cache. */
+#define GCM_CHUNK_BYTES 512
+
+static void gcm_start_text(Aes128Gcm *ctx){
+	if (!ctx->text) {
+		gcm_flush(ctx);
+		ctx->text = 1;
+	}
+}
+
+void aes128_gcm_encrypt(Aes128Gcm *ctx, Octet *out, const Octet *in, int len, const Octet *ekey){
+	gcm_start_text(ctx);
+	ctx->textLen += len;
+
+	while (len > 0) {
+		int n = len < GCM_CHUNK_BYTES ? len : GCM_CHUNK_BYTES;
+
+		aes128_ctr_xcrypt(&ctx->ctr, out, in, n, ekey);
+		gcm_update(ctx, out, n);
+		in += n;
+		out += n;
+		len -= n;
+	}
+}
+
+void aes128_gcm_decrypt(Aes128Gcm *ctx, Octet *out, const Octet *in, int len, const Octet *ekey){
+	gcm_start_text(ctx);
+	ctx->textLen += len;
+
+	while (len > 0) {
+		int n = len < GCM_CHUNK_BYTES ? len : GCM_CHUNK_BYTES;
+
+		gcm_update(ctx, in, n);
+		aes128_ctr_xcrypt(&ctx->ctr, out, in, n, ekey);
+		in += n;
+		out += n;
+		len -= n;
+	}
+}
+
+void aes128_gcm_tag(Aes128Gcm *ctx, Octet *tag){
+	Octet block[16];
+
+	gcm_start_text(ctx);
+	gcm_flush(ctx);
+
+	gcm_store64(block, ctx->aadLen * 8);
+	gcm_store64(block + 8, ctx->textLen * 8);
+	gcm_ghash(ctx, block, 1);
+
+	for (int i = 0; i < AES128_GCM_TAG_BYTES; i++) {
+		tag[i] = ctx->X[i] ^ ctx->mask[i];
+	}
+}
+
+int aes128_gcm_verify(Aes128Gcm *ctx, const Octet *tag, int tagLen){
+	Octet t[AES128_GCM_TAG_BYTES];
+	Octet diff = 0;
+
+	if (tagLen < 4 || tagLen > AES128_GCM_TAG_BYTES)
+		return 1;
+
+	aes128_gcm_tag(ctx, t);
+
+	/* Comparison in constant time. */
+	for (int i = 0; i < tagLen; i++) {
+		diff |= t[i] ^ tag[i];
+	}
+
+	return diff != 0;
+}
@@ -15,6 +15,11 @@ extern void aes_strcpy(unsigned char *dst, const unsigned char *src, int n);
  */
 extern void sub_word(unsigned char *word);
 
+/**
+ * Round keys of AES-128 (176 octets) by byte-oriented key schedule.
+ */
+extern void aes_key_expansion(unsigned char *ekey, const unsigned char *key);
+
 /**
  *
  */
@@ -27,4 +32,153 @@ extern void aes_encrypt(unsigned char *out, const unsigned char *in,
 extern void aes_decrypt(unsigned char *out, const unsigned char *in,
 	const unsigned char *ekey, int ekey_bytes);
 
+/**
+ * Round keys of equivalent inverse cipher: round keys of \ref aes_encrypt
+ * in reversed order, with InvMixColumns applied to inner round keys.
+ */
+extern void aes_inv_key(unsigned char *dkey, const unsigned char *ekey,
+	int ekey_bytes);
+
+#if defined(AES_COMPACT)
+
+/** Number of rounds of AES-128. */
+#define AES_COMPACT_ROUNDS 10
+
+/**
+ * Last round key of AES-128 (the schedule run forward from the key).
+ */
+extern void aes_compact_last_key(unsigned char *lkey, const unsigned char *key);
+
+/**
+ * Encryption under 16-octet key, round keys are computed forward.
+ */
+extern void aes_compact_encrypt(unsigned char *out, const unsigned char *in,
+	const unsigned char *key);
+
+/**
+ * Decryption from last round key of \ref aes_compact_last_key, round keys
+ * are computed backward.
+ */
+extern void aes_compact_decrypt(unsigned char *out, const unsigned char *in,
+	const unsigned char *lkey);
+
+#endif
+
+#if defined(AES_TTABLE)
+
+/**
+ * Encryption with 32-bit T-tables (four lookups per column and round).
+ */
+extern void aes_ttable_encrypt(unsigned char *out, const unsigned char *in,
+	const unsigned char *ekey, int ekey_bytes);
+
+/**
+ * Decryption with 32-bit T-tables under round keys of
+ * \ref aes_inv_key.
+ */
+extern void aes_ttable_decrypt(unsigned char *out, const unsigned char *in,
+	const unsigned char *dkey, int dkey_bytes);
+
+#endif
+
+#if defined(AES_BITSLICE)
+
+/**
+ * Round keys of bitsliced AES as bit planes, different for every block.
+ */
+typedef struct AesBsKeys_st {
+	unsigned char planes[8*15][16] __attribute__((aligned(16)));
+} AesBsKeys;
+
+/**
+ * Constant-time bitsliced encryption of blocks (8 at once).
+ */
+extern void aes_bs_encrypt(unsigned char *out, const unsigned char *in, int blocks,
+	const unsigned char *ekey, int ekey_bytes);
+
+/**
+ * Constant-time bitsliced decryption of blocks (8 at once) under round
+ * keys of \ref aes_encrypt.
+ */
+extern void aes_bs_decrypt(unsigned char *out, const unsigned char *in, int blocks,
+	const unsigned char *ekey, int ekey_bytes);
+
+/**
+ * Bit planes of round keys of up to 8 lanes, lane k under ekeys[k].
+ */
+extern void aes_bs_round_keys_lanes(AesBsKeys *keys, const unsigned char *const *ekeys,
+	int lanes, int ekey_bytes);
+
+/**
+ * Constant-time encryption of up to 8 blocks, block k under round keys of lane k.
+ */
+extern void aes_bs_encrypt_lanes(unsigned char *out, const unsigned char *in, int lanes,
+	const AesBsKeys *keys, int ekey_bytes);
+
+#endif
+
+#if defined(AES_NI)
+
+/**
+ * Non-zero if CPU has AES instructions (CPUID, checked once).
+ */
+extern int aes_ni_available(void);
+
+/**
+ * Non-zero if CPU has carry-less multiplication (PCLMULQDQ) and SSSE3,
+ * used by GHASH of AES-GCM.
+ */
+extern int aes_clmul_available(void);
+
+/**
+ * AES-128 key expansion with AESKEYGENASSIST: encryption round keys
+ * followed by round keys of equivalent inverse cipher (AESIMC).
+ */
+extern void aes128_ni_key_expansion(unsigned char *ekey, const unsigned char *key);
+
+/**
+ * AES-128 encryption of single block with AESENC.
+ */
+extern void aes128_ni_encrypt(unsigned char *out, const unsigned char *in,
+	const unsigned char *ekey);
+
+/**
+ * AES-128 decryption of single block with AESDEC.
+ */
+extern void aes128_ni_decrypt(unsigned char *out, const unsigned char *in,
+	const unsigned char *ekey);
+
+/**
+ * AES-128 encryption of independent blocks (8 blocks in flight).
+ */
+extern void aes128_ni_encrypt_blocks(unsigned char *out, const unsigned char *in,
+	int blocks, const unsigned char *ekey);
+
+/**
+ * AES-128 decryption of independent blocks (8 blocks in flight).
+ */
+extern void aes128_ni_decrypt_blocks(unsigned char *out, const unsigned char *in,
+	int blocks, const unsigned char *ekey);
+
+/**
+ * AES-128 encryption of up to 8 blocks, block k under ekeys[k] (in pipeline).
+ */
+extern void aes128_ni_encrypt_lanes(unsigned char *out, const unsigned char *in,
+	int lanes, const unsigned char *const *ekeys);
+
+/**
+ * CBC encryption of whole blocks; iv is replaced by last ciphertext block.
+ */
+extern void aes128_ni_cbc_encrypt(unsigned char *out, const unsigned char *in,
+	int blocks, unsigned char *iv, const unsigned char *ekey);
+
+/**
+ * CBC decryption of whole blocks (8 blocks in flight); iv is replaced by
+ * last ciphertext block. Input may be the same as output.
+ */
+extern void aes128_ni_cbc_decrypt(unsigned char *out, const unsigned char *in,
+	int blocks, unsigned char *iv, const unsigned char *ekey);
+
+#endif
+
 #endif
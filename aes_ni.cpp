@@ -0,0 +1,293 @@
+#include "crypto.h"
+#include "aes_locl.h"
+
+#if defined(AES_NI)
+
+#if !defined(__x86_64__) && !defined(__i386__)
+#error "AES_NI requires x86 target"
+#endif
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+/*
+ * Functions are compiled for AES instructions with target attributes, so
+ * the rest of program stays baseline x86 and single binary runs on any CPU:
+ * aes_128.cpp calls them only if aes_ni_available().
+ */
+#define AES_NI_TARGET __attribute__((target("aes,sse2")))
+
+#define AES128_ROUNDS 10
+
+static int aes_ni_cpuid(void){
+	unsigned int a, b, c, d;
+
+	if (!__get_cpuid(1, &a, &b, &c, &d))
+		return 0;
+
+	return (c & bit_AES) != 0;
+}
+
+int aes_ni_available(void){
+	static const int available = aes_ni_cpuid();
+
+	return available;
+}
+
+static int aes_clmul_cpuid(void){
+	unsigned int a, b, c, d;
+
+	if (!__get_cpuid(1, &a, &b, &c, &d))
+		return 0;
+
+	return (c & bit_PCLMUL) != 0 && (c & bit_SSSE3) != 0;
+}
+
+int aes_clmul_available(void){
+	static const int available = aes_clmul_cpuid();
+
+	return available;
+}
+
+AES_NI_TARGET static inline __m128i aes128_ni_assist(__m128i k, __m128i t){
+	t = _mm_shuffle_epi32(t, 0xFF);
+	k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+	k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+	k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+
+	return _mm_xor_si128(k, t);
+}
+
+/* Round constant has to be immediate operand of AESKEYGENASSIST. */
+#define AES128_NI_ROUND_KEY(rk, i, rc) \
+	rk[i] = aes128_ni_assist(rk[(i) - 1], _mm_aeskeygenassist_si128(rk[(i) - 1], rc))
+
+AES_NI_TARGET void aes128_ni_key_expansion(Octet *ekey, const Octet *key){
+	__m128i rk[AES128_ROUNDS + 1];
+	int i;
+
+	rk[0] = _mm_loadu_si128((const __m128i *)key);
+	AES128_NI_ROUND_KEY(rk, 1, 0x01);
+	AES128_NI_ROUND_KEY(rk, 2, 0x02);
+	AES128_NI_ROUND_KEY(rk, 3, 0x04);
+	AES128_NI_ROUND_KEY(rk, 4, 0x08);
+	AES128_NI_ROUND_KEY(rk, 5, 0x10);
+	AES128_NI_ROUND_KEY(rk, 6, 0x20);
+	AES128_NI_ROUND_KEY(rk, 7, 0x40);
+	AES128_NI_ROUND_KEY(rk, 8, 0x80);
+	AES128_NI_ROUND_KEY(rk, 9, 0x1B);
+	AES128_NI_ROUND_KEY(rk, 10, 0x36);
+
+	for (i = 0; i <= AES128_ROUNDS; i++)
+		_mm_storeu_si128((__m128i *)(ekey + i*AES_BLOCK_BYTES), rk[i]);
+
+	/* Equivalent inverse cipher, as in aes_inv_key(). */
+	ekey += AES128_RKEY_BYTES;
+	_mm_storeu_si128((__m128i *)ekey, rk[AES128_ROUNDS]);
+
+	for (i = 1; i < AES128_ROUNDS; i++)
+		_mm_storeu_si128((__m128i *)(ekey + i*AES_BLOCK_BYTES), _mm_aesimc_si128(rk[AES128_ROUNDS - i]));
+
+	_mm_storeu_si128((__m128i *)(ekey + AES128_ROUNDS*AES_BLOCK_BYTES), rk[0]);
+}
+
+AES_NI_TARGET static inline void aes128_ni_load(__m128i *rk, const Octet *ekey){
+	for (int i = 0; i <= AES128_ROUNDS; i++)
+		rk[i] = _mm_loadu_si128((const __m128i *)(ekey + i*AES_BLOCK_BYTES));
+}
+
+AES_NI_TARGET static inline __m128i aes128_ni_enc(__m128i b, const __m128i *rk){
+	b = _mm_xor_si128(b, rk[0]);
+
+	for (int i = 1; i < AES128_ROUNDS; i++)
+		b = _mm_aesenc_si128(b, rk[i]);
+
+	return _mm_aesenclast_si128(b, rk[AES128_ROUNDS]);
+}
+
+AES_NI_TARGET static inline __m128i aes128_ni_dec(__m128i b, const __m128i *dk){
+	b = _mm_xor_si128(b, dk[0]);
+
+	for (int i = 1; i < AES128_ROUNDS; i++)
+		b = _mm_aesdec_si128(b, dk[i]);
+
+	return _mm_aesdeclast_si128(b, dk[AES128_ROUNDS]);
+}
+
+AES_NI_TARGET void aes128_ni_encrypt(Octet *out, const Octet *in, const Octet *ekey){
+	__m128i rk[AES128_ROUNDS + 1];
+
+	OP_COUNT(OP_AES_BLOCK, 1);
+
+	aes128_ni_load(rk, ekey);
+	_mm_storeu_si128((__m128i *)out, aes128_ni_enc(_mm_loadu_si128((const __m128i *)in), rk));
+}
+
+AES_NI_TARGET void aes128_ni_decrypt(Octet *out, const Octet *in, const Octet *ekey){
+	__m128i dk[AES128_ROUNDS + 1];
+
+	OP_COUNT(OP_AES_BLOCK, 1);
+
+	aes128_ni_load(dk, ekey + AES128_RKEY_BYTES);
+	_mm_storeu_si128((__m128i *)out, aes128_ni_dec(_mm_loadu_si128((const __m128i *)in), dk));
+}
+
+AES_NI_TARGET void aes128_ni_cbc_encrypt(Octet *out, const Octet *in, int blocks, Octet *iv,
+	const Octet *ekey){
+	__m128i rk[AES128_ROUNDS + 1];
+	__m128i c = _mm_loadu_si128((const __m128i *)iv);
+
+	OP_COUNT(OP_AES_BLOCK, blocks);
+
+	aes128_ni_load(rk, ekey);
+
+	for (; blocks > 0; blocks--) {
+		c = aes128_ni_enc(_mm_xor_si128(c, _mm_loadu_si128((const __m128i *)in)), rk);
+		_mm_storeu_si128((__m128i *)out, c);
+		in += AES_BLOCK_BYTES;
+		out += AES_BLOCK_BYTES;
+	}
+
+	_mm_storeu_si128((__m128i *)iv, c);
+}
+
+/* Independent blocks: keep 8 of them in pipeline. */
+#define AES_NI_LANES 8
+
+AES_NI_TARGET void aes128_ni_encrypt_blocks(Octet *out, const Octet *in, int blocks, const Octet *ekey){
+	__m128i rk[AES128_ROUNDS + 1];
+	__m128i b[AES_NI_LANES];
+	int i, j;
+
+	OP_COUNT(OP_AES_BLOCK, blocks);
+
+	aes128_ni_load(rk, ekey);
+
+	for (; blocks >= AES_NI_LANES; blocks -= AES_NI_LANES) {
+		for (j = 0; j < AES_NI_LANES; j++)
+			b[j] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in + j*AES_BLOCK_BYTES)), rk[0]);
+
+		for (i = 1; i < AES128_ROUNDS; i++)
+			for (j = 0; j < AES_NI_LANES; j++)
+				b[j] = _mm_aesenc_si128(b[j], rk[i]);
+
+		for (j = 0; j < AES_NI_LANES; j++)
+			_mm_storeu_si128((__m128i *)(out + j*AES_BLOCK_BYTES), _mm_aesenclast_si128(b[j], rk[AES128_ROUNDS]));
+
+		in += AES_NI_LANES*AES_BLOCK_BYTES;
+		out += AES_NI_LANES*AES_BLOCK_BYTES;
+	}
+
+	for (; blocks > 0; blocks--) {
+		_mm_storeu_si128((__m128i *)out, aes128_ni_enc(_mm_loadu_si128((const __m128i *)in), rk));
+		in += AES_BLOCK_BYTES;
+		out += AES_BLOCK_BYTES;
+	}
+}
+
+AES_NI_TARGET static inline __attribute__((always_inline)) void aes128_ni_lanes(Octet *out, const Octet *in,
+	int lanes, const Octet *const *ekeys){
+	__m128i b[AES_NI_LANES];
+	int i, j;
+
+	for (j = 0; j < lanes; j++)
+		b[j] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in + j*AES_BLOCK_BYTES)),
+			_mm_loadu_si128((const __m128i *)ekeys[j]));
+
+	for (i = 1; i < AES128_ROUNDS; i++)
+		for (j = 0; j < lanes; j++)
+			b[j] = _mm_aesenc_si128(b[j], _mm_loadu_si128((const __m128i *)(ekeys[j] + i*AES_BLOCK_BYTES)));
+
+	for (j = 0; j < lanes; j++)
+		_mm_storeu_si128((__m128i *)(out + j*AES_BLOCK_BYTES), _mm_aesenclast_si128(b[j],
+			_mm_loadu_si128((const __m128i *)(ekeys[j] + AES128_ROUNDS*AES_BLOCK_BYTES))));
+}
+
+AES_NI_TARGET void aes128_ni_encrypt_lanes(Octet *out, const Octet *in, int lanes, const Octet *const *ekeys){
+	OP_COUNT(OP_AES_BLOCK, lanes);
+
+	/* Constant number of lanes lets compiler keep blocks in registers. */
+	if (lanes == AES_NI_LANES)
+		aes128_ni_lanes(out, in, AES_NI_LANES, ekeys);
+	else
+		aes128_ni_lanes(out, in, lanes, ekeys);
+}
+
+AES_NI_TARGET void aes128_ni_decrypt_blocks(Octet *out, const Octet *in, int blocks, const Octet *ekey){
+	__m128i dk[AES128_ROUNDS + 1];
+	__m128i b[AES_NI_LANES];
+	int i, j;
+
+	OP_COUNT(OP_AES_BLOCK, blocks);
+
+	aes128_ni_load(dk, ekey + AES128_RKEY_BYTES);
+
+	for (; blocks >= AES_NI_LANES; blocks -= AES_NI_LANES) {
+		for (j = 0; j < AES_NI_LANES; j++)
+			b[j] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in + j*AES_BLOCK_BYTES)), dk[0]);
+
+		for (i = 1; i < AES128_ROUNDS; i++)
+			for (j = 0; j < AES_NI_LANES; j++)
+				b[j] = _mm_aesdec_si128(b[j], dk[i]);
+
+		for (j = 0; j < AES_NI_LANES; j++)
+			_mm_storeu_si128((__m128i *)(out + j*AES_BLOCK_BYTES), _mm_aesdeclast_si128(b[j], dk[AES128_ROUNDS]));
+
+		in += AES_NI_LANES*AES_BLOCK_BYTES;
+		out += AES_NI_LANES*AES_BLOCK_BYTES;
+	}
+
+	for (; blocks > 0; blocks--) {
+		_mm_storeu_si128((__m128i *)out, aes128_ni_dec(_mm_loadu_si128((const __m128i *)in), dk));
+		in += AES_BLOCK_BYTES;
+		out += AES_BLOCK_BYTES;
+	}
+}
+
+AES_NI_TARGET void aes128_ni_cbc_decrypt(Octet *out, const Octet *in, int blocks, Octet *iv,
+	const Octet *ekey){
+	__m128i dk[AES128_ROUNDS + 1];
+	__m128i prev = _mm_loadu_si128((const __m128i *)iv);
+	__m128i c[AES_NI_LANES];
+	__m128i b[AES_NI_LANES];
+	int i, j;
+
+	OP_COUNT(OP_AES_BLOCK, blocks);
+
+	aes128_ni_load(dk, ekey + AES128_RKEY_BYTES);
+
+	for (; blocks >= AES_NI_LANES; blocks -= AES_NI_LANES) {
+		for (j = 0; j < AES_NI_LANES; j++) {
+			c[j] = _mm_loadu_si128((const __m128i *)(in + j*AES_BLOCK_BYTES));
+			b[j] = _mm_xor_si128(c[j], dk[0]);
+		}
+
+		for (i = 1; i < AES128_ROUNDS; i++)
+			for (j = 0; j < AES_NI_LANES; j++)
+				b[j] = _mm_aesdec_si128(b[j], dk[i]);
+
+		for (j = 0; j < AES_NI_LANES; j++)
+			b[j] = _mm_aesdeclast_si128(b[j], dk[AES128_ROUNDS]);
+
+		_mm_storeu_si128((__m128i *)out, _mm_xor_si128(b[0], prev));
+
+		for (j = 1; j < AES_NI_LANES; j++)
+			_mm_storeu_si128((__m128i *)(out + j*AES_BLOCK_BYTES), _mm_xor_si128(b[j], c[j - 1]));
+
+		prev = c[AES_NI_LANES - 1];
+		in += AES_NI_LANES*AES_BLOCK_BYTES;
+		out += AES_NI_LANES*AES_BLOCK_BYTES;
+	}
+
+	for (; blocks > 0; blocks--) {
+		c[0] = _mm_loadu_si128((const __m128i *)in);
+		_mm_storeu_si128((__m128i *)out, _mm_xor_si128(aes128_ni_dec(c[0], dk), prev));
+		prev = c[0];
+		in += AES_BLOCK_BYTES;
+		out += AES_BLOCK_BYTES;
+	}
+
+	_mm_storeu_si128((__m128i *)iv, prev);
+}
+
+#endif /* AES_NI */
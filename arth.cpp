@@ -1,7 +1,18 @@
+#include <string.h>
+
 #include "crypto.h"
 
 Digit arth_tmp[ARTH_TMP_DIGITS];
 
+#if defined(STAKE_OPCOUNT)
+thread_local OpCount op_count;
+#endif
+
+const char *const op_names[OP_KINDS] = {
+	"fp_mul", "fp_sqr", "fp_add", "fp_sub", "fp_inv", "n_modred", "n_inv", "ec_dbl", "ec_add", "aes_key", "aes_block",
+	"w_mul", "w_add", "w_shift"
+};
+
 void assign(Digit *dst, const Digit *src, int n)
 {
 	while (n--)
@@ -30,6 +41,64 @@ void reorder(Digit *dst, int n)
 	}
 }
 
+/*
+ * Big-endian octet string is reversed representation of number on
+ * little-endian host, so conversion in both directions is the same
+ * reversal done with 64-bit byte swaps.
+ */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+static void reverse_octets(Octet *dst, const Octet *src, int len)
+{
+	uint64_t t;
+
+	src += len;
+
+	while (len >= 8) {
+		src -= 8;
+		memcpy(&t, src, 8);
+		t = __builtin_bswap64(t);
+		memcpy(dst, &t, 8);
+		dst += 8;
+		len -= 8;
+	}
+
+	while (len--)
+		*dst++ = *--src;
+}
+
+void to_octets(Octet *dst, const Digit *src, int n)
+{
+	reverse_octets(dst, (const Octet *)src, n*(DIGIT_BITS/OCTET_BITS));
+}
+
+void from_octets(Digit *dst, const Octet *src, int n)
+{
+	reverse_octets((Octet *)dst, src, n*(DIGIT_BITS/OCTET_BITS));
+}
+#else
+void to_octets(Octet *dst, const Digit *src, int n)
+{
+	int j;
+
+	while (n--) {
+		for (j = DIGIT_BITS - OCTET_BITS; j >= 0; j -= OCTET_BITS)
+			*dst++ = (Octet)(src[n] >> j);
+	}
+}
+
+void from_octets(Digit *dst, const Octet *src, int n)
+{
+	int j;
+
+	while (n--) {
+		dst[n] = 0;
+
+		for (j = DIGIT_BITS - OCTET_BITS; j >= 0; j -= OCTET_BITS)
+			dst[n] |= (Digit)(*src++) << j;
+	}
+}
+#endif
+
 Cmp cmp(const Digit *op1, const Digit *op2, int n)
 {
 	Cmp comparison = 0;
@@ -70,6 +139,8 @@ Digit add(Digit *dst, const Digit *src, int n)
 {
 	DDigit carry = 0;
 
+	OP_COUNT(OP_W_ADD, n);
+
 	while (n--)
 	{
 		carry = (DDigit)(*dst) + (*src++) + carry;
@@ -102,6 +173,8 @@ Digit sub(Digit *dst, const Digit *src, int n)
 {
 	DDigit borrow = 0;
 
+	OP_COUNT(OP_W_ADD, n);
+
 	while (n--) {
 		borrow = (DDigit)(*dst) - (*src++) - borrow;
 		*dst++ = (Digit)borrow;
@@ -131,6 +204,8 @@ Digit sub_digit(Digit *dst, Digit src, int n)
 
 void div2(Digit *dst, int n)
 {
+	OP_COUNT(OP_W_SHIFT, n);
+
 	while (--n) {
 		*dst = (*dst >> 1) ^ (*(dst + 1) << (DIGIT_BITS - 1));
 		dst++;
@@ -141,6 +216,8 @@ void div2(Digit *dst, int n)
 
 void signed_div2(Digit *dst, int n)
 {
+	OP_COUNT(OP_W_SHIFT, n);
+
 	while (--n) {
 		*dst = (*dst >> 1) ^ (*(dst + 1) << (DIGIT_BITS - 1));
 		dst++;
@@ -157,6 +234,8 @@ Digit add_mul_digit(Digit *dst, const Digit *src, Digit factor, int n)
 {
 	DDigit carry = 0;
 
+	OP_COUNT(OP_W_MUL, n);
+
 	while (n--) {
 		carry = (DDigit)(*dst) + (DDigit)(*src++) * factor + carry;
 		*dst++ = (Digit)carry;
@@ -171,6 +250,8 @@ Digit sub_mul_digit(Digit *dst, const Digit *src, Digit factor, int n)
 	DDigit carry = 0;
 	DDigit borrow = 0;
 
+	OP_COUNT(OP_W_MUL, n);
+
 	while (n--) {
 		carry = (DDigit)(*src++) * factor + carry;
 		borrow = (DDigit)(*dst) - (Digit)carry - borrow;
@@ -0,0 +1,397 @@
+#include "async.h"
+
+void AsyncStep::await_suspend(std::coroutine_handle<> h)
+{
+	handle = h;
+	exec->post(this);
+}
+
+AsyncExecutor::AsyncExecutor() : running(0), inflight(0)
+{
+	for (int i = 0; i < ASYNC_STEP_KINDS; i++) {
+		batches[i] = 0;
+		steps[i] = 0;
+	}
+}
+
+AsyncExecutor::~AsyncExecutor()
+{
+	stop();
+}
+
+void AsyncExecutor::start()
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	if (!running) {
+		running = 1;
+		thread = std::thread(&AsyncExecutor::worker, this);
+	}
+}
+
+void AsyncExecutor::stop()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+
+		if (!running)
+			return;
+
+		running = 0;
+	}
+
+	posted.notify_all();
+	thread.join();
+}
+
+void AsyncExecutor::post(AsyncStep *step)
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		queue.push_back(step);
+		inflight++;
+	}
+
+	posted.notify_one();
+}
+
+void AsyncExecutor::worker()
+{
+	std::vector<AsyncStep *> todo;
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			posted.wait(guard, [this] { return !running || !queue.empty(); });
+
+			if (!running)
+				return;
+
+			todo.swap(queue);
+		}
+
+		execute(todo);
+
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			done.insert(done.end(), todo.begin(), todo.end());
+		}
+
+		executed.notify_all();
+		todo.clear();
+	}
+}
+
+int AsyncExecutor::poll(int wait)
+{
+	std::vector<AsyncStep *> ready;
+	std::vector<AsyncStep *> todo;
+
+	{
+		std::unique_lock<std::mutex> guard(lock);
+
+		if (!running) {
+			todo.swap(queue);
+		} else if (wait && done.empty() && inflight) {
+			executed.wait(guard, [this] { return !done.empty(); });
+		}
+	}
+
+	if (!todo.empty()) {
+		execute(todo);
+		ready.swap(todo);
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		ready.insert(ready.end(), done.begin(), done.end());
+		done.clear();
+		inflight -= (int)ready.size();
+	}
+
+	for (AsyncStep *step : ready)
+		step->handle.resume();
+
+	return (int)ready.size();
+}
+
+/*
+ * Execute steps with the same kind together. Steps q1, q2 and q3 are
+ * executed with batch functions, inputs are gathered into continuous
+ * tables, so every batch shares single field inversion.
+ */
+void AsyncExecutor::execute(std::vector<AsyncStep *> &todo)
+{
+	void *ctx[ECC_BATCH_MAX];
+	Digit in[ECC_BATCH_MAX*2*FP_DIGITS];
+	Digit out[ECC_BATCH_MAX*2*FP_DIGITS];
+	EcdsaSign sign[ECC_BATCH_MAX];
+	int err[ECC_BATCH_MAX];
+	AsyncStep *group[ECC_BATCH_MAX];
+
+	int kind;
+	int m;
+	int i;
+
+	for (kind = 0; kind < ASYNC_STEP_KINDS; kind++) {
+		m = 0;
+
+		for (size_t j = 0; j <= todo.size(); j++) {
+			if (j < todo.size()) {
+				if (todo[j]->kind != kind)
+					continue;
+
+				group[m++] = todo[j];
+
+				if (m < ECC_BATCH_MAX)
+					continue;
+			} else if (m == 0) {
+				break;
+			}
+
+			for (i = 0; i < m; i++) {
+				ctx[i] = group[i]->ctx;
+
+				if (kind == ASYNC_STAKE_Q2 || kind == ASYNC_STAKE_Q3 || kind == ASYNC_PKI_Q2)
+					assign(in + 2*FP_DIGITS*i, group[i]->in, 2*FP_DIGITS);
+				if (kind == ASYNC_PKI_Q2)
+					sign[i] = *group[i]->sign;
+			}
+
+			switch (kind) {
+			case ASYNC_STAKE_Q1:
+				ecc_iotstake_q1_batch((ProtocolIoTStake **)ctx, out, err, m);
+				break;
+			case ASYNC_STAKE_Q2:
+				ecc_iotstake_q2_batch((ProtocolIoTStake **)ctx, in, out, err, m);
+				break;
+			case ASYNC_STAKE_Q3:
+				ecc_iotstake_q3_batch((ProtocolIoTStake **)ctx, in, err, m);
+				break;
+			case ASYNC_PKI_Q2:
+				ecc_iotpki_q2_batch((ProtocolIoTPki **)ctx, in, sign, err, m);
+				break;
+			default:
+				for (i = 0; i < m; i++) {
+					AsyncStep *s = group[i];
+
+					switch (kind) {
+					case ASYNC_STAKE_INIT:
+						err[i] = ecc_iotstake_init((ProtocolIoTStake *)s->ctx, s->in, s->in2, 0);
+						break;
+					case ASYNC_STAKE_HASH:
+						err[i] = ecc_iotstake_hash((ProtocolIoTStake *)s->ctx, s->hash);
+						break;
+					case ASYNC_PKI_INIT:
+						err[i] = ecc_iotpki_init((ProtocolIoTPki *)s->ctx, s->in, s->in2, 0);
+						break;
+					case ASYNC_PKI_Q1:
+						err[i] = ecc_iotpki_q1((ProtocolIoTPki *)s->ctx, s->out, s->sign);
+						break;
+					case ASYNC_PKI_HASH:
+						err[i] = ecc_iotpki_hash((ProtocolIoTPki *)s->ctx, s->hash);
+						break;
+					}
+				}
+			}
+
+			for (i = 0; i < m; i++) {
+				group[i]->err = err[i];
+
+				if (group[i]->out && (kind == ASYNC_STAKE_Q1 || kind == ASYNC_STAKE_Q2))
+					assign(group[i]->out, out + 2*FP_DIGITS*i, 2*FP_DIGITS);
+			}
+
+			batches[kind]++;
+			steps[kind] += m;
+			m = 0;
+		}
+	}
+}
+
+AsyncTask &AsyncTask::operator=(AsyncTask &&t)
+{
+	if (this != &t) {
+		if (handle)
+			handle.destroy();
+
+		handle = t.handle;
+		t.handle = 0;
+	}
+
+	return *this;
+}
+
+AsyncTask::~AsyncTask()
+{
+	if (handle)
+		handle.destroy();
+}
+
+AsyncSession::AsyncSession(AsyncExecutor &exec, std::function<void(const AsyncMessage &)> send)
+	: exec(exec), sender(send), receiver(0)
+{
+}
+
+void AsyncSession::deliver(const AsyncMessage &msg)
+{
+	std::coroutine_handle<> h = receiver;
+
+	inbox.push_back(msg);
+
+	if (h) {
+		receiver = 0;
+		h.resume();
+	}
+}
+
+AsyncMessage AsyncSession::Receive::await_resume()
+{
+	AsyncMessage msg = session->inbox.front();
+
+	session->inbox.pop_front();
+
+	return msg;
+}
+
+AsyncStep AsyncSession::step(int kind, void *ctx, const Digit *in, const Digit *in2,
+	Digit *out, EcdsaSign *sign, Octet *hash)
+{
+	AsyncStep s;
+
+	s.kind = kind;
+	s.ctx = ctx;
+	s.in = in;
+	s.in2 = in2;
+	s.out = out;
+	s.sign = sign;
+	s.hash = hash;
+	s.err = 0;
+	s.exec = &exec;
+	s.handle = 0;
+
+	return s;
+}
+
+AsyncTask async_iotstake_server(AsyncSession &s, const Digit *prv, const Digit *pub)
+{
+	ProtocolIoTStake ctx;
+	AsyncMessage msg;
+	AsyncMessage reply;
+	int err;
+
+	// [1 SRV] Protocol initialization, determination of Q1 of server.
+	if ((err = co_await s.step(ASYNC_STAKE_INIT, &ctx, prv, pub)) != 0)
+		co_return err;
+	if ((err = co_await s.step(ASYNC_STAKE_Q1, &ctx, 0, 0, msg.P1)) != 0)
+		co_return err;
+
+	msg.type = ASYNC_MSG_Q1;
+	s.send(msg);
+
+	// [2 SRV] Determination of Q2 of sensor and Q3 of server.
+	reply = co_await s.receive();
+
+	if (reply.type != ASYNC_MSG_Q1Q2)
+		co_return 1;
+	if ((err = co_await s.step(ASYNC_STAKE_Q2, &ctx, reply.P1, 0, msg.P1)) != 0)
+		co_return err;
+	if ((err = co_await s.step(ASYNC_STAKE_Q3, &ctx, reply.P2)) != 0)
+		co_return err;
+
+	msg.type = ASYNC_MSG_Q2;
+	s.send(msg);
+
+	// [3 SRV] Determination of the hash.
+	co_return co_await s.step(ASYNC_STAKE_HASH, &ctx, 0, 0, 0, 0, s.key);
+}
+
+AsyncTask async_iotstake_sensor(AsyncSession &s, const Digit *prv, const Digit *pub)
+{
+	ProtocolIoTStake ctx;
+	AsyncMessage msg;
+	AsyncMessage reply;
+	int err;
+
+	// [1 MU] Protocol initialization, determination of Q1 of sensor and Q2 of server.
+	reply = co_await s.receive();
+
+	if (reply.type != ASYNC_MSG_Q1)
+		co_return 1;
+	if ((err = co_await s.step(ASYNC_STAKE_INIT, &ctx, prv, pub)) != 0)
+		co_return err;
+	if ((err = co_await s.step(ASYNC_STAKE_Q1, &ctx, 0, 0, msg.P1)) != 0)
+		co_return err;
+	if ((err = co_await s.step(ASYNC_STAKE_Q2, &ctx, reply.P1, 0, msg.P2)) != 0)
+		co_return err;
+
+	msg.type = ASYNC_MSG_Q1Q2;
+	s.send(msg);
+
+	// [2 MU] Determination of Q3 of sensor.
+	reply = co_await s.receive();
+
+	if (reply.type != ASYNC_MSG_Q2)
+		co_return 1;
+	if ((err = co_await s.step(ASYNC_STAKE_Q3, &ctx, reply.P1)) != 0)
+		co_return err;
+
+	// [3 MU] Determination of the hash.
+	co_return co_await s.step(ASYNC_STAKE_HASH, &ctx, 0, 0, 0, 0, s.key);
+}
+
+AsyncTask async_iotpki_server(AsyncSession &s, const Digit *prv, const Digit *pub)
+{
+	ProtocolIoTPki ctx;
+	AsyncMessage msg;
+	AsyncMessage reply;
+	int err;
+
+	// [1 SRV] Protocol initialization, determination of Q1 and signature.
+	if ((err = co_await s.step(ASYNC_PKI_INIT, &ctx, prv, pub)) != 0)
+		co_return err;
+	if ((err = co_await s.step(ASYNC_PKI_Q1, &ctx, 0, 0, msg.P1, &msg.sign)) != 0)
+		co_return err;
+
+	msg.type = ASYNC_MSG_Q1;
+	s.send(msg);
+
+	// [2 SRV] Verification of sensor signature, determination of Q2.
+	reply = co_await s.receive();
+
+	if (reply.type != ASYNC_MSG_Q1Q2)
+		co_return 1;
+	if ((err = co_await s.step(ASYNC_PKI_Q2, &ctx, reply.P1, 0, 0, &reply.sign)) != 0)
+		co_return err;
+
+	// [3 SRV] Determination of the hash.
+	co_return co_await s.step(ASYNC_PKI_HASH, &ctx, 0, 0, 0, 0, s.key);
+}
+
+AsyncTask async_iotpki_sensor(AsyncSession &s, const Digit *prv, const Digit *pub)
+{
+	ProtocolIoTPki ctx;
+	AsyncMessage msg;
+	AsyncMessage reply;
+	int err;
+
+	// [1 MU] Protocol initialization, determination of Q1 and signature.
+	reply = co_await s.receive();
+
+	if (reply.type != ASYNC_MSG_Q1)
+		co_return 1;
+	if ((err = co_await s.step(ASYNC_PKI_INIT, &ctx, prv, pub)) != 0)
+		co_return err;
+	if ((err = co_await s.step(ASYNC_PKI_Q1, &ctx, 0, 0, msg.P1, &msg.sign)) != 0)
+		co_return err;
+
+	msg.type = ASYNC_MSG_Q1Q2;
+	s.send(msg);
+
+	// [2 MU] Verification of server signature, determination of Q2.
+	if ((err = co_await s.step(ASYNC_PKI_Q2, &ctx, reply.P1, 0, 0, &reply.sign)) != 0)
+		co_return err;
+
+	// [3 MU] Determination of the hash.
+	co_return co_await s.step(ASYNC_PKI_HASH, &ctx, 0, 0, 0, 0, s.key);
+}
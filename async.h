@@ -0,0 +1,288 @@
+#ifndef __ASYNC_H
+#define __ASYNC_H
+
+#include <coroutine>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "crypto.h"
+
+/**
+ * \defgroup async_group Asynchronous protocol sessions
+ * \brief C++20 coroutine interface for IoT STAKE and IoT PKI handshakes.
+ *
+ * Every handshake is written as a coroutine which waits for incoming
+ * messages (\ref AsyncSession::receive) and offloads each heavy
+ * protocol step to \ref AsyncExecutor (\ref AsyncSession::step). Bodies
+ * of coroutines are always resumed by the thread which calls
+ * \ref AsyncExecutor::poll, so single I/O thread may drive any number
+ * of sessions.
+ *
+ * \{
+ */
+
+/** \brief Types of messages exchanged by asynchronous sessions. */
+enum AsyncMessageType {
+	/** \brief Point Q1 of server (STAKE), or Q1 and signature (PKI). */
+	ASYNC_MSG_Q1 = 1,
+	/** \brief Points Q1 and Q2 of sensor (STAKE), or Q1 and signature (PKI). */
+	ASYNC_MSG_Q1Q2 = 2,
+	/** \brief Point Q2 of server (STAKE). */
+	ASYNC_MSG_Q2 = 3
+};
+
+/** \brief Protocol message exchanged by asynchronous sessions. */
+typedef struct AsyncMessage_st {
+	/** \brief Type of message (\ref AsyncMessageType). */
+	int type;
+	/** \brief First point of message. */
+	Digit P1[2*FP_DIGITS];
+	/** \brief Second point of message. */
+	Digit P2[2*FP_DIGITS];
+	/** \brief Signature under X(P1) (PKI only). */
+	EcdsaSign sign;
+} AsyncMessage;
+
+/** \brief Protocol steps which can be offloaded to \ref AsyncExecutor. */
+enum AsyncStepKind {
+	ASYNC_STAKE_INIT,
+	ASYNC_STAKE_Q1,
+	ASYNC_STAKE_Q2,
+	ASYNC_STAKE_Q3,
+	ASYNC_STAKE_HASH,
+	ASYNC_PKI_INIT,
+	ASYNC_PKI_Q1,
+	ASYNC_PKI_Q2,
+	ASYNC_PKI_HASH,
+	ASYNC_STEP_KINDS
+};
+
+/**
+ * \brief Single protocol step waiting for execution.
+ *
+ * Arguments of step are passed to adequate ecc_iotstake_* or
+ * ecc_iotpki_* function:
+ *   - init: \a in - user private key, \a in2 - public key of the other side,
+ *   - q1: \a out - Q1A (STAKE, PKI), \a sign - signA (PKI),
+ *   - q2: \a in - Q1B, \a out - Q2B (STAKE), \a sign - signB (PKI),
+ *   - q3: \a in - Q2A,
+ *   - hash: \a hash - session key.
+ */
+struct AsyncStep {
+	int kind;
+	void *ctx;
+	const Digit *in;
+	const Digit *in2;
+	Digit *out;
+	EcdsaSign *sign;
+	Octet *hash;
+	int err;
+	class AsyncExecutor *exec;
+	std::coroutine_handle<> handle;
+
+	/** \brief Step is always suspended and posted to executor. */
+	bool await_ready() const noexcept { return false; }
+	void await_suspend(std::coroutine_handle<> h);
+	int await_resume() const noexcept { return err; }
+};
+
+/**
+ * \brief Executor of heavy protocol steps.
+ *
+ * Pending steps of the same kind are executed together with batch
+ * functions (e.g. \ref ecc_iotstake_q2_batch). Executor works inline
+ * (steps are executed by \ref poll) or with single worker thread
+ * (\ref start). Only one thread executes steps, because arithmetic
+ * and elliptic curve modules use shared memory.
+ */
+class AsyncExecutor {
+public:
+	AsyncExecutor();
+	~AsyncExecutor();
+
+	/** \brief Start worker thread which executes posted steps. */
+	void start();
+	/** \brief Stop worker thread (remaining steps are executed by \ref poll). */
+	void stop();
+
+	/** \brief Post step for execution (thread safe). */
+	void post(AsyncStep *step);
+
+	/**
+	 * \brief Resume coroutines of executed steps.
+	 *
+	 * In inline mode function executes all pending steps first.
+	 *
+	 * \param[in] wait -
+	 *   if non-zero and there is no executed step, then function waits
+	 *   until at least one step is executed.
+	 *
+	 * \return Number of resumed coroutines.
+	 */
+	int poll(int wait = 0);
+
+	/** \brief Number of posted steps which coroutines are not resumed yet. */
+	int pending() const { return inflight; }
+
+	/** \brief Number of executed batches of each step kind. */
+	long batches[ASYNC_STEP_KINDS];
+	/** \brief Number of executed steps of each kind. */
+	long steps[ASYNC_STEP_KINDS];
+
+private:
+	void execute(std::vector<AsyncStep *> &todo);
+	void worker();
+
+	std::mutex lock;
+	std::condition_variable posted;
+	std::condition_variable executed;
+	std::vector<AsyncStep *> queue;
+	std::vector<AsyncStep *> done;
+	std::thread thread;
+	int running;
+	int inflight;
+};
+
+/**
+ * \brief Coroutine which runs single handshake.
+ *
+ * Coroutine starts immediately and stays suspended after completion,
+ * so result can be read by owner. Handle is destroyed together with
+ * task object.
+ */
+class AsyncTask {
+public:
+	struct promise_type {
+		int result = -1;
+
+		AsyncTask get_return_object() {
+			return AsyncTask(std::coroutine_handle<promise_type>::from_promise(*this));
+		}
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; }
+		void return_value(int r) { result = r; }
+		void unhandled_exception() { result = -1; }
+	};
+
+	AsyncTask() : handle(0) {}
+	AsyncTask(AsyncTask &&t) : handle(t.handle) { t.handle = 0; }
+	AsyncTask &operator=(AsyncTask &&t);
+	~AsyncTask();
+
+	/** \brief Check if handshake is finished. */
+	bool done() const { return !handle || handle.done(); }
+	/** \brief Handshake result (0 - OK, otherwise error code). */
+	int result() const { return handle ? handle.promise().result : -1; }
+
+private:
+	explicit AsyncTask(std::coroutine_handle<promise_type> h) : handle(h) {}
+
+	std::coroutine_handle<promise_type> handle;
+};
+
+/**
+ * \brief Asynchronous protocol session.
+ *
+ * Session connects handshake coroutine with transport: outgoing
+ * messages are passed to \a send function, incoming messages have to
+ * be passed to \ref deliver.
+ */
+class AsyncSession {
+public:
+	AsyncSession(AsyncExecutor &exec, std::function<void(const AsyncMessage &)> send);
+
+	/** \brief Pass incoming message to session. */
+	void deliver(const AsyncMessage &msg);
+
+	/** \brief Awaitable which waits for incoming message. */
+	struct Receive {
+		AsyncSession *session;
+
+		bool await_ready() const noexcept { return !session->inbox.empty(); }
+		void await_suspend(std::coroutine_handle<> h) { session->receiver = h; }
+		AsyncMessage await_resume();
+	};
+
+	/** \brief Wait for incoming message. */
+	Receive receive() { return Receive{this}; }
+
+	/** \brief Send message to the other side. */
+	void send(const AsyncMessage &msg) { sender(msg); }
+
+	/** \brief Prepare protocol step which is executed after \c co_await. */
+	AsyncStep step(int kind, void *ctx, const Digit *in = 0, const Digit *in2 = 0,
+		Digit *out = 0, EcdsaSign *sign = 0, Octet *hash = 0);
+
+	/** \brief Session key (valid if handshake finished without error). */
+	Octet key[16];
+
+private:
+	AsyncExecutor &exec;
+	std::function<void(const AsyncMessage &)> sender;
+	std::deque<AsyncMessage> inbox;
+	std::coroutine_handle<> receiver;
+};
+
+/**
+ * \brief IoT STAKE handshake of server side.
+ *
+ * \param[in,out] s -
+ *   session used for communication.
+ * \param[in] prv -
+ *   server private key.
+ * \param[in] pub -
+ *   public key of sensor.
+ *
+ * \return Coroutine with result: 0 - OK, otherwise error.
+ */
+extern AsyncTask async_iotstake_server(AsyncSession &s, const Digit *prv, const Digit *pub);
+
+/**
+ * \brief IoT STAKE handshake of sensor side.
+ *
+ * \param[in,out] s -
+ *   session used for communication.
+ * \param[in] prv -
+ *   sensor private key.
+ * \param[in] pub -
+ *   public key of server.
+ *
+ * \return Coroutine with result: 0 - OK, otherwise error.
+ */
+extern AsyncTask async_iotstake_sensor(AsyncSession &s, const Digit *prv, const Digit *pub);
+
+/**
+ * \brief IoT PKI handshake of server side.
+ *
+ * \param[in,out] s -
+ *   session used for communication.
+ * \param[in] prv -
+ *   server private key.
+ * \param[in] pub -
+ *   public key of sensor.
+ *
+ * \return Coroutine with result: 0 - OK, otherwise error.
+ */
+extern AsyncTask async_iotpki_server(AsyncSession &s, const Digit *prv, const Digit *pub);
+
+/**
+ * \brief IoT PKI handshake of sensor side.
+ *
+ * \param[in,out] s -
+ *   session used for communication.
+ * \param[in] prv -
+ *   sensor private key.
+ * \param[in] pub -
+ *   public key of server.
+ *
+ * \return Coroutine with result: 0 - OK, otherwise error.
+ */
+extern AsyncTask async_iotpki_sensor(AsyncSession &s, const Digit *prv, const Digit *pub);
+
+/** \} */
+
+#endif /* __ASYNC_H */
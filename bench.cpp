@@ -0,0 +1,300 @@
+#include <sched.h>
+#include <stdlib.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "bench.h"
+
+static long bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec*1000000000L + ts.tv_nsec;
+}
+
+static unsigned long long bench_tsc(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static int bench_cmp(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Percentile of sorted table (nearest rank). */
+static double bench_percentile(const double *v, int n, double p)
+{
+	int i = (int)(p*(n - 1) + 0.5);
+
+	return v[i < 0 ? 0 : (i >= n ? n - 1 : i)];
+}
+
+void bench_default(BenchConfig *cfg)
+{
+	cfg->samples = 101;
+	cfg->warmupNs = 50000000L;
+	cfg->batchNs = 20000L;
+	cfg->outlier = 5.0;
+	cfg->cpu = 0;
+	cfg->format = BENCH_TEXT;
+	cfg->perf = 0;
+}
+
+int bench_pin(int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+
+	return sched_setaffinity(0, sizeof(set), &set) != 0;
+}
+
+void bench_run(BenchResult *res, const BenchConfig *cfg, const char *name,
+	void (*fn)(void *), void *arg, long bytes)
+{
+	static double cyc[BENCH_SAMPLES_MAX];
+	static double ns[BENCH_SAMPLES_MAX];
+	static double dev[BENCH_SAMPLES_MAX];
+	PerfCounters pc;
+	PerfSample p0, p1;
+	int samples = cfg->samples < BENCH_SAMPLES_MAX ? cfg->samples : BENCH_SAMPLES_MAX;
+	long batch = 1;
+	long start;
+	long i;
+	double median, mad;
+	int kept;
+	int s;
+
+	/* Warmup, then batch size for samples of at least batchNs. */
+	start = bench_now_ns();
+
+	while (bench_now_ns() - start < cfg->warmupNs)
+		fn(arg);
+
+	for (;;) {
+		start = bench_now_ns();
+
+		for (i = 0; i < batch; i++)
+			fn(arg);
+
+		if (bench_now_ns() - start >= cfg->batchNs || batch >= (1L << 30))
+			break;
+
+		batch *= 2;
+	}
+
+	if (cfg->perf) {
+		perf_open(&pc);
+		perf_read(&pc, &p0);
+	}
+
+	for (s = 0; s < samples; s++) {
+		unsigned long long t0 = bench_tsc();
+
+		start = bench_now_ns();
+
+		for (i = 0; i < batch; i++)
+			fn(arg);
+
+		ns[s] = (double)(bench_now_ns() - start)/batch;
+		cyc[s] = (double)(bench_tsc() - t0)/batch;
+	}
+
+	if (cfg->perf) {
+		perf_read(&pc, &p1);
+		perf_close(&pc);
+		perf_diff(&res->perf, &p0, &p1, (double)samples*batch);
+	} else {
+		for (i = 0; i < PERF_EVENTS; i++)
+			res->perf.v[i] = -1;
+	}
+
+	/* Time stamp counter is missing: statistics of nanoseconds. */
+	if (bench_tsc() == 0) {
+		for (s = 0; s < samples; s++)
+			cyc[s] = ns[s];
+	}
+
+	/* Rejection by median absolute deviation of cycles. */
+	for (s = 0; s < samples; s++)
+		dev[s] = cyc[s];
+
+	qsort(dev, samples, sizeof(double), bench_cmp);
+	median = bench_percentile(dev, samples, 0.5);
+
+	for (s = 0; s < samples; s++)
+		dev[s] = cyc[s] > median ? cyc[s] - median : median - cyc[s];
+
+	qsort(dev, samples, sizeof(double), bench_cmp);
+	mad = bench_percentile(dev, samples, 0.5);
+
+	kept = 0;
+
+	for (s = 0; s < samples; s++) {
+		double d = cyc[s] > median ? cyc[s] - median : median - cyc[s];
+
+		if (cfg->outlier <= 0 || d <= cfg->outlier*mad) {
+			cyc[kept] = cyc[s];
+			ns[kept] = ns[s];
+			kept++;
+		}
+	}
+
+	qsort(cyc, kept, sizeof(double), bench_cmp);
+	qsort(ns, kept, sizeof(double), bench_cmp);
+
+	res->name = name;
+	res->batch = batch;
+	res->samples = samples;
+	res->rejected = samples - kept;
+	res->ns = bench_percentile(ns, kept, 0.5);
+	res->cycles = bench_tsc() == 0 ? 0 : bench_percentile(cyc, kept, 0.5);
+	res->minCycles = cyc[0];
+	res->p90Cycles = bench_percentile(cyc, kept, 0.9);
+	res->p99Cycles = bench_percentile(cyc, kept, 0.99);
+	res->madCycles = mad;
+	res->bytes = bytes;
+}
+
+/* Throughput (MB/s) or 0. */
+static double bench_mbps(const BenchResult *r)
+{
+	return r->bytes > 0 && r->ns > 0 ? r->bytes*1e3/r->ns : 0;
+}
+
+/* Instructions per cycle or -1. */
+static double bench_ipc(const PerfSample *p)
+{
+	if (p->v[PERF_CYCLES] <= 0 || p->v[PERF_INSTRUCTIONS] < 0)
+		return -1;
+
+	return p->v[PERF_INSTRUCTIONS]/p->v[PERF_CYCLES];
+}
+
+/* Hardware counters of single result (cycles, instructions, IPC, branch and L1d misses). */
+static void bench_print_perf(FILE *out, int format, const PerfSample *p)
+{
+	static const char *const names[] = { "hw_cycles", "instructions", "ipc", "branch_misses", "l1d_misses" };
+	double v[5];
+	int i;
+
+	v[0] = p->v[PERF_CYCLES];
+	v[1] = p->v[PERF_INSTRUCTIONS];
+	v[2] = bench_ipc(p);
+	v[3] = p->v[PERF_BRANCH_MISSES];
+	v[4] = p->v[PERF_L1D_MISSES];
+
+	for (i = 0; i < 5; i++) {
+		switch (format) {
+		case BENCH_CSV:
+			if (v[i] < 0)
+				fprintf(out, ",");
+			else
+				fprintf(out, ",%.3f", v[i]);
+			break;
+
+		case BENCH_JSON:
+			if (v[i] < 0)
+				fprintf(out, ", \"%s\": null", names[i]);
+			else
+				fprintf(out, ", \"%s\": %.3f", names[i], v[i]);
+			break;
+
+		default:
+			/* Text: IPC and misses only, cycles are in table already. */
+			if (i < 2)
+				break;
+
+			if (v[i] < 0)
+				fprintf(out, " %9s", "-");
+			else
+				fprintf(out, i == 2 ? " %9.2f" : " %9.1f", v[i]);
+		}
+	}
+}
+
+void bench_print(FILE *out, const BenchConfig *cfg, const BenchResult *res, int n)
+{
+	int i;
+
+	switch (cfg->format) {
+	case BENCH_CSV:
+		fprintf(out, "name,ns,cycles,min_cycles,p90_cycles,p99_cycles,mad_cycles,samples,rejected,batch,bytes,mbps%s\n",
+			cfg->perf ? ",hw_cycles,instructions,ipc,branch_misses,l1d_misses" : "");
+
+		for (i = 0; i < n; i++) {
+			const BenchResult *r = res + i;
+
+			fprintf(out, "%s,%.2f,%.1f,%.1f,%.1f,%.1f,%.1f,%d,%d,%ld,%ld,%.2f", r->name, r->ns, r->cycles,
+				r->minCycles, r->p90Cycles, r->p99Cycles, r->madCycles, r->samples, r->rejected, r->batch,
+				r->bytes, bench_mbps(r));
+
+			if (cfg->perf)
+				bench_print_perf(out, cfg->format, &r->perf);
+
+			fprintf(out, "\n");
+		}
+		break;
+
+	case BENCH_JSON:
+		fprintf(out, "[\n");
+
+		for (i = 0; i < n; i++) {
+			const BenchResult *r = res + i;
+
+			fprintf(out, "  {\"name\": \"%s\", \"ns\": %.2f, \"cycles\": %.1f, \"min_cycles\": %.1f, "
+				"\"p90_cycles\": %.1f, \"p99_cycles\": %.1f, \"mad_cycles\": %.1f, \"samples\": %d, "
+				"\"rejected\": %d, \"batch\": %ld, \"bytes\": %ld, \"mbps\": %.2f", r->name, r->ns, r->cycles,
+				r->minCycles, r->p90Cycles, r->p99Cycles, r->madCycles, r->samples, r->rejected, r->batch,
+				r->bytes, bench_mbps(r));
+
+			if (cfg->perf)
+				bench_print_perf(out, cfg->format, &r->perf);
+
+			fprintf(out, "}%s\n", i + 1 < n ? "," : "");
+		}
+
+		fprintf(out, "]\n");
+		break;
+
+	default:
+		fprintf(out, "%-34s %12s %12s %12s %12s %12s %8s %10s", "name", "ns", "cycles", "min", "p90", "p99",
+			"rejected", "MB/s");
+
+		if (cfg->perf)
+			fprintf(out, " %9s %9s %9s", "IPC", "br-miss", "L1d-miss");
+
+		fprintf(out, "\n");
+
+		for (i = 0; i < n; i++) {
+			const BenchResult *r = res + i;
+
+			fprintf(out, "%-34s %12.1f %12.0f %12.0f %12.0f %12.0f %4d/%-3d ", r->name, r->ns, r->cycles,
+				r->minCycles, r->p90Cycles, r->p99Cycles, r->rejected, r->samples);
+
+			if (r->bytes > 0)
+				fprintf(out, "%10.1f", bench_mbps(r));
+			else
+				fprintf(out, "%10s", "-");
+
+			if (cfg->perf)
+				bench_print_perf(out, cfg->format, &r->perf);
+
+			fprintf(out, "\n");
+		}
+	}
+}
@@ -0,0 +1,144 @@
+#ifndef __BENCH_H
+#define __BENCH_H
+
+#include <stdio.h>
+
+#include "perf.h"
+
+/**
+ * \defgroup bench_group Microbenchmarks
+ * \brief Timing of single primitives with statistics of many samples.
+ *
+ * Every sample times a batch of calls, so timer overhead is negligible.
+ * Batch size is doubled until one batch takes at least
+ * \ref BenchConfig::batchNs nanoseconds. Before sampling the function is
+ * called for \ref BenchConfig::warmupNs nanoseconds (caches, branch
+ * predictors, CPU frequency). Samples further than
+ * \ref BenchConfig::outlier median absolute deviations from median are
+ * rejected (interrupts, migrations), then median and percentiles are
+ * computed from the rest.
+ *
+ * Time is measured by clock_gettime(CLOCK_MONOTONIC) and by time stamp
+ * counter (rdtsc) on x86. Time stamp counter runs at nominal frequency,
+ * so cycles equal core cycles only with fixed CPU frequency. With
+ * \ref BenchConfig::perf hardware counters (\ref perf_group) are read
+ * around all samples, their values per call include rejected samples.
+ *
+ * \{
+ */
+
+/** \brief Maximum number of samples of single benchmark. */
+#define BENCH_SAMPLES_MAX 1001
+
+/** \brief Output formats. */
+enum BenchFormat {
+	/** \brief Aligned table. */
+	BENCH_TEXT = 0,
+	/** \brief Comma separated values with header line. */
+	BENCH_CSV = 1,
+	/** \brief JSON array of objects. */
+	BENCH_JSON = 2
+};
+
+/** \brief Settings of benchmarks. */
+typedef struct BenchConfig_st {
+	/** \brief Number of samples (at most \ref BENCH_SAMPLES_MAX). */
+	int samples;
+	/** \brief Duration of warmup (nanoseconds). */
+	long warmupNs;
+	/** \brief Minimum duration of single sample (nanoseconds). */
+	long batchNs;
+	/** \brief Rejection threshold (median absolute deviations, 0 - none). */
+	double outlier;
+	/** \brief CPU to run on (-1 - no pinning). */
+	int cpu;
+	/** \brief Output format (\ref BenchFormat). */
+	int format;
+	/** \brief Non-zero to read hardware counters (\ref perf_group). */
+	int perf;
+} BenchConfig;
+
+/** \brief Statistics of single benchmark (per call). */
+typedef struct BenchResult_st {
+	/** \brief Name of benchmark. */
+	const char *name;
+	/** \brief Calls per sample. */
+	long batch;
+	/** \brief Number of samples. */
+	int samples;
+	/** \brief Number of rejected samples. */
+	int rejected;
+	/** \brief Median time (nanoseconds). */
+	double ns;
+	/** \brief Median of cycles of time stamp counter (0 - no counter). */
+	double cycles;
+	/** \brief Minimum of cycles. */
+	double minCycles;
+	/** \brief 90th percentile of cycles. */
+	double p90Cycles;
+	/** \brief 99th percentile of cycles. */
+	double p99Cycles;
+	/** \brief Median absolute deviation of cycles. */
+	double madCycles;
+	/** \brief Octets processed per call (0 - not a throughput benchmark). */
+	long bytes;
+	/** \brief Hardware counters per call (negative - not available or not read). */
+	PerfSample perf;
+} BenchResult;
+
+/**
+ * \brief Default settings: 101 samples, 50 ms of warmup, 20 us per sample,
+ * rejection at 5 median absolute deviations, CPU 0, text output, no
+ * hardware counters.
+ *
+ * \param[out] cfg -
+ *   settings.
+ */
+extern void bench_default(BenchConfig *cfg);
+
+/**
+ * \brief Pin calling thread to CPU.
+ *
+ * \param[in] cpu -
+ *   CPU number.
+ *
+ * \return 0 if thread is pinned.
+ */
+extern int bench_pin(int cpu);
+
+/**
+ * \brief Run benchmark.
+ *
+ * \param[out] res -
+ *   statistics.
+ * \param[in] cfg -
+ *   settings.
+ * \param[in] name -
+ *   name of benchmark (kept as pointer).
+ * \param[in] fn -
+ *   measured function.
+ * \param[in] arg -
+ *   argument of \a fn.
+ * \param[in] bytes -
+ *   octets processed by single call (0 - none).
+ */
+extern void bench_run(BenchResult *res, const BenchConfig *cfg, const char *name,
+	void (*fn)(void *), void *arg, long bytes);
+
+/**
+ * \brief Print statistics of benchmarks.
+ *
+ * \param[in] out -
+ *   output stream.
+ * \param[in] cfg -
+ *   settings (format).
+ * \param[in] res -
+ *   table of \a n results.
+ * \param[in] n -
+ *   number of results.
+ */
+extern void bench_print(FILE *out, const BenchConfig *cfg, const BenchResult *res, int n);
+
+/** \} */
+
+#endif /* __BENCH_H */
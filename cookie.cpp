@@ -0,0 +1,105 @@
+#include "crypto.h"
+
+/* Offsets of fields in cookie. */
+#define COOKIE_IV 0
+#define COOKIE_CIPHER AES128_BLOCK_BYTES
+#define COOKIE_MAC (AES128_BLOCK_BYTES + COOKIE_CIPHER_BYTES)
+
+static void cookie_zeroize(Octet *dst, int n)
+{
+	volatile Octet *p = dst;
+
+	while (n--)
+		*p++ = 0;
+}
+
+void iotstake_cookie_key(StakeCookieKey *ck, const Octet *key)
+{
+	static const Octet encLabel[16] = {'S', 'T', 'A', 'K', 'E', '-', 'C', 'O', 'O', 'K', 'I', 'E', 0, 0, 0, 1};
+	static const Octet macLabel[16] = {'S', 'T', 'A', 'K', 'E', '-', 'C', 'O', 'O', 'K', 'I', 'E', 0, 0, 0, 2};
+	Octet sub[AES128_KEY_BYTES];
+
+	aes128_key_expansion(ck->macKey, key);
+	aes128_encrypt(sub, encLabel, ck->macKey);
+	aes128_key_expansion(ck->encKey, sub);
+	aes128_encrypt(sub, macLabel, ck->macKey);
+	aes128_key_expansion(ck->macKey, sub);
+	cookie_zeroize(sub, sizeof(sub));
+}
+
+int iotstake_cookie_seal(const ProtocolIoTStake *ctx, Octet *cookie, uint64_t expiry,
+	const StakeCookieKey *ck, void (*rng)(Digit *, int))
+{
+	Digit iv[AES128_BLOCK_BYTES / sizeof(Digit)];
+	Octet state[COOKIE_STATE_BYTES];
+	Octet *p = state;
+	int i;
+
+	for (i = 56; i >= 0; i -= 8) {
+		*p++ = (Octet)(expiry >> i);
+	}
+
+	/* Digits are stored in big-endian order, so cookie is the same on every node. */
+	to_octets(p, ctx->ephPrvKeyA, EC_GEN_ORDER_DIGITS);
+	to_octets(p + EC_GEN_ORDER_OCTETS, ctx->pubKeyB, FP_DIGITS);
+	to_octets(p + EC_GEN_ORDER_OCTETS + FP_OCTETS, ctx->pubKeyB + FP_DIGITS, FP_DIGITS);
+
+	if (rng) {
+		rng(iv, AES128_BLOCK_BYTES / sizeof(Digit));
+	} else {
+		rng_bits(iv, AES128_BLOCK_BYTES / sizeof(Digit));
+	}
+
+	for (i = 0; i < AES128_BLOCK_BYTES; i++) {
+		cookie[COOKIE_IV + i] = ((Octet *)iv)[i];
+	}
+
+	aes128_cbc_encrypt(cookie + COOKIE_CIPHER, state, COOKIE_STATE_BYTES, cookie + COOKIE_IV, ck->encKey);
+	aes128_cbc_mac(cookie + COOKIE_MAC, cookie, COOKIE_MAC, ck->macKey);
+	cookie_zeroize(state, sizeof(state));
+
+	return 0;
+}
+
+int iotstake_cookie_open(ProtocolIoTStake *ctx, const Octet *cookie, uint64_t now,
+	const Digit *prvA, const StakeCookieKey *ck)
+{
+	Octet state[COOKIE_CIPHER_BYTES];
+	Octet mac[AES128_BLOCK_BYTES];
+	const Octet *p = state;
+	uint64_t expiry = 0;
+	Octet diff = 0;
+	int i;
+
+	aes128_cbc_mac(mac, cookie, COOKIE_MAC, ck->macKey);
+
+	/* Comparison in constant time. */
+	for (i = 0; i < AES128_BLOCK_BYTES; i++) {
+		diff |= mac[i] ^ cookie[COOKIE_MAC + i];
+	}
+
+	if (diff != 0)
+		return 1;
+
+	if (aes128_cbc_decrypt(state, cookie + COOKIE_CIPHER, COOKIE_CIPHER_BYTES, cookie + COOKIE_IV, ck->encKey) != COOKIE_STATE_BYTES) {
+		cookie_zeroize(state, sizeof(state));
+		return 1;
+	}
+
+	for (i = 0; i < 8; i++) {
+		expiry = (expiry << 8) | *p++;
+	}
+
+	if (now > expiry) {
+		cookie_zeroize(state, sizeof(state));
+		return 2;
+	}
+
+	assign(ctx->prvKeyA, prvA, EC_GEN_ORDER_DIGITS);
+	from_octets(ctx->ephPrvKeyA, p, EC_GEN_ORDER_DIGITS);
+	from_octets(ctx->pubKeyB, p + EC_GEN_ORDER_OCTETS, FP_DIGITS);
+	from_octets(ctx->pubKeyB + FP_DIGITS, p + EC_GEN_ORDER_OCTETS + FP_OCTETS, FP_DIGITS);
+	cookie_zeroize(state, sizeof(state));
+
+	return 0;
+}
@@ -0,0 +1,288 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cost.h"
+
+/* Kind of operation by short name or -1. */
+static int cost_kind(const char *name)
+{
+	int k;
+
+	for (k = 0; k < OP_KINDS; k++) {
+		if (strcmp(op_names[k], name) == 0)
+			return k;
+	}
+
+	return -1;
+}
+
+/* Strip white space at both ends. */
+static char *cost_trim(char *s)
+{
+	char *end;
+
+	while (*s == ' ' || *s == '\t')
+		s++;
+
+	end = s + strlen(s);
+
+	while (end > s && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r' || end[-1] == '\n'))
+		end--;
+
+	*end = 0;
+
+	return s;
+}
+
+/* Parse number, 0 if whole string is number. */
+static int cost_number(double *dst, const char *s)
+{
+	char *end;
+
+	*dst = strtod(s, &end);
+
+	return end == s || *end != 0;
+}
+
+/* Apply single "key = value" line, 0 if valid. */
+static int cost_line(CostProfile *prof, char *line)
+{
+	char *eq = strchr(line, '#');
+	char *key, *value, *name;
+	int k;
+
+	if (eq)
+		*eq = 0;
+
+	line = cost_trim(line);
+
+	if (*line == 0)
+		return 0;
+
+	if ((eq = strchr(line, '=')) == 0)
+		return 1;
+
+	*eq = 0;
+	key = cost_trim(line);
+	value = cost_trim(eq + 1);
+
+	if (strcmp(key, "name") == 0) {
+		if (strlen(value) >= COST_NAME_MAX)
+			return 1;
+
+		strcpy(prof->name, value);
+		return 0;
+	}
+
+	if (strcmp(key, "mhz") == 0)
+		return cost_number(&prof->mhz, value) || prof->mhz <= 0;
+
+	if (strcmp(key, "nj_per_cycle") == 0)
+		return cost_number(&prof->njPerCycle, value);
+
+	if (strcmp(key, "fit") == 0) {
+		for (name = strtok(value, " \t,"); name; name = strtok(0, " \t,")) {
+			if ((k = cost_kind(name)) < 0)
+				return 1;
+
+			prof->fit[k] = 1;
+		}
+
+		return 0;
+	}
+
+	if ((k = cost_kind(key)) < 0)
+		return 1;
+
+	return cost_number(&prof->cycles[k], value);
+}
+
+int cost_load(CostProfile *prof, const char *path)
+{
+	FILE *in = fopen(path, "r");
+	char line[256];
+	int n = 0;
+
+	if (in == 0)
+		return -1;
+
+	memset(prof, 0, sizeof(*prof));
+	prof->mhz = 1;
+
+	while (fgets(line, sizeof(line), in)) {
+		n++;
+
+		if (cost_line(prof, line) != 0) {
+			fclose(in);
+			return n;
+		}
+	}
+
+	fclose(in);
+
+	return 0;
+}
+
+void cost_save(FILE *out, const CostProfile *prof)
+{
+	int k;
+	int first = 1;
+
+	fprintf(out, "name = %s\n", prof->name);
+	fprintf(out, "mhz = %g\n", prof->mhz);
+	fprintf(out, "nj_per_cycle = %g\n", prof->njPerCycle);
+
+	for (k = 0; k < OP_KINDS; k++)
+		fprintf(out, "%s = %.6g\n", op_names[k], prof->cycles[k]);
+
+	for (k = 0; k < OP_KINDS; k++) {
+		if (prof->fit[k]) {
+			fprintf(out, "%s %s", first ? "fit =" : "", op_names[k]);
+			first = 0;
+		}
+	}
+
+	if (!first)
+		fprintf(out, "\n");
+}
+
+double cost_cycles(const CostProfile *prof, const unsigned long *ops)
+{
+	double cycles = 0;
+	int k;
+
+	for (k = 0; k < OP_KINDS; k++)
+		cycles += prof->cycles[k]*ops[k];
+
+	return cycles;
+}
+
+double cost_ms(const CostProfile *prof, double cycles)
+{
+	return cycles/(prof->mhz*1e3);
+}
+
+double cost_mj(const CostProfile *prof, double cycles)
+{
+	return cycles*prof->njPerCycle*1e-6;
+}
+
+int cost_fit(CostProfile *prof, const unsigned long (*ops)[OP_KINDS], const double *cycles, int m,
+	double *rms)
+{
+	static double a[COST_ROWS_MAX][OP_KINDS];
+	double b[COST_ROWS_MAX];
+	double scale[OP_KINDS];
+	double x[OP_KINDS];
+	int col[OP_KINDS];
+	int f = 0;
+	int i, j, k;
+
+	if (m > COST_ROWS_MAX)
+		return 1;
+
+	/*
+	 * Rows are divided by measured cycles (relative errors), columns by
+	 * their norms, so counts of digit and point operations are comparable.
+	 */
+	for (k = 0; k < OP_KINDS; k++) {
+		double norm = 0;
+
+		if (!prof->fit[k])
+			continue;
+
+		for (i = 0; i < m; i++)
+			norm += ((double)ops[i][k]/cycles[i])*((double)ops[i][k]/cycles[i]);
+
+		if (norm > 0) {
+			scale[f] = sqrt(norm);
+			col[f++] = k;
+		}
+	}
+
+	if (f > m)
+		return 1;
+
+	for (i = 0; i < m; i++) {
+		double fixed = 0;
+
+		for (k = 0; k < OP_KINDS; k++)
+			fixed += prof->cycles[k]*ops[i][k];
+
+		for (j = 0; j < f; j++) {
+			fixed -= prof->cycles[col[j]]*ops[i][col[j]];
+			a[i][j] = ops[i][col[j]]/cycles[i]/scale[j];
+		}
+
+		b[i] = (cycles[i] - fixed)/cycles[i];
+	}
+
+	/* Householder QR, R is left in upper triangle of a. */
+	for (j = 0; j < f; j++) {
+		double norm = 0, dot;
+
+		for (i = j; i < m; i++)
+			norm += a[i][j]*a[i][j];
+
+		norm = sqrt(norm);
+
+		if (norm < 1e-9)
+			return 1;
+
+		if (a[j][j] > 0)
+			norm = -norm;
+
+		/* v = a[j..m-1][j] - norm*e_j, R[j][j] = norm. */
+		a[j][j] -= norm;
+		dot = -norm*a[j][j];
+
+		for (k = j + 1; k < f; k++) {
+			double s = 0;
+
+			for (i = j; i < m; i++)
+				s += a[i][j]*a[i][k];
+
+			for (i = j; i < m; i++)
+				a[i][k] -= s/dot*a[i][j];
+		}
+
+		{
+			double s = 0;
+
+			for (i = j; i < m; i++)
+				s += a[i][j]*b[i];
+
+			for (i = j; i < m; i++)
+				b[i] -= s/dot*a[i][j];
+		}
+
+		a[j][j] = norm;
+	}
+
+	for (j = f - 1; j >= 0; j--) {
+		x[j] = b[j];
+
+		for (k = j + 1; k < f; k++)
+			x[j] -= a[j][k]*x[k];
+
+		x[j] /= a[j][j];
+	}
+
+	for (j = 0; j < f; j++)
+		prof->cycles[col[j]] = x[j]/scale[j];
+
+	if (rms) {
+		double sum = 0;
+
+		for (i = 0; i < m; i++) {
+			double e = (cost_cycles(prof, ops[i]) - cycles[i])/cycles[i];
+
+			sum += e*e;
+		}
+
+		*rms = m > 0 ? sqrt(sum/m) : 0;
+	}
+
+	return 0;
+}
@@ -0,0 +1,139 @@
+#ifndef __COST_H
+#define __COST_H
+
+#include <stdio.h>
+
+#include "crypto.h"
+
+/**
+ * \defgroup cost_group Cost model
+ * \brief Projection of operation counts (\ref opcount_group) to cycles,
+ * time and energy of microcontroller.
+ *
+ * Target is described by profile: clock frequency, energy per cycle and
+ * cycles per operation of every kind (\ref OpKind). Cycles of protocol
+ * step are sum of counts multiplied by cycles per operation. Digit
+ * operations (w_mul, w_add, w_shift) carry most of the work of field
+ * arithmetic, so cycles of field and point operations in profile stand
+ * only for the rest (calls, copies, comparisons, loops).
+ *
+ * Profile is text file of lines "key = value", '#' starts comment:
+ *
+ *   name = cortex-m4
+ *   mhz = 64
+ *   nj_per_cycle = 0.16
+ *   w_mul = 9
+ *   fit = w_mul w_add fp_mul
+ *
+ * Keys are name, mhz, nj_per_cycle, fit (kinds fitted by calibration) and
+ * short names of operation kinds (\ref op_names). Missing kinds cost 0.
+ *
+ * \{
+ */
+
+/** \brief Maximum length of profile name. */
+#define COST_NAME_MAX 32
+
+/** \brief Maximum number of measurements in calibration. */
+#define COST_ROWS_MAX 64
+
+/** \brief Profile of target. */
+typedef struct CostProfile_st {
+	/** \brief Name of target. */
+	char name[COST_NAME_MAX];
+	/** \brief Clock frequency (MHz). */
+	double mhz;
+	/** \brief Energy per cycle (nJ). */
+	double njPerCycle;
+	/** \brief Cycles per operation of every kind (\ref OpKind). */
+	double cycles[OP_KINDS];
+	/** \brief Non-zero for kinds fitted by \ref cost_fit. */
+	int fit[OP_KINDS];
+} CostProfile;
+
+/**
+ * \brief Load profile from file.
+ *
+ * \param[out] prof -
+ *   profile.
+ * \param[in] path -
+ *   path of profile file.
+ *
+ * \return 0 if profile is loaded, -1 if file cannot be opened, number of
+ *   invalid line otherwise.
+ */
+extern int cost_load(CostProfile *prof, const char *path);
+
+/**
+ * \brief Write profile in format of profile file.
+ *
+ * \param[in] out -
+ *   output stream.
+ * \param[in] prof -
+ *   profile.
+ */
+extern void cost_save(FILE *out, const CostProfile *prof);
+
+/**
+ * \brief Cycles of operations.
+ *
+ * \param[in] prof -
+ *   profile.
+ * \param[in] ops -
+ *   number of operations of every kind (\ref OpKind).
+ *
+ * \return predicted cycles.
+ */
+extern double cost_cycles(const CostProfile *prof, const unsigned long *ops);
+
+/**
+ * \brief Time of cycles.
+ *
+ * \param[in] prof -
+ *   profile.
+ * \param[in] cycles -
+ *   cycles.
+ *
+ * \return milliseconds.
+ */
+extern double cost_ms(const CostProfile *prof, double cycles);
+
+/**
+ * \brief Energy of cycles.
+ *
+ * \param[in] prof -
+ *   profile.
+ * \param[in] cycles -
+ *   cycles.
+ *
+ * \return millijoules.
+ */
+extern double cost_mj(const CostProfile *prof, double cycles);
+
+/**
+ * \brief Fit cycles of kinds marked in \ref CostProfile::fit to measured
+ * cycles of operations (linear least squares of relative errors).
+ *
+ * Cycles of other kinds are kept and subtracted from measurements. Marked
+ * kinds which do not occur in any measurement are kept as well.
+ *
+ * \param[in,out] prof -
+ *   profile.
+ * \param[in] ops -
+ *   operations of \a m measurements.
+ * \param[in] cycles -
+ *   measured cycles of \a m measurements.
+ * \param[in] m -
+ *   number of measurements (at most \ref COST_ROWS_MAX).
+ * \param[out] rms -
+ *   root mean square of relative errors after fit (may be 0).
+ *
+ * \return 0 if profile is fitted, 1 if there are more fitted kinds than
+ *   measurements or their counts are linearly dependent.
+ */
+extern int cost_fit(CostProfile *prof, const unsigned long (*ops)[OP_KINDS], const double *cycles, int m,
+	double *rms);
+
+/** \} */
+
+#endif /* __COST_H */
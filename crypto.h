@@ -33,15 +33,33 @@ typedef uint32_t Word;
  * \{
  */
 
-/** \brief Number of bits in single \ref Digit. */
-#define DIGIT_BITS 32
+/**
+ * \brief Number of bits in single \ref Digit: 32 (default) or 16 for
+ * microcontrollers with 16x16 multipliers (-DDIGIT_BITS=16). Results do
+ * not depend on it: numbers have the same octets in memory of
+ * little-endian host and constants are written as 32-bit words
+ * (\ref ARTH_WORD_DIGITS).
+ */
+#if !defined(DIGIT_BITS)
+#	define DIGIT_BITS 32
+#endif
+
+#if DIGIT_BITS == 32
 /** \brief Definition of type which represents single digit. */
 typedef uint32_t Digit;
 
 /** \brief Number of bits in single \ref DDigit. */
-#define DDIGIT_BITS 64
+#	define DDIGIT_BITS 64
 /** \brief Definition of type which contains two digits (\ref Digit) inside. */
 typedef uint64_t DDigit;
+#elif DIGIT_BITS == 16
+typedef uint16_t Digit;
+
+#	define DDIGIT_BITS 32
+typedef uint32_t DDigit;
+#else
+#	error "DIGIT_BITS must be 16 or 32"
+#endif
 
 /** \brief Definition of number comparison result. */
 typedef int Cmp;
@@ -79,6 +97,10 @@ typedef int Cmp;
 #define FP_DIGITS ((FP_BITS + DIGIT_BITS - 1) / DIGIT_BITS)
 /** \brief Number of digits in elliptic curve generator representation. */
 #define EC_GEN_ORDER_DIGITS ((EC_GEN_ORDER_BITS + DIGIT_BITS - 1) / DIGIT_BITS)
+/** \brief Number of octets in big-endian representation of field element. */
+#define FP_OCTETS (FP_DIGITS*(DIGIT_BITS/OCTET_BITS))
+/** \brief Number of octets in big-endian representation of integer modulo generator order. */
+#define EC_GEN_ORDER_OCTETS (EC_GEN_ORDER_DIGITS*(DIGIT_BITS/OCTET_BITS))
 /** \brief Macro which constructs names of adequate parameters and functions. */
 #define ECC_PARAMS_SET(param) XGLUE(ECC_PARAMS_PREFIX, param)
 
@@ -95,6 +117,23 @@ typedef int Cmp;
 #define ARTH_CLR_BIT(dst, bit) \
 	((dst)[(bit) / DIGIT_BITS] &= ~(Digit)(1 << ((bit) % DIGIT_BITS)))
 
+/**
+ * \brief Macro gives digits of 32-bit word \a w (least significant first)
+ * in initializer of number, e.g. { ARTH_WORD_DIGITS(0xFFFFFFFF), ... }.
+ */
+#if DIGIT_BITS == 32
+#	define ARTH_WORD_DIGITS(w) (Digit)(w)
+#else
+#	define ARTH_WORD_DIGITS(w) (Digit)(w), (Digit)((w) >> 16)
+#endif
+
+/** \brief Macro returns 32-bit word \a w of number (bits 32w to 32w + 31). */
+#if DIGIT_BITS == 32
+#	define ARTH_GET_WORD(src, w) ((Word)(src)[w])
+#else
+#	define ARTH_GET_WORD(src, w) ((Word)(src)[2*(w)] | (Word)(src)[2*(w) + 1] << 16)
+#endif
+
 /** \brief Maximum number of digits in numbers. */
 #define NUMBER_DIGITS_MAX (EC_GEN_ORDER_DIGITS + 1)
 
@@ -104,6 +143,82 @@ typedef int Cmp;
 /** \brief Shared memory in arithmetic module. */
 extern Digit arth_tmp[ARTH_TMP_DIGITS];
 
+/**
+ * \defgroup opcount_group Operation counters
+ * \brief Number of field, scalar, point and AES operations (STAKE_OPCOUNT).
+ *
+ * If compiled with STAKE_OPCOUNT, every field operation called by
+ * \ref FP_ADD, \ref FP_MUL etc., every reduction modulo generator order,
+ * inversion modulo generator order, point doubling and addition, AES key
+ * expansion and AES block is counted in \ref op_count of calling thread.
+ * Below them digit operations of the arithmetic module are counted: digit
+ * products of add_mul_digit() and sub_mul_digit(), digits added or
+ * subtracted by add() and sub(), digits shifted by div2() and
+ * signed_div2(). Otherwise \ref OP_COUNT expands to nothing. Protocol
+ * steps are measured as difference of counters before and after the step.
+ *
+ * \{
+ */
+
+/** \brief Kinds of counted operations. */
+enum OpKind {
+	/** \brief Field multiplication. */
+	OP_FP_MUL = 0,
+	/** \brief Field squaring. */
+	OP_FP_SQR,
+	/** \brief Field addition. */
+	OP_FP_ADD,
+	/** \brief Field subtraction and negation. */
+	OP_FP_SUB,
+	/** \brief Field inversion. */
+	OP_FP_INV,
+	/** \brief Reduction modulo generator order (after every product). */
+	OP_N_MODRED,
+	/** \brief Inversion modulo generator order. */
+	OP_N_INV,
+	/** \brief Point doubling. */
+	OP_EC_DBL,
+	/** \brief Point addition. */
+	OP_EC_ADD,
+	/** \brief AES-128 key expansion. */
+	OP_AES_KEY,
+	/** \brief AES-128 block encryption or decryption. */
+	OP_AES_BLOCK,
+	/** \brief Product of two digits (\ref DDigit result) with accumulation. */
+	OP_W_MUL,
+	/** \brief Addition or subtraction of digits with carry. */
+	OP_W_ADD,
+	/** \brief Shift of digit by one bit. */
+	OP_W_SHIFT,
+	/** \brief Number of kinds. */
+	OP_KINDS
+};
+
+/** \brief Short names of operation kinds. */
+extern const char *const op_names[OP_KINDS];
+
+#if defined(STAKE_OPCOUNT)
+
+/** \brief Operation counters. */
+typedef struct OpCount_st {
+	/** \brief Number of operations of every kind (\ref OpKind). */
+	unsigned long n[OP_KINDS];
+} OpCount;
+
+/** \brief Counters of calling thread. */
+extern thread_local OpCount op_count;
+
+/** \brief Count \a k operations of kind \a kind. */
+#define OP_COUNT(kind, k) ((void)(op_count.n[kind] += (k)))
+
+#else
+
+#define OP_COUNT(kind, k) ((void)0)
+
+#endif
+
+/** \} */
+
 /**
  * \brief Assigns one number to another.
  *
@@ -138,6 +253,30 @@ extern void assign_digit(Digit *dst, Digit src, int n);
  */
 extern void reorder(Digit *dst, int n);
 
+/**
+ * \brief Converts number to big-endian octet string.
+ *
+ * \param[out] dst -
+ *   table for n*DIGIT_BITS/OCTET_BITS octets.
+ * \param[in] src -
+ *   number.
+ * \param[in] n -
+ *   digits of \a src.
+ */
+extern void to_octets(Octet *dst, const Digit *src, int n);
+
+/**
+ * \brief Converts big-endian octet string to number.
+ *
+ * \param[out] dst -
+ *   number.
+ * \param[in] src -
+ *   table with n*DIGIT_BITS/OCTET_BITS octets.
+ * \param[in] n -
+ *   digits of \a dst.
+ */
+extern void from_octets(Digit *dst, const Octet *src, int n);
+
 /**
  * \brief Comparison of two numbers.
  *
@@ -333,10 +472,12 @@ extern void primeinv(Digit *dst, const Digit *src,
 
 /** \brief Elliptic curve generator. */
 #define EC_GEN ECC_PARAMS_SET(gen)
+/** \brief Table of comb of elliptic curve generator. */
+#define EC_GEN_COMB ECC_PARAMS_SET(comb)
 /** \brief Order of elliptic curve generator. */
 #define EC_GEN_ORDER ECC_PARAMS_SET(gen_order)
 /** \brief Reduction modulo generator order. */
-#define EC_GEN_ORDER_MODRED ECC_PARAMS_SET(gen_order_modred)
+#define EC_GEN_ORDER_MODRED(dst, n) (OP_COUNT(OP_N_MODRED, 1), ECC_PARAMS_SET(gen_order_modred)(dst, n))
 /** \brief Prime number which define field. */
 #define FP_PRIME ECC_PARAMS_SET(prime)
 /** \brief Inversion of 2 modulo \ref FP_PRIME. */
@@ -352,17 +493,17 @@ extern void primeinv(Digit *dst, const Digit *src,
 /** \brief Check if field element is equel to 1. */
 #define FP_IS_ONE(dst) (cmp_digit(dst, 1, FP_DIGITS) == 0)
 /** \brief Add two field elements and store result in first one. */
-#define FP_ADD ECC_PARAMS_SET(fp_add)
+#define FP_ADD(dst, src) (OP_COUNT(OP_FP_ADD, 1), ECC_PARAMS_SET(fp_add)(dst, src))
 /** \brief Subtract two field elements and store result in first one. */
-#define FP_SUB ECC_PARAMS_SET(fp_sub)
+#define FP_SUB(dst, src) (OP_COUNT(OP_FP_SUB, 1), ECC_PARAMS_SET(fp_sub)(dst, src))
 /** \brief Multiply two field elements and store result in first one. */
-#define FP_MUL ECC_PARAMS_SET(fp_mul)
+#define FP_MUL(dst, src) (OP_COUNT(OP_FP_MUL, 1), ECC_PARAMS_SET(fp_mul)(dst, src))
 /** \brief Compute square of field element and store result in argument. */
-#define FP_SQR ECC_PARAMS_SET(fp_sqr)
+#define FP_SQR(dst) (OP_COUNT(OP_FP_SQR, 1), ECC_PARAMS_SET(fp_sqr)(dst))
 /** \brief Compute reverse of field element and store result in argument. */
-#define FP_MINUS ECC_PARAMS_SET(fp_minus)
+#define FP_MINUS(dst) (OP_COUNT(OP_FP_SUB, 1), ECC_PARAMS_SET(fp_minus)(dst))
 /** \brief Compute inverse of field element and store result in argument. */
-#define FP_INV(dst) primeinv(dst, dst, FP_PRIME, FP_DIGITS)
+#define FP_INV(dst) (OP_COUNT(OP_FP_INV, 1), primeinv(dst, dst, FP_PRIME, FP_DIGITS))
 
 /**
  * \defgroup secp192r1_group SECP192R1
@@ -514,6 +655,105 @@ extern void secp192r1_gen_order_modred(Digit *dst, int n);
 /** \brief Shared memory in elliptic curve module. */
 extern Digit ecc_tmp[ECC_TMP_DIGITS];
 
+/**
+ * \defgroup profile_group Build profiles
+ * \brief Memory/speed configuration of elliptic curve core.
+ *
+ * Makefile variable STAKE_PROFILE selects one of:
+ *   - tiny (STAKE_PROFILE_TINY): NAF without table, no table of
+ *     generator, batches of 2 points (Makefile: AES key expanded on the fly),
+ *   - balanced (default): width-4 NAF, comb of 4 teeth for generator,
+ *     batches of 16 points (Makefile: byte AES),
+ *   - fast (STAKE_PROFILE_FAST): width-5 NAF, comb of 8 teeth for
+ *     generator, batches of 64 points (Makefile: AES instructions,
+ *     T-tables otherwise).
+ *
+ * Every parameter may be also set alone, e.g. -DECC_WNAF_WIDTH=6.
+ *
+ * \{
+ */
+
+#if defined(STAKE_PROFILE_TINY)
+#	define ECC_PROFILE_NAME "tiny"
+#	define ECC_PROFILE_WNAF_WIDTH 2
+#	define ECC_PROFILE_COMB_TEETH 0
+#	define ECC_PROFILE_BATCH_MAX 2
+#elif defined(STAKE_PROFILE_FAST)
+#	define ECC_PROFILE_NAME "fast"
+#	define ECC_PROFILE_WNAF_WIDTH 5
+#	define ECC_PROFILE_COMB_TEETH 8
+#	define ECC_PROFILE_BATCH_MAX 64
+#else
+#	define ECC_PROFILE_NAME "balanced"
+#	define ECC_PROFILE_WNAF_WIDTH 4
+#	define ECC_PROFILE_COMB_TEETH 4
+#	define ECC_PROFILE_BATCH_MAX 16
+#endif
+
+#if !defined(ECC_WNAF_WIDTH)
+/**
+ * \brief Width of NAF of multiples of variable point (2 - plain NAF
+ * computed on the fly, w - table of 2^(w-2) odd multiples on stack).
+ */
+#	define ECC_WNAF_WIDTH ECC_PROFILE_WNAF_WIDTH
+#endif
+
+#if !defined(ECC_COMB_TEETH)
+/**
+ * \brief Teeth of comb for multiples of generator (0 - no table, t - table
+ * of 2^t - 1 affine points).
+ */
+#	define ECC_COMB_TEETH ECC_PROFILE_COMB_TEETH
+#endif
+
+/** \brief Number of columns of comb (doublings of multiple of generator). */
+#define ECC_COMB_COLUMNS (ECC_COMB_TEETH ? (EC_GEN_ORDER_BITS + ECC_COMB_TEETH - 1) / ECC_COMB_TEETH : 0)
+
+/** \brief Points in table of comb. */
+#define ECC_COMB_POINTS (ECC_COMB_TEETH ? (1 << ECC_COMB_TEETH) - 1 : 0)
+
+#if !defined(ECC_BATCH_MAX)
+/** \brief Maximum number of points processed together by batch functions. */
+#	define ECC_BATCH_MAX ECC_PROFILE_BATCH_MAX
+#endif
+
+#if ECC_WNAF_WIDTH < 2 || ECC_WNAF_WIDTH > 7
+#	error "ECC_WNAF_WIDTH must be 2 to 7"
+#endif
+
+#if ECC_COMB_TEETH < 0 || ECC_COMB_TEETH > 10
+#	error "ECC_COMB_TEETH must be 0 to 10"
+#endif
+
+#if ECC_BATCH_MAX < 1
+#	error "ECC_BATCH_MAX must be positive"
+#endif
+
+#if ECC_COMB_TEETH > 0
+/**
+ * \brief Comb of generator: entry i - 1 is affine sum of
+ * [2^(j*\ref ECC_COMB_COLUMNS)]G for bits j of i. Constant table in
+ * secp192r1_comb.cpp is generated at build time by gencomb
+ * (main_gencomb.cpp), so it is placed in read-only memory (flash) and no
+ * curve operation is done before first multiple of generator.
+ */
+extern const Digit secp192r1_comb[ECC_COMB_POINTS][2*FP_DIGITS];
+#endif
+
+/** \} */
+
+/**
+ * \brief Number of digits in elliptic curve module batch memory.
+ *
+ * Batch memory contains \ref ECC_BATCH_MAX projective points stored one
+ * after another, followed by \ref ECC_BATCH_MAX field elements used for
+ * products of Z coordinates.
+ */
+#define ECC_BATCH_TMP_DIGITS (ECC_BATCH_MAX*(3*FP_DIGITS + FP_DIGITS))
+
+/** \brief Shared batch memory in elliptic curve module. */
+extern Digit ecc_batch_tmp[ECC_BATCH_TMP_DIGITS];
+
 typedef struct EcdsaSign_st {
     Digit r[EC_GEN_ORDER_DIGITS];
     Digit s[EC_GEN_ORDER_DIGITS];
@@ -527,6 +767,20 @@ typedef struct EcdsaSign_st {
  */
 extern void ecp_pro2aff(Digit *P);
 
+/**
+ * \brief Conversion of many points from projective to affine coordinates.
+ *
+ * Function uses simultaneous inversion (Montgomery trick), so only one
+ * field inversion is computed for all points. Points at infinity are
+ * converted in the same way as in \ref ecp_pro2aff.
+ *
+ * \param[in,out] P -
+ *   table of \a n projective points stored one after another.
+ * \param[in] n -
+ *   number of points (at most \ref ECC_BATCH_MAX).
+ */
+extern void ecp_pro2aff_batch(Digit *P, int n);
+
 /**
  * \brief Elliptic curve point addition (only projective coordinates).
  *
@@ -569,6 +823,48 @@ extern void ecp_doubling(Digit *P);
  */
 extern void ecp_multiple(Digit *P, const Digit *m);
 
+/**
+ * \brief Elliptic curve point multiple with projective result.
+ *
+ * Function computes [\a m]\a P and store result in \a T without
+ * final conversion to affine coordinates.
+ *
+ * \param[out] T -
+ *   result point (in projective coordinates).
+ * \param[in] P -
+ *   point to multiply (in affine coordinates).
+ * \param[in] m -
+ *   multiple which will be computed. Number of digits for this
+ *   number is constant and equal to \ref EC_GEN_ORDER_DIGITS.
+ */
+extern void ecp_multiple_pro(Digit *T, const Digit *P, const Digit *m);
+
+/**
+ * \brief Multiple of generator (only affine coordinates).
+ *
+ * Function computes [\a m]G by comb of \ref ECC_COMB_TEETH teeth, by
+ * \ref ecp_multiple if there is no comb. Table of comb is constant
+ * (\ref secp192r1_comb), so the function has no state.
+ *
+ * \param[out] P -
+ *   result point (in affine coordinates).
+ * \param[in] m -
+ *   multiple which will be computed. Number of digits for this
+ *   number is constant and equal to \ref EC_GEN_ORDER_DIGITS.
+ */
+extern void ecp_generator_multiple(Digit *P, const Digit *m);
+
+/**
+ * \brief Multiple of generator with projective result.
+ *
+ * \param[out] T -
+ *   result point (in projective coordinates).
+ * \param[in] m -
+ *   multiple which will be computed. Number of digits for this
+ *   number is constant and equal to \ref EC_GEN_ORDER_DIGITS.
+ */
+extern void ecp_generator_multiple_pro(Digit *T, const Digit *m);
+
 /**
  * \brief Elliptic curve point scalar product (only affine coordinates).
  *
@@ -587,6 +883,25 @@ extern void ecp_multiple(Digit *P, const Digit *m);
  */
 extern void ecp_scalar_product(Digit *P, const Digit *mp, const Digit *Q, const Digit *mq);
 
+/**
+ * \brief Elliptic curve point scalar product with projective result.
+ *
+ * Function computes [\a mp]\a P + [\a mq]\a Q and store result in \a T
+ * without final conversion to affine coordinates.
+ *
+ * \param[out] T -
+ *   result point (in projective coordinates).
+ * \param[in] P -
+ *   point to scalar product (in affine coordinates).
+ * \param[in] mp -
+ *   multiple of P.
+ * \param[in] Q -
+ *   point to scalar product (in affine coordinates).
+ * \param[in] mq -
+ *   multiple of Q.
+ */
+extern void ecp_scalar_product_pro(Digit *T, const Digit *P, const Digit *mp, const Digit *Q, const Digit *mq);
+
 /**
  * \brief ECC key pair generation.
  *
@@ -604,6 +919,30 @@ extern void ecp_scalar_product(Digit *P, const Digit *mp, const Digit *Q, const
  */
 extern void ecc_generate_key(Digit *public_key, Digit *private_key, void (*rng)(Digit *, int));
 
+/**
+ * \brief Default generator of random digits based on rand().
+ *
+ * \param[out] dst -
+ *   buffer for random digits.
+ * \param[in] n -
+ *   number of digits.
+ */
+extern void rng_bits(Digit *dst, int n);
+
+/**
+ * \brief ECC private key generation.
+ *
+ * Function generates only private key, i.e. integer greater than 1
+ * and less than elliptic curve generator order.
+ *
+ * \param[out] private_key -
+ *   buffer for private key.
+ * \parameter[in] rng -
+ *   random number generation function. If 0 pointer, then function
+ *   uses rand().
+ */
+extern void ecc_generate_private_key(Digit *private_key, void (*rng)(Digit *, int));
+
 /**
  * \brief Compute digital signature based on ECDSA scheme.
  * 
@@ -650,6 +989,56 @@ extern int ecc_ecdsa_verify(const EcdsaSign *signature, const Octet *digest, int
  */
 extern int ecc_ecdh_shared_info(Octet *shared_info, Digit *P, const Digit *private_key);
 
+/**
+ * \brief Batch multiplication of elliptic curve points.
+ *
+ * Function checks all points first, then computes [\a k[i]]\a P[i] for
+ * every correct point in projective coordinates and converts all results
+ * to affine coordinates with single field inversion per
+ * \ref ECC_BATCH_MAX points. Points which are not on supported curve
+ * are left unchanged.
+ *
+ * \param[in,out] P -
+ *   table of \a n pointers to affine points.
+ * \param[in] k -
+ *   table of \a n pointers to multiples.
+ * \param[out] err -
+ *   table of \a n results: 0 - if OK, 1 - if point is not on supported
+ *   curve (may be 0).
+ * \param[in] n -
+ *   number of points.
+ *
+ * \return Number of points which are not on supported curve.
+ */
+extern int ecc_multiplication_batch(Digit *const *P, const Digit *const *k, int *err, int n);
+
+/**
+ * \brief Compute hash of common secret point.
+ *
+ * Hash is used by IoT STAKE and IoT PKI protocols as a session key.
+ *
+ * \param[out] hash -
+ *   buffer for 16 octets of hash.
+ * \param[in] P -
+ *   common secret point (in affine coordinates).
+ */
+extern void ecc_point_hash(Octet *hash, const Digit *P);
+
+/**
+ * \brief Compute resumption secret from common secret point.
+ *
+ * Secret is derived from all 24 octets of X coordinate (big-endian): key
+ * k = AES(X[0..15], X[16..23] || "STAKE-RS"), secret = AES(k, "STAKE-RESUME").
+ * Key of \ref ecc_point_hash is not used, so session key, which depends
+ * only on part of the coordinate, does not help to find the secret.
+ *
+ * \param[out] secret -
+ *   buffer for \ref RESUME_SECRET_BYTES octets of resumption secret.
+ * \param[in] P -
+ *   common secret point (in affine coordinates).
+ */
+extern void ecc_point_resumption(Octet *secret, const Digit *P);
+
 /** \brief Data structure for IoT STAKE protocol. */
 typedef struct ProtocolIoTStake_st {
 	/** \brief User private key. */
@@ -746,6 +1135,80 @@ extern int ecc_iotstake_q3(ProtocolIoTStake *ctx, const Digit *Q2A);
  */
 extern int ecc_iotstake_hash(ProtocolIoTStake *ctx, Octet *hash);
 
+/**
+ * \brief IoT STAKE protocol determine resumption secret.
+ *
+ * Function can be called after \ref ecc_iotstake_q3. Secret is used by
+ * \ref iotstake_resume_init to establish new session key without
+ * elliptic curve operations.
+ *
+ * \param[in] ctx -
+ *   protocol context.
+ * \param[out] secret -
+ *   buffer for \ref RESUME_SECRET_BYTES octets of resumption secret.
+ *
+ * \return
+ *   - \ref 0 - if everything is OK.
+ *   - \ref 1 - if error.
+ */
+extern int ecc_iotstake_resumption(ProtocolIoTStake *ctx, Octet *secret);
+
+/**
+ * \brief IoT STAKE protocol determine points Q1 for many contexts.
+ *
+ * Batch version of \ref ecc_iotstake_q1.
+ *
+ * \param[in,out] ctx -
+ *   table of \a n protocol contexts.
+ * \param[out] Q1A -
+ *   table of \a n user Q1 EC points stored one after another (may be 0).
+ * \param[out] err -
+ *   table of \a n results of \ref ecc_iotstake_q1 (may be 0).
+ * \param[in] n -
+ *   number of contexts.
+ *
+ * \return Number of contexts for which error occurred.
+ */
+extern int ecc_iotstake_q1_batch(ProtocolIoTStake *const *ctx, Digit *Q1A, int *err, int n);
+
+/**
+ * \brief IoT STAKE protocol determine points Q2 for many contexts.
+ *
+ * Batch version of \ref ecc_iotstake_q2.
+ *
+ * \param[in,out] ctx -
+ *   table of \a n protocol contexts.
+ * \param[in] Q1B -
+ *   table of \a n Q1 points of the other sides stored one after another.
+ * \param[out] Q2B -
+ *   table of \a n Q2 points for the other sides (may be 0).
+ * \param[out] err -
+ *   table of \a n results of \ref ecc_iotstake_q2 (may be 0).
+ * \param[in] n -
+ *   number of contexts.
+ *
+ * \return Number of contexts for which error occurred.
+ */
+extern int ecc_iotstake_q2_batch(ProtocolIoTStake *const *ctx, const Digit *Q1B, Digit *Q2B, int *err, int n);
+
+/**
+ * \brief IoT STAKE protocol determine points Q3 for many contexts.
+ *
+ * Batch version of \ref ecc_iotstake_q3.
+ *
+ * \param[in,out] ctx -
+ *   table of \a n protocol contexts.
+ * \param[in] Q2A -
+ *   table of \a n user Q2 points received from the other sides.
+ * \param[out] err -
+ *   table of \a n results of \ref ecc_iotstake_q3 (may be 0).
+ * \param[in] n -
+ *   number of contexts.
+ *
+ * \return Number of contexts for which error occurred.
+ */
+extern int ecc_iotstake_q3_batch(ProtocolIoTStake *const *ctx, const Digit *Q2A, int *err, int n);
+
 /** \brief Data structure for IoT PKI protocol. */
 typedef struct ProtocolIoTPki_st {
 	/** \brief User private ECDSA key. */
@@ -828,6 +1291,26 @@ extern int ecc_iotpki_q2(ProtocolIoTPki *ctx, const Digit *Q1B, const EcdsaSign
  */
 extern int ecc_iotpki_hash(ProtocolIoTPki *ctx, Octet *hash);
 
+/**
+ * \brief IoT PKI protocol determine points Q2 for many contexts.
+ *
+ * Batch version of \ref ecc_iotpki_q2.
+ *
+ * \param[in,out] ctx -
+ *   table of \a n protocol contexts.
+ * \param[in] Q1B -
+ *   table of \a n Q1 points of the other sides stored one after another.
+ * \param[in] signB -
+ *   table of \a n signatures under X(Q1B).
+ * \param[out] err -
+ *   table of \a n results of \ref ecc_iotpki_q2 (may be 0).
+ * \param[in] n -
+ *   number of contexts.
+ *
+ * \return Number of contexts for which error occurred.
+ */
+extern int ecc_iotpki_q2_batch(ProtocolIoTPki *const *ctx, const Digit *Q1B, const EcdsaSign *signB, int *err, int n);
+
 /** \} */
 
 
@@ -849,8 +1332,33 @@ extern int ecc_iotpki_hash(ProtocolIoTPki *ctx, Octet *hash);
 
 /** \brief Number of key bytes for AES-128. */
 #define AES128_KEY_BYTES 16
+/** \brief Number of bytes of AES-128 round keys (11 round keys). */
+#define AES128_RKEY_BYTES 176
+#if defined(AES_COMPACT)
+#if defined(AES_TTABLE) || defined(AES_NI) || defined(AES_BITSLICE)
+#error "AES_COMPACT computes round keys on the fly, it cannot be combined with AES_TTABLE, AES_NI or AES_BITSLICE"
+#endif
+/**
+ * \brief Number of expanded key bytes for AES-128.
+ *
+ * In compact mode (AES_COMPACT) expanded key is the key itself. Round keys
+ * are computed forward during encryption and backward (from the last round
+ * key) during decryption, so only 16 octets of round key are live.
+ */
+#define AES128_EKEY_BYTES AES128_KEY_BYTES
+#elif defined(AES_TTABLE) || defined(AES_NI)
+/**
+ * \brief Number of expanded key bytes for AES-128.
+ *
+ * With T-tables (AES_TTABLE) or AES instructions (AES_NI) encryption round keys are followed by round
+ * keys of equivalent inverse cipher, so decryption takes the same time as
+ * encryption.
+ */
+#define AES128_EKEY_BYTES (2*AES128_RKEY_BYTES)
+#else
 /** \brief Number of expanded key bytes for AES-128. */
-#define AES128_EKEY_BYTES 176
+#define AES128_EKEY_BYTES AES128_RKEY_BYTES
+#endif
 /** \brief Number of block bytes for AES-128. */
 #define AES128_BLOCK_BYTES AES_BLOCK_BYTES
 
@@ -888,6 +1396,38 @@ extern void aes128_encrypt(Octet *out, const Octet *in, const Octet *ekey);
  */
 extern void aes128_decrypt(Octet *out, const Octet *in, const Octet *ekey);
 
+/**
+ * \brief Encrypt consecutive blocks using AES-128 (ECB).
+ *
+ * Blocks are independent, so they are encrypted in parallel: 8 at once in
+ * registers by bitsliced code (AES_BITSLICE) or in pipeline of AES
+ * instructions.
+ *
+ * \param[out] out -
+ *   table for output blocks (may be the same as in).
+ * \param[in] in -
+ *   table with blocks * \ref AES128_BLOCK_BYTES bytes.
+ * \param[in] blocks -
+ *   number of blocks.
+ * \param[in] ekey -
+ *   table with key expansion for AES-128.
+ */
+extern void aes128_encrypt_blocks(Octet *out, const Octet *in, int blocks, const Octet *ekey);
+
+/**
+ * \brief Decrypt consecutive blocks using AES-128 (ECB).
+ *
+ * \param[out] out -
+ *   table for output blocks (may be the same as in).
+ * \param[in] in -
+ *   table with blocks * \ref AES128_BLOCK_BYTES bytes.
+ * \param[in] blocks -
+ *   number of blocks.
+ * \param[in] ekey -
+ *   table with key expansion for AES-128.
+ */
+extern void aes128_decrypt_blocks(Octet *out, const Octet *in, int blocks, const Octet *ekey);
+
 /**
  * \brief Encrypt data using AES-128-CBC.
  *
@@ -907,19 +1447,481 @@ extern int aes128_cbc_encrypt(Octet *out, const Octet *in, int len, const Octet*
 /**
  * \brief Decrypt data using AES-128-CBC.
  *
+ * Blocks are decrypted several at once (\ref aes128_decrypt_blocks) and
+ * long inputs are split between threads (\ref aes128_cbc_set_threads).
+ * Padding is checked in constant time.
+ *
  * \param[out] out -
- *   table for output data.
+ *   table for output data (may be the same as in). Only plaintext is
+ *   written; nothing of last block is written if padding is bad.
  * \param[in] in -
  *   table with input data.
  * \param[in] len -
- *   number of octets in \a in data buffer.
+ *   number of octets in \a in data buffer (positive multiple of
+ *   \ref AES128_BLOCK_BYTES).
  * \param[in] iv -
  *   initialization vector.
  * \param[in] ekey -
  *   table with key expansion for AES-128.
+ *
+ * \return Length of plaintext or -1 if length or padding is bad.
  */
 extern int aes128_cbc_decrypt(Octet *out, const Octet *in, int len, const Octet* iv, const Octet *ekey);
 
+/**
+ * \brief Set number of threads of \ref aes128_cbc_decrypt.
+ *
+ * Only inputs of at least 256 KiB per thread are split.
+ *
+ * \param[in] threads -
+ *   maximum number of threads (0 - number of CPUs, default).
+ */
+extern void aes128_cbc_set_threads(int threads);
+
+/** \brief Job of \ref aes128_cbc_encrypt_multi: input of \ref aes128_cbc_encrypt. */
+typedef struct Aes128CbcJob_st {
+	/** \brief Table for output data (len + \ref AES128_BLOCK_BYTES octets, not overlapping in). */
+	Octet *out;
+	/** \brief Table with input data. */
+	const Octet *in;
+	/** \brief Number of octets in \a in data buffer. */
+	int len;
+	/** \brief Initialization vector. */
+	const Octet *iv;
+	/** \brief Table with key expansion for AES-128 of stream. */
+	const Octet *ekey;
+	/** \brief Length of ciphertext (result). */
+	int outLen;
+} Aes128CbcJob;
+
+/**
+ * \brief Encrypt many independent streams using AES-128-CBC.
+ *
+ * Result of every job is the same as of \ref aes128_cbc_encrypt. Blocks of
+ * one stream depend on each other, so up to 8 streams (each under its own
+ * key) are encrypted in lock step, one block of every stream at once. Jobs
+ * are grouped by length, so streams of a group end at about the same step.
+ *
+ * \param[in,out] jobs -
+ *   table of jobs.
+ * \param[in] count -
+ *   number of jobs.
+ */
+extern void aes128_cbc_encrypt_multi(Aes128CbcJob *jobs, int count);
+
+/**
+ * \brief Compute AES-128-CBC-MAC.
+ *
+ * Last block is padded with zeros. CBC-MAC is secure only for messages
+ * of fixed length, so every usage has to define length of messages.
+ *
+ * \param[out] mac -
+ *   table for \ref AES128_BLOCK_BYTES octets of MAC.
+ * \param[in] in -
+ *   table with input data.
+ * \param[in] len -
+ *   number of octets in \a in data buffer.
+ * \param[in] ekey -
+ *   table with key expansion for AES-128.
+ */
+extern void aes128_cbc_mac(Octet *mac, const Octet *in, int len, const Octet *ekey);
+
+/** \brief State of AES-128 in CTR mode (key stream position). */
+typedef struct Aes128Ctr_st {
+	/** \brief Counter block of next key stream block (big-endian). */
+	Octet counter[AES128_BLOCK_BYTES];
+	/** \brief Last key stream block. */
+	Octet stream[AES128_BLOCK_BYTES];
+	/** \brief Number of used octets of stream. */
+	int used;
+} Aes128Ctr;
+
+/**
+ * \brief Start AES-128 in CTR mode (NIST SP 800-38A).
+ *
+ * \param[out] ctx -
+ *   state of CTR mode.
+ * \param[in] iv -
+ *   initial counter block (\ref AES128_BLOCK_BYTES bytes). The whole block
+ *   is incremented as 128-bit big-endian number. Counter blocks must never
+ *   repeat under the same key.
+ */
+extern void aes128_ctr_init(Aes128Ctr *ctx, const Octet *iv);
+
+/**
+ * \brief Encrypt or decrypt data using AES-128 in CTR mode.
+ *
+ * Data may be split between calls at any point: consecutive calls give
+ * the same result as single call. Whole blocks are encrypted several at
+ * once (\ref aes128_encrypt_blocks).
+ *
+ * \param[in,out] ctx -
+ *   state of CTR mode.
+ * \param[out] out -
+ *   table for len bytes of output (may be the same as in).
+ * \param[in] in -
+ *   table with len bytes of input.
+ * \param[in] len -
+ *   number of bytes (any).
+ * \param[in] ekey -
+ *   table with key expansion for AES-128.
+ */
+extern void aes128_ctr_xcrypt(Aes128Ctr *ctx, Octet *out, const Octet *in, int len, const Octet *ekey);
+
+/** \brief Number of octets of AES-GCM initialization vector. */
+#define AES128_GCM_IV_BYTES 12
+/** \brief Number of octets of AES-GCM tag. */
+#define AES128_GCM_TAG_BYTES 16
+
+/**
+ * \brief State of AES-128 in GCM mode (NIST SP 800-38D).
+ *
+ * Data is encrypted by CTR mode (\ref Aes128Ctr) and authenticated by
+ * GHASH in the same pass. GHASH uses carry-less multiplication (PCLMULQDQ)
+ * if built with AES_NI and CPU supports it, otherwise 4-bit tables.
+ */
+typedef struct Aes128Gcm_st {
+	/** \brief CTR mode from counter block J0 + 1. */
+	Aes128Ctr ctr;
+	/** \brief Multiples of hash key H (4-bit tables) or powers H..H^4. */
+	uint64_t htable[16][2];
+	/** \brief Encrypted counter block J0, masks tag. */
+	Octet mask[AES128_BLOCK_BYTES];
+	/** \brief GHASH accumulator. */
+	Octet X[AES128_BLOCK_BYTES];
+	/** \brief Partial block of GHASH input. */
+	Octet buf[AES128_BLOCK_BYTES];
+	/** \brief Number of octets in buf. */
+	int bufLen;
+	/** \brief Non-zero after first octet of text. */
+	int text;
+	/** \brief Number of octets of additional data. */
+	uint64_t aadLen;
+	/** \brief Number of octets of text. */
+	uint64_t textLen;
+} Aes128Gcm;
+
+/**
+ * \brief Start AES-128 in GCM mode.
+ *
+ * Only 96-bit IV is supported. Then counter block J0 = IV || 0^31 || 1 and
+ * 128-bit increment of CTR mode equals inc32 for every message not longer
+ * than limit of GCM (2^32 - 2 blocks).
+ *
+ * \param[out] ctx -
+ *   state of GCM mode.
+ * \param[in] iv -
+ *   initialization vector (\ref AES128_GCM_IV_BYTES octets), must never
+ *   repeat under the same key.
+ * \param[in] ekey -
+ *   table with key expansion for AES-128.
+ */
+extern void aes128_gcm_init(Aes128Gcm *ctx, const Octet *iv, const Octet *ekey);
+
+/**
+ * \brief Authenticate additional data (any number of calls before text).
+ *
+ * \param[in,out] ctx -
+ *   state of GCM mode.
+ * \param[in] aad -
+ *   additional data.
+ * \param[in] len -
+ *   number of octets.
+ */
+extern void aes128_gcm_aad(Aes128Gcm *ctx, const Octet *aad, int len);
+
+/**
+ * \brief Encrypt and authenticate next part of plaintext.
+ *
+ * \param[in,out] ctx -
+ *   state of GCM mode.
+ * \param[out] out -
+ *   ciphertext (len octets, may be equal to in).
+ * \param[in] in -
+ *   plaintext.
+ * \param[in] len -
+ *   number of octets, any.
+ * \param[in] ekey -
+ *   table with key expansion for AES-128.
+ */
+extern void aes128_gcm_encrypt(Aes128Gcm *ctx, Octet *out, const Octet *in, int len, const Octet *ekey);
+
+/**
+ * \brief Authenticate and decrypt next part of ciphertext.
+ *
+ * Plaintext must not be used until \ref aes128_gcm_verify succeeds.
+ *
+ * \param[in,out] ctx -
+ *   state of GCM mode.
+ * \param[out] out -
+ *   plaintext (len octets, may be equal to in).
+ * \param[in] in -
+ *   ciphertext.
+ * \param[in] len -
+ *   number of octets, any.
+ * \param[in] ekey -
+ *   table with key expansion for AES-128.
+ */
+extern void aes128_gcm_decrypt(Aes128Gcm *ctx, Octet *out, const Octet *in, int len, const Octet *ekey);
+
+/**
+ * \brief Finish GCM mode and compute tag.
+ *
+ * \param[in,out] ctx -
+ *   state of GCM mode.
+ * \param[out] tag -
+ *   tag (\ref AES128_GCM_TAG_BYTES octets).
+ */
+extern void aes128_gcm_tag(Aes128Gcm *ctx, Octet *tag);
+
+/**
+ * \brief Finish GCM mode and check tag in constant time.
+ *
+ * \param[in,out] ctx -
+ *   state of GCM mode.
+ * \param[in] tag -
+ *   received tag.
+ * \param[in] tagLen -
+ *   number of octets of tag (4 .. \ref AES128_GCM_TAG_BYTES).
+ *
+ * \return 0 if tag is valid.
+ */
+extern int aes128_gcm_verify(Aes128Gcm *ctx, const Octet *tag, int tagLen);
+
+/** \} */
+
+/**
+ * \defgroup resume_group IoT STAKE session resumption
+ * \brief Establishing new session key from resumption secret.
+ *
+ * After successful IoT STAKE handshake both sides determine resumption
+ * secret (\ref ecc_iotstake_resumption). Reconnect then needs only AES-128
+ * operations:
+ *   - sensor sends ticket identifier and its nonce (\ref iotstake_resume_q1),
+ *   - server finds secret by ticket identifier, sends its nonce and
+ *     confirmation (\ref iotstake_resume_q2),
+ *   - sensor checks confirmation (\ref iotstake_resume_q3).
+ *
+ * New session key and next resumption secret are computed by
+ * \ref iotstake_resume_hash. Every secret is used only once, so ticket
+ * identifiers of consecutive sessions are not linkable. If the
+ * exchange is interrupted, sensor has to run full handshake.
+ *
+ * \{
+ */
+
+/** \brief Number of octets of resumption secret. */
+#define RESUME_SECRET_BYTES 16
+/** \brief Number of octets of resumption ticket identifier. */
+#define RESUME_TICKET_BYTES 16
+/** \brief Number of octets of resumption nonce. */
+#define RESUME_NONCE_BYTES 16
+
+/** \brief Data structure for IoT STAKE session resumption. */
+typedef struct ProtocolIoTResume_st {
+	/** \brief Resumption secret. */
+	Octet secret[RESUME_SECRET_BYTES];
+	/** \brief Nonce of sensor. */
+	Octet nonceC[RESUME_NONCE_BYTES];
+	/** \brief Nonce of server. */
+	Octet nonceS[RESUME_NONCE_BYTES];
+	/** \brief New session key. */
+	Octet hash[16];
+} ProtocolIoTResume;
+
+/**
+ * \brief Determine ticket identifier of resumption secret.
+ *
+ * \param[out] id -
+ *   buffer for \ref RESUME_TICKET_BYTES octets of identifier.
+ * \param[in] secret -
+ *   resumption secret.
+ */
+extern void iotstake_resume_ticket(Octet *id, const Octet *secret);
+
+/**
+ * \brief IoT STAKE session resumption initialization.
+ *
+ * \param[out] ctx -
+ *   resumption context.
+ * \param[in] secret -
+ *   resumption secret.
+ * \param[in] rng -
+ *   pointer to function which generates random numbers (may be 0).
+ *
+ * \return
+ *   - \ref 0 - if everything is OK.
+ *   - \ref 1 - if error.
+ */
+extern int iotstake_resume_init(ProtocolIoTResume *ctx, const Octet *secret, void (*rng)(Digit *, int));
+
+/**
+ * \brief IoT STAKE session resumption, sensor determine the first message.
+ *
+ * \param[in,out] ctx -
+ *   resumption context.
+ * \param[out] id -
+ *   ticket identifier.
+ * \param[out] nonceC -
+ *   nonce of sensor.
+ *
+ * \return
+ *   - \ref 0 - if everything is OK.
+ *   - \ref 1 - if error.
+ */
+extern int iotstake_resume_q1(ProtocolIoTResume *ctx, Octet *id, Octet *nonceC);
+
+/**
+ * \brief IoT STAKE session resumption, server determine the answer.
+ *
+ * \param[in,out] ctx -
+ *   resumption context initialized with secret found by ticket identifier.
+ * \param[in] nonceC -
+ *   nonce of sensor.
+ * \param[out] nonceS -
+ *   nonce of server.
+ * \param[out] confirm -
+ *   confirmation of server (16 octets).
+ *
+ * \return
+ *   - \ref 0 - if everything is OK.
+ *   - \ref 1 - if error.
+ */
+extern int iotstake_resume_q2(ProtocolIoTResume *ctx, const Octet *nonceC, Octet *nonceS, Octet *confirm);
+
+/**
+ * \brief IoT STAKE session resumption, sensor check the answer of server.
+ *
+ * \param[in,out] ctx -
+ *   resumption context.
+ * \param[in] nonceS -
+ *   nonce of server.
+ * \param[in] confirm -
+ *   confirmation of server.
+ *
+ * \return
+ *   - \ref 0 - if everything is OK.
+ *   - \ref 1 - if confirmation is not correct.
+ */
+extern int iotstake_resume_q3(ProtocolIoTResume *ctx, const Octet *nonceS, const Octet *confirm);
+
+/**
+ * \brief IoT STAKE session resumption determine new session key.
+ *
+ * Resumption secret in context is zeroized.
+ *
+ * \param[in,out] ctx -
+ *   resumption context.
+ * \param[out] hash -
+ *   new session key (may be 0).
+ * \param[out] secret -
+ *   next resumption secret (may be 0).
+ *
+ * \return
+ *   - \ref 0 - if everything is OK.
+ *   - \ref 1 - if error.
+ */
+extern int iotstake_resume_hash(ProtocolIoTResume *ctx, Octet *hash, Octet *secret);
+
+/** \} */
+
+/**
+ * \defgroup cookie_group IoT STAKE stateless server
+ * \brief Keeping server state of IoT STAKE handshake in sealed cookies.
+ *
+ * Between the first and the second round server needs only session
+ * private key and public key of sensor. Instead of keeping context in
+ * memory, server seals them (\ref iotstake_cookie_seal) and sends the
+ * cookie to sensor together with its point Q1. Sensor returns the cookie
+ * with its points Q1 and Q2, and any server node which holds the same
+ * cookie key restores context (\ref iotstake_cookie_open) and finishes
+ * the handshake.
+ *
+ * Cookie is encrypted with AES-128-CBC and authenticated with
+ * AES-128-CBC-MAC over IV and ciphertext (encrypt-then-MAC). Both keys
+ * are derived from single server key. Cookie layout:
+ *   - IV (16 octets),
+ *   - ciphertext (\ref COOKIE_CIPHER_BYTES octets) of expiry time
+ *     (8 octets), session private key and public key of sensor (digits
+ *     in big-endian order),
+ *   - MAC (16 octets).
+ *
+ * Cookie may be replayed until it expires, so expiry time should be
+ * short (single round trip).
+ *
+ * \{
+ */
+
+/** \brief Number of octets of sealed state. */
+#define COOKIE_STATE_BYTES (8 + EC_GEN_ORDER_OCTETS + 2*FP_OCTETS)
+/** \brief Number of octets of cookie ciphertext (state with CBC padding). */
+#define COOKIE_CIPHER_BYTES ((COOKIE_STATE_BYTES/AES128_BLOCK_BYTES + 1)*AES128_BLOCK_BYTES)
+/** \brief Number of octets of cookie. */
+#define COOKIE_BYTES (AES128_BLOCK_BYTES + COOKIE_CIPHER_BYTES + AES128_BLOCK_BYTES)
+
+/** \brief Expanded keys of server used for cookies. */
+typedef struct StakeCookieKey_st {
+	/** \brief Expanded encryption key. */
+	Octet encKey[AES128_EKEY_BYTES];
+	/** \brief Expanded MAC key. */
+	Octet macKey[AES128_EKEY_BYTES];
+} StakeCookieKey;
+
+/**
+ * \brief Derive cookie keys from server key.
+ *
+ * \param[out] ck -
+ *   cookie keys.
+ * \param[in] key -
+ *   \ref AES128_KEY_BYTES octets of server key (common for all nodes).
+ */
+extern void iotstake_cookie_key(StakeCookieKey *ck, const Octet *key);
+
+/**
+ * \brief Seal server state of IoT STAKE handshake after \ref ecc_iotstake_q1.
+ *
+ * \param[in] ctx -
+ *   protocol context.
+ * \param[out] cookie -
+ *   buffer for \ref COOKIE_BYTES octets of cookie.
+ * \param[in] expiry -
+ *   time after which cookie is not accepted.
+ * \param[in] ck -
+ *   cookie keys.
+ * \param[in] rng -
+ *   pointer to function which generates random numbers (may be 0).
+ *
+ * \return
+ *   - \ref 0 - if everything is OK.
+ *   - \ref 1 - if error.
+ */
+extern int iotstake_cookie_seal(const ProtocolIoTStake *ctx, Octet *cookie, uint64_t expiry,
+	const StakeCookieKey *ck, void (*rng)(Digit *, int));
+
+/**
+ * \brief Restore server state of IoT STAKE handshake from cookie.
+ *
+ * Context is ready for \ref ecc_iotstake_q2 and \ref ecc_iotstake_q3.
+ *
+ * \param[out] ctx -
+ *   protocol context.
+ * \param[in] cookie -
+ *   \ref COOKIE_BYTES octets of cookie.
+ * \param[in] now -
+ *   current time.
+ * \param[in] prvA -
+ *   server private key.
+ * \param[in] ck -
+ *   cookie keys.
+ *
+ * \return
+ *   - \ref 0 - if everything is OK.
+ *   - \ref 1 - if cookie is not authentic.
+ *   - \ref 2 - if cookie expired.
+ */
+extern int iotstake_cookie_open(ProtocolIoTStake *ctx, const Octet *cookie, uint64_t now,
+	const Digit *prvA, const StakeCookieKey *ck);
+
 /** \} */
 
 /** \} */
@@ -3,15 +3,23 @@
 
 Digit ecc_tmp[ECC_TMP_DIGITS];
 
-static void rng_bits(Digit *dst, int n)
+void rng_bits(Digit *dst, int n)
 {
-	while (n--) {
-		*dst++ = ((Digit)rand() << 24) ^ ((Digit)rand() << 16) ^
-			((Digit)rand() << 8) ^ (Digit)rand();
+	Word w = 0;
+	int i;
+
+	/* Whole 32-bit words, so numbers do not depend on DIGIT_BITS. */
+	for (i = 0; i < n; i++) {
+		if (i % (WORD_BITS/DIGIT_BITS) == 0) {
+			w = ((Word)rand() << 24) ^ ((Word)rand() << 16) ^
+				((Word)rand() << 8) ^ (Word)rand();
+		}
+
+		dst[i] = (Digit)(w >> (DIGIT_BITS * (i % (WORD_BITS/DIGIT_BITS))));
 	}
 }
 
-void ecc_generate_key(Digit *public_key, Digit *private_key, void (*rng)(Digit *, int))
+void ecc_generate_private_key(Digit *private_key, void (*rng)(Digit *, int))
 {
 	/*
 	 * Generation of integer which is greather than 1 and
@@ -28,18 +36,42 @@ void ecc_generate_key(Digit *public_key, Digit *private_key, void (*rng)(Digit *
 		EC_GEN_ORDER_MODRED(private_key, EC_GEN_ORDER_DIGITS);
 	}
 	while (cmp_digit(private_key, 2, EC_GEN_ORDER_DIGITS) < 0);
+}
 
-	/* Assign generator. */
-	FP_ASSIGN(X(ecc_tmp), X(EC_GEN));
-	FP_ASSIGN(Y(ecc_tmp), Y(EC_GEN));
+void ecc_generate_key(Digit *public_key, Digit *private_key, void (*rng)(Digit *, int))
+{
+	ecc_generate_private_key(private_key, rng);
 
 	/* Compute public key. */
-	ecp_multiple(ecc_tmp, private_key);
+	ecp_generator_multiple(ecc_tmp, private_key);
 
 	FP_ASSIGN(X(public_key), X(ecc_tmp));
 	FP_ASSIGN(Y(public_key), Y(ecc_tmp));
 }
 
+/*
+ * Convert digest to integer: leftmost octets of digest are interpreted
+ * as big-endian number and reduced modulo ec generator order.
+ */
+static void ecc_digest_to_int(Digit *e, const Octet *digest, int digest_octets)
+{
+	int i;
+
+	if (digest_octets > EC_GEN_ORDER_OCTETS)
+		digest_octets = EC_GEN_ORDER_OCTETS;
+
+	assign_digit(e, 0, EC_GEN_ORDER_DIGITS);
+
+	for (i = 0; i < digest_octets; i++) {
+		int pos = digest_octets - 1 - i;
+
+		e[pos / (DIGIT_BITS/OCTET_BITS)] |= (Digit)digest[i] << (OCTET_BITS * (pos % (DIGIT_BITS/OCTET_BITS)));
+	}
+
+	if (cmp(e, EC_GEN_ORDER, EC_GEN_ORDER_DIGITS) >= 0)
+		sub(e, EC_GEN_ORDER, EC_GEN_ORDER_DIGITS);
+}
+
 void ecc_ecdsa_sign(EcdsaSign *signature, const Octet *digest, int digest_octets, const Digit *private_key)
 {
 	Digit *t = arth_tmp;
@@ -48,9 +80,6 @@ void ecc_ecdsa_sign(EcdsaSign *signature, const Octet *digest, int digest_octets
 	Digit *s = r + EC_GEN_ORDER_DIGITS;
 	Digit *e = s + EC_GEN_ORDER_DIGITS;
 
-	int i;
-	int digest_words;
-
 	/* Do this sequence until integer s != 0. */
 	do {
 		/* Do this sequence until integer r != 0. */
@@ -64,12 +93,8 @@ void ecc_ecdsa_sign(EcdsaSign *signature, const Octet *digest, int digest_octets
 			}
 			while (cmp_digit(k, 0, EC_GEN_ORDER_DIGITS) == 0);
 
-			/* Assign generator to r. */
-            FP_ASSIGN(X(r), X(EC_GEN));
-            FP_ASSIGN(Y(r), Y(EC_GEN));
-
 			/* Compute [k]G, and write X([k]G) to r. */
-			ecp_multiple(r, k);
+			ecp_generator_multiple(r, k);
 
 			/* Add lead zeros to the table representing r. */
 			assign_digit(r + FP_DIGITS, 0, EC_GEN_ORDER_DIGITS -
@@ -81,14 +106,10 @@ void ecc_ecdsa_sign(EcdsaSign *signature, const Octet *digest, int digest_octets
 		while (cmp_digit(r, 0, EC_GEN_ORDER_DIGITS) == 0);
 
         /* Convert digest to integer. */
-        digest_words = (digest_octets * OCTET_BITS) / WORD_BITS;
-        if (EC_GEN_ORDER_DIGITS <= digest_words)
-        	digest_words = EC_GEN_ORDER_DIGITS;
-
-        assign_digit(e, 0, EC_GEN_ORDER_DIGITS);
-        assign(e, (const Digit *)digest, digest_words);
+        ecc_digest_to_int(e, digest, digest_octets);
 
 		/* Compute k <- k^(-1) modulo ec generator order. */
+		OP_COUNT(OP_N_INV, 1);
 		primeinv(k, k, EC_GEN_ORDER, EC_GEN_ORDER_DIGITS);
 		/* Compute t <- r*pk modulo ec generator order. */
 		mul(t, r, private_key, EC_GEN_ORDER_DIGITS);
@@ -114,20 +135,16 @@ int ecc_ecdsa_verify(const EcdsaSign *signature, const Octet *digest, int digest
 	Digit *s = e + EC_GEN_ORDER_DIGITS;
 	Digit *u1 = s + EC_GEN_ORDER_DIGITS;
 	Digit *u2 = u1 + EC_GEN_ORDER_DIGITS;
-	Digit *R = u2 + EC_GEN_ORDER_DIGITS;
-
-	int i;
-	int digest_words;
+	Digit R[3*FP_DIGITS];
+#if ECC_COMB_TEETH > 0
+	Digit T[3*FP_DIGITS];
+#endif
 
 	/* Convert digest to integer. */
-	digest_words = (digest_octets * OCTET_BITS) / WORD_BITS;
-	if (EC_GEN_ORDER_DIGITS <= digest_words)
-		digest_words = EC_GEN_ORDER_DIGITS;
-
-	assign_digit(e, 0, EC_GEN_ORDER_DIGITS);
-	assign(e, (const Digit *)digest, digest_words);
+	ecc_digest_to_int(e, digest, digest_octets);
 
 	/* Compute s <- s^(-1) modulo ec generator order. */
+	OP_COUNT(OP_N_INV, 1);
 	primeinv(s, signature->s, EC_GEN_ORDER, EC_GEN_ORDER_DIGITS);
 	/* Compute u1 <- e*s^(-1) modulo ec generator order. */
 	mul(t, e, s, EC_GEN_ORDER_DIGITS);
@@ -137,20 +154,29 @@ int ecc_ecdsa_verify(const EcdsaSign *signature, const Octet *digest, int digest
 	mul(t, signature->r, s, EC_GEN_ORDER_DIGITS);
 	EC_GEN_ORDER_MODRED(t, 2*EC_GEN_ORDER_DIGITS);
 	assign(u2, t, EC_GEN_ORDER_DIGITS);
-	/* Assign generator to R. */
-	FP_ASSIGN(X(R), X(EC_GEN));
-	FP_ASSIGN(Y(R), Y(EC_GEN));
 	/* Compute R <- [u1]G + [u2]P where P is public key. */
-	ecp_scalar_product(R, u1, public_key, u2);
+#if ECC_COMB_TEETH > 0
+	ecp_generator_multiple_pro(R, u1);
+	ecp_multiple_pro(T, public_key, u2);
+	ecp_addition(R, T, 1);
+#else
+	ecp_scalar_product_pro(R, EC_GEN, u1, public_key, u2);
+#endif
+	/*
+	 * Check X(R) = r without conversion to affine coordinates,
+	 * i.e. compare X with r * Z^2.
+	 */
+	FP_SQR(Z(R));
+	FP_MUL(Z(R), signature->r);
 
-	if (cmp(X(R), signature->r, EC_GEN_ORDER_DIGITS) == 0) {
+	if (cmp(X(R), Z(R), FP_DIGITS) == 0) {
 	    return 0;
 	} else {
 	    return 1;
 	}
 }
 
-static int ecc_multiplication(Digit *P, const Digit *k)
+static int ecc_point_check(const Digit *P)
 {
 	Digit *t1 = ecc_tmp;
 	Digit *t2 = t1 + FP_DIGITS;
@@ -176,11 +202,71 @@ static int ecc_multiplication(Digit *P, const Digit *k)
 	if (!FP_IS_ZERO(t1))
 		return 1;
 
+	return 0;
+}
+
+static int ecc_multiplication(Digit *P, const Digit *k)
+{
+	if (ecc_point_check(P))
+		return 1;
+
 	ecp_multiple(P, k);
 
 	return 0;
 }
 
+int ecc_multiplication_batch(Digit *const *P, const Digit *const *k, int *err, int n)
+{
+	Digit *T;
+	int chk[ECC_BATCH_MAX];
+	int errors = 0;
+	int m;
+	int i;
+
+	while (n > 0) {
+		m = (n < ECC_BATCH_MAX) ? n : ECC_BATCH_MAX;
+
+		/* Check all points before any multiplication. */
+		for (i = 0; i < m; i++) {
+			chk[i] = ecc_point_check(P[i]);
+			errors += chk[i];
+
+			if (err)
+				err[i] = chk[i];
+		}
+
+		/* Compute multiples, results are kept in projective coordinates. */
+		for (i = 0; i < m; i++) {
+			T = ecc_batch_tmp + 3*FP_DIGITS*i;
+
+			if (chk[i]) {
+				FP_ASSIGN_ONE(X(T));
+				FP_ASSIGN_ONE(Y(T));
+				FP_ASSIGN_ONE(Z(T));
+			} else {
+				ecp_multiple_pro(T, P[i], k[i]);
+			}
+		}
+
+		/* Single inversion for all points. */
+		ecp_pro2aff_batch(ecc_batch_tmp, m);
+
+		for (i = 0; i < m; i++) {
+			if (!chk[i])
+				assign(P[i], ecc_batch_tmp + 3*FP_DIGITS*i, 2*FP_DIGITS);
+		}
+
+		P += m;
+		k += m;
+		n -= m;
+
+		if (err)
+			err += m;
+	}
+
+	return errors;
+}
+
 int ecc_ecdh_shared_info(Octet *shared_info, Digit *P, const Digit *private_key)
 {
 	int err;
@@ -243,22 +329,73 @@ int ecc_iotstake_q3(ProtocolIoTStake *ctx, const Digit *Q2A)
 	return err;
 }
 
-int ecc_iotstake_hash(ProtocolIoTStake *ctx, Octet *hash)
+/* Encrypt block with the key taken from X coordinate of point P. */
+static void ecc_point_prf(Octet *out, const Digit *P, const Octet *block)
 {
 	Octet ekey[AES128_EKEY_BYTES];
 	int i;
 
 	for (i = 0; i < 16; i++) {
-		ctx->hash[i] = (ctx->Q3[i/4] >> (i % 4)) & 0xFF;
+		out[i] = (ARTH_GET_WORD(P, i/4) >> (i % 4)) & 0xFF;
 	}
 
-	aes128_key_expansion(ekey, ctx->hash);
+	aes128_key_expansion(ekey, out);
+	aes128_encrypt(out, block, ekey);
+}
 
-	for (i = 0; i < 16; i++) {
-		ctx->hash[i] = 0;
+void ecc_point_hash(Octet *hash, const Digit *P)
+{
+	static const Octet zero[16] = {0};
+
+	ecc_point_prf(hash, P, zero);
+}
+
+static void ecc_zeroize(Octet *dst, int n)
+{
+	volatile Octet *p = dst;
+
+	while (n--)
+		*p++ = 0;
+}
+
+void ecc_point_resumption(Octet *secret, const Digit *P)
+{
+	static const Octet label[16] = {'S', 'T', 'A', 'K', 'E', '-', 'R', 'E', 'S', 'U', 'M', 'E', 0, 0, 0, 0};
+	static const Octet extract[8] = {'S', 'T', 'A', 'K', 'E', '-', 'R', 'S'};
+	Octet x[FP_OCTETS];
+	Octet block[16];
+	Octet k[16];
+	Octet ekey[AES128_EKEY_BYTES];
+	int i;
+
+	/*
+	 * Whole X coordinate (not the key of ecc_point_prf): high 16 octets
+	 * key AES of low 8 octets with label "STAKE-RS", result keys AES of
+	 * "STAKE-RESUME".
+	 */
+	to_octets(x, X(P), FP_DIGITS);
+
+	for (i = 0; i < 8; i++) {
+		block[i] = x[16 + i];
+		block[8 + i] = extract[i];
 	}
 
-	aes128_encrypt(ctx->hash, ctx->hash, ekey);
+	aes128_key_expansion(ekey, x);
+	aes128_encrypt(k, block, ekey);
+	aes128_key_expansion(ekey, k);
+	aes128_encrypt(secret, label, ekey);
+
+	ecc_zeroize(x, sizeof(x));
+	ecc_zeroize(block, sizeof(block));
+	ecc_zeroize(k, sizeof(k));
+	ecc_zeroize(ekey, sizeof(ekey));
+}
+
+int ecc_iotstake_hash(ProtocolIoTStake *ctx, Octet *hash)
+{
+	int i;
+
+	ecc_point_hash(ctx->hash, ctx->Q3);
 
 	if (hash) {
 		for (i = 0; i < 16; i++) {
@@ -269,6 +406,124 @@ int ecc_iotstake_hash(ProtocolIoTStake *ctx, Octet *hash)
 	return 0;
 }
 
+static int ecc_iotstake_step_batch(Digit *const *P, const Digit *const *k, Digit *out, int *err, int m)
+{
+	int chk[ECC_BATCH_MAX];
+	int errors;
+	int i;
+
+	errors = ecc_multiplication_batch(P, k, chk, m);
+
+	for (i = 0; i < m; i++) {
+		if (err)
+			err[i] = chk[i];
+
+		if (out && !chk[i])
+			assign(out + 2*FP_DIGITS*i, P[i], 2*FP_DIGITS);
+	}
+
+	return errors;
+}
+
+int ecc_iotstake_q1_batch(ProtocolIoTStake *const *ctx, Digit *Q1A, int *err, int n)
+{
+	Digit *P[ECC_BATCH_MAX];
+	const Digit *k[ECC_BATCH_MAX];
+	int errors = 0;
+	int m;
+	int i;
+
+	while (n > 0) {
+		m = (n < ECC_BATCH_MAX) ? n : ECC_BATCH_MAX;
+
+		for (i = 0; i < m; i++) {
+			assign(ctx[i]->Q1, ctx[i]->pubKeyB, 2*FP_DIGITS);
+			P[i] = ctx[i]->Q1;
+			k[i] = ctx[i]->ephPrvKeyA;
+		}
+
+		errors += ecc_iotstake_step_batch(P, k, Q1A, err, m);
+
+		ctx += m;
+		n -= m;
+
+		if (Q1A)
+			Q1A += 2*FP_DIGITS*m;
+		if (err)
+			err += m;
+	}
+
+	return errors;
+}
+
+int ecc_iotstake_q2_batch(ProtocolIoTStake *const *ctx, const Digit *Q1B, Digit *Q2B, int *err, int n)
+{
+	Digit *P[ECC_BATCH_MAX];
+	const Digit *k[ECC_BATCH_MAX];
+	int errors = 0;
+	int m;
+	int i;
+
+	while (n > 0) {
+		m = (n < ECC_BATCH_MAX) ? n : ECC_BATCH_MAX;
+
+		for (i = 0; i < m; i++) {
+			assign(ctx[i]->Q2, Q1B + 2*FP_DIGITS*i, 2*FP_DIGITS);
+			P[i] = ctx[i]->Q2;
+			k[i] = ctx[i]->ephPrvKeyA;
+		}
+
+		errors += ecc_iotstake_step_batch(P, k, Q2B, err, m);
+
+		ctx += m;
+		Q1B += 2*FP_DIGITS*m;
+		n -= m;
+
+		if (Q2B)
+			Q2B += 2*FP_DIGITS*m;
+		if (err)
+			err += m;
+	}
+
+	return errors;
+}
+
+int ecc_iotstake_q3_batch(ProtocolIoTStake *const *ctx, const Digit *Q2A, int *err, int n)
+{
+	Digit *P[ECC_BATCH_MAX];
+	const Digit *k[ECC_BATCH_MAX];
+	int errors = 0;
+	int m;
+	int i;
+
+	while (n > 0) {
+		m = (n < ECC_BATCH_MAX) ? n : ECC_BATCH_MAX;
+
+		for (i = 0; i < m; i++) {
+			assign(ctx[i]->Q3, Q2A + 2*FP_DIGITS*i, 2*FP_DIGITS);
+			P[i] = ctx[i]->Q3;
+			k[i] = ctx[i]->prvKeyA;
+		}
+
+		errors += ecc_iotstake_step_batch(P, k, 0, err, m);
+
+		ctx += m;
+		Q2A += 2*FP_DIGITS*m;
+		n -= m;
+
+		if (err)
+			err += m;
+	}
+
+	return errors;
+}
+
+int ecc_iotstake_resumption(ProtocolIoTStake *ctx, Octet *secret)
+{
+	ecc_point_resumption(secret, ctx->Q3);
+	return 0;
+}
+
 int ecc_iotpki_init(ProtocolIoTPki *ctx, const Digit *prvA, const Digit *pubB, void (*rng)(Digit *, int))
 {
 	assign(ctx->prvKeyA, prvA, EC_GEN_ORDER_DIGITS);
@@ -279,18 +534,20 @@ int ecc_iotpki_init(ProtocolIoTPki *ctx, const Digit *prvA, const Digit *pubB, v
 
 int ecc_iotpki_q1(ProtocolIoTPki *ctx, Digit *Q1A, EcdsaSign *signA)
 {
-	int err;
+	Octet x[FP_OCTETS];
 
 	assign(ctx->Q1, ctx->ephPubKeyA, 2*FP_DIGITS);
 	assign(Q1A, ctx->Q1, 2*FP_DIGITS);
-	ecc_ecdsa_sign(signA, (const Octet *)Q1A, FP_DIGITS*(WORD_BITS/OCTET_BITS), ctx->prvKeyA);
+	/* Signed message is X coordinate in big-endian order (as on the wire). */
+	to_octets(x, Q1A, FP_DIGITS);
+	ecc_ecdsa_sign(signA, x, FP_OCTETS, ctx->prvKeyA);
 
 	return 0;
 }
 
 int ecc_iotpki_q2(ProtocolIoTPki *ctx, const Digit *Q1B, const EcdsaSign *signB)
 {
-	int err;
+	Octet x[FP_OCTETS];
 
 	assign(ctx->Q2, Q1B, 2*FP_DIGITS);
 
@@ -298,29 +555,67 @@ int ecc_iotpki_q2(ProtocolIoTPki *ctx, const Digit *Q1B, const EcdsaSign *signB)
 	    return 1;
 	}
 
-	if (ecc_ecdsa_verify(signB, (const Octet *)Q1B, FP_DIGITS*(WORD_BITS/OCTET_BITS), ctx->pubKeyB) != 0) {
+	to_octets(x, Q1B, FP_DIGITS);
+
+	if (ecc_ecdsa_verify(signB, x, FP_OCTETS, ctx->pubKeyB) != 0) {
 		return 2;
 	}
 
 	return 0;
 }
 
-int ecc_iotpki_hash(ProtocolIoTPki *ctx, Octet *hash)
+int ecc_iotpki_q2_batch(ProtocolIoTPki *const *ctx, const Digit *Q1B, const EcdsaSign *signB, int *err, int n)
 {
-	Octet ekey[AES128_EKEY_BYTES];
+	Digit *P[ECC_BATCH_MAX];
+	const Digit *k[ECC_BATCH_MAX];
+	int chk[ECC_BATCH_MAX];
+	Octet x[FP_OCTETS];
+	int errors = 0;
+	int m;
 	int i;
 
-	for (i = 0; i < 16; i++) {
-		ctx->hash[i] = (ctx->Q2[i/4] >> (i % 4)) & 0xFF;
-	}
+	while (n > 0) {
+		m = (n < ECC_BATCH_MAX) ? n : ECC_BATCH_MAX;
+
+		for (i = 0; i < m; i++) {
+			assign(ctx[i]->Q2, Q1B + 2*FP_DIGITS*i, 2*FP_DIGITS);
+			P[i] = ctx[i]->Q2;
+			k[i] = ctx[i]->ephPrvKeyA;
+		}
 
-	aes128_key_expansion(ekey, ctx->hash);
+		ecc_multiplication_batch(P, k, chk, m);
 
-	for (i = 0; i < 16; i++) {
-		ctx->hash[i] = 0;
+		for (i = 0; i < m; i++) {
+			if (!chk[i]) {
+				to_octets(x, Q1B + 2*FP_DIGITS*i, FP_DIGITS);
+
+				if (ecc_ecdsa_verify(signB + i, x, FP_OCTETS, ctx[i]->pubKeyB) != 0)
+					chk[i] = 2;
+			}
+
+			if (chk[i])
+				errors++;
+			if (err)
+				err[i] = chk[i];
+		}
+
+		ctx += m;
+		Q1B += 2*FP_DIGITS*m;
+		signB += m;
+		n -= m;
+
+		if (err)
+			err += m;
 	}
 
-	aes128_encrypt(ctx->hash, ctx->hash, ekey);
+	return errors;
+}
+
+int ecc_iotpki_hash(ProtocolIoTPki *ctx, Octet *hash)
+{
+	int i;
+
+	ecc_point_hash(ctx->hash, ctx->Q2);
 
 	if (hash) {
 		for (i = 0; i < 16; i++) {
@@ -1,5 +1,7 @@
 #include "crypto.h"
 
+Digit ecc_batch_tmp[ECC_BATCH_TMP_DIGITS];
+
 void ecp_pro2aff(Digit *P)
 {
 	FP_INV(Z(P));
@@ -10,6 +12,63 @@ void ecp_pro2aff(Digit *P)
 	FP_ASSIGN_ONE(Z(P));
 }
 
+void ecp_pro2aff_batch(Digit *P, int n)
+{
+	Digit *c = ecc_batch_tmp + ECC_BATCH_MAX*3*FP_DIGITS;
+	Digit inv[FP_DIGITS];
+	Digit t[FP_DIGITS];
+	Digit *Pi;
+
+	int i;
+
+	if (n <= 0)
+		return;
+
+	/* Prefix products c[i] = Z0 * Z1 * ... * Zi (points at infinity are skipped). */
+	for (i = 0; i < n; i++) {
+		Pi = P + 3*FP_DIGITS*i;
+
+		if (i == 0) {
+			FP_ASSIGN_ONE(c);
+		} else {
+			FP_ASSIGN(c + FP_DIGITS*i, c + FP_DIGITS*(i - 1));
+		}
+
+		if ( !FP_IS_ZERO(Z(Pi)) )
+			FP_MUL(c + FP_DIGITS*i, Z(Pi));
+	}
+
+	/* Single inversion of the product of all Z coordinates. */
+	FP_ASSIGN(inv, c + FP_DIGITS*(n - 1));
+	FP_INV(inv);
+
+	for (i = n - 1; i >= 0; i--) {
+		Pi = P + 3*FP_DIGITS*i;
+
+		if ( FP_IS_ZERO(Z(Pi)) ) {
+			/* The same result as ecp_pro2aff() gives for point at infinity. */
+			FP_ASSIGN_ZERO(X(Pi));
+			FP_ASSIGN_ZERO(Y(Pi));
+			FP_ASSIGN_ONE(Z(Pi));
+			continue;
+		}
+
+		/* t <- Zi^(-1), inv <- (Z0 * ... * Z(i-1))^(-1). */
+		FP_ASSIGN(t, inv);
+
+		if (i > 0) {
+			FP_MUL(t, c + FP_DIGITS*(i - 1));
+			FP_MUL(inv, Z(Pi));
+		}
+
+		FP_MUL(Y(Pi), t);
+		FP_SQR(t);
+		FP_MUL(X(Pi), t);
+		FP_MUL(Y(Pi), t);
+		FP_ASSIGN_ONE(Z(Pi));
+	}
+}
+
 /* Algorithm works only for special case a = p - 3. */
 void ecp_doubling(Digit *P)
 {
@@ -19,6 +78,8 @@ void ecp_doubling(Digit *P)
 	Digit *t4 = arth_tmp + 2*NUMBER_DIGITS_MAX;
 	Digit *t5 = t4 + NUMBER_DIGITS_MAX;
 
+	OP_COUNT(OP_EC_DBL, 1);
+
 	if ( FP_IS_ZERO(t2) || FP_IS_ZERO(t3) ) {
 		FP_ASSIGN_ONE(X(P));
 		FP_ASSIGN_ONE(Y(P));
@@ -66,6 +127,8 @@ void ecp_addition(Digit *P, const Digit *Q, int qsign)
 	Digit *t5 = t4 + NUMBER_DIGITS_MAX;
 	Digit *t7 = t5 + NUMBER_DIGITS_MAX;
 
+	OP_COUNT(OP_EC_ADD, 1);
+
 	FP_ASSIGN(t4, X(Q));
 	FP_ASSIGN(t5, Y(Q));
 
@@ -146,9 +209,100 @@ void ecp_addition(Digit *P, const Digit *Q, int qsign)
 
 #include <iostream>
 
-void ecp_multiple(Digit *P, const Digit *m)
+#if ECC_WNAF_WIDTH > 2
+/* Odd multiples P, [3]P, ..., [2^(w-1) - 1]P in table of ecp_multiple_pro(). */
+#define ECP_WNAF_POINTS (1 << (ECC_WNAF_WIDTH - 2))
+
+/* Affine coordinates of many points, ECC_BATCH_MAX points per inversion. */
+static void ecp_pro2aff_table(Digit *P, int n)
+{
+	int m;
+
+	while (n > 0) {
+		m = (n < ECC_BATCH_MAX) ? n : ECC_BATCH_MAX;
+		ecp_pro2aff_batch(P, m);
+		P += 3*FP_DIGITS*m;
+		n -= m;
+	}
+}
+
+/*
+ * Width-w NAF of m, least significant digit first: odd digits
+ * |d| < 2^(w-1), nonzero digit followed by at least w-1 zeros.
+ * Returns number of digits (at most EC_GEN_ORDER_BITS + 1).
+ */
+static int ecp_wnaf(signed char *naf, const Digit *m)
+{
+	Digit k[EC_GEN_ORDER_DIGITS + 1];
+	int len = 0;
+	int d;
+
+	assign(k, m, EC_GEN_ORDER_DIGITS);
+	k[EC_GEN_ORDER_DIGITS] = 0;
+
+	while (cmp_digit(k, 0, EC_GEN_ORDER_DIGITS + 1) != 0) {
+		d = 0;
+
+		if (k[0] & 1) {
+			d = (int)(k[0] & ((1 << ECC_WNAF_WIDTH) - 1));
+
+			if (d >= (1 << (ECC_WNAF_WIDTH - 1)))
+				d -= 1 << ECC_WNAF_WIDTH;
+
+			if (d > 0)
+				sub_digit(k, (Digit)d, EC_GEN_ORDER_DIGITS + 1);
+			else
+				add_digit(k, (Digit)(-d), EC_GEN_ORDER_DIGITS + 1);
+		}
+
+		naf[len++] = (signed char)d;
+		div2(k, EC_GEN_ORDER_DIGITS + 1);
+	}
+
+	return len;
+}
+
+void ecp_multiple_pro(Digit *T, const Digit *P, const Digit *m)
+{
+	Digit tab[ECP_WNAF_POINTS*3*FP_DIGITS];
+	Digit P2[3*FP_DIGITS];
+	signed char naf[EC_GEN_ORDER_BITS + 1];
+
+	int len;
+	int d;
+
+	int i;
+
+	/* tab[i] <- [2i + 1]P in affine coordinates (Z = 1, mixed additions). */
+	FP_ASSIGN(X(tab), X(P));
+	FP_ASSIGN(Y(tab), Y(P));
+	FP_ASSIGN_ONE(Z(tab));
+	assign(P2, tab, 3*FP_DIGITS);
+	ecp_doubling(P2);
+
+	for (i = 1; i < ECP_WNAF_POINTS; i++) {
+		assign(tab + 3*FP_DIGITS*i, P2, 3*FP_DIGITS);
+		ecp_addition(tab + 3*FP_DIGITS*i, tab + 3*FP_DIGITS*(i - 1), 1);
+	}
+
+	ecp_pro2aff_table(tab + 3*FP_DIGITS, ECP_WNAF_POINTS - 1);
+
+	FP_ASSIGN_ONE(X(T));
+	FP_ASSIGN_ONE(Y(T));
+	FP_ASSIGN_ZERO(Z(T));
+
+	len = ecp_wnaf(naf, m);
+
+	for (i = len - 1; i >= 0; i--) {
+		ecp_doubling(T);
+
+		if ((d = naf[i]) != 0)
+			ecp_addition(T, tab + 3*FP_DIGITS*((d < 0 ? -d : d) >> 1), d < 0 ? -1 : 1);
+	}
+}
+#else
+void ecp_multiple_pro(Digit *T, const Digit *P, const Digit *m)
 {
-	Digit T[3*FP_DIGITS];
 	Digit TP[3*FP_DIGITS];
 
 	int k = ARTH_GET_BIT(m, 0);
@@ -158,8 +312,6 @@ void ecp_multiple(Digit *P, const Digit *m)
 	int s;
 
 	int i;
-	
-	int ops = 0;
 
 	FP_ASSIGN_ONE(X(T));
 	FP_ASSIGN_ONE(Y(T));
@@ -183,20 +335,72 @@ void ecp_multiple(Digit *P, const Digit *m)
 
 		if (s) {
 			ecp_addition(T, TP, s);
-			ops++;
 		}
 
 		ecp_doubling(TP);
-		ops++;
 	}
+}
+#endif
+
+void ecp_multiple(Digit *P, const Digit *m)
+{
+	Digit T[3*FP_DIGITS];
 
+	ecp_multiple_pro(T, P, m);
 	ecp_pro2aff(T);
 	assign(P, T, 2*FP_DIGITS);
 }
 
-void ecp_scalar_product(Digit *P, const Digit *mp, const Digit *Q, const Digit *mq)
+void ecp_generator_multiple_pro(Digit *T, const Digit *m)
+{
+#if ECC_COMB_TEETH > 0
+	Digit Q[3*FP_DIGITS];
+
+	int bit;
+	int idx;
+
+	int i;
+	int j;
+
+	FP_ASSIGN_ONE(X(T));
+	FP_ASSIGN_ONE(Y(T));
+	FP_ASSIGN_ZERO(Z(T));
+	FP_ASSIGN_ONE(Z(Q));
+
+	for (i = ECC_COMB_COLUMNS - 1; i >= 0; i--) {
+		ecp_doubling(T);
+
+		/* Bits i, i + d, i + 2d, ... of m select sum of teeth. */
+		idx = 0;
+
+		for (j = 0; j < ECC_COMB_TEETH; j++) {
+			bit = j*ECC_COMB_COLUMNS + i;
+
+			if (bit < EC_GEN_ORDER_BITS)
+				idx |= ARTH_GET_BIT(m, bit) << j;
+		}
+
+		if (idx) {
+			assign(Q, EC_GEN_COMB[idx - 1], 2*FP_DIGITS);
+			ecp_addition(T, Q, 1);
+		}
+	}
+#else
+	ecp_multiple_pro(T, EC_GEN, m);
+#endif
+}
+
+void ecp_generator_multiple(Digit *P, const Digit *m)
 {
 	Digit T[3*FP_DIGITS];
+
+	ecp_generator_multiple_pro(T, m);
+	ecp_pro2aff(T);
+	assign(P, T, 2*FP_DIGITS);
+}
+
+void ecp_scalar_product_pro(Digit *T, const Digit *P, const Digit *mp, const Digit *Q, const Digit *mq)
+{
 	Digit TP[3*FP_DIGITS];
 	Digit TQ[3*FP_DIGITS];
 	Digit TPQ[3*FP_DIGITS];
@@ -205,8 +409,6 @@ void ecp_scalar_product(Digit *P, const Digit *mp, const Digit *Q, const Digit *
 	int mqi;
 
 	int i;
-	
-	int ops = 0;
 
 	FP_ASSIGN_ONE(X(T));
 	FP_ASSIGN_ONE(Y(T));
@@ -227,23 +429,25 @@ void ecp_scalar_product(Digit *P, const Digit *mp, const Digit *Q, const Digit *
 
 	for (i = EC_GEN_ORDER_BITS - 1; i >= 0; i--) {
 		ecp_doubling(T);
-		ops++;
 
 		mpi = ARTH_GET_BIT(mp, i);
 		mqi = ARTH_GET_BIT(mq, i);
 
 		if ((mpi == 1) && (mqi == 1)) {
 			ecp_addition(T, TPQ, 1);
-			ops++;
 		} else if (mpi == 1) {
             ecp_addition(T, TP, 1);
-            ops++;
 		} else if (mqi == 1) {
             ecp_addition(T, TQ, 1);
-            ops++;
 		}
 	}
+}
+
+void ecp_scalar_product(Digit *P, const Digit *mp, const Digit *Q, const Digit *mq)
+{
+	Digit T[3*FP_DIGITS];
 
+	ecp_scalar_product_pro(T, P, mp, Q, mq);
 	ecp_pro2aff(T);
 	assign(P, T, 2*FP_DIGITS);
 }
@@ -0,0 +1,201 @@
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "energy.h"
+
+static long energy_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec*1000000000L + ts.tv_nsec;
+}
+
+/* Read first line of file, 0 if read. */
+static int energy_file(char *dst, int len, const char *dir, const char *name)
+{
+	char path[ENERGY_PATH_MAX + 32];
+	FILE *in;
+	int err;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+
+	if ((in = fopen(path, "r")) == 0)
+		return 1;
+
+	err = fgets(dst, len, in) == 0;
+	fclose(in);
+
+	return err;
+}
+
+/* Read number from file, 0 if read. */
+static int energy_number(unsigned long long *dst, const char *path)
+{
+	FILE *in = fopen(path, "r");
+	int err;
+
+	if (in == 0)
+		return 1;
+
+	err = fscanf(in, "%llu", dst) != 1;
+	fclose(in);
+
+	return err;
+}
+
+int energy_open(EnergyMeter *m, const char *root)
+{
+	DIR *dir = opendir(root);
+	struct dirent *ent;
+	char base[ENERGY_PATH_MAX];
+	char line[64];
+
+	memset(m, 0, sizeof(*m));
+
+	if (dir == 0)
+		return 0;
+
+	while ((ent = readdir(dir)) != 0 && m->domains < ENERGY_DOMAINS_MAX) {
+		unsigned long long uj;
+		char *path = m->path[m->domains];
+
+		if (ent->d_name[0] == '.')
+			continue;
+
+		if (snprintf(base, sizeof(base), "%s/%s", root, ent->d_name) >= (int)sizeof(base) - 16)
+			continue;
+
+		/* Packages only, their subdomains (core, uncore, dram) are inside. */
+		if (energy_file(line, sizeof(line), base, "name") != 0 || strncmp(line, "package", 7) != 0)
+			continue;
+
+		if (snprintf(path, ENERGY_PATH_MAX, "%s/energy_uj", base) >= ENERGY_PATH_MAX)
+			continue;
+
+		if (energy_file(line, sizeof(line), base, "max_energy_range_uj") != 0
+				|| sscanf(line, "%llu", &m->range[m->domains]) != 1 || energy_number(&uj, path) != 0)
+			continue;
+
+		m->domains++;
+	}
+
+	closedir(dir);
+
+	return m->domains;
+}
+
+int energy_read(const EnergyMeter *m, EnergySample *s)
+{
+	int err = 0;
+	int i;
+
+	for (i = 0; i < m->domains; i++)
+		err |= energy_number(&s->uj[i], m->path[i]);
+
+	s->ns = energy_now_ns();
+
+	return err;
+}
+
+int energy_idle(EnergyMeter *m, long ms)
+{
+	EnergySample start, end;
+	struct timespec ts;
+	double joules;
+
+	m->idleW = 0;
+
+	if (m->domains == 0 || energy_read(m, &start) != 0)
+		return 1;
+
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000)*1000000L;
+	nanosleep(&ts, 0);
+
+	if (energy_read(m, &end) != 0 || end.ns <= start.ns)
+		return 1;
+
+	joules = energy_joules(m, &start, &end);
+	m->idleW = joules/((end.ns - start.ns)*1e-9);
+
+	return 0;
+}
+
+double energy_joules(const EnergyMeter *m, const EnergySample *start, const EnergySample *end)
+{
+	double uj = 0;
+	int i;
+
+	for (i = 0; i < m->domains; i++) {
+		if (end->uj[i] >= start->uj[i])
+			uj += end->uj[i] - start->uj[i];
+		else
+			uj += end->uj[i] + (m->range[i] - start->uj[i]) + 1;
+	}
+
+	return uj*1e-6 - m->idleW*(end->ns - start->ns)*1e-9;
+}
+
+int energy_phase_open(EnergyPhase *ph, const char *profile, FILE *log)
+{
+	memset(ph, 0, sizeof(*ph));
+
+	if (energy_open(&ph->meter, ENERGY_POWERCAP) > 0 && energy_idle(&ph->meter, 500) == 0) {
+		ph->mode = ENERGY_RAPL;
+		return 0;
+	}
+
+#if defined(STAKE_OPCOUNT)
+	if (cost_load(&ph->model, profile) == 0) {
+		fprintf(log, "Warn: RAPL not available, energy of operation counts (%s)\n", profile);
+		ph->mode = ENERGY_MODEL;
+		return 0;
+	}
+
+	fprintf(log, "Err: RAPL not available, cannot load %s\n", profile);
+#else
+	(void)profile;
+	fprintf(log, "Err: RAPL not available, build with OPCOUNT=1 for energy of operation counts\n");
+#endif
+
+	return 1;
+}
+
+void energy_phase_begin(EnergyPhase *ph)
+{
+	if (ph->mode == ENERGY_RAPL)
+		energy_read(&ph->meter, &ph->start);
+#if defined(STAKE_OPCOUNT)
+	if (ph->mode == ENERGY_MODEL)
+		memcpy(ph->ops, op_count.n, sizeof(ph->ops));
+#endif
+}
+
+void energy_phase_end(const EnergyPhase *ph, FILE *out, int ops)
+{
+	if (ph->mode == ENERGY_RAPL) {
+		EnergySample end;
+
+		energy_read(&ph->meter, &end);
+		fprintf(out, "        energy: %.4f mJ (RAPL, idle %.2f W subtracted)\n",
+			energy_joules(&ph->meter, &ph->start, &end)*1e3/ops, ph->meter.idleW);
+	}
+#if defined(STAKE_OPCOUNT)
+	if (ph->mode == ENERGY_MODEL) {
+		unsigned long n[OP_KINDS];
+		double cycles;
+		int k;
+
+		for (k = 0; k < OP_KINDS; k++)
+			n[k] = op_count.n[k] - ph->ops[k];
+
+		cycles = cost_cycles(&ph->model, n)/ops;
+		fprintf(out, "        energy: %.4f mJ (model %s, %.0f cycles)\n", cost_mj(&ph->model, cycles),
+			ph->model.name, cycles);
+	}
+#endif
+}
@@ -0,0 +1,166 @@
+#ifndef __ENERGY_H
+#define __ENERGY_H
+
+#include <stdio.h>
+
+#include "cost.h"
+
+/**
+ * \defgroup energy_group Package energy
+ * \brief Energy of processor packages from Linux powercap (RAPL).
+ *
+ * Every package domain of powercap (directory with name "package-N",
+ * e.g. /sys/class/powercap/intel-rapl:0) has counter of microjoules
+ * (energy_uj) which wraps at max_energy_range_uj. Difference of two
+ * samples is corrected for single wraparound, so measured interval has to
+ * be shorter than range of counter (tens of minutes at hundred watts).
+ * Energy of interval is reduced by idle power of packages times duration
+ * of interval, so only energy of measured work remains (other load of the
+ * machine is not separated). Counters are readable by root only on
+ * current kernels.
+ *
+ * \{
+ */
+
+/** \brief Default root of powercap. */
+#define ENERGY_POWERCAP "/sys/class/powercap"
+
+/** \brief Maximum number of package domains. */
+#define ENERGY_DOMAINS_MAX 8
+
+/** \brief Maximum length of path of counter. */
+#define ENERGY_PATH_MAX 128
+
+/** \brief Package domains. */
+typedef struct EnergyMeter_st {
+	/** \brief Number of readable domains. */
+	int domains;
+	/** \brief Path of energy_uj of every domain. */
+	char path[ENERGY_DOMAINS_MAX][ENERGY_PATH_MAX];
+	/** \brief Range of every counter (microjoules). */
+	unsigned long long range[ENERGY_DOMAINS_MAX];
+	/** \brief Idle power of all domains (watts, 0 - not measured). */
+	double idleW;
+} EnergyMeter;
+
+/** \brief Counters at single moment. */
+typedef struct EnergySample_st {
+	/** \brief Counter of every domain (microjoules). */
+	unsigned long long uj[ENERGY_DOMAINS_MAX];
+	/** \brief Monotonic time (nanoseconds). */
+	long ns;
+} EnergySample;
+
+/**
+ * \brief Find readable package domains.
+ *
+ * \param[out] m -
+ *   domains.
+ * \param[in] root -
+ *   root of powercap (\ref ENERGY_POWERCAP).
+ *
+ * \return number of domains (0 - RAPL is absent or not readable).
+ */
+extern int energy_open(EnergyMeter *m, const char *root);
+
+/**
+ * \brief Read counters of all domains.
+ *
+ * \param[in] m -
+ *   domains.
+ * \param[out] s -
+ *   counters and time.
+ *
+ * \return 0 if all counters are read.
+ */
+extern int energy_read(const EnergyMeter *m, EnergySample *s);
+
+/**
+ * \brief Measure idle power of packages (calling thread sleeps).
+ *
+ * \param[in,out] m -
+ *   domains, \ref EnergyMeter::idleW is set.
+ * \param[in] ms -
+ *   duration of measurement (milliseconds).
+ *
+ * \return 0 if idle power is measured.
+ */
+extern int energy_idle(EnergyMeter *m, long ms);
+
+/**
+ * \brief Energy of all domains between two samples above idle power.
+ *
+ * \param[in] m -
+ *   domains.
+ * \param[in] start -
+ *   counters at start.
+ * \param[in] end -
+ *   counters at end.
+ *
+ * \return joules (may be negative when idle power is overestimated).
+ */
+extern double energy_joules(const EnergyMeter *m, const EnergySample *start, const EnergySample *end);
+
+/** \brief Source of energy of phases. */
+enum EnergyMode {
+	/** \brief Energy is not measured. */
+	ENERGY_OFF = 0,
+	/** \brief Package counters (RAPL) above idle power. */
+	ENERGY_RAPL,
+	/** \brief Cycles of operation counts in cost model (OPCOUNT=1 builds). */
+	ENERGY_MODEL
+};
+
+/** \brief Energy around phases of several operations (zero - off). */
+typedef struct EnergyPhase_st {
+	/** \brief Source of energy (\ref EnergyMode). */
+	int mode;
+	/** \brief Package domains (\ref ENERGY_RAPL). */
+	EnergyMeter meter;
+	/** \brief Counters at start of phase (\ref ENERGY_RAPL). */
+	EnergySample start;
+	/** \brief Cost model (\ref ENERGY_MODEL). */
+	CostProfile model;
+	/** \brief Operation counts at start of phase (\ref ENERGY_MODEL). */
+	unsigned long ops[OP_KINDS];
+} EnergyPhase;
+
+/**
+ * \brief Select source of energy of phases: RAPL with idle power measured
+ * for 0.5 s, cost model of operation counts if RAPL is absent and the
+ * build counts operations (\ref STAKE_OPCOUNT).
+ *
+ * \param[out] ph -
+ *   phase energy.
+ * \param[in] profile -
+ *   cost model profile (\ref cost_load) used without RAPL.
+ * \param[in] log -
+ *   stream of warnings and errors.
+ *
+ * \return 0 if energy is measured, 1 if neither RAPL nor model is available.
+ */
+extern int energy_phase_open(EnergyPhase *ph, const char *profile, FILE *log);
+
+/**
+ * \brief Start phase (nothing if energy is off).
+ *
+ * \param[in,out] ph -
+ *   phase energy.
+ */
+extern void energy_phase_begin(EnergyPhase *ph);
+
+/**
+ * \brief Print energy per operation of phase (nothing if energy is off).
+ *
+ * \param[in] ph -
+ *   phase energy.
+ * \param[in] out -
+ *   output stream.
+ * \param[in] ops -
+ *   operations of phase.
+ */
+extern void energy_phase_end(const EnergyPhase *ph, FILE *out, int ops);
+
+/** \} */
+
+#endif /* __ENERGY_H */
@@ -0,0 +1,129 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <vector>
+
+#include "crypto.h"
+#include "async.h"
+
+// Static SERVER key pair generated by the keygen program.
+Digit prvSrv[FP_DIGITS] = {
+	ARTH_WORD_DIGITS(0x2454fba4), ARTH_WORD_DIGITS(0x8da7f60f), ARTH_WORD_DIGITS(0x3373886b), ARTH_WORD_DIGITS(0xaf7eabb7),
+	ARTH_WORD_DIGITS(0x72d6f1b9), ARTH_WORD_DIGITS(0x22674a67)
+};
+
+Digit pubSrv[2*FP_DIGITS] = {
+	ARTH_WORD_DIGITS(0xd388264f), ARTH_WORD_DIGITS(0x3940a178), ARTH_WORD_DIGITS(0x10710de9), ARTH_WORD_DIGITS(0xb87bbf09),
+	ARTH_WORD_DIGITS(0x1b7543dd), ARTH_WORD_DIGITS(0xd6b941e1), ARTH_WORD_DIGITS(0xc3a727d3), ARTH_WORD_DIGITS(0x37aa763e),
+	ARTH_WORD_DIGITS(0x4a33547c), ARTH_WORD_DIGITS(0xfbbe8072), ARTH_WORD_DIGITS(0xe5390cd1), ARTH_WORD_DIGITS(0x9398e3d4)
+};
+
+// Static MICROCONTROLLER (SENSOR) key pair generated by the keygen program.
+Digit prvMu[FP_DIGITS] = {
+	ARTH_WORD_DIGITS(0x16b1c8fd), ARTH_WORD_DIGITS(0x0f7eeb08), ARTH_WORD_DIGITS(0x46a846f0), ARTH_WORD_DIGITS(0x32593b27),
+	ARTH_WORD_DIGITS(0x059e4b50), ARTH_WORD_DIGITS(0x6bb0570f)
+};
+
+Digit pubMu[2*FP_DIGITS] = {
+	ARTH_WORD_DIGITS(0xa2f1b4e6), ARTH_WORD_DIGITS(0xa3d59896), ARTH_WORD_DIGITS(0x555b859e), ARTH_WORD_DIGITS(0x0eb8e223),
+	ARTH_WORD_DIGITS(0x77a021d3), ARTH_WORD_DIGITS(0x86883364), ARTH_WORD_DIGITS(0x2c151e28), ARTH_WORD_DIGITS(0xcfd3f377),
+	ARTH_WORD_DIGITS(0xb7795ebf), ARTH_WORD_DIGITS(0xd59ad5c5), ARTH_WORD_DIGITS(0x9c0915a0), ARTH_WORD_DIGITS(0x1eaee60a)
+};
+
+// Messages in flight: destination session and message.
+struct Packet {
+	AsyncSession *dst;
+	AsyncMessage msg;
+};
+
+std::deque<Packet> network;
+
+int handshakes(const char *name, int N, int threaded, int pki) {
+	AsyncExecutor exec;
+	std::vector<AsyncSession *> srv(N);
+	std::vector<AsyncSession *> mu(N);
+	std::vector<AsyncTask> srvTask(N);
+	std::vector<AsyncTask> muTask(N);
+
+	int bad = 0;
+
+	clock_t startTime;
+	clock_t endTime;
+
+	std::cout << "START: " << name << "()\n";
+
+	if (threaded)
+		exec.start();
+
+	startTime = clock();
+
+	// Every session sends messages through the in-memory network.
+	for (int i = 0; i < N; i++) {
+		srv[i] = new AsyncSession(exec, [&mu, i](const AsyncMessage &m) { network.push_back(Packet{mu[i], m}); });
+		mu[i] = new AsyncSession(exec, [&srv, i](const AsyncMessage &m) { network.push_back(Packet{srv[i], m}); });
+	}
+
+	for (int i = 0; i < N; i++) {
+		if (pki) {
+			muTask[i] = async_iotpki_sensor(*mu[i], prvMu, pubSrv);
+			srvTask[i] = async_iotpki_server(*srv[i], prvSrv, pubMu);
+		} else {
+			muTask[i] = async_iotstake_sensor(*mu[i], prvMu, pubSrv);
+			srvTask[i] = async_iotstake_server(*srv[i], prvSrv, pubMu);
+		}
+	}
+
+	// Single I/O loop drives all handshakes.
+	while (exec.pending() || !network.empty()) {
+		while (!network.empty()) {
+			Packet p = network.front();
+			network.pop_front();
+			p.dst->deliver(p.msg);
+		}
+
+		exec.poll(1);
+	}
+
+	endTime = clock();
+
+	for (int i = 0; i < N; i++) {
+		if (!srvTask[i].done() || !muTask[i].done() || srvTask[i].result() || muTask[i].result()
+				|| memcmp(srv[i]->key, mu[i]->key, 16) != 0) {
+			bad++;
+		}
+
+		delete srv[i];
+		delete mu[i];
+	}
+
+	std::cout << "[" << N << " handshakes] " << (bad ? "FAILED: " : "OK: ");
+	std::cout << ((double)(endTime - startTime)/(N*CLOCKS_PER_SEC)) << "s per handshake\n";
+
+	for (int k = 0; k < ASYNC_STEP_KINDS; k++) {
+		if (exec.steps[k]) {
+			std::cout << "  step " << k << ": " << exec.steps[k] << " in " << exec.batches[k] << " batches\n";
+		}
+	}
+
+	std::cout << "STOP: " << name << "()\n";
+
+	return bad;
+}
+
+int main(int argc, char *argv[]) {
+	int N = 100;
+	int threaded = 0;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-t") == 0) {
+			threaded = 1;
+		} else {
+			N = atoi(argv[i]);
+		}
+	}
+
+	handshakes("async_iotstake", N, threaded, 0);
+	handshakes("async_iotpki", N, threaded, 1);
+}
@@ -0,0 +1,1144 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "crypto.h"
+#include "aes_locl.h"
+#include "bench.h"
+#include "mem.h"
+#include "wire.h"
+
+// Static SERVER key pair generated by the keygen program.
+Digit prvSrv[FP_DIGITS] = {
+	ARTH_WORD_DIGITS(0x2454fba4), ARTH_WORD_DIGITS(0x8da7f60f), ARTH_WORD_DIGITS(0x3373886b), ARTH_WORD_DIGITS(0xaf7eabb7),
+	ARTH_WORD_DIGITS(0x72d6f1b9), ARTH_WORD_DIGITS(0x22674a67)
+};
+
+// Static MICROCONTROLLER (SENSOR) key pair generated by the keygen program.
+Digit pubMu[2*FP_DIGITS] = {
+	ARTH_WORD_DIGITS(0xa2f1b4e6), ARTH_WORD_DIGITS(0xa3d59896), ARTH_WORD_DIGITS(0x555b859e), ARTH_WORD_DIGITS(0x0eb8e223),
+	ARTH_WORD_DIGITS(0x77a021d3), ARTH_WORD_DIGITS(0x86883364), ARTH_WORD_DIGITS(0x2c151e28), ARTH_WORD_DIGITS(0xcfd3f377),
+	ARTH_WORD_DIGITS(0xb7795ebf), ARTH_WORD_DIGITS(0xd59ad5c5), ARTH_WORD_DIGITS(0x9c0915a0), ARTH_WORD_DIGITS(0x1eaee60a)
+};
+
+double now() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Time stamp counter (nanoseconds if there is none).
+unsigned long long cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return (unsigned long long)(now() * 1e9);
+#endif
+}
+
+void report(const char *name, int N, int bytes, double time) {
+	std::cout << name << ": " << (time * 1e9 / N) << " ns/msg, ";
+	std::cout << ((double)N * bytes / time / 1e6) << " MB/s\n";
+}
+
+// Encode and decode throughput of every message type.
+int wire_throughput(int N) {
+	ProtocolIoTStake ctx;
+	EcdsaSign sign;
+	Octet cookie[COOKIE_BYTES];
+	Octet buf[WIRE_MAX_BYTES];
+	WireMessage msg;
+	Digit Q1[2*FP_DIGITS];
+	Digit Q2[2*FP_DIGITS];
+	Digit P[2*FP_DIGITS];
+	EcdsaSign s;
+	volatile Digit sink = 0;
+	double startTime;
+	int len = 0;
+
+	static const struct {
+		const char *name;
+		int type;
+		int cookie;
+	} kinds[] = {
+		{"Q1", WIRE_Q1, 0},
+		{"Q1+cookie", WIRE_Q1, 1},
+		{"Q1Q2", WIRE_Q1Q2, 0},
+		{"Q1Q2+cookie", WIRE_Q1Q2, 1},
+		{"Q2", WIRE_Q2, 0},
+		{"Q1+sign", WIRE_Q1_SIGN, 0},
+	};
+
+	ecc_iotstake_init(&ctx, prvSrv, pubMu, 0);
+	ecc_iotstake_q1(&ctx, Q1);
+	assign(Q2, ctx.ephPubKeyA, 2*FP_DIGITS);
+	ecc_ecdsa_sign(&sign, (const Octet *)"message", 7, prvSrv);
+	memset(cookie, 0xA5, sizeof(cookie));
+
+	std::cout << "START: wire_throughput()\n";
+
+	for (auto &k : kinds) {
+		char name[64];
+
+		startTime = now();
+
+		for (int i = 0; i < N; i++) {
+			len = wire_encode(buf, sizeof(buf), k.type, Q1, Q2, &sign, k.cookie ? cookie : 0);
+			sink = sink ^ buf[len - 1];
+		}
+
+		snprintf(name, sizeof(name), "encode %-12s (%3d B)", k.name, len);
+		report(name, N, len, now() - startTime);
+
+		startTime = now();
+
+		for (int i = 0; i < N; i++) {
+			if (wire_decode(&msg, buf, len) != len) {
+				std::cout << "Err: decode " << k.name << "\n";
+				return 1;
+			}
+
+			wire_get_point(P, msg.P1);
+			if (msg.P2)
+				wire_get_point(P, msg.P2);
+			if (msg.sign)
+				wire_get_sign(&s, msg.sign);
+
+			sink = sink ^ P[0];
+		}
+
+		snprintf(name, sizeof(name), "decode %-12s (%3d B)", k.name, len);
+		report(name, N, len, now() - startTime);
+
+		// Round trip has to give the same numbers.
+		if (cmp(P, msg.P2 ? Q2 : Q1, 2*FP_DIGITS) != 0 || (msg.sign && cmp(s.s, sign.s, EC_GEN_ORDER_DIGITS) != 0)) {
+			std::cout << "Err: round trip " << k.name << "\n";
+			return 1;
+		}
+	}
+
+	// Coordinate equal to p is rejected, p - 1 is accepted (in either point).
+	for (int c = 0; c < 4; c++) {
+		Digit *x = P + (c & 1)*FP_DIGITS;
+
+		assign(P, Q2, 2*FP_DIGITS);
+		assign(x, secp192r1_prime, FP_DIGITS);
+		len = wire_encode(buf, sizeof(buf), WIRE_Q1Q2, c < 2 ? P : Q2, c < 2 ? Q2 : P, 0, 0);
+
+		if (wire_decode(&msg, buf, len) != -1) {
+			std::cout << "Err: coordinate p accepted\n";
+			return 1;
+		}
+
+		x[0]--;
+		len = wire_encode(buf, sizeof(buf), WIRE_Q1Q2, c < 2 ? P : Q2, c < 2 ? Q2 : P, 0, 0);
+
+		if (wire_decode(&msg, buf, len) != len) {
+			std::cout << "Err: coordinate p - 1 rejected\n";
+			return 1;
+		}
+	}
+
+	std::cout << "STOP: wire_throughput()\n";
+
+	return 0;
+}
+
+// Random mutations of correct messages: parser never accepts frame longer than input.
+int wire_fuzz(int N) {
+	Digit Q1[2*FP_DIGITS];
+	Octet cookie[COOKIE_BYTES] = {0};
+	Octet buf[WIRE_MAX_BYTES + 16];
+	WireMessage msg;
+	int accepted = 0;
+	int incomplete = 0;
+	int rejected = 0;
+
+	std::cout << "START: wire_fuzz()\n";
+
+	srand(31);
+	rng_bits(Q1, 2*FP_DIGITS);
+
+	for (int i = 0; i < N; i++) {
+		int len = wire_encode(buf, sizeof(buf), 1 + rand() % 4, Q1, Q1, (const EcdsaSign *)Q1, (rand() & 1) ? cookie : 0);
+
+		if (len < 0)
+			len = rand() % sizeof(buf);
+
+		// Flip a few octets, then cut or extend the input.
+		for (int j = rand() % 4; j > 0; j--)
+			buf[rand() % sizeof(buf)] ^= (Octet)(1 + rand() % 255);
+
+		len = (rand() & 1) ? rand() % (len + 1) : len;
+
+		int r = wire_decode(&msg, buf, len);
+
+		if (r > len) {
+			std::cout << "Err: frame of " << r << " octets in " << len << " octets\n";
+			return 1;
+		} else if (r > 0) {
+			accepted++;
+		} else if (r == 0) {
+			incomplete++;
+		} else {
+			rejected++;
+		}
+	}
+
+	std::cout << "[" << N << " inputs] accepted: " << accepted << ", incomplete: " << incomplete;
+	std::cout << ", rejected: " << rejected << "\n";
+	std::cout << "STOP: wire_fuzz()\n";
+
+	return 0;
+}
+
+// AES-128 implementation used by aes128_* functions.
+const char *aes_backend() {
+#if defined(AES_NI)
+	if (aes_ni_available())
+		return "aesni";
+#endif
+#if defined(AES_BITSLICE)
+	return "bitslice";
+#elif defined(AES_TTABLE)
+	return "ttable";
+#elif defined(AES_COMPACT)
+	return "compact";
+#else
+	return "byte";
+#endif
+}
+
+// Non-zero if GHASH uses carry-less multiplication.
+int aes_clmul() {
+#if defined(AES_NI)
+	return aes_clmul_available();
+#else
+	return 0;
+#endif
+}
+
+typedef void (*AesBlockFn)(Octet *out, const Octet *in, const Octet *ekey);
+
+static void aes_byte_encrypt(Octet *out, const Octet *in, const Octet *ekey) {
+	aes_encrypt(out, in, ekey, AES128_RKEY_BYTES);
+}
+
+static void aes_byte_decrypt(Octet *out, const Octet *in, const Octet *ekey) {
+	aes_decrypt(out, in, ekey, AES128_RKEY_BYTES);
+}
+
+// Cycles per byte of chained blocks (every block depends on previous one).
+double aes_cpb(AesBlockFn fn, const Octet *ekey, int N) {
+	Octet buf[AES128_BLOCK_BYTES] = {0};
+	unsigned long long start;
+
+	for (int i = 0; i < N / 16 + 1; i++)
+		fn(buf, buf, ekey);
+
+	start = cycles();
+
+	for (int i = 0; i < N; i++)
+		fn(buf, buf, ekey);
+
+	return (double)(cycles() - start) / N / AES128_BLOCK_BYTES;
+}
+
+// AES-128 block functions of selected backend against byte-oriented code.
+int aes_speed(int N) {
+	static const Octet key[AES128_KEY_BYTES] = {
+		0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+	};
+	static const Octet pt[AES128_BLOCK_BYTES] = {
+		0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+	};
+	// FIPS-197, appendix C.1.
+	static const Octet ct[AES128_BLOCK_BYTES] = {
+		0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a
+	};
+	Octet ekey[AES128_EKEY_BYTES];
+	Octet rkey[AES128_RKEY_BYTES];
+	Octet a[AES128_BLOCK_BYTES];
+	Octet b[AES128_BLOCK_BYTES];
+
+	std::cout << "START: aes_speed() [" << aes_backend() << ", " << AES128_EKEY_BYTES << " B key schedule]\n";
+
+	aes128_key_expansion(ekey, key);
+	aes128_encrypt(a, pt, ekey);
+	aes128_decrypt(b, a, ekey);
+
+	if (memcmp(a, ct, sizeof(ct)) != 0 || memcmp(b, pt, sizeof(pt)) != 0) {
+		std::cout << "Err: FIPS-197 test vector\n";
+		return 1;
+	}
+
+	// Backend has to agree with byte-oriented code on random keys and blocks.
+	srand(34);
+
+	for (int i = 0; i < 1000; i++) {
+		Octet k[AES128_KEY_BYTES];
+		Octet x[AES128_BLOCK_BYTES];
+
+		for (int j = 0; j < 16; j++) {
+			k[j] = (Octet)rand();
+			x[j] = (Octet)rand();
+		}
+
+		aes128_key_expansion(ekey, k);
+		aes_key_expansion(rkey, k);
+		aes128_encrypt(a, x, ekey);
+		aes_byte_encrypt(b, x, rkey);
+
+		if (memcmp(a, b, sizeof(a)) != 0) {
+			std::cout << "Err: encryption differs from byte-oriented code\n";
+			return 1;
+		}
+
+		aes128_decrypt(a, x, ekey);
+		aes_byte_decrypt(b, x, rkey);
+
+		if (memcmp(a, b, sizeof(a)) != 0) {
+			std::cout << "Err: decryption differs from byte-oriented code\n";
+			return 1;
+		}
+
+		// Multi-block functions on up to 19 blocks.
+		Octet blk[19*AES128_BLOCK_BYTES];
+		Octet ref[19*AES128_BLOCK_BYTES];
+		int n = i % 20;
+
+		for (int j = 0; j < n*AES128_BLOCK_BYTES; j++)
+			blk[j] = (Octet)rand();
+
+		for (int j = 0; j < n; j++)
+			aes_byte_encrypt(ref + j*AES128_BLOCK_BYTES, blk + j*AES128_BLOCK_BYTES, rkey);
+
+		aes128_encrypt_blocks(blk, blk, n, ekey);
+
+		if (memcmp(blk, ref, n*AES128_BLOCK_BYTES) != 0) {
+			std::cout << "Err: encryption of " << n << " blocks\n";
+			return 1;
+		}
+
+		for (int j = 0; j < n; j++)
+			aes_byte_decrypt(ref + j*AES128_BLOCK_BYTES, blk + j*AES128_BLOCK_BYTES, rkey);
+
+		aes128_decrypt_blocks(blk, blk, n, ekey);
+
+		if (memcmp(blk, ref, n*AES128_BLOCK_BYTES) != 0) {
+			std::cout << "Err: decryption of " << n << " blocks\n";
+			return 1;
+		}
+
+		// CBC round trip of every length up to 20 blocks.
+		Octet msg[320];
+		Octet enc[336];
+		Octet dec[336];
+		int len = i % 320;
+
+		for (int j = 0; j < len; j++)
+			msg[j] = (Octet)rand();
+
+		if (aes128_cbc_decrypt(dec, enc, aes128_cbc_encrypt(enc, msg, len, x, ekey), x, ekey) != len ||
+			memcmp(dec, msg, len) != 0) {
+			std::cout << "Err: CBC round trip of " << len << " octets\n";
+			return 1;
+		}
+	}
+
+	std::cout << "encrypt " << aes_backend() << ": " << aes_cpb(aes128_encrypt, ekey, N) << " cycles/byte\n";
+	std::cout << "decrypt " << aes_backend() << ": " << aes_cpb(aes128_decrypt, ekey, N) << " cycles/byte\n";
+
+	if (strcmp(aes_backend(), "byte") != 0) {
+		aes_key_expansion(rkey, key);
+		std::cout << "encrypt byte: " << aes_cpb(aes_byte_encrypt, rkey, N) << " cycles/byte\n";
+		std::cout << "decrypt byte: " << aes_cpb(aes_byte_decrypt, rkey, N) << " cycles/byte\n";
+	}
+
+
+	// CBC over buffers of sensor traffic size and of bulk size.
+	static Octet data[65536 + AES128_BLOCK_BYTES];
+
+	for (int len : {256, 65536}) {
+		char name[64];
+		int M = (int)((double)N * AES128_BLOCK_BYTES / len) + 1;
+		double startTime;
+
+		startTime = now();
+		for (int i = 0; i < M; i++)
+			aes128_encrypt_blocks(data, data, len / AES128_BLOCK_BYTES, ekey);
+		snprintf(name, sizeof(name), "ecb_encrypt %s (%5d B)", aes_backend(), len);
+		report(name, M, len, now() - startTime);
+
+		startTime = now();
+		for (int i = 0; i < M; i++)
+			aes128_decrypt_blocks(data, data, len / AES128_BLOCK_BYTES, ekey);
+		snprintf(name, sizeof(name), "ecb_decrypt %s (%5d B)", aes_backend(), len);
+		report(name, M, len, now() - startTime);
+
+		startTime = now();
+		for (int i = 0; i < M; i++)
+			aes128_cbc_encrypt(data, data, len, pt, ekey);
+		snprintf(name, sizeof(name), "cbc_encrypt %s (%5d B)", aes_backend(), len);
+		report(name, M, len, now() - startTime);
+
+		startTime = now();
+		for (int i = 0; i < M; i++)
+			aes128_cbc_decrypt(data, data, len + AES128_BLOCK_BYTES, pt, ekey);
+		snprintf(name, sizeof(name), "cbc_decrypt %s (%5d B)", aes_backend(), len);
+		report(name, M, len, now() - startTime);
+	}
+
+	std::cout << "STOP: aes_speed()\n";
+
+	return 0;
+}
+
+// AES-128-CBC decryption: bad padding is rejected, threads give the same plaintext.
+int aes_cbc_decrypt(int N) {
+	static Octet data[1 << 22];
+	static Octet ref[(1 << 22) + AES128_BLOCK_BYTES];
+	static Octet enc[(1 << 22) + AES128_BLOCK_BYTES];
+	Octet key[AES128_KEY_BYTES] = {0};
+	Octet iv[AES128_BLOCK_BYTES] = {0};
+	Octet bad[AES128_BLOCK_BYTES];
+	Octet ekey[AES128_EKEY_BYTES];
+	Octet out[64];
+	int len;
+
+	std::cout << "START: aes_cbc_decrypt() [" << aes_backend() << "]\n";
+
+	aes128_key_expansion(ekey, key);
+
+	// 13 octets: last octet of single block is padding 0x03, the rest is message.
+	len = aes128_cbc_encrypt(enc, (const Octet *)"sensor report", 13, iv, ekey);
+
+	static const struct {
+		const char *name;
+		int pos;
+		Octet mask;
+	} cases[] = {
+		{"padding 0", 15, 0x03},
+		{"padding 17", 15, 0x03 ^ 0x11},
+		{"padding 255", 15, 0x03 ^ 0xFF},
+		{"padding octet", 14, 0x01},
+		{"padding octet", 13, 0x80},
+	};
+
+	// Flip of IV flips the same octet of plaintext.
+	for (auto &c : cases) {
+		memcpy(bad, iv, sizeof(bad));
+		bad[c.pos] ^= c.mask;
+
+		if (aes128_cbc_decrypt(out, enc, len, bad, ekey) != -1) {
+			std::cout << "Err: accepted " << c.name << "\n";
+			return 1;
+		}
+	}
+
+	if (aes128_cbc_decrypt(out, enc, len - 1, iv, ekey) != -1 || aes128_cbc_decrypt(out, enc, 0, iv, ekey) != -1) {
+		std::cout << "Err: accepted partial block\n";
+		return 1;
+	}
+
+	if (aes128_cbc_decrypt(out, enc, len, iv, ekey) != 13 || memcmp(out, "sensor report", 13) != 0) {
+		std::cout << "Err: good padding\n";
+		return 1;
+	}
+
+	// Buffer of plaintext size: octets after it (canary) are not written, with good or bad padding.
+	memset(out, 0xC5, 32);
+
+	if (aes128_cbc_decrypt(out, enc, len, iv, ekey) != 13 || memcmp(out, "sensor report", 13) != 0) {
+		std::cout << "Err: good padding\n";
+		return 1;
+	}
+
+	// Bad padding (0x02 followed by 0x03) writes nothing.
+	memcpy(bad, iv, sizeof(bad));
+	bad[15] ^= 0x01;
+
+	if (aes128_cbc_decrypt(out + 16, enc, len, bad, ekey) != -1) {
+		std::cout << "Err: accepted padding 2\n";
+		return 1;
+	}
+
+	for (int i = 13; i < 32; i++) {
+		if (out[i] != 0xC5) {
+			std::cout << "Err: octet " << i << " written after plaintext\n";
+			return 1;
+		}
+	}
+
+	// Threads split 4 MiB into segments.
+	srand(38);
+
+	for (int i = 0; i < (int)sizeof(data); i++)
+		data[i] = (Octet)rand();
+
+	len = aes128_cbc_encrypt(enc, data, sizeof(data), iv, ekey);
+
+	for (int threads : {1, 2, 3, 8}) {
+		char name[64];
+		int M = N / 65536 + 1;
+		double startTime = now();
+
+		aes128_cbc_set_threads(threads);
+
+		for (int i = 0; i < M; i++) {
+			if (aes128_cbc_decrypt(ref, enc, len, iv, ekey) != (int)sizeof(data) || memcmp(ref, data, sizeof(data)) != 0) {
+				std::cout << "Err: decryption with " << threads << " threads\n";
+				return 1;
+			}
+		}
+
+		snprintf(name, sizeof(name), "cbc_decrypt %s %d threads (%d B)", aes_backend(), threads, len);
+		report(name, M, len, now() - startTime);
+	}
+
+	aes128_cbc_set_threads(0);
+
+	std::cout << "STOP: aes_cbc_decrypt()\n";
+
+	return 0;
+}
+
+// Many CBC streams under different keys: interleaved against one after another.
+int aes_cbc_multi(int N) {
+	const int J = 4096;
+	const int K = 64;
+	static Octet ekeys[K][AES128_EKEY_BYTES];
+	static Octet ivs[J][AES128_BLOCK_BYTES];
+	static Octet in[J][1024];
+	static Octet out[J][1024 + AES128_BLOCK_BYTES];
+	static Octet ref[J][1024 + AES128_BLOCK_BYTES];
+	static Aes128CbcJob jobs[J];
+	long total = 0;
+	int M = N / J + 1;
+	double startTime;
+	char name[64];
+
+	std::cout << "START: aes_cbc_multi() [" << aes_backend() << "]\n";
+
+	srand(39);
+
+	for (int k = 0; k < K; k++) {
+		Octet key[AES128_KEY_BYTES];
+
+		for (int i = 0; i < AES128_KEY_BYTES; i++)
+			key[i] = (Octet)rand();
+		aes128_key_expansion(ekeys[k], key);
+	}
+
+	// Downlink messages of sessions: lengths from empty to 1 KiB.
+	for (int j = 0; j < J; j++) {
+		for (int i = 0; i < AES128_BLOCK_BYTES; i++)
+			ivs[j][i] = (Octet)rand();
+		for (int i = 0; i < 1024; i++)
+			in[j][i] = (Octet)rand();
+
+		jobs[j].out = out[j];
+		jobs[j].in = in[j];
+		jobs[j].len = rand() % 1025;
+		jobs[j].iv = ivs[j];
+		jobs[j].ekey = ekeys[rand() % K];
+		total += jobs[j].len;
+	}
+
+	startTime = now();
+	for (int m = 0; m < M; m++)
+		for (int j = 0; j < J; j++)
+			aes128_cbc_encrypt(ref[j], in[j], jobs[j].len, ivs[j], jobs[j].ekey);
+	snprintf(name, sizeof(name), "cbc_encrypt %s (%d streams)", aes_backend(), J);
+	report(name, M*J, total / J, now() - startTime);
+
+	startTime = now();
+	for (int m = 0; m < M; m++)
+		aes128_cbc_encrypt_multi(jobs, J);
+	snprintf(name, sizeof(name), "cbc_encrypt_multi %s (%d streams)", aes_backend(), J);
+	report(name, M*J, total / J, now() - startTime);
+
+	for (int j = 0; j < J; j++) {
+		if (jobs[j].outLen != (jobs[j].len / 16 + 1) * 16 || memcmp(out[j], ref[j], jobs[j].outLen) != 0) {
+			std::cout << "Err: stream " << j << " of " << jobs[j].len << " octets\n";
+			return 1;
+		}
+	}
+
+	std::cout << "STOP: aes_cbc_multi()\n";
+
+	return 0;
+}
+
+// AES-128-CTR: test vector, streaming in pieces, throughput from one block to megabytes.
+int aes_ctr(int N) {
+	// NIST SP 800-38A, F.5.1 (counter carries into octet 14).
+	static const Octet key[AES128_KEY_BYTES] = {
+		0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c
+	};
+	static const Octet iv[AES128_BLOCK_BYTES] = {
+		0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff
+	};
+	static const Octet pt[64] = {
+		0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+		0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+		0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11, 0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+		0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17, 0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10
+	};
+	static const Octet ct[64] = {
+		0x87, 0x4d, 0x61, 0x91, 0xb6, 0x20, 0xe3, 0x26, 0x1b, 0xef, 0x68, 0x64, 0x99, 0x0d, 0xb6, 0xce,
+		0x98, 0x06, 0xf6, 0x6b, 0x79, 0x70, 0xfd, 0xff, 0x86, 0x17, 0x18, 0x7b, 0xb9, 0xff, 0xfd, 0xff,
+		0x5a, 0xe4, 0xdf, 0x3e, 0xdb, 0xd5, 0xd3, 0x5e, 0x5b, 0x4f, 0x09, 0x02, 0x0d, 0xb0, 0x3e, 0xab,
+		0x1e, 0x03, 0x1d, 0xda, 0x2f, 0xbe, 0x03, 0xd1, 0x79, 0x21, 0x70, 0xa0, 0xf3, 0x00, 0x9c, 0xee
+	};
+	static Octet data[1 << 22];
+	static Octet copy[1 << 22];
+	Octet ekey[AES128_EKEY_BYTES];
+	Octet buf[64];
+	Aes128Ctr ctx;
+
+	std::cout << "START: aes_ctr() [" << aes_backend() << "]\n";
+
+	aes128_key_expansion(ekey, key);
+	aes128_ctr_init(&ctx, iv);
+	aes128_ctr_xcrypt(&ctx, buf, pt, sizeof(pt), ekey);
+
+	if (memcmp(buf, ct, sizeof(ct)) != 0) {
+		std::cout << "Err: SP 800-38A test vector\n";
+		return 1;
+	}
+
+	// The same stream cut into random pieces, in place.
+	srand(37);
+
+	for (int i = 0; i < (int)sizeof(data); i++)
+		data[i] = copy[i] = (Octet)rand();
+
+	aes128_ctr_init(&ctx, iv);
+	aes128_ctr_xcrypt(&ctx, data, data, 100000, ekey);
+	aes128_ctr_init(&ctx, iv);
+
+	for (int off = 0, n; off < 100000; off += n) {
+		n = rand() % 300;
+		n = n < 100000 - off ? n : 100000 - off;
+		aes128_ctr_xcrypt(&ctx, data + off, data + off, n, ekey);
+	}
+
+	if (memcmp(data, copy, 100000) != 0) {
+		std::cout << "Err: CTR stream in pieces\n";
+		return 1;
+	}
+
+	for (int len = 16; len <= (int)sizeof(data); len *= 4) {
+		char name[64];
+		int M = (int)((double)N * AES128_BLOCK_BYTES / len) + 1;
+		double startTime = now();
+
+		for (int i = 0; i < M; i++) {
+			aes128_ctr_init(&ctx, iv);
+			aes128_ctr_xcrypt(&ctx, data, data, len, ekey);
+		}
+
+		snprintf(name, sizeof(name), "ctr_xcrypt %s (%7d B)", aes_backend(), len);
+		report(name, M, len, now() - startTime);
+	}
+
+	std::cout << "STOP: aes_ctr()\n";
+
+	return 0;
+}
+
+static int aes_gcm_hex(Octet *out, const char *hex) {
+	int n = 0;
+
+	for (; hex[0] && hex[1]; hex += 2)
+		sscanf(hex, "%2hhx", out + n++);
+
+	return n;
+}
+
+// GCM test vectors, streaming, forgery and one pass against encrypt-then-MAC.
+int aes_gcm(int N) {
+	// McGrew, Viega: The Galois/Counter Mode of Operation, test cases 1, 2, 4.
+	static const struct {
+		const char *key, *iv, *pt, *aad, *ct, *tag;
+	} vectors[] = {
+		{ "00000000000000000000000000000000", "000000000000000000000000", "", "", "",
+		  "58e2fccefa7e3061367f1d57a4e7455a" },
+		{ "00000000000000000000000000000000", "000000000000000000000000",
+		  "00000000000000000000000000000000", "", "0388dace60b6a392f328c2b971b2fe78",
+		  "ab6e47d42cec13bdf53a67b21257bddf" },
+		{ "feffe9928665731c6d6a8f9467308308", "cafebabefacedbaddecaf888",
+		  "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72"
+		  "1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39",
+		  "feedfacedeadbeeffeedfacedeadbeefabaddad2",
+		  "42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e"
+		  "21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091",
+		  "5bc94fbc3221a5db94fae95ae7121a47" }
+	};
+	static Octet data[1 << 20];
+	static Octet copy[(1 << 20) + AES128_BLOCK_BYTES];
+	Octet key[AES128_KEY_BYTES], iv[AES128_GCM_IV_BYTES];
+	Octet pt[64], aad[64], ct[64], tag[AES128_GCM_TAG_BYTES], buf[64];
+	Octet ekey[AES128_EKEY_BYTES];
+	Aes128Gcm ctx;
+
+	std::cout << "START: aes_gcm() [" << aes_backend() << (aes_clmul() ? ", pclmul" : ", 4-bit ghash") << "]\n";
+
+	for (const auto &v : vectors) {
+		int ptLen, aadLen;
+
+		aes_gcm_hex(key, v.key);
+		aes_gcm_hex(iv, v.iv);
+		ptLen = aes_gcm_hex(pt, v.pt);
+		aadLen = aes_gcm_hex(aad, v.aad);
+		aes_gcm_hex(ct, v.ct);
+		aes_gcm_hex(tag, v.tag);
+		aes128_key_expansion(ekey, key);
+
+		aes128_gcm_init(&ctx, iv, ekey);
+		aes128_gcm_aad(&ctx, aad, aadLen);
+		aes128_gcm_encrypt(&ctx, buf, pt, ptLen, ekey);
+		aes128_gcm_tag(&ctx, buf + ptLen);
+
+		if (memcmp(buf, ct, ptLen) != 0 || memcmp(buf + ptLen, tag, sizeof(tag)) != 0) {
+			std::cout << "Err: GCM test vector\n";
+			return 1;
+		}
+
+		aes128_gcm_init(&ctx, iv, ekey);
+		aes128_gcm_aad(&ctx, aad, aadLen);
+		aes128_gcm_decrypt(&ctx, buf, ct, ptLen, ekey);
+
+		if (aes128_gcm_verify(&ctx, tag, sizeof(tag)) != 0 || memcmp(buf, pt, ptLen) != 0) {
+			std::cout << "Err: GCM test vector (decrypt)\n";
+			return 1;
+		}
+	}
+
+	// The same message cut into random pieces, every changed octet detected.
+	srand(40);
+
+	for (int i = 0; i < N / 1000 + 1; i++) {
+		int aadLen = rand() % 64;
+		int len = rand() % 2000;
+		Octet tag2[AES128_GCM_TAG_BYTES];
+
+		for (int j = 0; j < len; j++)
+			copy[j] = (Octet)rand();
+		for (int j = 0; j < aadLen; j++)
+			aad[j] = (Octet)rand();
+
+		aes128_gcm_init(&ctx, iv, ekey);
+		aes128_gcm_aad(&ctx, aad, aadLen);
+		aes128_gcm_encrypt(&ctx, data, copy, len, ekey);
+		aes128_gcm_tag(&ctx, tag);
+
+		aes128_gcm_init(&ctx, iv, ekey);
+
+		for (int off = 0, n; off < aadLen; off += n) {
+			n = rand() % 20;
+			n = n < aadLen - off ? n : aadLen - off;
+			aes128_gcm_aad(&ctx, aad + off, n);
+		}
+
+		for (int off = 0, n; off < len; off += n) {
+			n = rand() % 100;
+			n = n < len - off ? n : len - off;
+			aes128_gcm_encrypt(&ctx, data + off, copy + off, n, ekey);
+		}
+
+		aes128_gcm_tag(&ctx, tag2);
+
+		if (memcmp(tag, tag2, sizeof(tag)) != 0) {
+			std::cout << "Err: GCM stream in pieces\n";
+			return 1;
+		}
+
+		if (len > 0) {
+			int pos = rand() % len;
+
+			data[pos] ^= 1 << (rand() % 8);
+			aes128_gcm_init(&ctx, iv, ekey);
+			aes128_gcm_aad(&ctx, aad, aadLen);
+			aes128_gcm_decrypt(&ctx, data, data, len, ekey);
+
+			if (aes128_gcm_verify(&ctx, tag, sizeof(tag)) == 0) {
+				std::cout << "Err: GCM forgery accepted\n";
+				return 1;
+			}
+		}
+	}
+
+	for (int len = 64; len <= (int)sizeof(data); len *= 16) {
+		char name[64];
+		int M = (int)((double)N * AES128_BLOCK_BYTES / len) + 1;
+		double startTime = now();
+
+		for (int i = 0; i < M; i++) {
+			aes128_gcm_init(&ctx, iv, ekey);
+			aes128_gcm_encrypt(&ctx, data, data, len, ekey);
+			aes128_gcm_tag(&ctx, tag);
+		}
+
+		snprintf(name, sizeof(name), "gcm_encrypt %s (%7d B)", aes_backend(), len);
+		report(name, M, len, now() - startTime);
+
+		// Two passes: CTR encryption, then CBC-MAC of ciphertext.
+		startTime = now();
+
+		for (int i = 0; i < M; i++) {
+			Aes128Ctr ctr;
+
+			memcpy(copy, iv, AES128_GCM_IV_BYTES);
+			memset(copy + AES128_GCM_IV_BYTES, 0, AES128_BLOCK_BYTES - AES128_GCM_IV_BYTES);
+			aes128_ctr_init(&ctr, copy);
+			aes128_ctr_xcrypt(&ctr, data, data, len, ekey);
+			aes128_cbc_mac(tag, data, len, ekey);
+		}
+
+		snprintf(name, sizeof(name), "ctr+cbc_mac %s (%7d B)", aes_backend(), len);
+		report(name, M, len, now() - startTime);
+	}
+
+	std::cout << "STOP: aes_gcm()\n";
+
+	return 0;
+}
+
+// Arguments of primitive benchmarks (global scratch, single thread).
+struct PrimArgs {
+	Digit a[FP_DIGITS];
+	Digit b[FP_DIGITS];
+	Digit x[FP_DIGITS];
+	Digit prod[2*FP_DIGITS];
+	Digit t[2*FP_DIGITS];
+	Digit G[3*FP_DIGITS];
+	Digit P[3*FP_DIGITS];
+	Digit Q[3*FP_DIGITS];
+	Digit R[3*FP_DIGITS];
+	Digit pub[2*FP_DIGITS];
+	Digit m[EC_GEN_ORDER_DIGITS];
+	Octet digest[FP_OCTETS];
+	EcdsaSign sign;
+	int len;
+	Octet key[AES128_KEY_BYTES];
+	Octet ekey[AES128_EKEY_BYTES];
+	Octet iv[AES128_BLOCK_BYTES];
+	Octet in[8*1024 + AES128_BLOCK_BYTES];
+	Octet out[8*1024 + AES128_BLOCK_BYTES];
+	Octet ct[1024 + AES128_BLOCK_BYTES];
+	Octet pt[1024 + AES128_BLOCK_BYTES];
+	Aes128CbcJob jobs[8];
+};
+
+static PrimArgs prim;
+
+// Microbenchmarks of arithmetic, curve, signature and AES primitives.
+int primitives(const BenchConfig *cfg) {
+	static const struct {
+		const char *name;
+		void (*fn)(void *);
+		int bytes;
+	} cases[] = {
+		{ "mul", [](void *) { mul(prim.prod, prim.a, prim.b, FP_DIGITS); }, 0 },
+		{ "secp192r1_fp_mul", [](void *) { secp192r1_fp_mul(prim.x, prim.b); }, 0 },
+		{ "secp192r1_fp_sqr", [](void *) { secp192r1_fp_sqr(prim.x); }, 0 },
+		{ "secp192r1_fp_modred", [](void *) {
+			assign(prim.t, prim.prod, 2*FP_DIGITS);
+			secp192r1_fp_modred(prim.t);
+		}, 0 },
+		{ "primeinv", [](void *) { primeinv(prim.x, prim.a, secp192r1_prime, FP_DIGITS); }, 0 },
+		{ "secp192r1_gen_order_modred", [](void *) {
+			assign(prim.t, prim.prod, 2*EC_GEN_ORDER_DIGITS);
+			secp192r1_gen_order_modred(prim.t, 2*EC_GEN_ORDER_DIGITS);
+		}, 0 },
+		{ "ecp_doubling", [](void *) { ecp_doubling(prim.P); }, 0 },
+		{ "ecp_addition (mixed)", [](void *) { ecp_addition(prim.P, prim.G, 1); }, 0 },
+		{ "ecp_addition (general)", [](void *) { ecp_addition(prim.P, prim.Q, 1); }, 0 },
+		{ "ecp_multiple", [](void *) {
+			assign(prim.R, prim.pub, 2*FP_DIGITS);
+			ecp_multiple(prim.R, prim.m);
+		}, 0 },
+		{ "ecp_scalar_product", [](void *) { ecp_scalar_product(prim.R, prim.m, prim.pub, prim.a); }, 0 },
+		{ "ecc_ecdsa_sign", [](void *) { ecc_ecdsa_sign(&prim.sign, prim.digest, FP_OCTETS, prvSrv); }, 0 },
+		{ "ecc_ecdsa_verify", [](void *) { ecc_ecdsa_verify(&prim.sign, prim.digest, FP_OCTETS, prim.pub); }, 0 },
+		{ "aes128_key_expansion", [](void *) { aes128_key_expansion(prim.ekey, prim.key); }, 0 },
+		{ "aes128_encrypt", [](void *) { aes128_encrypt(prim.out, prim.out, prim.ekey); }, AES128_BLOCK_BYTES },
+		{ "aes128_decrypt", [](void *) { aes128_decrypt(prim.out, prim.out, prim.ekey); }, AES128_BLOCK_BYTES },
+		{ "aes128_encrypt_blocks", [](void *) {
+			aes128_encrypt_blocks(prim.out, prim.in, prim.len / AES128_BLOCK_BYTES, prim.ekey);
+		}, -1 },
+		{ "aes128_decrypt_blocks", [](void *) {
+			aes128_decrypt_blocks(prim.out, prim.in, prim.len / AES128_BLOCK_BYTES, prim.ekey);
+		}, -1 },
+		{ "aes128_cbc_encrypt", [](void *) { aes128_cbc_encrypt(prim.out, prim.in, prim.len, prim.iv, prim.ekey); }, -1 },
+		{ "aes128_cbc_decrypt", [](void *) {
+			aes128_cbc_decrypt(prim.pt, prim.ct, prim.len + AES128_BLOCK_BYTES, prim.iv, prim.ekey);
+		}, -1 },
+		{ "aes128_cbc_mac", [](void *) { aes128_cbc_mac(prim.out, prim.in, prim.len, prim.ekey); }, -1 },
+		{ "aes128_cbc_encrypt_multi (8)", [](void *) { aes128_cbc_encrypt_multi(prim.jobs, 8); }, -8 },
+		{ "aes128_ctr_xcrypt", [](void *) {
+			Aes128Ctr ctx;
+
+			aes128_ctr_init(&ctx, prim.iv);
+			aes128_ctr_xcrypt(&ctx, prim.out, prim.in, prim.len, prim.ekey);
+		}, -1 },
+		{ "aes128_gcm_encrypt", [](void *) {
+			Aes128Gcm ctx;
+
+			aes128_gcm_init(&ctx, prim.iv, prim.ekey);
+			aes128_gcm_encrypt(&ctx, prim.out, prim.in, prim.len, prim.ekey);
+			aes128_gcm_tag(&ctx, prim.out + prim.len);
+		}, -1 }
+	};
+	const int count = sizeof(cases) / sizeof(cases[0]);
+	static BenchResult res[sizeof(cases) / sizeof(cases[0])];
+
+	if (cfg->format == BENCH_TEXT)
+		std::cout << "START: primitives() [" << aes_backend() << ", 1024 B AES messages]" << std::endl;
+
+	if (cfg->cpu >= 0 && bench_pin(cfg->cpu) != 0)
+		std::cerr << "Warn: cannot pin to CPU " << cfg->cpu << "\n";
+
+	if (cfg->perf) {
+		PerfCounters pc;
+
+		perf_open(&pc);
+		perf_warn(stderr, &pc);
+		perf_close(&pc);
+	}
+
+	srand(42);
+
+	for (int i = 0; i < FP_DIGITS; i++) {
+		prim.a[i] = prvSrv[i] >> 1;
+		prim.b[i] = pubMu[i];
+		prim.x[i] = pubMu[FP_DIGITS + i];
+	}
+
+	for (int i = 0; i < EC_GEN_ORDER_DIGITS; i++)
+		prim.m[i] = prvSrv[i];
+
+	for (int i = 0; i < FP_OCTETS; i++)
+		prim.digest[i] = (Octet)rand();
+
+	mul(prim.prod, prim.a, prim.b, FP_DIGITS);
+
+	// Public key of prvSrv, P = G, Q = [2]G with Z != 1.
+	assign(prim.pub, EC_GEN, 2*FP_DIGITS);
+	ecp_multiple(prim.pub, prvSrv);
+	assign(prim.G, EC_GEN, 2*FP_DIGITS);
+	assign_digit(prim.G + 2*FP_DIGITS, 1, FP_DIGITS);
+	assign(prim.Q, prim.G, 3*FP_DIGITS);
+	ecp_doubling(prim.Q);
+	ecc_ecdsa_sign(&prim.sign, prim.digest, FP_OCTETS, prvSrv);
+
+	if (ecc_ecdsa_verify(&prim.sign, prim.digest, FP_OCTETS, prim.pub) != 0) {
+		std::cout << "Err: ECDSA signature of benchmark\n";
+		return 1;
+	}
+
+	for (int i = 0; i < AES128_KEY_BYTES; i++) {
+		prim.key[i] = (Octet)rand();
+		prim.iv[i] = (Octet)rand();
+	}
+
+	for (int i = 0; i < (int)sizeof(prim.in); i++)
+		prim.in[i] = (Octet)rand();
+
+	aes128_key_expansion(prim.ekey, prim.key);
+	prim.len = 1024;
+	aes128_cbc_encrypt(prim.ct, prim.in, prim.len, prim.iv, prim.ekey);
+
+	for (int i = 0; i < 8; i++) {
+		prim.jobs[i].out = prim.out + i*prim.len;
+		prim.jobs[i].in = prim.in + i*prim.len;
+		prim.jobs[i].len = prim.len - AES128_BLOCK_BYTES;
+		prim.jobs[i].iv = prim.iv;
+		prim.jobs[i].ekey = prim.ekey;
+	}
+
+	for (int i = 0; i < count; i++) {
+		long bytes = cases[i].bytes < 0 ? -cases[i].bytes*(long)prim.len : cases[i].bytes;
+
+		// Multi-stream jobs are one block shorter (room for padding).
+		if (cases[i].bytes == -8)
+			bytes = 8L*prim.jobs[0].len;
+
+		// Every case starts from the same point P = [2]G (calls may leave infinity).
+		assign(prim.P, prim.Q, 3*FP_DIGITS);
+		bench_run(&res[i], cfg, cases[i].name, cases[i].fn, 0, bytes);
+	}
+
+	std::cout.flush();
+	bench_print(stdout, cfg, res, count);
+	fflush(stdout);
+
+	if (cfg->format == BENCH_TEXT)
+		std::cout << "STOP: primitives()\n";
+
+	return 0;
+}
+
+// Static RAM, peak stack and time of curve and AES operations of build profile.
+int profile_report(const BenchConfig *cfg) {
+	static const struct {
+		const char *name;
+		void (*fn)(void *);
+	} cases[] = {
+		{ "ecp_multiple", [](void *) {
+			assign(prim.R, prim.pub, 2*FP_DIGITS);
+			ecp_multiple(prim.R, prim.m);
+		} },
+		{ "ecp_generator_multiple", [](void *) { ecp_generator_multiple(prim.R, prim.m); } },
+		{ "ecc_ecdsa_sign", [](void *) { ecc_ecdsa_sign(&prim.sign, prim.digest, FP_OCTETS, prvSrv); } },
+		{ "ecc_ecdsa_verify", [](void *) { ecc_ecdsa_verify(&prim.sign, prim.digest, FP_OCTETS, prim.pub); } },
+		{ "aes128_key_expansion", [](void *) { aes128_key_expansion(prim.ekey, prim.key); } },
+		{ "aes128_encrypt", [](void *) { aes128_encrypt(prim.out, prim.in, prim.ekey); } }
+	};
+	const int count = sizeof(cases) / sizeof(cases[0]);
+	const long comb = (long)ECC_COMB_POINTS*2*FP_DIGITS*sizeof(Digit);
+	BenchResult res;
+
+	std::cout << "START: profile_report() [" << ECC_PROFILE_NAME << ": wNAF " << ECC_WNAF_WIDTH << ", comb "
+		<< ECC_COMB_TEETH << " teeth, batch " << ECC_BATCH_MAX << ", " << aes_backend() << "]" << std::endl;
+
+	if (cfg->cpu >= 0 && bench_pin(cfg->cpu) != 0)
+		std::cerr << "Warn: cannot pin to CPU " << cfg->cpu << "\n";
+
+	srand(42);
+
+	assign(prim.pub, EC_GEN, 2*FP_DIGITS);
+	ecp_multiple(prim.pub, prvSrv);
+
+	for (int i = 0; i < EC_GEN_ORDER_DIGITS; i++)
+		prim.m[i] = prvSrv[i];
+
+	for (int i = 0; i < FP_OCTETS; i++)
+		prim.digest[i] = (Octet)rand();
+
+	for (int i = 0; i < AES128_KEY_BYTES; i++)
+		prim.key[i] = (Octet)rand();
+
+	ecc_ecdsa_sign(&prim.sign, prim.digest, FP_OCTETS, prvSrv);
+	aes128_key_expansion(prim.ekey, prim.key);
+
+	printf("ROM  comb table %6ld B (const)\n", comb);
+	printf("RAM  arth_tmp %ld B, ecc_tmp %ld B, ecc_batch_tmp %ld B, AES key %d B\n", (long)sizeof(arth_tmp),
+		(long)sizeof(ecc_tmp), (long)sizeof(ecc_batch_tmp), AES128_EKEY_BYTES);
+	printf("RAM  total      %6ld B\n", (long)(sizeof(arth_tmp) + sizeof(ecc_tmp) + sizeof(ecc_batch_tmp))
+		+ AES128_EKEY_BYTES);
+
+	for (int i = 0; i < count; i++) {
+		long stack = 0;
+
+		if (mem_stack_peak(&stack, cases[i].fn, 0) != 0) {
+			std::cout << "Err: stack of " << cases[i].name << "\n";
+			return 1;
+		}
+
+		bench_run(&res, cfg, cases[i].name, cases[i].fn, 0, 0);
+		printf("%-24s stack %6ld B  time %12.3f us\n", cases[i].name, stack, res.ns/1e3);
+	}
+
+	if (ecc_ecdsa_verify(&prim.sign, prim.digest, FP_OCTETS, prim.pub) != 0) {
+		std::cout << "Err: ECDSA signature of profile\n";
+		return 1;
+	}
+
+	std::cout << "STOP: profile_report()\n";
+
+	return 0;
+}
+
+// Whole decimal number from min to max, 0 if valid.
+int arg_int(int *dst, const char *arg, int min, long max = 1000000000L) {
+	char *end;
+	long v = strtol(arg, &end, 10);
+
+	if (end == arg || *end != 0 || v < min || v > max)
+		return 1;
+
+	*dst = (int)v;
+
+	return 0;
+}
+
+int usage() {
+	std::cerr << "usage: ./bench [N]                  wire and AES benchmarks, N > 0 iterations\n"
+		"       ./bench -p [-f text|csv|json] [-c cpu] [-s samples] [-e]\n"
+		"       ./bench -r [-c cpu] [-s samples]\n"
+		"       cpu -1 - no pinning, samples 1 to " << BENCH_SAMPLES_MAX << "\n";
+
+	return 1;
+}
+
+int main(int argc, char *argv[]) {
+	BenchConfig cfg;
+	int N = 1000000;
+	int prims = 0;
+	int report = 0;
+
+	bench_default(&cfg);
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-p") == 0) {
+			prims = 1;
+		} else if (strcmp(argv[i], "-r") == 0) {
+			report = 1;
+		} else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+			i++;
+
+			if (strcmp(argv[i], "json") == 0)
+				cfg.format = BENCH_JSON;
+			else if (strcmp(argv[i], "csv") == 0)
+				cfg.format = BENCH_CSV;
+			else if (strcmp(argv[i], "text") == 0)
+				cfg.format = BENCH_TEXT;
+			else
+				return usage();
+		} else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+			if (arg_int(&cfg.cpu, argv[++i], -1))
+				return usage();
+		} else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+			if (arg_int(&cfg.samples, argv[++i], 1, BENCH_SAMPLES_MAX))
+				return usage();
+		} else if (strcmp(argv[i], "-e") == 0) {
+			cfg.perf = 1;
+		} else if (arg_int(&N, argv[i], 1)) {
+			return usage();
+		}
+	}
+
+	// Primitive microbenchmarks only: bench -p [-f text|csv|json] [-c cpu] [-s samples] [-e].
+	if (prims)
+		return primitives(&cfg);
+
+	// Memory and time of build profile (STAKE_PROFILE): bench -r [-c cpu] [-s samples].
+	if (report)
+		return profile_report(&cfg);
+
+	if (wire_throughput(N))
+		return 1;
+	if (wire_fuzz(N))
+		return 1;
+	if (aes_speed(N))
+		return 1;
+	if (aes_ctr(N))
+		return 1;
+	if (aes_gcm(N))
+		return 1;
+	if (aes_cbc_decrypt(N))
+		return 1;
+	if (aes_cbc_multi(N))
+		return 1;
+
+	return 0;
+}
@@ -0,0 +1,259 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "crypto.h"
+
+// Static SERVER key pair generated by the keygen program.
+Digit prvSrv[FP_DIGITS] = {
+	ARTH_WORD_DIGITS(0x2454fba4), ARTH_WORD_DIGITS(0x8da7f60f), ARTH_WORD_DIGITS(0x3373886b), ARTH_WORD_DIGITS(0xaf7eabb7),
+	ARTH_WORD_DIGITS(0x72d6f1b9), ARTH_WORD_DIGITS(0x22674a67)
+};
+
+Digit pubSrv[2*FP_DIGITS] = {
+	ARTH_WORD_DIGITS(0xd388264f), ARTH_WORD_DIGITS(0x3940a178), ARTH_WORD_DIGITS(0x10710de9), ARTH_WORD_DIGITS(0xb87bbf09),
+	ARTH_WORD_DIGITS(0x1b7543dd), ARTH_WORD_DIGITS(0xd6b941e1), ARTH_WORD_DIGITS(0xc3a727d3), ARTH_WORD_DIGITS(0x37aa763e),
+	ARTH_WORD_DIGITS(0x4a33547c), ARTH_WORD_DIGITS(0xfbbe8072), ARTH_WORD_DIGITS(0xe5390cd1), ARTH_WORD_DIGITS(0x9398e3d4)
+};
+
+// Static MICROCONTROLLER (SENSOR) key pair generated by the keygen program.
+Digit prvMu[FP_DIGITS] = {
+	ARTH_WORD_DIGITS(0x16b1c8fd), ARTH_WORD_DIGITS(0x0f7eeb08), ARTH_WORD_DIGITS(0x46a846f0), ARTH_WORD_DIGITS(0x32593b27),
+	ARTH_WORD_DIGITS(0x059e4b50), ARTH_WORD_DIGITS(0x6bb0570f)
+};
+
+Digit pubMu[2*FP_DIGITS] = {
+	ARTH_WORD_DIGITS(0xa2f1b4e6), ARTH_WORD_DIGITS(0xa3d59896), ARTH_WORD_DIGITS(0x555b859e), ARTH_WORD_DIGITS(0x0eb8e223),
+	ARTH_WORD_DIGITS(0x77a021d3), ARTH_WORD_DIGITS(0x86883364), ARTH_WORD_DIGITS(0x2c151e28), ARTH_WORD_DIGITS(0xcfd3f377),
+	ARTH_WORD_DIGITS(0xb7795ebf), ARTH_WORD_DIGITS(0xd59ad5c5), ARTH_WORD_DIGITS(0x9c0915a0), ARTH_WORD_DIGITS(0x1eaee60a)
+};
+
+// Cookie key shared by all server nodes.
+Octet cookieKey[AES128_KEY_BYTES] = {
+	0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c
+};
+
+enum {
+	MSG_HELLO = 1,  // sensor -> server: start of handshake
+	MSG_Q1 = 2,     // server -> sensor: Q1 of server and cookie
+	MSG_Q1Q2 = 3,   // sensor -> server: Q1 and Q2 of sensor, cookie
+	MSG_Q2 = 4,     // server -> sensor: Q2 of server
+	MSG_QUIT = 5
+};
+
+struct Message {
+	int type;
+	int err;
+	// Lifetime of cookie in seconds (HELLO).
+	long ttl;
+	Digit P1[2*FP_DIGITS];
+	Digit P2[2*FP_DIGITS];
+	Octet cookie[COOKIE_BYTES];
+	// Session key of server, sent only to check the demo.
+	Octet key[16];
+};
+
+struct Node {
+	pid_t pid;
+	int fd;
+};
+
+// Server node: it keeps no state between messages.
+void node(int fd) {
+	StakeCookieKey ck;
+	ProtocolIoTStake ctx;
+	Message msg;
+	clock_t startTime;
+	clock_t cpuTime = 0;
+
+	srand(getpid() ^ time(0));
+	iotstake_cookie_key(&ck, cookieKey);
+
+	while (read(fd, &msg, sizeof(msg)) == sizeof(msg)) {
+		startTime = clock();
+
+		if (msg.type == MSG_HELLO) {
+			// [1 SRV] Determination of Q1 of server, state goes to cookie.
+			ecc_iotstake_init(&ctx, prvSrv, pubMu, 0);
+			msg.err = ecc_iotstake_q1(&ctx, msg.P1);
+
+			if (!msg.err)
+				msg.err = iotstake_cookie_seal(&ctx, msg.cookie, time(0) + msg.ttl, &ck, 0);
+
+			memset(&ctx, 0, sizeof(ctx));
+			msg.type = MSG_Q1;
+		} else if (msg.type == MSG_Q1Q2) {
+			// [2 SRV] State from cookie, determination of Q2 of sensor and Q3 of server.
+			msg.err = iotstake_cookie_open(&ctx, msg.cookie, time(0), prvSrv, &ck);
+
+			if (!msg.err)
+				msg.err = ecc_iotstake_q2(&ctx, msg.P1, msg.P1);
+			if (!msg.err)
+				msg.err = ecc_iotstake_q3(&ctx, msg.P2);
+			if (!msg.err)
+				ecc_iotstake_hash(&ctx, msg.key);
+
+			memset(&ctx, 0, sizeof(ctx));
+			msg.type = MSG_Q2;
+		} else {
+			break;
+		}
+
+		cpuTime += clock() - startTime;
+
+		if (write(fd, &msg, sizeof(msg)) != sizeof(msg))
+			break;
+	}
+
+	std::cout << "node " << getpid() << ": " << ((double)cpuTime/CLOCKS_PER_SEC) << "s CPU\n";
+}
+
+// Listener passes every message to the chosen node and returns answer.
+int request(Node &n, Message &msg) {
+	if (write(n.fd, &msg, sizeof(msg)) != sizeof(msg))
+		return 1;
+	if (read(n.fd, &msg, sizeof(msg)) != sizeof(msg))
+		return 1;
+
+	return 0;
+}
+
+// Sensor side of single handshake. The second round goes to other node.
+int handshake(std::vector<Node> &nodes, int first, int second, long ttl, int tamper) {
+	ProtocolIoTStake ctxMu;
+	Message msg;
+	Digit q1Srv[2*FP_DIGITS];
+	Octet key[16];
+	int err;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.type = MSG_HELLO;
+	msg.ttl = ttl;
+
+	if (request(nodes[first], msg) || msg.type != MSG_Q1)
+		return -1;
+	if (msg.err)
+		return msg.err;
+
+	// [1 MU] Protocol initialization, determination of Q1 of sensor and Q2 of server.
+	assign(q1Srv, msg.P1, 2*FP_DIGITS);
+	ecc_iotstake_init(&ctxMu, prvMu, pubSrv, 0);
+
+	if ((err = ecc_iotstake_q1(&ctxMu, msg.P1)) != 0)
+		return err;
+	if ((err = ecc_iotstake_q2(&ctxMu, q1Srv, msg.P2)) != 0)
+		return err;
+
+	if (tamper)
+		msg.cookie[COOKIE_BYTES / 2] ^= 0x01;
+
+	msg.type = MSG_Q1Q2;
+
+	if (request(nodes[second], msg) || msg.type != MSG_Q2)
+		return -1;
+	if (msg.err)
+		return msg.err;
+
+	// [2 MU] Determination of Q3 of sensor and the hash.
+	if ((err = ecc_iotstake_q3(&ctxMu, msg.P1)) != 0)
+		return err;
+
+	ecc_iotstake_hash(&ctxMu, key);
+
+	if (memcmp(key, msg.key, sizeof(key)) != 0)
+		return -2;
+
+	return 0;
+}
+
+// Monotonic time in milliseconds.
+double now_ms() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec*1e3 + ts.tv_nsec*1e-6;
+}
+
+int main(int argc, char *argv[]) {
+	int N = 100;
+	int W = 4;
+	int err;
+
+	if (argc > 1)
+		N = atoi(argv[1]);
+	if (argc > 2)
+		W = atoi(argv[2]);
+	if (W < 2)
+		W = 2;
+
+	std::cout << "START: iotstake_cookie()" << std::endl;
+
+	std::vector<Node> nodes(W);
+
+	for (int i = 0; i < W; i++) {
+		int fd[2];
+
+		if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fd) != 0) {
+			std::cout << "socketpair failed\n";
+			return 1;
+		}
+
+		nodes[i].pid = fork();
+
+		if (nodes[i].pid == 0) {
+			close(fd[0]);
+			node(fd[1]);
+			std::cout.flush();
+			_exit(0);
+		}
+
+		close(fd[1]);
+		nodes[i].fd = fd[0];
+	}
+
+	clock_t startTime = clock();
+	double wallStart = now_ms();
+
+	for (int k = 0; k < N; k++) {
+		if ((err = handshake(nodes, k % W, (k + 1) % W, 30, 0)) != 0) {
+			std::cout << "Err handshake " << k << ": " << err << "\n";
+			return 1;
+		}
+	}
+
+	double wall = now_ms() - wallStart;
+
+	std::cout << "[" << N << " handshakes, " << W << " nodes] OK, sensor CPU: ";
+	std::cout << ((double)(clock() - startTime)/(N*CLOCKS_PER_SEC)) << "s per handshake, wall: ";
+	std::cout << wall << "ms (" << (wall > 0 ? 1000.0*N/wall : 0) << " handshakes/s)\n";
+
+	// Modified cookie is rejected, expired cookie too.
+	err = handshake(nodes, 0, 1, 30, 1);
+	std::cout << "modified cookie: " << (err == 1 ? "rejected" : "ACCEPTED") << "\n";
+	err = handshake(nodes, 0, 1, -1, 0);
+	std::cout << "expired cookie: " << (err == 2 ? "rejected" : "ACCEPTED") << std::endl;
+
+	for (int i = 0; i < W; i++) {
+		Message msg;
+
+		memset(&msg, 0, sizeof(msg));
+		msg.type = MSG_QUIT;
+
+		if (write(nodes[i].fd, &msg, sizeof(msg)) != sizeof(msg))
+			std::cout << "node " << nodes[i].pid << " lost\n";
+
+		waitpid(nodes[i].pid, 0, 0);
+		close(nodes[i].fd);
+	}
+
+	std::cout << "STOP: iotstake_cookie()\n";
+
+	return 0;
+}
@@ -0,0 +1,201 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+
+#include "cost.h"
+
+// Operations of single step of one side, read from tables of stake and pki.
+typedef struct OpRow_st {
+	char proto[8];
+	char side[8];
+	char step[8];
+	unsigned long n[OP_KINDS];
+} OpRow;
+
+OpRow rows[COST_ROWS_MAX];
+int nrows = 0;
+
+// Reads tables printed by stake and pki built with OPCOUNT=1 ("START:
+// iotstake_ops()", header "step side fp_mul ...", rows, total rows).
+int read_ops(FILE *in) {
+	char line[1024];
+	char proto[8] = "";
+	int column[OP_KINDS + 2];
+	int columns = 0;
+
+	while (fgets(line, sizeof(line), in)) {
+		char *tok[OP_KINDS + 2];
+		int n = 0;
+
+		if (strncmp(line, "START: iotstake_ops()", 21) == 0)
+			strcpy(proto, "stake");
+		else if (strncmp(line, "START: iotpki_ops()", 19) == 0)
+			strcpy(proto, "pki");
+
+		for (char *t = strtok(line, " \t\r\n"); t && n < OP_KINDS + 2; t = strtok(0, " \t\r\n"))
+			tok[n++] = t;
+
+		if (n >= 2 && strcmp(tok[0], "step") == 0 && strcmp(tok[1], "side") == 0) {
+			// Header: operation kind of every column (-1 unknown).
+			columns = n;
+
+			for (int c = 2; c < n; c++) {
+				column[c] = -1;
+
+				for (int k = 0; k < OP_KINDS; k++) {
+					if (strcmp(tok[c], op_names[k]) == 0)
+						column[c] = k;
+				}
+			}
+
+			continue;
+		}
+
+		if (columns == 0 || n != columns || strcmp(tok[0], "total") == 0)
+			continue;
+
+		if (nrows == COST_ROWS_MAX || strlen(tok[0]) >= 8 || strlen(tok[1]) >= 8) {
+			std::cerr << "Err: too many steps\n";
+			return 1;
+		}
+
+		OpRow *row = &rows[nrows++];
+
+		memset(row, 0, sizeof(*row));
+		strcpy(row->proto, proto);
+		strcpy(row->side, tok[1]);
+		strcpy(row->step, tok[0]);
+
+		for (int c = 2; c < n; c++) {
+			if (column[c] >= 0)
+				row->n[column[c]] = strtoul(tok[c], 0, 10);
+		}
+	}
+
+	return 0;
+}
+
+// Predicted cycles, time and energy of every step and of both sides.
+void predict(const CostProfile *prof) {
+	printf("profile %s: %g MHz, %g nJ/cycle\n", prof->name, prof->mhz, prof->njPerCycle);
+	printf("%-6s %-4s %-6s %14s %12s %10s\n", "proto", "side", "step", "cycles", "ms", "mJ");
+
+	for (int i = 0; i < nrows; i++) {
+		double cycles = cost_cycles(prof, rows[i].n);
+
+		printf("%-6s %-4s %-6s %14.0f %12.3f %10.4f\n", rows[i].proto, rows[i].side, rows[i].step, cycles,
+			cost_ms(prof, cycles), cost_mj(prof, cycles));
+
+		// Total after last step of side.
+		if (i + 1 == nrows || strcmp(rows[i + 1].side, rows[i].side) != 0
+				|| strcmp(rows[i + 1].proto, rows[i].proto) != 0) {
+			double total = 0;
+
+			for (int j = 0; j <= i; j++) {
+				if (strcmp(rows[j].side, rows[i].side) == 0 && strcmp(rows[j].proto, rows[i].proto) == 0)
+					total += cost_cycles(prof, rows[j].n);
+			}
+
+			printf("%-6s %-4s %-6s %14.0f %12.3f %10.4f\n", rows[i].proto, rows[i].side, "total", total,
+				cost_ms(prof, total), cost_mj(prof, total));
+		}
+	}
+}
+
+// Fits profile to measured cycles ("proto side step cycles" lines), writes
+// fitted profile to standard output.
+int calibrate(CostProfile *prof, const char *path) {
+	static unsigned long ops[COST_ROWS_MAX][OP_KINDS];
+	double cycles[COST_ROWS_MAX];
+	char line[256];
+	double rms;
+	int m = 0;
+	FILE *in = fopen(path, "r");
+
+	if (in == 0) {
+		std::cerr << "Err: cannot open " << path << "\n";
+		return 1;
+	}
+
+	while (fgets(line, sizeof(line), in)) {
+		char proto[8], side[8], step[8];
+		double c;
+		int i;
+
+		if (line[0] == '#' || sscanf(line, "%7s %7s %7s %lf", proto, side, step, &c) != 4)
+			continue;
+
+		for (i = 0; i < nrows; i++) {
+			if (strcmp(rows[i].proto, proto) == 0 && strcmp(rows[i].side, side) == 0
+					&& strcmp(rows[i].step, step) == 0)
+				break;
+		}
+
+		if (i == nrows || c <= 0 || m == COST_ROWS_MAX) {
+			std::cerr << "Err: no operations of " << proto << " " << side << " " << step << "\n";
+			fclose(in);
+			return 1;
+		}
+
+		memcpy(ops[m], rows[i].n, sizeof(ops[m]));
+		cycles[m++] = c;
+	}
+
+	fclose(in);
+
+	if (cost_fit(prof, ops, cycles, m, &rms) != 0) {
+		std::cerr << "Err: " << m << " measurements do not determine fitted kinds\n";
+		return 1;
+	}
+
+	printf("# fitted to %d measurements of %s, rms relative error %.4f\n", m, path, rms);
+	cost_save(stdout, prof);
+
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+	const char *meas = 0;
+	int profiles = 0;
+
+	// Operation tables on standard input: (./stake; ./pki) | ./cost [-c measurements] profile...
+	if (read_ops(stdin))
+		return 1;
+
+	if (nrows == 0) {
+		std::cerr << "Err: no operation tables on input (build stake and pki with OPCOUNT=1)\n";
+		return 1;
+	}
+
+	for (int i = 1; i < argc; i++) {
+		CostProfile prof;
+		int err;
+
+		if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+			meas = argv[++i];
+			continue;
+		}
+
+		if ((err = cost_load(&prof, argv[i])) != 0) {
+			if (err < 0)
+				std::cerr << "Err: cannot open " << argv[i] << "\n";
+			else
+				std::cerr << "Err: " << argv[i] << ":" << err << ": invalid line\n";
+			return 1;
+		}
+
+		if (profiles++)
+			printf("\n");
+
+		if (meas ? calibrate(&prof, meas) : (predict(&prof), 0))
+			return 1;
+	}
+
+	if (profiles == 0) {
+		std::cerr << "usage: ./cost [-c measurements] profile...\n";
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,134 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstdio>
+
+#include "crypto.h"
+
+// Largest comb (ECC_COMB_TEETH is at most 10).
+#define GEN_TEETH_MAX 10
+#define GEN_POINTS_MAX ((1 << GEN_TEETH_MAX) - 1)
+
+// Comb of generator: comb[i - 1] = sum of [2^(j*columns)]G for bits j of i.
+Digit comb[GEN_POINTS_MAX][2*FP_DIGITS];
+
+// Affine points of comb, ECC_BATCH_MAX points per inversion.
+void comb_build(int teeth, int columns) {
+	static Digit chunk[ECC_BATCH_MAX*3*FP_DIGITS];
+	const int points = (1 << teeth) - 1;
+	Digit Q[3*FP_DIGITS];
+	Digit *Ti;
+
+	// Single teeth [2^(j*columns)]G.
+	FP_ASSIGN(X(Q), X(EC_GEN));
+	FP_ASSIGN(Y(Q), Y(EC_GEN));
+	FP_ASSIGN_ONE(Z(Q));
+
+	for (int j = 0; j < teeth; j++) {
+		if (j > 0) {
+			for (int i = 0; i < columns; i++)
+				ecp_doubling(Q);
+
+			ecp_pro2aff(Q);
+		}
+
+		assign(comb[(1 << j) - 1], Q, 2*FP_DIGITS);
+	}
+
+	// Other sums in ascending order, every one is earlier sum plus its lowest tooth.
+	FP_ASSIGN_ONE(Z(Q));
+
+	for (int start = 1, n; start <= points; start += n) {
+		n = points - start + 1 < ECC_BATCH_MAX ? points - start + 1 : ECC_BATCH_MAX;
+
+		for (int i = start; i < start + n; i++) {
+			int low = i & -i;
+
+			Ti = chunk + 3*FP_DIGITS*(i - start);
+
+			if (i - low >= start) {
+				assign(Ti, chunk + 3*FP_DIGITS*(i - low - start), 3*FP_DIGITS);
+			} else {
+				assign(Ti, comb[(i == low ? i : i - low) - 1], 2*FP_DIGITS);
+				FP_ASSIGN_ONE(Z(Ti));
+			}
+
+			if (i != low) {
+				assign(Q, comb[low - 1], 2*FP_DIGITS);
+				ecp_addition(Ti, Q, 1);
+			}
+		}
+
+		ecp_pro2aff_batch(chunk, n);
+
+		for (int i = start; i < start + n; i++)
+			assign(comb[i - 1], chunk + 3*FP_DIGITS*(i - start), 2*FP_DIGITS);
+	}
+}
+
+// Every point of comb against multiple of generator by its scalar.
+int comb_check(int teeth, int columns) {
+	Digit m[EC_GEN_ORDER_DIGITS];
+	Digit P[2*FP_DIGITS];
+
+	for (int i = 1; i < (1 << teeth); i++) {
+		assign_digit(m, 0, EC_GEN_ORDER_DIGITS);
+
+		for (int j = 0; j < teeth; j++) {
+			if ((i >> j) & 1)
+				ARTH_SET_BIT(m, j*columns);
+		}
+
+		assign(P, EC_GEN, 2*FP_DIGITS);
+		ecp_multiple(P, m);
+
+		if (cmp(P, comb[i - 1], 2*FP_DIGITS) != 0) {
+			std::cerr << "Err: point " << i << " of comb\n";
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+// Generates source of constant comb table: ./gencomb [teeth] > secp192r1_comb.cpp
+int main(int argc, char *argv[]) {
+	int teeth = argc > 1 ? atoi(argv[1]) : ECC_COMB_TEETH;
+	int columns;
+
+	if (teeth < 0 || teeth > GEN_TEETH_MAX) {
+		std::cerr << "usage: ./gencomb [teeth 0 to " << GEN_TEETH_MAX << "]\n";
+		return 1;
+	}
+
+	printf("/* Generated by gencomb (make secp192r1_comb.cpp), do not edit. */\n");
+	printf("#include \"crypto.h\"\n\n");
+	printf("#if ECC_COMB_TEETH != %d\n", teeth);
+	printf("#\terror \"secp192r1_comb.cpp is generated for %d teeth (make clean)\"\n", teeth);
+	printf("#endif\n");
+
+	if (teeth == 0)
+		return 0;
+
+	columns = (EC_GEN_ORDER_BITS + teeth - 1) / teeth;
+	comb_build(teeth, columns);
+
+	if (comb_check(teeth, columns))
+		return 1;
+
+	// 32-bit words, so the table does not depend on DIGIT_BITS.
+	printf("\nconst Digit secp192r1_comb[ECC_COMB_POINTS][2*FP_DIGITS] = {\n");
+
+	for (int i = 0; i < (1 << teeth) - 1; i++) {
+		printf("\t{");
+
+		for (int w = 0; w < 2*FP_BITS/WORD_BITS; w++)
+			printf("%sARTH_WORD_DIGITS(0x%08x)", w == 0 ? "\n\t\t" : (w % 4 ? ", " : ",\n\t\t"),
+				(unsigned)ARTH_GET_WORD(comb[i], w));
+
+		printf("\n\t}%s\n", i < (1 << teeth) - 2 ? "," : "");
+	}
+
+	printf("};\n");
+
+	return 0;
+}
@@ -0,0 +1,799 @@
+#include <iostream>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "crypto.h"
+#include "wire.h"
+
+// Static SERVER key pair generated by the keygen program.
+Digit prvSrv[FP_DIGITS] = {
+	ARTH_WORD_DIGITS(0x2454fba4), ARTH_WORD_DIGITS(0x8da7f60f), ARTH_WORD_DIGITS(0x3373886b), ARTH_WORD_DIGITS(0xaf7eabb7),
+	ARTH_WORD_DIGITS(0x72d6f1b9), ARTH_WORD_DIGITS(0x22674a67)
+};
+
+Digit pubSrv[2*FP_DIGITS] = {
+	ARTH_WORD_DIGITS(0xd388264f), ARTH_WORD_DIGITS(0x3940a178), ARTH_WORD_DIGITS(0x10710de9), ARTH_WORD_DIGITS(0xb87bbf09),
+	ARTH_WORD_DIGITS(0x1b7543dd), ARTH_WORD_DIGITS(0xd6b941e1), ARTH_WORD_DIGITS(0xc3a727d3), ARTH_WORD_DIGITS(0x37aa763e),
+	ARTH_WORD_DIGITS(0x4a33547c), ARTH_WORD_DIGITS(0xfbbe8072), ARTH_WORD_DIGITS(0xe5390cd1), ARTH_WORD_DIGITS(0x9398e3d4)
+};
+
+// Static MICROCONTROLLER (SENSOR) key pair generated by the keygen program.
+Digit prvMu[FP_DIGITS] = {
+	ARTH_WORD_DIGITS(0x16b1c8fd), ARTH_WORD_DIGITS(0x0f7eeb08), ARTH_WORD_DIGITS(0x46a846f0), ARTH_WORD_DIGITS(0x32593b27),
+	ARTH_WORD_DIGITS(0x059e4b50), ARTH_WORD_DIGITS(0x6bb0570f)
+};
+
+Digit pubMu[2*FP_DIGITS] = {
+	ARTH_WORD_DIGITS(0xa2f1b4e6), ARTH_WORD_DIGITS(0xa3d59896), ARTH_WORD_DIGITS(0x555b859e), ARTH_WORD_DIGITS(0x0eb8e223),
+	ARTH_WORD_DIGITS(0x77a021d3), ARTH_WORD_DIGITS(0x86883364), ARTH_WORD_DIGITS(0x2c151e28), ARTH_WORD_DIGITS(0xcfd3f377),
+	ARTH_WORD_DIGITS(0xb7795ebf), ARTH_WORD_DIGITS(0xd59ad5c5), ARTH_WORD_DIGITS(0x9c0915a0), ARTH_WORD_DIGITS(0x1eaee60a)
+};
+
+// Datagrams follow wire.h: session identifier and wire message.
+#define LOAD_ID_BYTES WIRE_ID_BYTES
+#define LOAD_MSG_BYTES WIRE_DATAGRAM_BYTES
+#define LOAD_STOP 0xFFFFFFFF
+
+// Handshake which is not finished in this time is counted as lost.
+#define LOAD_TIMEOUT_NS 2000000000ULL
+
+enum { TRANSPORT_INPROC, TRANSPORT_UNIX, TRANSPORT_UDP };
+
+// Server steps: STAKE uses all of them, PKI has no q3.
+enum { STEP_INIT, STEP_Q1, STEP_Q2, STEP_Q3, STEP_HASH, STEPS };
+
+const char *stepNames[STEPS] = {"init", "q1", "q2", "q3", "hash"};
+
+// Log-linear histogram of nanoseconds: 32 buckets per power of 2 (3% resolution).
+#define HIST_SUB_BITS 5
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (HIST_SUB + (64 - HIST_SUB_BITS)*(HIST_SUB/2))
+
+struct Histogram {
+	uint32_t count[HIST_BUCKETS];
+	uint64_t total;
+	uint64_t sum;
+	uint64_t max;
+};
+
+void hist_add(Histogram *h, uint64_t v) {
+	int idx = (int)v;
+
+	if (v >= HIST_SUB) {
+		int shift = 63 - __builtin_clzll(v) - (HIST_SUB_BITS - 1);
+
+		idx = HIST_SUB + (shift - 1)*(HIST_SUB/2) + (int)(v >> shift) - HIST_SUB/2;
+	}
+
+	h->count[idx]++;
+	h->total++;
+	h->sum += v;
+
+	if (v > h->max)
+		h->max = v;
+}
+
+// Middle of the bucket which contains percentile p.
+double hist_percentile(const Histogram *h, double p) {
+	uint64_t rank = (uint64_t)ceil(p / 100.0 * h->total);
+	uint64_t seen = 0;
+
+	if (h->total == 0)
+		return 0;
+	if (rank == 0)
+		rank = 1;
+
+	for (int idx = 0; idx < HIST_BUCKETS; idx++) {
+		seen += h->count[idx];
+
+		if (seen >= rank) {
+			if (idx < HIST_SUB)
+				return idx;
+
+			int shift = (idx - HIST_SUB) / (HIST_SUB/2) + 1;
+			uint64_t low = (uint64_t)((idx - HIST_SUB) % (HIST_SUB/2) + HIST_SUB/2) << shift;
+
+			return low + (double)(1ULL << shift) / 2;
+		}
+	}
+
+	return h->max;
+}
+
+uint64_t now_ns(clockid_t clk = CLOCK_MONOTONIC) {
+	struct timespec ts;
+
+	clock_gettime(clk, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * SERVER
+ */
+struct ServerStats {
+	Histogram step[STEPS];
+	uint64_t cpu;
+	long handshakes;
+	long errors;
+};
+
+struct Server {
+	int pki;
+	std::unordered_map<uint32_t, ProtocolIoTStake> stake;
+	std::unordered_map<uint32_t, ProtocolIoTPki> iotpki;
+	ServerStats stats;
+};
+
+// Run single step and add its time to histogram.
+#define SERVER_STEP(kind, call) \
+	do { \
+		uint64_t t = now_ns(); \
+		err = (call); \
+		hist_add(&srv->stats.step[kind], now_ns() - t); \
+	} while (0)
+
+// Handle request of sensor, return length of reply.
+int server_handle(Server *srv, const Octet *in, int len, Octet *out) {
+	uint64_t cpu = now_ns(CLOCK_THREAD_CPUTIME_ID);
+	uint32_t id = wire_get_id(in);
+	Digit P1[2*FP_DIGITS];
+	Digit P2[2*FP_DIGITS];
+	EcdsaSign sign;
+	WireMessage msg;
+	int reply = -1;
+	int err = 0;
+
+	wire_put_id(out, id);
+
+	if (len == LOAD_ID_BYTES && !srv->pki) {
+		// [1 SRV] Protocol initialization, determination of Q1.
+		ProtocolIoTStake &ctx = srv->stake[id];
+
+		SERVER_STEP(STEP_INIT, ecc_iotstake_init(&ctx, prvSrv, pubMu, 0));
+		if (!err)
+			SERVER_STEP(STEP_Q1, ecc_iotstake_q1(&ctx, P1));
+		if (!err)
+			reply = wire_encode(out + LOAD_ID_BYTES, WIRE_MAX_BYTES, WIRE_Q1, P1, 0, 0, 0);
+	} else if (len == LOAD_ID_BYTES) {
+		// [1 SRV] Protocol initialization, determination of Q1 and signature.
+		ProtocolIoTPki &ctx = srv->iotpki[id];
+
+		SERVER_STEP(STEP_INIT, ecc_iotpki_init(&ctx, prvSrv, pubMu, 0));
+		if (!err)
+			SERVER_STEP(STEP_Q1, ecc_iotpki_q1(&ctx, P1, &sign));
+		if (!err)
+			reply = wire_encode(out + LOAD_ID_BYTES, WIRE_MAX_BYTES, WIRE_Q1_SIGN, P1, 0, &sign, 0);
+	} else if (wire_decode(&msg, in + LOAD_ID_BYTES, len - LOAD_ID_BYTES) > 0) {
+		if (!srv->pki && msg.type == WIRE_Q1Q2 && srv->stake.count(id)) {
+			// [2 SRV] Determination of Q2 of sensor, Q3 and the hash.
+			ProtocolIoTStake &ctx = srv->stake[id];
+
+			wire_get_point(P1, msg.P1);
+			wire_get_point(P2, msg.P2);
+
+			SERVER_STEP(STEP_Q2, ecc_iotstake_q2(&ctx, P1, P1));
+			if (!err)
+				SERVER_STEP(STEP_Q3, ecc_iotstake_q3(&ctx, P2));
+			if (!err)
+				SERVER_STEP(STEP_HASH, ecc_iotstake_hash(&ctx, 0));
+			if (!err)
+				reply = wire_encode(out + LOAD_ID_BYTES, WIRE_MAX_BYTES, WIRE_Q2, P1, 0, 0, 0);
+
+			srv->stake.erase(id);
+		} else if (srv->pki && msg.type == WIRE_Q1_SIGN && srv->iotpki.count(id)) {
+			// [2 SRV] Verification of sensor signature, determination of Q2 and the hash.
+			ProtocolIoTPki &ctx = srv->iotpki[id];
+
+			wire_get_point(P1, msg.P1);
+			wire_get_sign(&sign, msg.sign);
+
+			SERVER_STEP(STEP_Q2, ecc_iotpki_q2(&ctx, P1, &sign));
+			if (!err)
+				SERVER_STEP(STEP_HASH, ecc_iotpki_hash(&ctx, 0));
+			if (!err)
+				reply = 0;
+
+			srv->iotpki.erase(id);
+		}
+
+		if (reply >= 0)
+			srv->stats.handshakes++;
+	}
+
+	if (reply < 0) {
+		srv->stats.errors++;
+		out[LOAD_ID_BYTES] = WIRE_ERROR;
+		reply = 1;
+	}
+
+	srv->stats.cpu += now_ns(CLOCK_THREAD_CPUTIME_ID) - cpu;
+
+	return LOAD_ID_BYTES + reply;
+}
+
+/*
+ * TRANSPORT
+ */
+struct Transport {
+	int kind;
+	int fd;
+	pid_t pid;
+	Server *server;
+	std::deque<std::vector<Octet> > inbox;
+};
+
+// Server process: answer requests until STOP, then send statistics.
+void server_loop(int fd, int pki) {
+	Server *srv = new Server();
+	Octet in[LOAD_MSG_BYTES];
+	Octet out[LOAD_MSG_BYTES];
+	struct sockaddr_storage peer;
+	socklen_t peerLen;
+	int len;
+
+	srv->pki = pki;
+	srand(getpid() ^ time(0));
+
+	for (;;) {
+		peerLen = sizeof(peer);
+		len = recvfrom(fd, in, sizeof(in), 0, (struct sockaddr *)&peer, &peerLen);
+
+		if (len < LOAD_ID_BYTES)
+			break;
+
+		if (wire_get_id(in) == LOAD_STOP) {
+			sendto(fd, &srv->stats, sizeof(srv->stats), 0, (struct sockaddr *)&peer, peerLen);
+			break;
+		}
+
+		len = server_handle(srv, in, len, out);
+		sendto(fd, out, len, 0, (struct sockaddr *)&peer, peerLen);
+	}
+
+	delete srv;
+}
+
+int transport_open(Transport *t, int kind, int pki, const struct sockaddr_in *server) {
+	int fd[2];
+
+	t->kind = kind;
+	t->pid = 0;
+	t->server = 0;
+
+	if (kind == TRANSPORT_INPROC) {
+		t->server = new Server();
+		t->server->pki = pki;
+		return 0;
+	}
+
+	if (kind == TRANSPORT_UDP && server->sin_port) {
+		int size = 4 << 20;
+
+		// External server, e.g. the server daemon.
+		if ((t->fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+			return 1;
+		if (connect(t->fd, (const struct sockaddr *)server, sizeof(*server)) != 0)
+			return 1;
+
+		setsockopt(t->fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+		return 0;
+	}
+
+	if (kind == TRANSPORT_UNIX) {
+		if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fd) != 0)
+			return 1;
+	} else {
+		struct sockaddr_in addr;
+		socklen_t addrLen = sizeof(addr);
+		int size = 4 << 20;
+
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		fd[1] = socket(AF_INET, SOCK_DGRAM, 0);
+		fd[0] = socket(AF_INET, SOCK_DGRAM, 0);
+
+		if (fd[0] < 0 || fd[1] < 0)
+			return 1;
+		if (bind(fd[1], (struct sockaddr *)&addr, sizeof(addr)) != 0)
+			return 1;
+		if (getsockname(fd[1], (struct sockaddr *)&addr, &addrLen) != 0)
+			return 1;
+		if (connect(fd[0], (struct sockaddr *)&addr, sizeof(addr)) != 0)
+			return 1;
+
+		setsockopt(fd[0], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+		setsockopt(fd[1], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	}
+
+	std::cout.flush();
+	t->pid = fork();
+
+	if (t->pid == 0) {
+		close(fd[0]);
+		server_loop(fd[1], pki);
+		_exit(0);
+	}
+
+	close(fd[1]);
+	t->fd = fd[0];
+
+	return t->pid < 0;
+}
+
+void transport_send(Transport *t, const Octet *buf, int len) {
+	if (t->kind == TRANSPORT_INPROC) {
+		std::vector<Octet> reply(LOAD_MSG_BYTES);
+
+		reply.resize(server_handle(t->server, buf, len, reply.data()));
+		t->inbox.push_back(reply);
+	} else if (send(t->fd, buf, len, 0) != len) {
+		std::cout << "send failed\n";
+	}
+}
+
+// Receive message, wait at most timeout milliseconds. Return length or 0.
+int transport_recv(Transport *t, Octet *buf, int size, int timeout) {
+	struct pollfd pfd;
+	int len;
+
+	if (t->kind == TRANSPORT_INPROC) {
+		if (t->inbox.empty())
+			return 0;
+
+		len = (int)t->inbox.front().size();
+		memcpy(buf, t->inbox.front().data(), len);
+		t->inbox.pop_front();
+
+		return len;
+	}
+
+	pfd.fd = t->fd;
+	pfd.events = POLLIN;
+
+	if (poll(&pfd, 1, timeout) <= 0)
+		return 0;
+
+	len = recv(t->fd, buf, size, 0);
+
+	return len > 0 ? len : 0;
+}
+
+// Stop server and take its statistics.
+void transport_close(Transport *t, ServerStats *stats) {
+	if (t->kind == TRANSPORT_INPROC) {
+		*stats = t->server->stats;
+		delete t->server;
+		return;
+	}
+
+	Octet stop[LOAD_ID_BYTES];
+
+	if (t->pid == 0) {
+		// Statistics of external server are not known.
+		memset(stats, 0, sizeof(*stats));
+		close(t->fd);
+		return;
+	}
+
+	wire_put_id(stop, LOAD_STOP);
+	transport_send(t, stop, sizeof(stop));
+
+	if (transport_recv(t, (Octet *)stats, sizeof(*stats), 5000) != sizeof(*stats)) {
+		std::cout << "server statistics lost\n";
+		memset(stats, 0, sizeof(*stats));
+	}
+
+	waitpid(t->pid, 0, 0);
+	close(t->fd);
+}
+
+/*
+ * GENERATOR
+ */
+struct Config {
+	int sensors;
+	long count;
+	double rate;
+	int transport;
+	int synthetic;
+	// Address of external UDP server (port 0 - server is started by generator).
+	struct sockaddr_in server;
+};
+
+struct Report {
+	Histogram handshake;
+	Histogram round[2];
+	ServerStats server;
+	long done;
+	long errors;
+	long lost;
+	double wall;
+	uint64_t cpu;
+};
+
+struct Sensor {
+	int state;
+	uint64_t start;
+	uint64_t sent;
+	ProtocolIoTStake stake;
+	ProtocolIoTPki iotpki;
+};
+
+// Messages of synthetic sensors: valid points and signatures computed in advance.
+#define POOL 16
+
+struct Pool {
+	Digit Q1[POOL][2*FP_DIGITS];
+	Digit Q2[POOL][2*FP_DIGITS];
+	EcdsaSign sign[POOL];
+};
+
+void pool_create(Pool *pool, int pki) {
+	Digit prv[EC_GEN_ORDER_DIGITS];
+	Octet x[FP_OCTETS];
+
+	for (int i = 0; i < POOL; i++) {
+		ecc_generate_key(pool->Q1[i], prv, 0);
+		ecc_generate_key(pool->Q2[i], prv, 0);
+
+		if (pki) {
+			to_octets(x, pool->Q1[i], FP_DIGITS);
+			ecc_ecdsa_sign(&pool->sign[i], x, FP_OCTETS, prvMu);
+		}
+	}
+}
+
+// xorshift generator for arrival times (rand() is used by key generation).
+double arrival_gap(double rate) {
+	static uint64_t x = 88172645463325252ULL;
+
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+
+	return -log((double)((x >> 11) + 1) / 9007199254740993.0) / rate * 1e9;
+}
+
+// Sensor answers the first message of server, return length of request (0 - error).
+int sensor_round1(Sensor *s, const Config *cfg, const Pool *pool, int pki, const WireMessage *msg, Octet *out) {
+	Digit P1[2*FP_DIGITS];
+	Digit Q1[2*FP_DIGITS];
+	Digit Q2[2*FP_DIGITS];
+	EcdsaSign sign;
+	EcdsaSign signSrv;
+
+	// Reply of other protocol (e.g. server of STAKE only to PKI sensor) is an error.
+	if (msg->type != (pki ? WIRE_Q1_SIGN : WIRE_Q1) || !msg->P1 || (pki && !msg->sign))
+		return 0;
+
+	// Cookie of stateless server is returned with Q1 and Q2 of sensor.
+	if (cfg->synthetic) {
+		int i = rand() % POOL;
+
+		if (pki)
+			return wire_encode(out, WIRE_MAX_BYTES, WIRE_Q1_SIGN, pool->Q1[i], 0, &pool->sign[i], 0);
+
+		return wire_encode(out, WIRE_MAX_BYTES, WIRE_Q1Q2, pool->Q1[i], pool->Q2[i], 0, msg->cookie);
+	}
+
+	wire_get_point(P1, msg->P1);
+
+	if (!pki) {
+		// [1 MU] Protocol initialization, determination of Q1 of sensor and Q2 of server.
+		if (ecc_iotstake_init(&s->stake, prvMu, pubSrv, 0) ||
+			ecc_iotstake_q1(&s->stake, Q1) || ecc_iotstake_q2(&s->stake, P1, Q2))
+			return 0;
+
+		return wire_encode(out, WIRE_MAX_BYTES, WIRE_Q1Q2, Q1, Q2, 0, msg->cookie);
+	}
+
+	// [1 MU] Protocol initialization, determination of Q1, verification of server.
+	wire_get_sign(&signSrv, msg->sign);
+
+	if (ecc_iotpki_init(&s->iotpki, prvMu, pubSrv, 0) ||
+		ecc_iotpki_q1(&s->iotpki, Q1, &sign) || ecc_iotpki_q2(&s->iotpki, P1, &signSrv) ||
+		ecc_iotpki_hash(&s->iotpki, 0))
+		return 0;
+
+	return wire_encode(out, WIRE_MAX_BYTES, WIRE_Q1_SIGN, Q1, 0, &sign, 0);
+}
+
+// Sensor finishes handshake after the last message of server, return 0 if OK.
+int sensor_round2(Sensor *s, const Config *cfg, int pki, const Octet *in, int len) {
+	Digit P1[2*FP_DIGITS];
+	WireMessage msg;
+
+	if (pki)
+		return len != 0;
+
+	if (wire_decode(&msg, in, len) <= 0 || msg.type != WIRE_Q2)
+		return 1;
+	if (cfg->synthetic)
+		return 0;
+
+	// [2 MU] Determination of Q3 and the hash.
+	wire_get_point(P1, msg.P1);
+
+	return ecc_iotstake_q3(&s->stake, P1) || ecc_iotstake_hash(&s->stake, 0);
+}
+
+int run(const Config *cfg, int pki, Report *rep) {
+	std::vector<Sensor> sensors(cfg->sensors);
+	std::vector<int> idle;
+	Transport t;
+	Pool pool;
+	Octet in[LOAD_MSG_BYTES];
+	Octet out[LOAD_MSG_BYTES];
+	WireMessage msg;
+	long started = 0;
+	uint64_t next;
+	uint64_t start;
+	uint64_t lastCheck;
+	uint64_t cpu;
+	uint64_t now;
+	int len;
+
+	memset(rep, 0, sizeof(*rep));
+
+	if (cfg->synthetic)
+		pool_create(&pool, pki);
+
+	if (transport_open(&t, cfg->transport, pki, &cfg->server) != 0) {
+		std::cout << "transport failed\n";
+		return 1;
+	}
+
+	for (int i = cfg->sensors - 1; i >= 0; i--) {
+		sensors[i].state = 0;
+		idle.push_back(i);
+	}
+
+	cpu = now_ns(CLOCK_PROCESS_CPUTIME_ID);
+	start = next = lastCheck = now_ns();
+
+	while (rep->done + rep->errors + rep->lost < cfg->count) {
+		now = now_ns();
+
+		// New handshakes: at arrival times (open loop) or as soon as sensor is idle (closed loop).
+		while (started < cfg->count && !idle.empty() && (cfg->rate <= 0 || next <= now)) {
+			Sensor &s = sensors[idle.back()];
+
+			wire_put_id(out, idle.back());
+			idle.pop_back();
+
+			s.state = 1;
+			s.start = cfg->rate > 0 ? next : now;
+			s.sent = now_ns();
+			started++;
+
+			if (cfg->rate > 0)
+				next += (uint64_t)arrival_gap(cfg->rate);
+
+			transport_send(&t, out, LOAD_ID_BYTES);
+		}
+
+		int timeout = 100;
+
+		if (cfg->rate > 0 && started < cfg->count && !idle.empty())
+			timeout = next > now ? (int)((next - now) / 1000000) : 0;
+
+		len = transport_recv(&t, in, sizeof(in), timeout);
+
+		if (len >= LOAD_ID_BYTES && wire_get_id(in) < (uint32_t)cfg->sensors) {
+			uint32_t id = wire_get_id(in);
+			Sensor &s = sensors[id];
+			int fail = (len == LOAD_ID_BYTES + 1);
+
+			now = now_ns();
+
+			if (s.state == 1 && !fail) {
+				hist_add(&rep->round[0], now - s.sent);
+
+				if (wire_decode(&msg, in + LOAD_ID_BYTES, len - LOAD_ID_BYTES) <= 0)
+					fail = 1;
+				else if ((len = sensor_round1(&s, cfg, &pool, pki, &msg, out + LOAD_ID_BYTES)) == 0)
+					fail = 1;
+
+				if (!fail) {
+					wire_put_id(out, id);
+					s.state = 2;
+					s.sent = now_ns();
+					transport_send(&t, out, LOAD_ID_BYTES + len);
+					continue;
+				}
+			} else if (s.state == 2 && !fail) {
+				hist_add(&rep->round[1], now - s.sent);
+				fail = sensor_round2(&s, cfg, pki, in + LOAD_ID_BYTES, len - LOAD_ID_BYTES);
+
+				if (!fail) {
+					hist_add(&rep->handshake, now_ns() - s.start);
+					rep->done++;
+				}
+			} else if (s.state == 0) {
+				// Late answer of lost handshake.
+				continue;
+			}
+
+			if (fail)
+				rep->errors++;
+
+			s.state = 0;
+			idle.push_back(id);
+		}
+
+		// Datagrams may be lost, so handshakes which last too long are abandoned.
+		now = now_ns();
+
+		if (now - lastCheck > LOAD_TIMEOUT_NS / 4) {
+			for (int i = 0; i < cfg->sensors; i++) {
+				if (sensors[i].state != 0 && now - sensors[i].sent > LOAD_TIMEOUT_NS) {
+					sensors[i].state = 0;
+					idle.push_back(i);
+					rep->lost++;
+				}
+			}
+
+			lastCheck = now;
+		}
+	}
+
+	rep->wall = (now_ns() - start) * 1e-9;
+	rep->cpu = now_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+	transport_close(&t, &rep->server);
+
+	return 0;
+}
+
+void print_row(const char *name, const Report *rep, int n, double (*value)(const Report *, int), int step) {
+	printf("%-28s", name);
+
+	for (int i = 0; i < n; i++) {
+		double v = value(&rep[i], step);
+
+		if (std::isnan(v))
+			printf("%14s", "-");
+		else
+			printf("%14.6g", v);
+	}
+
+	printf("\n");
+}
+
+void print_hist(const char *name, const Report *rep, int n, const Histogram *(*hist)(const Report *, int), int step) {
+	static const double pct[] = {50, 99, 99.9};
+	static const char *pctNames[] = {"p50", "p99", "p99.9"};
+	char row[64];
+
+	for (int p = 0; p < 3; p++) {
+		snprintf(row, sizeof(row), "%s %s [ms]", name, pctNames[p]);
+		printf("%-28s", row);
+
+		for (int i = 0; i < n; i++) {
+			const Histogram *h = hist(&rep[i], step);
+
+			if (h->total)
+				printf("%14.3f", hist_percentile(h, pct[p]) * 1e-6);
+			else
+				printf("%14s", "-");
+		}
+
+		printf("\n");
+	}
+}
+
+int main(int argc, char *argv[]) {
+	Config cfg = {16, 200, 0, TRANSPORT_INPROC, 0, {}};
+	const char *names[2] = {"STAKE", "PKI"};
+	int protocols[2] = {0, 1};
+	int n = 2;
+	Report rep[2];
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+			cfg.sensors = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+			cfg.count = atol(argv[++i]);
+		} else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+			cfg.rate = atof(argv[++i]);
+		} else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+			i++;
+			cfg.transport = strcmp(argv[i], "unix") == 0 ? TRANSPORT_UNIX :
+				strcmp(argv[i], "udp") == 0 ? TRANSPORT_UDP : TRANSPORT_INPROC;
+		} else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+			const char *port = strchr(argv[++i], ':');
+
+			cfg.transport = TRANSPORT_UDP;
+			cfg.server.sin_family = AF_INET;
+			cfg.server.sin_port = htons(atoi(port ? port + 1 : argv[i]));
+			cfg.server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+			if (port) {
+				std::string host(argv[i], port - argv[i]);
+
+				if (inet_pton(AF_INET, host.c_str(), &cfg.server.sin_addr) != 1) {
+					std::cout << "bad address: " << argv[i] << "\n";
+					return 1;
+				}
+			}
+		} else if (strcmp(argv[i], "-s") == 0) {
+			cfg.synthetic = 1;
+		} else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+			i++;
+			if (strcmp(argv[i], "stake") == 0) {
+				n = 1;
+			} else if (strcmp(argv[i], "pki") == 0) {
+				n = 1;
+				protocols[0] = 1;
+				names[0] = "PKI";
+			}
+		} else {
+			std::cout << "usage: load [-n sensors] [-c handshakes] [-r rate/s (0 - closed loop)]\n";
+			std::cout << "            [-t inproc|unix|udp] [-a [host:]port (external UDP server)]\n";
+			std::cout << "            [-s (synthetic sensors)] [-p stake|pki|both]\n";
+			return 1;
+		}
+	}
+
+	if (cfg.sensors < 1)
+		cfg.sensors = 1;
+
+	srand(32);
+
+	for (int i = 0; i < n; i++) {
+		if (run(&cfg, protocols[i], &rep[i]) != 0)
+			return 1;
+	}
+
+	printf("%d sensors, %ld handshakes, %s, %s, %s sensors\n", cfg.sensors, cfg.count,
+		cfg.rate > 0 ? "open loop" : "closed loop",
+		cfg.transport == TRANSPORT_UNIX ? "UNIX socket" : cfg.server.sin_port ? "external UDP server" :
+		cfg.transport == TRANSPORT_UDP ? "UDP loopback" : "in-process",
+		cfg.synthetic ? "synthetic" : "full");
+
+	printf("%-28s", "");
+
+	for (int i = 0; i < n; i++) {
+		printf("%14s", names[i]);
+	}
+
+	printf("\n");
+
+	print_row("handshakes", rep, n, [](const Report *r, int) { return (double)r->done; }, 0);
+	print_row("errors", rep, n, [](const Report *r, int) { return (double)r->errors; }, 0);
+	print_row("lost", rep, n, [](const Report *r, int) { return (double)r->lost; }, 0);
+	print_row("throughput [1/s]", rep, n, [](const Report *r, int) { return r->done / r->wall; }, 0);
+	print_row("server CPU/handshake [ms]", rep, n, [](const Report *r, int) {
+		return r->server.handshakes ? r->server.cpu * 1e-6 / r->server.handshakes : NAN; }, 0);
+	print_row("generator CPU/handshake [ms]", rep, n, [](const Report *r, int) {
+		return r->done ? r->cpu * 1e-6 / r->done : 0; }, 0);
+
+	print_hist("handshake", rep, n, [](const Report *r, int) { return &r->handshake; }, 0);
+	print_hist("round 1", rep, n, [](const Report *r, int i) { return &r->round[i]; }, 0);
+	print_hist("round 2", rep, n, [](const Report *r, int i) { return &r->round[i]; }, 1);
+
+	for (int step = 0; step < STEPS; step++) {
+		char name[32];
+
+		snprintf(name, sizeof(name), "server %s", stepNames[step]);
+		print_hist(name, rep, n, [](const Report *r, int i) { return &r->server.step[i]; }, step);
+	}
+
+	return 0;
+}
@@ -1,8 +1,14 @@
 #include <iostream>
 #include <cstdlib>
+#include <cstdio>
+#include <cstring>
 #include <ctime>
 
+#include "cost.h"
 #include "crypto.h"
+#include "energy.h"
+#include "mem.h"
+#include "perf.h"
 
 unsigned long startTime;
 unsigned long endTime;
@@ -29,22 +35,235 @@ int keygen(void){
 
 // Static SERVER key pair generated by the keygen program.
 Digit prvSrv[FP_DIGITS] = {
-	0x2454fba4, 0x8da7f60f, 0x3373886b, 0xaf7eabb7, 0x72d6f1b9, 0x22674a67
+	ARTH_WORD_DIGITS(0x2454fba4), ARTH_WORD_DIGITS(0x8da7f60f), ARTH_WORD_DIGITS(0x3373886b), ARTH_WORD_DIGITS(0xaf7eabb7),
+	ARTH_WORD_DIGITS(0x72d6f1b9), ARTH_WORD_DIGITS(0x22674a67)
 };
 
 Digit pubSrv[2*FP_DIGITS] = {
-	0xd388264f, 0x3940a178, 0x10710de9, 0xb87bbf09, 0x1b7543dd, 0xd6b941e1, 0xc3a727d3, 0x37aa763e, 0x4a33547c, 0xfbbe8072, 0xe5390cd1, 0x9398e3d4
+	ARTH_WORD_DIGITS(0xd388264f), ARTH_WORD_DIGITS(0x3940a178), ARTH_WORD_DIGITS(0x10710de9), ARTH_WORD_DIGITS(0xb87bbf09),
+	ARTH_WORD_DIGITS(0x1b7543dd), ARTH_WORD_DIGITS(0xd6b941e1), ARTH_WORD_DIGITS(0xc3a727d3), ARTH_WORD_DIGITS(0x37aa763e),
+	ARTH_WORD_DIGITS(0x4a33547c), ARTH_WORD_DIGITS(0xfbbe8072), ARTH_WORD_DIGITS(0xe5390cd1), ARTH_WORD_DIGITS(0x9398e3d4)
 };
 
 // Static MICROCONTROLLER (SENSOR) key pair generated by the keygen program.
 Digit prvMu[FP_DIGITS] = {
-	0x16b1c8fd, 0x0f7eeb08, 0x46a846f0, 0x32593b27, 0x059e4b50, 0x6bb0570f
+	ARTH_WORD_DIGITS(0x16b1c8fd), ARTH_WORD_DIGITS(0x0f7eeb08), ARTH_WORD_DIGITS(0x46a846f0), ARTH_WORD_DIGITS(0x32593b27),
+	ARTH_WORD_DIGITS(0x059e4b50), ARTH_WORD_DIGITS(0x6bb0570f)
 };
 
 Digit pubMu[2*FP_DIGITS] = {
-	0xa2f1b4e6, 0xa3d59896, 0x555b859e, 0x0eb8e223, 0x77a021d3, 0x86883364, 0x2c151e28, 0xcfd3f377, 0xb7795ebf, 0xd59ad5c5, 0x9c0915a0, 0x1eaee60a
+	ARTH_WORD_DIGITS(0xa2f1b4e6), ARTH_WORD_DIGITS(0xa3d59896), ARTH_WORD_DIGITS(0x555b859e), ARTH_WORD_DIGITS(0x0eb8e223),
+	ARTH_WORD_DIGITS(0x77a021d3), ARTH_WORD_DIGITS(0x86883364), ARTH_WORD_DIGITS(0x2c151e28), ARTH_WORD_DIGITS(0xcfd3f377),
+	ARTH_WORD_DIGITS(0xb7795ebf), ARTH_WORD_DIGITS(0xd59ad5c5), ARTH_WORD_DIGITS(0x9c0915a0), ARTH_WORD_DIGITS(0x1eaee60a)
 };
 
+#if defined(STAKE_OPCOUNT)
+// Counters at the start of current step.
+OpCount opsMark;
+
+void ops_begin() {
+	opsMark = op_count;
+}
+
+void ops_end(OpCount *step) {
+	for (int k = 0; k < OP_KINDS; k++)
+		step->n[k] = op_count.n[k] - opsMark.n[k];
+}
+
+// Table of operations per protocol step of both sides.
+void print_ops(const char *const *names, const OpCount *srv, const OpCount *mu, int steps) {
+	printf("%-6s %-4s", "step", "side");
+
+	for (int k = 0; k < OP_KINDS; k++)
+		printf(" %9s", op_names[k]);
+
+	printf("\n");
+
+	for (int side = 0; side < 2; side++) {
+		const OpCount *ops = side ? mu : srv;
+		OpCount total = {};
+
+		for (int i = 0; i <= steps; i++) {
+			const OpCount *row = i < steps ? &ops[i] : &total;
+
+			printf("%-6s %-4s", i < steps ? names[i] : "total", side ? "MU" : "SRV");
+
+			for (int k = 0; k < OP_KINDS; k++) {
+				printf(" %9lu", row->n[k]);
+
+				if (i < steps)
+					total.n[k] += row->n[k];
+			}
+
+			printf("\n");
+		}
+	}
+}
+
+// Operations of every step of single handshake (STAKE_OPCOUNT).
+int iotpki_ops() {
+	static const char *const names[] = { "init", "q1", "q2", "hash" };
+	ProtocolIoTPki ctxSrv;
+	ProtocolIoTPki ctxMu;
+	EcdsaSign q1SrvSign;
+	Digit q1Srv[2*FP_DIGITS];
+	EcdsaSign q1MuSign;
+	Digit q1Mu[2*FP_DIGITS];
+	Octet aesKeySrv[16];
+	Octet aesKeyMu[16];
+	OpCount srv[4];
+	OpCount mu[4];
+	int err = 0;
+
+	std::cout << "START: iotpki_ops() [" << DIGIT_BITS << "-bit digits]" << std::endl;
+
+	ops_begin(); err |= ecc_iotpki_init(&ctxSrv, prvSrv, pubMu, 0); ops_end(&srv[0]);
+	ops_begin(); err |= ecc_iotpki_q1(&ctxSrv, q1Srv, &q1SrvSign); ops_end(&srv[1]);
+	ops_begin(); err |= ecc_iotpki_init(&ctxMu, prvMu, pubSrv, 0); ops_end(&mu[0]);
+	ops_begin(); err |= ecc_iotpki_q1(&ctxMu, q1Mu, &q1MuSign); ops_end(&mu[1]);
+	ops_begin(); err |= ecc_iotpki_q2(&ctxSrv, q1Mu, &q1MuSign); ops_end(&srv[2]);
+	ops_begin(); err |= ecc_iotpki_q2(&ctxMu, q1Srv, &q1SrvSign); ops_end(&mu[2]);
+	ops_begin(); err |= ecc_iotpki_hash(&ctxSrv, aesKeySrv); ops_end(&srv[3]);
+	ops_begin(); err |= ecc_iotpki_hash(&ctxMu, aesKeyMu); ops_end(&mu[3]);
+
+	if (err != 0 || memcmp(aesKeySrv, aesKeyMu, sizeof(aesKeySrv)) != 0) {
+		std::cout << "Err: handshake failed\n";
+		return 1;
+	}
+
+	print_ops(names, srv, mu, 4);
+	std::cout << "STOP: iotpki_ops()\n";
+
+	return 0;
+}
+#endif
+
+// Peak memory of single step: stack and used parts of global scratch.
+typedef struct MemUse_st {
+	long stack;
+	long arth;
+	long ecc;
+	long batch;
+} MemUse;
+
+// Runs step on painted stack with painted scratch.
+int mem_step(MemUse *use, void (*fn)(void *), void *arg) {
+	mem_paint(arth_tmp, sizeof(arth_tmp));
+	mem_paint(ecc_tmp, sizeof(ecc_tmp));
+	mem_paint(ecc_batch_tmp, sizeof(ecc_batch_tmp));
+
+	if (mem_stack_peak(&use->stack, fn, arg) != 0)
+		return 1;
+
+	use->arth = mem_high_water(arth_tmp, sizeof(arth_tmp));
+	use->ecc = mem_high_water(ecc_tmp, sizeof(ecc_tmp));
+	use->batch = mem_high_water(ecc_batch_tmp, sizeof(ecc_batch_tmp));
+
+	return 0;
+}
+
+// Table of peak memory per protocol step of both sides (octets), context of side included.
+void print_mem(const char *const *names, const MemUse *srv, const MemUse *mu, int steps, long ctx) {
+	printf("scratch: arth_tmp %ld B, ecc_tmp %ld B, ecc_batch_tmp %ld B; context %ld B\n", (long)sizeof(arth_tmp),
+		(long)sizeof(ecc_tmp), (long)sizeof(ecc_batch_tmp), ctx);
+	printf("%-6s %-4s %8s %8s %8s %9s %8s %8s\n", "step", "side", "stack", "arth_tmp", "ecc_tmp", "batch_tmp",
+		"context", "total");
+
+	for (int side = 0; side < 2; side++) {
+		const MemUse *use = side ? mu : srv;
+		MemUse peak = {};
+		long peakTotal = 0;
+
+		for (int i = 0; i <= steps; i++) {
+			const MemUse *row = i < steps ? &use[i] : &peak;
+			long total = row->stack + row->arth + row->ecc + row->batch + ctx;
+
+			if (i < steps) {
+				peak.stack = row->stack > peak.stack ? row->stack : peak.stack;
+				peak.arth = row->arth > peak.arth ? row->arth : peak.arth;
+				peak.ecc = row->ecc > peak.ecc ? row->ecc : peak.ecc;
+				peak.batch = row->batch > peak.batch ? row->batch : peak.batch;
+				peakTotal = total > peakTotal ? total : peakTotal;
+			} else {
+				total = peakTotal;
+			}
+
+			printf("%-6s %-4s %8ld %8ld %8ld %9ld %8ld %8ld\n", i < steps ? names[i] : "peak", side ? "MU" : "SRV",
+				row->stack, row->arth, row->ecc, row->batch, ctx, total);
+		}
+	}
+}
+
+// State of single handshake profiled step by step (-s).
+struct {
+	ProtocolIoTPki srv;
+	ProtocolIoTPki mu;
+	EcdsaSign q1SrvSign;
+	Digit q1Srv[2*FP_DIGITS];
+	EcdsaSign q1MuSign;
+	Digit q1Mu[2*FP_DIGITS];
+	Octet aesKeySrv[16];
+	Octet aesKeyMu[16];
+	int err;
+} hs;
+
+// Peak memory of every step of single handshake.
+int iotpki_mem() {
+	static const char *const names[] = { "init", "q1", "q2", "hash" };
+	// Steps in protocol order: side (0 SRV, 1 MU), step, operation.
+	static const struct {
+		int side;
+		int step;
+		void (*fn)(void *);
+	} run[] = {
+		{ 0, 0, [](void *) { hs.err |= ecc_iotpki_init(&hs.srv, prvSrv, pubMu, 0); } },
+		{ 0, 1, [](void *) { hs.err |= ecc_iotpki_q1(&hs.srv, hs.q1Srv, &hs.q1SrvSign); } },
+		{ 1, 0, [](void *) { hs.err |= ecc_iotpki_init(&hs.mu, prvMu, pubSrv, 0); } },
+		{ 1, 1, [](void *) { hs.err |= ecc_iotpki_q1(&hs.mu, hs.q1Mu, &hs.q1MuSign); } },
+		{ 0, 2, [](void *) { hs.err |= ecc_iotpki_q2(&hs.srv, hs.q1Mu, &hs.q1MuSign); } },
+		{ 1, 2, [](void *) { hs.err |= ecc_iotpki_q2(&hs.mu, hs.q1Srv, &hs.q1SrvSign); } },
+		{ 0, 3, [](void *) { hs.err |= ecc_iotpki_hash(&hs.srv, hs.aesKeySrv); } },
+		{ 1, 3, [](void *) { hs.err |= ecc_iotpki_hash(&hs.mu, hs.aesKeyMu); } }
+	};
+	MemUse use[2][4];
+
+	std::cout << "START: iotpki_mem()" << std::endl;
+	hs.err = 0;
+
+	for (const auto &r : run) {
+		if (mem_step(&use[r.side][r.step], r.fn, 0) != 0) {
+			std::cout << "Err: no memory for stack\n";
+			return 1;
+		}
+	}
+
+	if (hs.err != 0 || memcmp(hs.aesKeySrv, hs.aesKeyMu, sizeof(hs.aesKeySrv)) != 0) {
+		std::cout << "Err: handshake failed\n";
+		return 1;
+	}
+
+	print_mem(names, use[0], use[1], 4, sizeof(ProtocolIoTPki));
+	std::cout << "STOP: iotpki_mem()\n";
+
+	return 0;
+}
+
+// Hardware counters (-e) and energy (-j) around protocol phases, off otherwise.
+PerfPhase perfPhase;
+EnergyPhase energyPhase;
+
+void phase_begin() {
+	perf_phase_begin(&perfPhase);
+	energy_phase_begin(&energyPhase);
+}
+
+// Counters and energy per handshake of the last B handshakes.
+void phase_end(int B) {
+	energy_phase_end(&energyPhase, stdout, B);
+	perf_phase_end(&perfPhase, stdout, B);
+	fflush(stdout);
+}
+
 int iotpki(int B = 1) {
 	std::cout << "START: iotpki()\n";
 	// Initialization of variables and data structures ...
@@ -67,6 +286,7 @@ int iotpki(int B = 1) {
 
 	// !!! START OF THE INTERACTIVE PROTOCOL SECTION !!!
 	// [1 SRV] Protocol initialization, determination of q1Srv.
+	phase_begin();
 	startTime = clock();
 
 	for (int i = 0; i < B; i++) {
@@ -83,12 +303,14 @@ int iotpki(int B = 1) {
 
 	endTime = clock();
 	std::cout << "[1 SRV] init(1M), q1(1Sig): ";
-	std::cout << ((double)(endTime - startTime)/(B*CLOCKS_PER_SEC)) << "ms\n";
+	std::cout << (1000.0*(endTime - startTime)/(B*CLOCKS_PER_SEC)) << "ms\n";
+	phase_end(B);
 
 	// Sending q1Srv and q1SrvSign to the microcontroller (sensor).
 	// ...
 	// Receiving q1Srv and q1SrvSign from the server.
 	// [1 MU] Protocol initialization, determination of q1Mu.
+	phase_begin();
 	startTime = clock();
 
 	for (int i = 0; i < B; i++) {
@@ -105,12 +327,14 @@ int iotpki(int B = 1) {
 
 	endTime = clock();
 	std::cout << "[1 MU ] init(1M), q1(1Sig): ";
-	std::cout << ((double)(endTime - startTime)/(B*CLOCKS_PER_SEC)) << "ms\n";
+	std::cout << (1000.0*(endTime - startTime)/(B*CLOCKS_PER_SEC)) << "ms\n";
+	phase_end(B);
 
 	// Sending q1Mu and q1MuSign to the server.
 	// ...
 	// Receiving q1Mu and q1MuSign from the microcontroller (sensor).
 	// [2 SRV] Determination of q2Srv.
+	phase_begin();
 	startTime = clock();
 
 	for (int i = 0; i < B; i++) {
@@ -122,9 +346,11 @@ int iotpki(int B = 1) {
 
 	endTime = clock();
 	std::cout << "[2 SRV] q2(1M+1Ver): ";
-	std::cout << ((double)(endTime - startTime)/(B*CLOCKS_PER_SEC)) << "ms\n";
+	std::cout << (1000.0*(endTime - startTime)/(B*CLOCKS_PER_SEC)) << "ms\n";
+	phase_end(B);
 
 	// [2 MU] Determination of q3Mu.
+	phase_begin();
 	startTime = clock();
 
 	for (int i = 0; i < B; i++) {
@@ -136,10 +362,12 @@ int iotpki(int B = 1) {
 
 	endTime = clock();
 	std::cout << "[2 MU ] q2(1M+1Ver): ";
-	std::cout << ((double)(endTime - startTime)/(B*CLOCKS_PER_SEC)) << "ms\n";
+	std::cout << (1000.0*(endTime - startTime)/(B*CLOCKS_PER_SEC)) << "ms\n";
+	phase_end(B);
 
 	// !!! END OF THE INTERACTIVE PROTOCOL SECTION.
 	// [3 SRV] Determination of the hash and retrieval as the key for the AES-128 algorithm.
+	phase_begin();
 	startTime = clock();
 
 	if ((err = ecc_iotpki_hash(&ctxSrv, aesKeySrv)) != 0) {
@@ -149,8 +377,10 @@ int iotpki(int B = 1) {
 
 	endTime = clock();
 	std::cout << "[3 SRV] AES-128\n";
+	phase_end(1);
 
 	// [3 MU] Determination of the hash and retrieval as the key for the AES-128 algorithm.
+	phase_begin();
 	startTime = clock();
 
 	if ((err = ecc_iotpki_hash(&ctxMu, aesKeyMu)) != 0) {
@@ -160,6 +390,7 @@ int iotpki(int B = 1) {
 
 	endTime = clock();
 	std::cout << "[3 MU ] AES-128\n";
+	phase_end(1);
 
 	std::cout << "STOP: iotpki()\n";
 
@@ -168,8 +399,33 @@ int iotpki(int B = 1) {
 
 int main(int argc, char *argv[]) {
 	int B = 100;
-	if (argc == 2) {
-		B = atoi(argv[1]);
+	int energy = 0;
+	int mem = 0;
+	const char *profile = "profiles/x86-64.prof";
+
+	// [-e] hardware counters per phase, [-j [-m profile]] energy per phase, [-s] peak memory per step,
+	// [B] handshakes per phase.
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-e") == 0) {
+			perf_phase_open(&perfPhase, stderr);
+		} else if (strcmp(argv[i], "-s") == 0) {
+			mem = 1;
+		} else if (strcmp(argv[i], "-j") == 0) {
+			energy = 1;
+		} else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+			profile = argv[++i];
+		} else {
+			B = atoi(argv[i]);
+		}
 	}
+
+	if (energy && energy_phase_open(&energyPhase, profile, stderr) != 0)
+		return 1;
+
 	iotpki(B);
+	if (mem)
+		iotpki_mem();
+#if defined(STAKE_OPCOUNT)
+	iotpki_ops();
+#endif
 }
@@ -0,0 +1,638 @@
+#include <iostream>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <unordered_map>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "crypto.h"
+#include "store.h"
+#include "wire.h"
+
+// Static SERVER key pair generated by the keygen program.
+Digit prvSrv[FP_DIGITS] = {
+	ARTH_WORD_DIGITS(0x2454fba4), ARTH_WORD_DIGITS(0x8da7f60f), ARTH_WORD_DIGITS(0x3373886b), ARTH_WORD_DIGITS(0xaf7eabb7),
+	ARTH_WORD_DIGITS(0x72d6f1b9), ARTH_WORD_DIGITS(0x22674a67)
+};
+
+// Public key of sensors (in real deployment it is found by sensor identity).
+Digit pubMu[2*FP_DIGITS] = {
+	ARTH_WORD_DIGITS(0xa2f1b4e6), ARTH_WORD_DIGITS(0xa3d59896), ARTH_WORD_DIGITS(0x555b859e), ARTH_WORD_DIGITS(0x0eb8e223),
+	ARTH_WORD_DIGITS(0x77a021d3), ARTH_WORD_DIGITS(0x86883364), ARTH_WORD_DIGITS(0x2c151e28), ARTH_WORD_DIGITS(0xcfd3f377),
+	ARTH_WORD_DIGITS(0xb7795ebf), ARTH_WORD_DIGITS(0xd59ad5c5), ARTH_WORD_DIGITS(0x9c0915a0), ARTH_WORD_DIGITS(0x1eaee60a)
+};
+
+// Cookie key shared by all workers (stateless mode).
+Octet cookieKey[AES128_KEY_BYTES] = {
+	0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c
+};
+
+// Maximum number of datagrams received or sent by single system call.
+#define SERVER_BATCH_MAX 256
+
+struct Config {
+	int port;
+	// Number of datagrams which are processed together.
+	int batch;
+	// Maximum time of waiting for full batch (microseconds).
+	int budget;
+	int workers;
+	int cookies;
+	// Time after which half-open session is removed (seconds).
+	int timeout;
+};
+
+// Session is identified by address of sensor and identifier chosen by sensor.
+struct SessionKey {
+	uint32_t addr;
+	uint32_t id;
+	uint16_t port;
+
+	bool operator==(const SessionKey &k) const {
+		return addr == k.addr && id == k.id && port == k.port;
+	}
+};
+
+struct SessionHash {
+	size_t operator()(const SessionKey &k) const {
+		return std::hash<uint64_t>()(((uint64_t)k.addr << 32 | k.port) ^ ((uint64_t)k.id * 0x9E3779B97F4A7C15ULL));
+	}
+};
+
+struct Session {
+	int slot;
+	time_t expires;
+	// Number of batch which used session (the same session is used once per batch).
+	long batch;
+};
+
+struct Datagram {
+	struct sockaddr_in peer;
+	Octet buf[WIRE_DATAGRAM_BYTES];
+	int len;
+};
+
+struct Worker {
+	const Config *cfg;
+	int fd;
+	int ep;
+	int timer;
+	int armed;
+	StakeStore store;
+	StakeCookieKey ck;
+	std::unordered_map<SessionKey, Session, SessionHash> sessions;
+	std::vector<Datagram> in;
+	std::vector<Datagram> out;
+	int pending;
+	time_t lastSweep;
+
+	long handshakes;
+	long errors;
+	long dropped;
+	long batches;
+	long datagrams;
+};
+
+volatile sig_atomic_t stopping = 0;
+
+void on_signal(int) {
+	stopping = 1;
+}
+
+int session_key(const Datagram *d, SessionKey *key) {
+	key->addr = d->peer.sin_addr.s_addr;
+	key->port = d->peer.sin_port;
+	key->id = wire_get_id(d->buf);
+
+	return 0;
+}
+
+Datagram *reply(Worker *w, const Datagram *d) {
+	w->out.emplace_back();
+
+	Datagram *r = &w->out.back();
+
+	r->peer = d->peer;
+	memcpy(r->buf, d->buf, WIRE_ID_BYTES);
+	r->len = WIRE_ID_BYTES;
+
+	return r;
+}
+
+/*
+ * Error is sent only to peers with session or valid cookie; everything
+ * else is dropped, so spoofed sources do not get datagrams reflected.
+ */
+void reply_error(Worker *w, const Datagram *d) {
+	Datagram *r = reply(w, d);
+
+	r->buf[r->len++] = WIRE_ERROR;
+	w->errors++;
+}
+
+void drop(Worker *w) {
+	w->dropped++;
+}
+
+/*
+ * Round 1 of many sessions: initialization and points Q1 of server.
+ */
+void round1(Worker *w, std::vector<const Datagram *> &req) {
+	int n = (int)req.size();
+	std::vector<int> slot(n);
+	std::vector<int> err(n);
+	std::vector<Digit> pub(2*FP_DIGITS*n);
+	std::vector<Digit> Q1(2*FP_DIGITS*n);
+	int m = 0;
+
+	if (w->cfg->cookies) {
+		// Stateless: contexts live only during the batch, then go to cookies.
+		std::vector<ProtocolIoTStake> ctx(n);
+		std::vector<ProtocolIoTStake *> ctxp(n);
+
+		for (int i = 0; i < n; i++) {
+			ecc_iotstake_init(&ctx[i], prvSrv, pubMu, 0);
+			ctxp[i] = &ctx[i];
+		}
+
+		ecc_iotstake_q1_batch(ctxp.data(), Q1.data(), err.data(), n);
+
+		for (int i = 0; i < n; i++) {
+			Octet cookie[COOKIE_BYTES];
+
+			if (err[i] || iotstake_cookie_seal(&ctx[i], cookie, time(0) + w->cfg->timeout, &w->ck, 0)) {
+				drop(w);
+				continue;
+			}
+
+			Datagram *r = reply(w, req[i]);
+
+			r->len += wire_encode(r->buf + WIRE_ID_BYTES, WIRE_MAX_BYTES, WIRE_Q1, &Q1[2*FP_DIGITS*i], 0, 0, cookie);
+		}
+
+		memset(ctx.data(), 0, n*sizeof(ProtocolIoTStake));
+
+		return;
+	}
+
+	// Stateful: sessions are kept in the store between rounds.
+	for (int i = 0; i < n; i++) {
+		SessionKey key;
+
+		session_key(req[i], &key);
+
+		auto it = w->sessions.find(key);
+
+		if (it != w->sessions.end() && it->second.batch == w->batches) {
+			// Repeated request in the same batch.
+			req[i] = 0;
+			continue;
+		}
+
+		if (it == w->sessions.end()) {
+			int s = stake_store_alloc(&w->store);
+
+			if (s < 0) {
+				drop(w);
+				continue;
+			}
+
+			it = w->sessions.emplace(key, Session{s, 0, 0}).first;
+		}
+
+		it->second.expires = time(0) + w->cfg->timeout;
+		it->second.batch = w->batches;
+
+		req[m] = req[i];
+		slot[m] = it->second.slot;
+		assign(&pub[2*FP_DIGITS*m], pubMu, 2*FP_DIGITS);
+		m++;
+	}
+
+	stake_store_init(&w->store, slot.data(), pub.data(), 0, m);
+	stake_store_q1(&w->store, slot.data(), Q1.data(), err.data(), m);
+
+	for (int i = 0; i < m; i++) {
+		if (err[i]) {
+			// Session is not established: its slot is released, nothing is sent.
+			SessionKey key;
+
+			session_key(req[i], &key);
+			w->sessions.erase(key);
+			stake_store_free(&w->store, slot[i]);
+			drop(w);
+			continue;
+		}
+
+		Datagram *r = reply(w, req[i]);
+
+		r->len += wire_encode(r->buf + WIRE_ID_BYTES, WIRE_MAX_BYTES, WIRE_Q1, &Q1[2*FP_DIGITS*i], 0, 0, 0);
+	}
+}
+
+/*
+ * Round 2 of many sessions: points Q2 of sensors, Q3 and keys.
+ */
+void round2(Worker *w, std::vector<const Datagram *> &req, std::vector<WireMessage> &msg) {
+	int n = (int)req.size();
+	std::vector<int> slot(n);
+	std::vector<int> err(n);
+	std::vector<Digit> Q1(2*FP_DIGITS*n);
+	std::vector<Digit> Q2(2*FP_DIGITS*n);
+	std::vector<Digit> out(2*FP_DIGITS*n);
+	std::vector<ProtocolIoTStake> ctx(w->cfg->cookies ? n : 0);
+	std::vector<ProtocolIoTStake *> ctxp(n);
+	time_t now = time(0);
+	int m = 0;
+	int k;
+
+	for (int i = 0; i < n; i++) {
+		if (w->cfg->cookies) {
+			if (!msg[i].cookie || iotstake_cookie_open(&ctx[m], msg[i].cookie, now, prvSrv, &w->ck) != 0) {
+				drop(w);
+				continue;
+			}
+
+			ctxp[m] = &ctx[m];
+		} else {
+			SessionKey key;
+
+			session_key(req[i], &key);
+
+			auto it = w->sessions.find(key);
+
+			if (it == w->sessions.end()) {
+				drop(w);
+				continue;
+			}
+
+			if (it->second.batch == w->batches) {
+				reply_error(w, req[i]);
+				continue;
+			}
+
+			// Session is finished in this batch, whatever the result.
+			slot[m] = it->second.slot;
+			w->sessions.erase(it);
+		}
+
+		req[m] = req[i];
+		wire_get_point(&Q1[2*FP_DIGITS*m], msg[i].P1);
+		wire_get_point(&Q2[2*FP_DIGITS*m], msg[i].P2);
+		m++;
+	}
+
+	if (w->cfg->cookies) {
+		ecc_iotstake_q2_batch(ctxp.data(), Q1.data(), out.data(), err.data(), m);
+	} else {
+		stake_store_q2(&w->store, slot.data(), Q1.data(), out.data(), err.data(), m);
+	}
+
+	// Points Q3 only of sessions without error.
+	for (int i = k = 0; i < m; i++) {
+		if (err[i]) {
+			reply_error(w, req[i]);
+
+			if (!w->cfg->cookies)
+				stake_store_free(&w->store, slot[i]);
+
+			continue;
+		}
+
+		req[k] = req[i];
+		slot[k] = slot[i];
+		ctxp[k] = ctxp[i];
+		assign(&Q2[2*FP_DIGITS*k], &Q2[2*FP_DIGITS*i], 2*FP_DIGITS);
+		assign(&out[2*FP_DIGITS*k], &out[2*FP_DIGITS*i], 2*FP_DIGITS);
+		k++;
+	}
+
+	if (w->cfg->cookies) {
+		ecc_iotstake_q3_batch(ctxp.data(), Q2.data(), err.data(), k);
+	} else {
+		stake_store_q3(&w->store, slot.data(), Q2.data(), err.data(), k);
+		stake_store_hash(&w->store, slot.data(), 0, k);
+	}
+
+	for (int i = 0; i < k; i++) {
+		if (err[i]) {
+			reply_error(w, req[i]);
+		} else {
+			// Session key is ready here (stake_store_key or ecc_iotstake_hash).
+			if (w->cfg->cookies)
+				ecc_iotstake_hash(ctxp[i], 0);
+
+			Datagram *r = reply(w, req[i]);
+
+			r->len += wire_encode(r->buf + WIRE_ID_BYTES, WIRE_MAX_BYTES, WIRE_Q2, &out[2*FP_DIGITS*i], 0, 0, 0);
+			w->handshakes++;
+		}
+
+		if (!w->cfg->cookies)
+			stake_store_free(&w->store, slot[i]);
+	}
+
+	memset(ctx.data(), 0, ctx.size()*sizeof(ProtocolIoTStake));
+}
+
+void send_replies(Worker *w) {
+	struct mmsghdr hdr[SERVER_BATCH_MAX];
+	struct iovec iov[SERVER_BATCH_MAX];
+	int sent = 0;
+
+	while (sent < (int)w->out.size()) {
+		int n = (int)w->out.size() - sent;
+
+		if (n > SERVER_BATCH_MAX)
+			n = SERVER_BATCH_MAX;
+
+		for (int i = 0; i < n; i++) {
+			Datagram *d = &w->out[sent + i];
+
+			iov[i].iov_base = d->buf;
+			iov[i].iov_len = d->len;
+			memset(&hdr[i], 0, sizeof(hdr[i]));
+			hdr[i].msg_hdr.msg_name = &d->peer;
+			hdr[i].msg_hdr.msg_namelen = sizeof(d->peer);
+			hdr[i].msg_hdr.msg_iov = &iov[i];
+			hdr[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		int r = sendmmsg(w->fd, hdr, n, 0);
+
+		// Datagrams which can not be sent are dropped, sensors repeat handshake.
+		sent += r > 0 ? r : n;
+	}
+
+	w->out.clear();
+}
+
+// Process all pending datagrams as single batch.
+void process(Worker *w) {
+	std::vector<const Datagram *> hello;
+	std::vector<const Datagram *> q1q2;
+	std::vector<WireMessage> msg;
+	WireMessage m;
+
+	for (int i = 0; i < w->pending; i++) {
+		const Datagram *d = &w->in[i];
+
+		if (d->len == WIRE_ID_BYTES) {
+			hello.push_back(d);
+		} else if (d->len > WIRE_ID_BYTES && wire_decode(&m, d->buf + WIRE_ID_BYTES, d->len - WIRE_ID_BYTES) == d->len - WIRE_ID_BYTES &&
+			m.type == WIRE_Q1Q2) {
+			q1q2.push_back(d);
+			msg.push_back(m);
+		} else {
+			drop(w);
+		}
+	}
+
+	// Round 2 goes first: it finishes sessions, which frees memory for new ones.
+	if (!q1q2.empty())
+		round2(w, q1q2, msg);
+	if (!hello.empty())
+		round1(w, hello);
+
+	send_replies(w);
+
+	w->datagrams += w->pending;
+	w->batches++;
+	w->pending = 0;
+}
+
+void arm_timer(Worker *w, int usec) {
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = usec / 1000000;
+	its.it_value.tv_nsec = (usec % 1000000) * 1000;
+	timerfd_settime(w->timer, 0, &its, 0);
+	w->armed = usec != 0;
+}
+
+// Receive all waiting datagrams, process batch if it is full.
+void receive(Worker *w) {
+	struct mmsghdr hdr[SERVER_BATCH_MAX];
+	struct iovec iov[SERVER_BATCH_MAX];
+
+	for (;;) {
+		int n = w->cfg->batch - w->pending;
+
+		for (int i = 0; i < n; i++) {
+			Datagram *d = &w->in[w->pending + i];
+
+			iov[i].iov_base = d->buf;
+			iov[i].iov_len = sizeof(d->buf);
+			memset(&hdr[i], 0, sizeof(hdr[i]));
+			hdr[i].msg_hdr.msg_name = &d->peer;
+			hdr[i].msg_hdr.msg_namelen = sizeof(d->peer);
+			hdr[i].msg_hdr.msg_iov = &iov[i];
+			hdr[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		int r = recvmmsg(w->fd, hdr, n, MSG_DONTWAIT, 0);
+
+		if (r <= 0)
+			break;
+
+		for (int i = 0; i < r; i++) {
+			w->in[w->pending + i].len = hdr[i].msg_len;
+		}
+
+		w->pending += r;
+
+		if (w->pending == w->cfg->batch) {
+			arm_timer(w, 0);
+			process(w);
+		}
+	}
+
+	if (w->pending && !w->armed) {
+		if (w->cfg->budget > 0) {
+			arm_timer(w, w->cfg->budget);
+		} else {
+			process(w);
+		}
+	}
+}
+
+// Remove half-open sessions which expired.
+void sweep(Worker *w) {
+	time_t now = time(0);
+
+	if (now == w->lastSweep)
+		return;
+
+	for (auto it = w->sessions.begin(); it != w->sessions.end();) {
+		if (it->second.expires < now) {
+			stake_store_free(&w->store, it->second.slot);
+			it = w->sessions.erase(it);
+		} else {
+			++it;
+		}
+	}
+
+	w->lastSweep = now;
+}
+
+int worker(const Config *cfg, int fd) {
+	Worker *w = new Worker();
+	struct epoll_event ev;
+	struct epoll_event events[2];
+
+	w->cfg = cfg;
+	w->fd = fd;
+	w->in.resize(cfg->batch);
+	w->ep = epoll_create1(0);
+	w->timer = timerfd_create(CLOCK_MONOTONIC, 0);
+
+	stake_store_create(&w->store, prvSrv);
+	iotstake_cookie_key(&w->ck, cookieKey);
+	srand(getpid() ^ time(0));
+
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	epoll_ctl(w->ep, EPOLL_CTL_ADD, fd, &ev);
+	ev.data.fd = w->timer;
+	epoll_ctl(w->ep, EPOLL_CTL_ADD, w->timer, &ev);
+
+	while (!stopping) {
+		int n = epoll_wait(w->ep, events, 2, 1000);
+
+		for (int i = 0; i < n; i++) {
+			if (events[i].data.fd == w->timer) {
+				uint64_t expirations;
+
+				if (read(w->timer, &expirations, sizeof(expirations)) > 0 && w->pending) {
+					w->armed = 0;
+					process(w);
+				}
+			} else {
+				receive(w);
+			}
+		}
+
+		sweep(w);
+	}
+
+	printf("worker %d: %ld handshakes, %ld errors, %ld dropped, %ld datagrams in %ld batches (%.2f per batch), "
+		"%zu open sessions\n", getpid(), w->handshakes, w->errors, w->dropped, w->datagrams, w->batches,
+		w->batches ? (double)w->datagrams / w->batches : 0.0, w->sessions.size());
+
+	stake_store_destroy(&w->store);
+	close(w->timer);
+	close(w->ep);
+	close(fd);
+	delete w;
+
+	return 0;
+}
+
+int open_socket(int port) {
+	struct sockaddr_in addr;
+	int fd = socket(AF_INET, SOCK_DGRAM, 0);
+	int one = 1;
+	int size = 4 << 20;
+
+	if (fd < 0)
+		return -1;
+
+	// Every worker has its own socket, kernel spreads sensors among them.
+	setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+int main(int argc, char *argv[]) {
+	Config cfg = {4433, 64, 200, 1, 0, 5};
+	std::vector<pid_t> children;
+	struct sigaction sa;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+			cfg.port = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+			cfg.batch = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+			cfg.budget = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+			cfg.workers = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-k") == 0) {
+			cfg.cookies = 1;
+		} else {
+			std::cout << "usage: server [-p port] [-b batch] [-l latency budget (us)] [-w workers] [-k (cookies)]\n"
+				"STAKE only, PKI handshakes are not served.\n";
+			return 1;
+		}
+	}
+
+	if (cfg.batch < 1)
+		cfg.batch = 1;
+	if (cfg.batch > SERVER_BATCH_MAX)
+		cfg.batch = SERVER_BATCH_MAX;
+	if (cfg.workers < 1)
+		cfg.workers = 1;
+
+	// Without cookies sessions are kept by workers, so second round has to reach
+	// the same worker (SO_REUSEPORT hashes address of sensor, so it does).
+	printf("server: port %d, %d workers, batch %d, latency budget %d us, %s\n", cfg.port, cfg.workers,
+		cfg.batch, cfg.budget, cfg.cookies ? "stateless (cookies)" : "sessions in store");
+	fflush(stdout);
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sigaction(SIGINT, &sa, 0);
+	sigaction(SIGTERM, &sa, 0);
+
+	for (int i = 0; i < cfg.workers; i++) {
+		int fd = open_socket(cfg.port);
+
+		if (fd < 0) {
+			perror("bind");
+			return 1;
+		}
+
+		// The last worker runs in this process.
+		if (i == cfg.workers - 1) {
+			worker(&cfg, fd);
+			break;
+		}
+
+		pid_t pid = fork();
+
+		if (pid == 0)
+			return worker(&cfg, fd);
+
+		close(fd);
+		children.push_back(pid);
+	}
+
+	for (pid_t pid : children) {
+		kill(pid, SIGTERM);
+		waitpid(pid, 0, 0);
+	}
+
+	return 0;
+}
@@ -1,8 +1,16 @@
 #include <iostream>
 #include <cstdlib>
+#include <cstdio>
+#include <cstring>
 #include <ctime>
+#include <vector>
 
+#include "cost.h"
 #include "crypto.h"
+#include "energy.h"
+#include "mem.h"
+#include "store.h"
+#include "perf.h"
 
 unsigned long startTime;
 unsigned long endTime;
@@ -29,22 +37,363 @@ int keygen(void){
 
 // Static SERVER key pair generated by the keygen program.
 Digit prvSrv[FP_DIGITS] = {
-	0x2454fba4, 0x8da7f60f, 0x3373886b, 0xaf7eabb7, 0x72d6f1b9, 0x22674a67
+	ARTH_WORD_DIGITS(0x2454fba4), ARTH_WORD_DIGITS(0x8da7f60f), ARTH_WORD_DIGITS(0x3373886b), ARTH_WORD_DIGITS(0xaf7eabb7),
+	ARTH_WORD_DIGITS(0x72d6f1b9), ARTH_WORD_DIGITS(0x22674a67)
 };
 
 Digit pubSrv[2*FP_DIGITS] = {
-	0xd388264f, 0x3940a178, 0x10710de9, 0xb87bbf09, 0x1b7543dd, 0xd6b941e1, 0xc3a727d3, 0x37aa763e, 0x4a33547c, 0xfbbe8072, 0xe5390cd1, 0x9398e3d4
+	ARTH_WORD_DIGITS(0xd388264f), ARTH_WORD_DIGITS(0x3940a178), ARTH_WORD_DIGITS(0x10710de9), ARTH_WORD_DIGITS(0xb87bbf09),
+	ARTH_WORD_DIGITS(0x1b7543dd), ARTH_WORD_DIGITS(0xd6b941e1), ARTH_WORD_DIGITS(0xc3a727d3), ARTH_WORD_DIGITS(0x37aa763e),
+	ARTH_WORD_DIGITS(0x4a33547c), ARTH_WORD_DIGITS(0xfbbe8072), ARTH_WORD_DIGITS(0xe5390cd1), ARTH_WORD_DIGITS(0x9398e3d4)
 };
 
 // Static MICROCONTROLLER (SENSOR) key pair generated by the keygen program.
 Digit prvMu[FP_DIGITS] = {
-	0x16b1c8fd, 0x0f7eeb08, 0x46a846f0, 0x32593b27, 0x059e4b50, 0x6bb0570f
+	ARTH_WORD_DIGITS(0x16b1c8fd), ARTH_WORD_DIGITS(0x0f7eeb08), ARTH_WORD_DIGITS(0x46a846f0), ARTH_WORD_DIGITS(0x32593b27),
+	ARTH_WORD_DIGITS(0x059e4b50), ARTH_WORD_DIGITS(0x6bb0570f)
 };
 
 Digit pubMu[2*FP_DIGITS] = {
-	0xa2f1b4e6, 0xa3d59896, 0x555b859e, 0x0eb8e223, 0x77a021d3, 0x86883364, 0x2c151e28, 0xcfd3f377, 0xb7795ebf, 0xd59ad5c5, 0x9c0915a0, 0x1eaee60a
+	ARTH_WORD_DIGITS(0xa2f1b4e6), ARTH_WORD_DIGITS(0xa3d59896), ARTH_WORD_DIGITS(0x555b859e), ARTH_WORD_DIGITS(0x0eb8e223),
+	ARTH_WORD_DIGITS(0x77a021d3), ARTH_WORD_DIGITS(0x86883364), ARTH_WORD_DIGITS(0x2c151e28), ARTH_WORD_DIGITS(0xcfd3f377),
+	ARTH_WORD_DIGITS(0xb7795ebf), ARTH_WORD_DIGITS(0xd59ad5c5), ARTH_WORD_DIGITS(0x9c0915a0), ARTH_WORD_DIGITS(0x1eaee60a)
 };
 
+// Known answers (computed independently), the same for every DIGIT_BITS.
+const Digit katScalar[EC_GEN_ORDER_DIGITS] = {
+	ARTH_WORD_DIGITS(0x4b5a6978), ARTH_WORD_DIGITS(0x0f1e2d3c), ARTH_WORD_DIGITS(0x76543210), ARTH_WORD_DIGITS(0xfedcba98),
+	ARTH_WORD_DIGITS(0x89abcdef), ARTH_WORD_DIGITS(0x01234567)
+};
+
+// [katScalar]pubMu.
+const Digit katMultiple[2*FP_DIGITS] = {
+	ARTH_WORD_DIGITS(0xd5facdf9), ARTH_WORD_DIGITS(0x40fc2030), ARTH_WORD_DIGITS(0x98a7dabd), ARTH_WORD_DIGITS(0x598166a6),
+	ARTH_WORD_DIGITS(0x9f519aae), ARTH_WORD_DIGITS(0x181a8271), ARTH_WORD_DIGITS(0x899d6b12), ARTH_WORD_DIGITS(0x960a2699),
+	ARTH_WORD_DIGITS(0xa5605ce5), ARTH_WORD_DIGITS(0x3ef1e631), ARTH_WORD_DIGITS(0xba64f279), ARTH_WORD_DIGITS(0x9962666d)
+};
+
+// ECDSA signature of katDigest under prvSrv.
+const Octet katDigest[24] = {
+	0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b,
+	0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27
+};
+
+const EcdsaSign katSign = {
+	{
+		ARTH_WORD_DIGITS(0xad4d8810), ARTH_WORD_DIGITS(0x42f4e0d6), ARTH_WORD_DIGITS(0x699d8656), ARTH_WORD_DIGITS(0xf4875cdf),
+		ARTH_WORD_DIGITS(0x7fe2cb50), ARTH_WORD_DIGITS(0x1e4be700)
+	},
+	{
+		ARTH_WORD_DIGITS(0x9792d1d3), ARTH_WORD_DIGITS(0x4befb076), ARTH_WORD_DIGITS(0x6f39f8d7), ARTH_WORD_DIGITS(0xb6efda36),
+		ARTH_WORD_DIGITS(0xdc8dcb6f), ARTH_WORD_DIGITS(0xf8b0f8b2)
+	}
+};
+
+// Multiples of points and ECDSA against known answers, return 0 if OK.
+int known_answers() {
+	Digit P[2*FP_DIGITS];
+	Octet digest[24];
+	EcdsaSign sign;
+
+	std::cout << "START: known_answers()\n";
+
+	ecp_generator_multiple(P, prvSrv);
+
+	if (cmp(P, pubSrv, 2*FP_DIGITS) != 0) {
+		std::cout << "Err: [prvSrv]G != pubSrv\n";
+		return 1;
+	}
+
+	assign(P, pubMu, 2*FP_DIGITS);
+	ecp_multiple(P, katScalar);
+
+	if (cmp(P, katMultiple, 2*FP_DIGITS) != 0) {
+		std::cout << "Err: [k]pubMu\n";
+		return 1;
+	}
+
+	if (ecc_ecdsa_verify(&katSign, katDigest, sizeof(katDigest), pubSrv) != 0) {
+		std::cout << "Err: known signature rejected\n";
+		return 1;
+	}
+
+	// Tampered signature and digest are rejected.
+	sign = katSign;
+	sign.s[0] ^= 1;
+
+	if (ecc_ecdsa_verify(&sign, katDigest, sizeof(katDigest), pubSrv) == 0) {
+		std::cout << "Err: tampered signature accepted\n";
+		return 1;
+	}
+
+	memcpy(digest, katDigest, sizeof(digest));
+	digest[23] ^= 1;
+
+	if (ecc_ecdsa_verify(&katSign, digest, sizeof(digest), pubSrv) == 0) {
+		std::cout << "Err: signature of other digest accepted\n";
+		return 1;
+	}
+
+	// Fresh signature (random nonce) is accepted.
+	ecc_ecdsa_sign(&sign, katDigest, sizeof(katDigest), prvSrv);
+
+	if (ecc_ecdsa_verify(&sign, katDigest, sizeof(katDigest), pubSrv) != 0) {
+		std::cout << "Err: fresh signature rejected\n";
+		return 1;
+	}
+
+	std::cout << "STOP: known_answers()\n";
+
+	return 0;
+}
+
+#if defined(STAKE_OPCOUNT)
+// Counters at the start of current step.
+OpCount opsMark;
+
+void ops_begin() {
+	opsMark = op_count;
+}
+
+void ops_end(OpCount *step) {
+	for (int k = 0; k < OP_KINDS; k++)
+		step->n[k] = op_count.n[k] - opsMark.n[k];
+}
+
+// Table of operations per protocol step of both sides.
+void print_ops(const char *const *names, const OpCount *srv, const OpCount *mu, int steps) {
+	printf("%-6s %-4s", "step", "side");
+
+	for (int k = 0; k < OP_KINDS; k++)
+		printf(" %9s", op_names[k]);
+
+	printf("\n");
+
+	for (int side = 0; side < 2; side++) {
+		const OpCount *ops = side ? mu : srv;
+		OpCount total = {};
+
+		for (int i = 0; i <= steps; i++) {
+			const OpCount *row = i < steps ? &ops[i] : &total;
+
+			printf("%-6s %-4s", i < steps ? names[i] : "total", side ? "MU" : "SRV");
+
+			for (int k = 0; k < OP_KINDS; k++) {
+				printf(" %9lu", row->n[k]);
+
+				if (i < steps)
+					total.n[k] += row->n[k];
+			}
+
+			printf("\n");
+		}
+	}
+}
+
+// No curve work before the first handshake: nothing is counted before main() and the first
+// multiple of generator costs the same as the next one (comb is constant, not built on first use).
+int startup_check() {
+	OpCount first;
+	OpCount next;
+	Digit P[2*FP_DIGITS];
+
+	std::cout << "START: startup_check()" << std::endl;
+
+	for (int k = 0; k < OP_KINDS; k++) {
+		if (op_count.n[k] != 0) {
+			std::cout << "Err: " << op_count.n[k] << " " << op_names[k] << " before main()\n";
+			return 1;
+		}
+	}
+
+	ops_begin();
+	ecp_generator_multiple(P, prvSrv);
+	ops_end(&first);
+	ops_begin();
+	ecp_generator_multiple(P, prvSrv);
+	ops_end(&next);
+
+	for (int k = 0; k < OP_KINDS; k++) {
+		if (first.n[k] != next.n[k]) {
+			std::cout << "Err: first multiple of generator does " << first.n[k] - next.n[k] << " more "
+				<< op_names[k] << "\n";
+			return 1;
+		}
+	}
+
+	std::cout << "STOP: startup_check()\n";
+
+	return 0;
+}
+
+// Operations of every step of single handshake (STAKE_OPCOUNT).
+int iotstake_ops() {
+	static const char *const names[] = { "init", "q1", "q2", "q3", "hash" };
+	ProtocolIoTStake ctxSrv;
+	ProtocolIoTStake ctxMu;
+	Digit q1Srv[2*FP_DIGITS];
+	Digit q2Srv[2*FP_DIGITS];
+	Digit q1Mu[2*FP_DIGITS];
+	Digit q2Mu[2*FP_DIGITS];
+	Octet aesKeySrv[16];
+	Octet aesKeyMu[16];
+	OpCount srv[5];
+	OpCount mu[5];
+	int err = 0;
+
+	std::cout << "START: iotstake_ops() [" << DIGIT_BITS << "-bit digits]" << std::endl;
+
+	ops_begin(); err |= ecc_iotstake_init(&ctxSrv, prvSrv, pubMu, 0); ops_end(&srv[0]);
+	ops_begin(); err |= ecc_iotstake_q1(&ctxSrv, q1Srv); ops_end(&srv[1]);
+	ops_begin(); err |= ecc_iotstake_init(&ctxMu, prvMu, pubSrv, 0); ops_end(&mu[0]);
+	ops_begin(); err |= ecc_iotstake_q1(&ctxMu, q1Mu); ops_end(&mu[1]);
+	ops_begin(); err |= ecc_iotstake_q2(&ctxMu, q1Srv, q2Srv); ops_end(&mu[2]);
+	ops_begin(); err |= ecc_iotstake_q2(&ctxSrv, q1Mu, q2Mu); ops_end(&srv[2]);
+	ops_begin(); err |= ecc_iotstake_q3(&ctxSrv, q2Srv); ops_end(&srv[3]);
+	ops_begin(); err |= ecc_iotstake_q3(&ctxMu, q2Mu); ops_end(&mu[3]);
+	ops_begin(); err |= ecc_iotstake_hash(&ctxSrv, aesKeySrv); ops_end(&srv[4]);
+	ops_begin(); err |= ecc_iotstake_hash(&ctxMu, aesKeyMu); ops_end(&mu[4]);
+
+	if (err != 0 || memcmp(aesKeySrv, aesKeyMu, sizeof(aesKeySrv)) != 0) {
+		std::cout << "Err: handshake failed\n";
+		return 1;
+	}
+
+	print_ops(names, srv, mu, 5);
+	std::cout << "STOP: iotstake_ops()\n";
+
+	return 0;
+}
+#endif
+
+// Peak memory of single step: stack and used parts of global scratch.
+typedef struct MemUse_st {
+	long stack;
+	long arth;
+	long ecc;
+	long batch;
+} MemUse;
+
+// Runs step on painted stack with painted scratch.
+int mem_step(MemUse *use, void (*fn)(void *), void *arg) {
+	mem_paint(arth_tmp, sizeof(arth_tmp));
+	mem_paint(ecc_tmp, sizeof(ecc_tmp));
+	mem_paint(ecc_batch_tmp, sizeof(ecc_batch_tmp));
+
+	if (mem_stack_peak(&use->stack, fn, arg) != 0)
+		return 1;
+
+	use->arth = mem_high_water(arth_tmp, sizeof(arth_tmp));
+	use->ecc = mem_high_water(ecc_tmp, sizeof(ecc_tmp));
+	use->batch = mem_high_water(ecc_batch_tmp, sizeof(ecc_batch_tmp));
+
+	return 0;
+}
+
+// Table of peak memory per protocol step of both sides (octets), context of side included.
+void print_mem(const char *const *names, const MemUse *srv, const MemUse *mu, int steps, long ctx) {
+	printf("scratch: arth_tmp %ld B, ecc_tmp %ld B, ecc_batch_tmp %ld B; context %ld B\n", (long)sizeof(arth_tmp),
+		(long)sizeof(ecc_tmp), (long)sizeof(ecc_batch_tmp), ctx);
+	printf("%-6s %-4s %8s %8s %8s %9s %8s %8s\n", "step", "side", "stack", "arth_tmp", "ecc_tmp", "batch_tmp",
+		"context", "total");
+
+	for (int side = 0; side < 2; side++) {
+		const MemUse *use = side ? mu : srv;
+		MemUse peak = {};
+		long peakTotal = 0;
+
+		for (int i = 0; i <= steps; i++) {
+			const MemUse *row = i < steps ? &use[i] : &peak;
+			long total = row->stack + row->arth + row->ecc + row->batch + ctx;
+
+			if (i < steps) {
+				peak.stack = row->stack > peak.stack ? row->stack : peak.stack;
+				peak.arth = row->arth > peak.arth ? row->arth : peak.arth;
+				peak.ecc = row->ecc > peak.ecc ? row->ecc : peak.ecc;
+				peak.batch = row->batch > peak.batch ? row->batch : peak.batch;
+				peakTotal = total > peakTotal ? total : peakTotal;
+			} else {
+				total = peakTotal;
+			}
+
+			printf("%-6s %-4s %8ld %8ld %8ld %9ld %8ld %8ld\n", i < steps ? names[i] : "peak", side ? "MU" : "SRV",
+				row->stack, row->arth, row->ecc, row->batch, ctx, total);
+		}
+	}
+}
+
+// State of single handshake profiled step by step (-s).
+struct {
+	ProtocolIoTStake srv;
+	ProtocolIoTStake mu;
+	Digit q1Srv[2*FP_DIGITS];
+	Digit q2Srv[2*FP_DIGITS];
+	Digit q1Mu[2*FP_DIGITS];
+	Digit q2Mu[2*FP_DIGITS];
+	Octet aesKeySrv[16];
+	Octet aesKeyMu[16];
+	int err;
+} hs;
+
+// Peak memory of every step of single handshake.
+int iotstake_mem() {
+	static const char *const names[] = { "init", "q1", "q2", "q3", "hash" };
+	// Steps in protocol order: side (0 SRV, 1 MU), step, operation.
+	static const struct {
+		int side;
+		int step;
+		void (*fn)(void *);
+	} run[] = {
+		{ 0, 0, [](void *) { hs.err |= ecc_iotstake_init(&hs.srv, prvSrv, pubMu, 0); } },
+		{ 0, 1, [](void *) { hs.err |= ecc_iotstake_q1(&hs.srv, hs.q1Srv); } },
+		{ 1, 0, [](void *) { hs.err |= ecc_iotstake_init(&hs.mu, prvMu, pubSrv, 0); } },
+		{ 1, 1, [](void *) { hs.err |= ecc_iotstake_q1(&hs.mu, hs.q1Mu); } },
+		{ 1, 2, [](void *) { hs.err |= ecc_iotstake_q2(&hs.mu, hs.q1Srv, hs.q2Srv); } },
+		{ 0, 2, [](void *) { hs.err |= ecc_iotstake_q2(&hs.srv, hs.q1Mu, hs.q2Mu); } },
+		{ 0, 3, [](void *) { hs.err |= ecc_iotstake_q3(&hs.srv, hs.q2Srv); } },
+		{ 1, 3, [](void *) { hs.err |= ecc_iotstake_q3(&hs.mu, hs.q2Mu); } },
+		{ 0, 4, [](void *) { hs.err |= ecc_iotstake_hash(&hs.srv, hs.aesKeySrv); } },
+		{ 1, 4, [](void *) { hs.err |= ecc_iotstake_hash(&hs.mu, hs.aesKeyMu); } }
+	};
+	MemUse use[2][5];
+
+	std::cout << "START: iotstake_mem()" << std::endl;
+	hs.err = 0;
+
+	for (const auto &r : run) {
+		if (mem_step(&use[r.side][r.step], r.fn, 0) != 0) {
+			std::cout << "Err: no memory for stack\n";
+			return 1;
+		}
+	}
+
+	if (hs.err != 0 || memcmp(hs.aesKeySrv, hs.aesKeyMu, sizeof(hs.aesKeySrv)) != 0) {
+		std::cout << "Err: handshake failed\n";
+		return 1;
+	}
+
+	print_mem(names, use[0], use[1], 5, sizeof(ProtocolIoTStake));
+	std::cout << "STOP: iotstake_mem()\n";
+
+	return 0;
+}
+
+// Hardware counters (-e) and energy (-j) around protocol phases, off otherwise.
+PerfPhase perfPhase;
+EnergyPhase energyPhase;
+
+void phase_begin() {
+	perf_phase_begin(&perfPhase);
+	energy_phase_begin(&energyPhase);
+}
+
+// Counters and energy per handshake of the last B handshakes.
+void phase_end(int B) {
+	energy_phase_end(&energyPhase, stdout, B);
+	perf_phase_end(&perfPhase, stdout, B);
+	fflush(stdout);
+}
+
 int iotstake(int B = 1) {
 	std::cout << "START: iotstake()\n";
 	// Initialization of variables and data structures ...
@@ -66,6 +415,7 @@ int iotstake(int B = 1) {
 
 	// !!! START OF THE INTERACTIVE PROTOCOL SECTION !!!
 	// [1 SRV] Protocol initialization, determination of q1Srv.
+	phase_begin();
 	startTime = clock();
 
 	for (int i = 0; i < B; i++) {
@@ -82,12 +432,14 @@ int iotstake(int B = 1) {
 
 	endTime = clock();
 	std::cout << "[1 SRV] init(1M), q1(1M): ";
-	std::cout << ((double)(endTime - startTime)/(B*CLOCKS_PER_SEC)) << "ms\n";
+	std::cout << (1000.0*(endTime - startTime)/(B*CLOCKS_PER_SEC)) << "ms\n";
+	phase_end(B);
 
 	// Sending q1Srv to the microcontroller (sensor).
 	// ...
 	// Receiving q1Srv from the server.
 	// [1 MU] Protocol initialization, determination of q1Mu and q2Srv.
+	phase_begin();
 	startTime = clock();
 
 	for (int i = 0; i < B; i++) {
@@ -109,12 +461,14 @@ int iotstake(int B = 1) {
 
 	endTime = clock();
 	std::cout << "[1 MU ] init(1M), q1(1M), q2(1M): ";
-	std::cout << ((double)(endTime - startTime)/(B*CLOCKS_PER_SEC)) << "ms\n";
+	std::cout << (1000.0*(endTime - startTime)/(B*CLOCKS_PER_SEC)) << "ms\n";
+	phase_end(B);
 
 	// Sending q1Mu and q2Srv to the server.
 	// ...
 	// Receiving q1Mu, q2Srv from the microcontroller (sensor).
 	// [2 SRV] Determination of q2Mu and q3Srv.
+	phase_begin();
 	startTime = clock();
 
 	for (int i = 0; i < B; i++) {
@@ -131,12 +485,14 @@ int iotstake(int B = 1) {
 
 	endTime = clock();
 	std::cout << "[2 SRV] q2(1M), q3(1M): ";
-	std::cout << ((double)(endTime - startTime)/(B*CLOCKS_PER_SEC)) << "ms\n";
+	std::cout << (1000.0*(endTime - startTime)/(B*CLOCKS_PER_SEC)) << "ms\n";
+	phase_end(B);
 
 	// Sending q2Mu to the microcontroller (sensor).
 	// ...
 	// Receiving q2Mu from the server.
 	// [2 MU] Determination of q3Mu.
+	phase_begin();
 	startTime = clock();
 
 	for (int i = 0; i < B; i++) {
@@ -148,10 +504,12 @@ int iotstake(int B = 1) {
 
 	endTime = clock();
 	std::cout << "[2 MU ] q3(1M): ";
-	std::cout << ((double)(endTime - startTime)/(B*CLOCKS_PER_SEC)) << "ms\n";
+	std::cout << (1000.0*(endTime - startTime)/(B*CLOCKS_PER_SEC)) << "ms\n";
+	phase_end(B);
 
 	// !!! END OF THE INTERACTIVE PROTOCOL SECTION.
 	// [3 SRV] Determination of the hash and retrieval as the key for the AES-128 algorithm.
+	phase_begin();
 	startTime = clock();
 
 	if ((err = ecc_iotstake_hash(&ctxSrv, aesKeySrv)) != 0) {
@@ -161,8 +519,10 @@ int iotstake(int B = 1) {
 
 	endTime = clock();
 	std::cout << "[3 SRV] AES-128\n";
+	phase_end(1);
 
 	// [3 MU] Determination of the hash and retrieval as the key for the AES-128 algorithm.
+	phase_begin();
 	startTime = clock();
 
 	if ((err = ecc_iotstake_hash(&ctxMu, aesKeyMu)) != 0) {
@@ -172,16 +532,306 @@ int iotstake(int B = 1) {
 
 	endTime = clock();
 	std::cout << "[3 MU ] AES-128\n";
+	phase_end(1);
 
 	std::cout << "STOP: iotstake()\n";
 
 	return 0;
 }
 
+void print_store(const char *label, const StakeStore *st) {
+	StakeStoreStats stats;
+
+	stake_store_stats(st, &stats);
+	std::cout << label << " sessions: " << stats.sessions << ", allocated: " << stats.allocatedBytes;
+	std::cout << "B, live: " << stats.liveBytes << "B";
+
+	if (stats.sessions) {
+		std::cout << " (" << ((double)stats.liveBytes/stats.sessions) << "B per session)";
+	}
+
+	std::cout << "\n";
+}
+
+// Handshakes of B sessions of store, return 0 if OK.
+int store_handshakes(StakeStore *store, const int *slot, int B) {
+	ProtocolIoTStake ctxMu;
+
+	std::vector<Digit> pubB(B*2*FP_DIGITS);
+	std::vector<Digit> q1Srv(B*2*FP_DIGITS);
+	std::vector<Digit> q1Mu(B*2*FP_DIGITS);
+	std::vector<Digit> q2Srv(B*2*FP_DIGITS);
+	std::vector<Digit> q2Mu(B*2*FP_DIGITS);
+	Octet aesKeyMu[16];
+
+	int err = 0;
+
+	clock_t startTime;
+	clock_t endTime;
+
+	for (int i = 0; i < B; i++)
+		assign(&pubB[2*FP_DIGITS*i], pubMu, 2*FP_DIGITS);
+
+	// [1 SRV] Protocol initialization, determination of q1Srv for all sessions.
+	startTime = clock();
+	stake_store_init(store, slot, pubB.data(), 0, B);
+	print_store("[1 SRV] init:", store);
+
+	if ((err = stake_store_q1(store, slot, q1Srv.data(), 0, B)) != 0) {
+		std::cout << "Err 1: " << err << "\n";
+		return err;
+	}
+
+	endTime = clock();
+	std::cout << "[1 SRV] init(0M), q1(1M): ";
+	std::cout << (1000.0*(endTime - startTime)/(B*CLOCKS_PER_SEC)) << "ms\n";
+	print_store("[1 SRV] q1:", store);
+
+	// [1 MU] Every sensor determines q1Mu and q2Srv.
+	for (int i = 0; i < B; i++) {
+		ecc_iotstake_init(&ctxMu, prvMu, pubSrv, 0);
+		ecc_iotstake_q1(&ctxMu, &q1Mu[2*FP_DIGITS*i]);
+		ecc_iotstake_q2(&ctxMu, &q1Srv[2*FP_DIGITS*i], &q2Srv[2*FP_DIGITS*i]);
+	}
+
+	// [2 SRV] Determination of q2Mu and q3Srv for all sessions.
+	startTime = clock();
+
+	if ((err = stake_store_q2(store, slot, q1Mu.data(), q2Mu.data(), 0, B)) != 0) {
+		std::cout << "Err 5: " << err << "\n";
+		return err;
+	}
+
+	if ((err = stake_store_q3(store, slot, q2Srv.data(), 0, B)) != 0) {
+		std::cout << "Err 6: " << err << "\n";
+		return err;
+	}
+
+	endTime = clock();
+	std::cout << "[2 SRV] q2(1M), q3(1M): ";
+	std::cout << (1000.0*(endTime - startTime)/(B*CLOCKS_PER_SEC)) << "ms\n";
+	print_store("[2 SRV] q3:", store);
+
+	// [3 SRV] Determination of the hash, compared with key of the last sensor.
+	stake_store_hash(store, slot, 0, B);
+	print_store("[3 SRV] hash:", store);
+
+	ecc_iotstake_q3(&ctxMu, &q2Mu[2*FP_DIGITS*(B - 1)]);
+	ecc_iotstake_hash(&ctxMu, aesKeyMu);
+
+	for (int i = 0; i < 16; i++) {
+		if (stake_store_key(store, slot[B - 1])[i] != aesKeyMu[i]) {
+			std::cout << "Err 9: keys differ\n";
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+int iotstake_store(int B = 1) {
+	std::cout << "START: iotstake_store()\n";
+	// Server sessions are kept in the session store, sensor uses plain context.
+	StakeStore store;
+	std::vector<int> slot;
+
+	int err = 0;
+
+	stake_store_create(&store, prvSrv);
+
+	for (int i = 0; i < B; i++) {
+		int s = stake_store_alloc(&store);
+
+		if (s < 0) {
+			std::cout << "Err 0: store is full\n";
+			err = 1;
+			break;
+		}
+
+		slot.push_back(s);
+	}
+
+	// Sessions are released on every path.
+	if (err == 0)
+		err = store_handshakes(&store, slot.data(), B);
+
+	for (int s : slot)
+		stake_store_free(&store, s);
+
+	print_store("[3 SRV] free:", &store);
+	stake_store_destroy(&store);
+
+	if (err != 0)
+		return err;
+
+	std::cout << "STOP: iotstake_store()\n";
+
+	return 0;
+}
+
+int iotstake_resume(int B = 1) {
+	std::cout << "START: iotstake_resume()\n";
+	// Full handshake is done once, then sensor reconnects B times.
+	ProtocolIoTStake ctxSrv;
+	ProtocolIoTStake ctxMu;
+	ProtocolIoTResume resSrv;
+	ProtocolIoTResume resMu;
+	StakeTickets tickets;
+
+	Digit q1Srv[2*FP_DIGITS];
+	Digit q1Mu[2*FP_DIGITS];
+	Digit q2Srv[2*FP_DIGITS];
+	Digit q2Mu[2*FP_DIGITS];
+
+	Octet secretSrv[RESUME_SECRET_BYTES];
+	Octet secretMu[RESUME_SECRET_BYTES];
+	Octet id[RESUME_TICKET_BYTES];
+	Octet nonceC[RESUME_NONCE_BYTES];
+	Octet nonceS[RESUME_NONCE_BYTES];
+	Octet confirm[16];
+	Octet aesKeySrv[16];
+	Octet aesKeyMu[16];
+
+	int err = 0;
+
+	clock_t startTime;
+	clock_t endTime;
+	clock_t srvTime = 0;
+	clock_t muTime = 0;
+
+	ecc_iotstake_init(&ctxSrv, prvSrv, pubMu, 0);
+	ecc_iotstake_q1(&ctxSrv, q1Srv);
+	ecc_iotstake_init(&ctxMu, prvMu, pubSrv, 0);
+	ecc_iotstake_q1(&ctxMu, q1Mu);
+	ecc_iotstake_q2(&ctxMu, q1Srv, q2Srv);
+	ecc_iotstake_q2(&ctxSrv, q1Mu, q2Mu);
+	ecc_iotstake_q3(&ctxSrv, q2Srv);
+	ecc_iotstake_q3(&ctxMu, q2Mu);
+
+	// Both sides determine resumption secret, server keeps it in the ticket store.
+	ecc_iotstake_resumption(&ctxSrv, secretSrv);
+	ecc_iotstake_resumption(&ctxMu, secretMu);
+
+	// Points which differ in bit 16 (not in key of session hash) give the same session key,
+	// resumption secret has to differ.
+	Digit Q3[2*FP_DIGITS];
+	Octet hash[2][16];
+	Octet secret[2][RESUME_SECRET_BYTES];
+
+	assign(Q3, ctxSrv.Q3, 2*FP_DIGITS);
+	ecc_point_hash(hash[0], Q3);
+	ecc_point_resumption(secret[0], Q3);
+	Q3[16 / DIGIT_BITS] ^= (Digit)1 << (16 % DIGIT_BITS);
+	ecc_point_hash(hash[1], Q3);
+	ecc_point_resumption(secret[1], Q3);
+
+	if (memcmp(hash[0], hash[1], 16) != 0 || memcmp(secret[0], secret[1], RESUME_SECRET_BYTES) == 0) {
+		std::cout << "Err 23: resumption secret depends on key of session hash only\n";
+		return 1;
+	}
+
+	stake_tickets_create(&tickets, 1024);
+	stake_tickets_put(&tickets, secretSrv);
+
+	for (int i = 0; i < B; i++) {
+		// [1 MU] Ticket identifier and nonce of sensor.
+		startTime = clock();
+		iotstake_resume_init(&resMu, secretMu, 0);
+		iotstake_resume_q1(&resMu, id, nonceC);
+		endTime = clock();
+		muTime += endTime - startTime;
+
+		// [1 SRV] Secret from the ticket store, nonce and confirmation of server.
+		startTime = clock();
+
+		if ((err = stake_tickets_take(&tickets, id, secretSrv)) != 0) {
+			std::cout << "Err 20: " << err << "\n";
+			return err;
+		}
+
+		iotstake_resume_init(&resSrv, secretSrv, 0);
+		iotstake_resume_q2(&resSrv, nonceC, nonceS, confirm);
+		iotstake_resume_hash(&resSrv, aesKeySrv, secretSrv);
+		stake_tickets_put(&tickets, secretSrv);
+		endTime = clock();
+		srvTime += endTime - startTime;
+
+		// [2 MU] Check of confirmation, new session key.
+		startTime = clock();
+
+		if ((err = iotstake_resume_q3(&resMu, nonceS, confirm)) != 0) {
+			std::cout << "Err 21: " << err << "\n";
+			return err;
+		}
+
+		iotstake_resume_hash(&resMu, aesKeyMu, secretMu);
+		endTime = clock();
+		muTime += endTime - startTime;
+
+		for (int j = 0; j < 16; j++) {
+			if (aesKeySrv[j] != aesKeyMu[j]) {
+				std::cout << "Err 22: keys differ\n";
+				return 1;
+			}
+		}
+	}
+
+	std::cout << "[1 SRV] resume(0M): ";
+	std::cout << ((double)srvTime/(B*CLOCKS_PER_SEC)) << "s\n";
+	std::cout << "[1 MU ] resume(0M): ";
+	std::cout << ((double)muTime/(B*CLOCKS_PER_SEC)) << "s\n";
+
+	stake_tickets_destroy(&tickets);
+
+	std::cout << "STOP: iotstake_resume()\n";
+
+	return 0;
+}
+
 int main(int argc, char *argv[]) {
 	int B = 100;
-	if (argc == 2) {
-		B = atoi(argv[1]);
+	int energy = 0;
+	int mem = 0;
+	const char *profile = "profiles/x86-64.prof";
+
+	// [-e] hardware counters per phase, [-j [-m profile]] energy per phase, [-s] peak memory per step,
+	// [B] handshakes per phase.
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-e") == 0) {
+			perf_phase_open(&perfPhase, stderr);
+		} else if (strcmp(argv[i], "-s") == 0) {
+			mem = 1;
+		} else if (strcmp(argv[i], "-j") == 0) {
+			energy = 1;
+		} else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+			profile = argv[++i];
+		} else {
+			B = atoi(argv[i]);
+		}
+
+		if (B < 1) {
+			std::cerr << "usage: ./stake [-e] [-j [-m profile]] [-s] [handshakes per phase > 0]\n";
+			return 1;
+		}
 	}
+
+#if defined(STAKE_OPCOUNT)
+	if (startup_check())
+		return 1;
+#endif
+
+	if (known_answers())
+		return 1;
+
+	if (energy && energy_phase_open(&energyPhase, profile, stderr) != 0)
+		return 1;
+
 	iotstake(B);
+	iotstake_store(B);
+	iotstake_resume(B);
+	if (mem)
+		iotstake_mem();
+#if defined(STAKE_OPCOUNT)
+	iotstake_ops();
+#endif
 }
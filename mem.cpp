@@ -0,0 +1,90 @@
+#include <string.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "mem.h"
+
+/* Operation run by mem_stack_run() and contexts of both stacks. */
+static void (*mem_fn)(void *);
+static void *mem_arg;
+static ucontext_t mem_caller;
+static ucontext_t mem_callee;
+
+static void mem_stack_run(void)
+{
+	mem_fn(mem_arg);
+}
+
+static void mem_nop(void *)
+{
+}
+
+void mem_paint(void *buf, long len)
+{
+	memset(buf, MEM_PAINT, len);
+}
+
+long mem_high_water(const void *buf, long len)
+{
+	const unsigned char *p = (const unsigned char *)buf;
+
+	while (len > 0 && p[len - 1] == MEM_PAINT)
+		len--;
+
+	return len;
+}
+
+/* Octets of stack used by fn with frames of makecontext() trampoline. */
+static int mem_stack_used(long *used, void (*fn)(void *), void *arg)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	unsigned char *map;
+	unsigned char *stack;
+	long low;
+
+	map = (unsigned char *)mmap(0, MEM_STACK_BYTES + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+		-1, 0);
+
+	if (map == MAP_FAILED)
+		return 1;
+
+	/* Guard page below stack. */
+	mprotect(map, page, PROT_NONE);
+	stack = map + page;
+	mem_paint(stack, MEM_STACK_BYTES);
+
+	mem_fn = fn;
+	mem_arg = arg;
+
+	getcontext(&mem_callee);
+	mem_callee.uc_stack.ss_sp = stack;
+	mem_callee.uc_stack.ss_size = MEM_STACK_BYTES;
+	mem_callee.uc_link = &mem_caller;
+	makecontext(&mem_callee, mem_stack_run, 0);
+	swapcontext(&mem_caller, &mem_callee);
+
+	for (low = 0; low < MEM_STACK_BYTES && stack[low] == MEM_PAINT; low++)
+		;
+
+	*used = MEM_STACK_BYTES - low;
+	munmap(map, MEM_STACK_BYTES + page);
+
+	return 0;
+}
+
+int mem_stack_peak(long *peak, void (*fn)(void *), void *arg)
+{
+	static long base = -1;
+
+	/* Trampoline frames are measured with empty operation once. */
+	if (base < 0 && mem_stack_used(&base, mem_nop, 0) != 0)
+		return 1;
+
+	if (mem_stack_used(peak, fn, arg) != 0)
+		return 1;
+
+	*peak = *peak > base ? *peak - base : 0;
+
+	return 0;
+}
@@ -0,0 +1,63 @@
+#ifndef __MEM_H
+#define __MEM_H
+
+/**
+ * \defgroup mem_group Memory profiler
+ * \brief Peak stack and scratch memory of single operation.
+ *
+ * Memory is painted with \ref MEM_PAINT before the operation and scanned
+ * for the last overwritten byte after it. Stack of the operation is
+ * separate stack of \ref MEM_STACK_BYTES (ucontext) with inaccessible page
+ * below, so overflow ends with fault instead of damage. Bytes which are
+ * written with value equal to paint are not seen, so results may be
+ * smaller by few bytes. On microcontroller the same is done with the
+ * region below stack pointer.
+ *
+ * \{
+ */
+
+/** \brief Value of painted octets. */
+#define MEM_PAINT 0xA5
+
+/** \brief Size of stack of profiled operation. */
+#define MEM_STACK_BYTES (256*1024)
+
+/**
+ * \brief Paint memory.
+ *
+ * \param[out] buf -
+ *   memory.
+ * \param[in] len -
+ *   octets of \a buf.
+ */
+extern void mem_paint(void *buf, long len);
+
+/**
+ * \brief High-water mark of painted memory used from its start.
+ *
+ * \param[in] buf -
+ *   memory painted by \ref mem_paint.
+ * \param[in] len -
+ *   octets of \a buf.
+ *
+ * \return octets from start of \a buf up to last changed octet.
+ */
+extern long mem_high_water(const void *buf, long len);
+
+/**
+ * \brief Run operation on painted stack.
+ *
+ * \param[out] peak -
+ *   octets of stack used by \a fn (stack grows down).
+ * \param[in] fn -
+ *   profiled operation.
+ * \param[in] arg -
+ *   argument of \a fn.
+ *
+ * \return 0 if operation is profiled, 1 if stack cannot be allocated.
+ */
+extern int mem_stack_peak(long *peak, void (*fn)(void *), void *arg);
+
+/** \} */
+
+#endif /* __MEM_H */
@@ -0,0 +1,176 @@
+#include <string.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "perf.h"
+
+const char *const perf_names[PERF_EVENTS] = {
+	"cycles", "instructions", "branch_misses", "l1d_misses", "task_clock"
+};
+
+#if defined(__linux__)
+/* Type and configuration of every event. */
+static const unsigned long long perf_config[PERF_EVENTS][2] = {
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	{ PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+		| (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+	{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK }
+};
+#endif
+
+int perf_open(PerfCounters *pc)
+{
+	int opened = 0;
+	int e;
+
+	for (e = 0; e < PERF_EVENTS; e++) {
+		pc->fd[e] = -1;
+
+#if defined(__linux__)
+		struct perf_event_attr attr;
+
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = (unsigned)perf_config[e][0];
+		attr.config = perf_config[e][1];
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+		pc->fd[e] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+
+		if (pc->fd[e] >= 0)
+			opened++;
+#endif
+	}
+
+	return opened;
+}
+
+void perf_close(PerfCounters *pc)
+{
+	int e;
+
+	for (e = 0; e < PERF_EVENTS; e++) {
+#if defined(__linux__)
+		if (pc->fd[e] >= 0)
+			close(pc->fd[e]);
+#endif
+		pc->fd[e] = -1;
+	}
+}
+
+void perf_warn(FILE *out, const PerfCounters *pc)
+{
+	int missing = 0;
+	int e;
+
+	for (e = 0; e < PERF_EVENTS; e++) {
+		if (pc->fd[e] < 0)
+			fprintf(out, "%s %s", missing++ ? "" : "Warn: counters not available:", perf_names[e]);
+	}
+
+	if (missing)
+		fprintf(out, "\n");
+}
+
+void perf_read(const PerfCounters *pc, PerfSample *s)
+{
+	int e;
+
+	for (e = 0; e < PERF_EVENTS; e++) {
+		s->v[e] = -1;
+
+#if defined(__linux__)
+		unsigned long long buf[3];
+
+		/* Value, time enabled, time running. */
+		if (pc->fd[e] < 0 || read(pc->fd[e], buf, sizeof(buf)) != (ssize_t)sizeof(buf))
+			continue;
+
+		if (buf[2] == 0)
+			s->v[e] = 0;
+		else if (buf[2] < buf[1])
+			s->v[e] = (double)buf[0]*buf[1]/buf[2];
+		else
+			s->v[e] = (double)buf[0];
+#endif
+	}
+}
+
+void perf_diff(PerfSample *dst, const PerfSample *start, const PerfSample *end, double ops)
+{
+	int e;
+
+	for (e = 0; e < PERF_EVENTS; e++) {
+		if (start->v[e] < 0 || end->v[e] < 0 || ops <= 0)
+			dst->v[e] = -1;
+		else
+			dst->v[e] = (end->v[e] - start->v[e])/ops;
+	}
+}
+
+/* Value or "n/a" in field of width 10. */
+static void perf_field(FILE *out, const char *name, double v)
+{
+	if (v < 0)
+		fprintf(out, " %s %10s", name, "n/a");
+	else
+		fprintf(out, " %s %10.0f", name, v);
+}
+
+void perf_print(FILE *out, const char *label, const PerfSample *d)
+{
+	const double *v = d->v;
+
+	fprintf(out, "%s", label);
+	perf_field(out, "cycles", v[PERF_CYCLES]);
+	perf_field(out, "instr", v[PERF_INSTRUCTIONS]);
+
+	if (v[PERF_CYCLES] > 0 && v[PERF_INSTRUCTIONS] >= 0)
+		fprintf(out, " IPC %5.2f", v[PERF_INSTRUCTIONS]/v[PERF_CYCLES]);
+	else
+		fprintf(out, " IPC %5s", "n/a");
+
+	perf_field(out, "br-miss", v[PERF_BRANCH_MISSES]);
+	perf_field(out, "L1d-miss", v[PERF_L1D_MISSES]);
+
+	if (v[PERF_TASK_CLOCK] < 0)
+		fprintf(out, " cpu %10s\n", "n/a");
+	else
+		fprintf(out, " cpu %8.3fus\n", v[PERF_TASK_CLOCK]/1e3);
+}
+
+int perf_phase_open(PerfPhase *ph, FILE *warn)
+{
+	int opened = perf_open(&ph->pc);
+
+	perf_warn(warn, &ph->pc);
+	ph->on = opened > 0;
+
+	return opened;
+}
+
+void perf_phase_begin(PerfPhase *ph)
+{
+	if (ph->on)
+		perf_read(&ph->pc, &ph->start);
+}
+
+void perf_phase_end(const PerfPhase *ph, FILE *out, int ops)
+{
+	PerfSample end, d;
+
+	if (!ph->on)
+		return;
+
+	perf_read(&ph->pc, &end);
+	perf_diff(&d, &ph->start, &end, ops);
+	perf_print(out, "        perf:", &d);
+}
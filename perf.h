@@ -0,0 +1,161 @@
+#ifndef __PERF_H
+#define __PERF_H
+
+#include <stdio.h>
+
+/**
+ * \defgroup perf_group Hardware counters
+ * \brief Linux perf_event_open counters of calling thread.
+ *
+ * Counters count in user space only (allowed with perf_event_paranoid up
+ * to 2). Every counter is opened alone, so counters which cannot be
+ * opened (no PMU in virtual machine or container, seccomp, other
+ * architecture) are skipped and reported as not available, the rest still
+ * count. When the kernel multiplexes counters, values are scaled by
+ * enabled/running time.
+ *
+ * \{
+ */
+
+/** \brief Counted events. */
+enum PerfEvent {
+	/** \brief Core cycles. */
+	PERF_CYCLES = 0,
+	/** \brief Retired instructions. */
+	PERF_INSTRUCTIONS,
+	/** \brief Mispredicted branches. */
+	PERF_BRANCH_MISSES,
+	/** \brief Level 1 data cache read misses. */
+	PERF_L1D_MISSES,
+	/** \brief CPU time of thread (nanoseconds, software counter). */
+	PERF_TASK_CLOCK,
+	/** \brief Number of events. */
+	PERF_EVENTS
+};
+
+/** \brief Short names of events. */
+extern const char *const perf_names[PERF_EVENTS];
+
+/** \brief Open counters. */
+typedef struct PerfCounters_st {
+	/** \brief Descriptor of every event (-1 - not available). */
+	int fd[PERF_EVENTS];
+} PerfCounters;
+
+/** \brief Values of counters. */
+typedef struct PerfSample_st {
+	/** \brief Scaled value of every event (negative - not available). */
+	double v[PERF_EVENTS];
+} PerfSample;
+
+/**
+ * \brief Open counters of calling thread.
+ *
+ * \param[out] pc -
+ *   counters.
+ *
+ * \return number of opened counters (0 - none available).
+ */
+extern int perf_open(PerfCounters *pc);
+
+/**
+ * \brief Close counters.
+ *
+ * \param[in,out] pc -
+ *   counters.
+ */
+extern void perf_close(PerfCounters *pc);
+
+/**
+ * \brief Print names of counters which are not available (nothing if all
+ * are open).
+ *
+ * \param[in] out -
+ *   output stream.
+ * \param[in] pc -
+ *   counters.
+ */
+extern void perf_warn(FILE *out, const PerfCounters *pc);
+
+/**
+ * \brief Read counters.
+ *
+ * \param[in] pc -
+ *   counters.
+ * \param[out] s -
+ *   current values.
+ */
+extern void perf_read(const PerfCounters *pc, PerfSample *s);
+
+/**
+ * \brief Difference of counters per operation.
+ *
+ * \param[out] dst -
+ *   (\a end - \a start)/\a ops, negative for events not available.
+ * \param[in] start -
+ *   values before operations.
+ * \param[in] end -
+ *   values after operations.
+ * \param[in] ops -
+ *   number of operations.
+ */
+extern void perf_diff(PerfSample *dst, const PerfSample *start, const PerfSample *end, double ops);
+
+/**
+ * \brief Print counters per operation on single line: cycles,
+ * instructions, instructions per cycle, branch and L1d misses, CPU time.
+ *
+ * \param[in] out -
+ *   output stream.
+ * \param[in] label -
+ *   prefix of line.
+ * \param[in] d -
+ *   counters per operation (\ref perf_diff).
+ */
+extern void perf_print(FILE *out, const char *label, const PerfSample *d);
+
+/** \brief Counters around phases of several operations (zero - not open). */
+typedef struct PerfPhase_st {
+	/** \brief Non-zero if at least one counter is open. */
+	int on;
+	/** \brief Open counters. */
+	PerfCounters pc;
+	/** \brief Counters at start of phase. */
+	PerfSample start;
+} PerfPhase;
+
+/**
+ * \brief Open counters of phases, warn about counters which are not available.
+ *
+ * \param[out] ph -
+ *   phase counters.
+ * \param[in] warn -
+ *   stream of warning.
+ *
+ * \return number of open counters.
+ */
+extern int perf_phase_open(PerfPhase *ph, FILE *warn);
+
+/**
+ * \brief Start phase (nothing if counters are not open).
+ *
+ * \param[in,out] ph -
+ *   phase counters.
+ */
+extern void perf_phase_begin(PerfPhase *ph);
+
+/**
+ * \brief Print counters per operation of phase (nothing if counters are not open).
+ *
+ * \param[in] ph -
+ *   phase counters.
+ * \param[in] out -
+ *   output stream.
+ * \param[in] ops -
+ *   operations of phase.
+ */
+extern void perf_phase_end(const PerfPhase *ph, FILE *out, int ops);
+
+/** \} */
+
+#endif /* __PERF_H */
@@ -0,0 +1,149 @@
+#include "crypto.h"
+
+/* Labels which separate usages of resumption secret. */
+#define RESUME_LABEL_TICKET 1
+#define RESUME_LABEL_CONFIRM 2
+#define RESUME_LABEL_KEY 3
+#define RESUME_LABEL_NEXT 4
+
+/*
+ * Pseudorandom function: AES-128-CBC-MAC under resumption secret over
+ * message of fixed length (label block, nonce of sensor, nonce of server).
+ */
+static void resume_prf(Octet *out, const Octet *ekey, int label, const Octet *nonceC, const Octet *nonceS)
+{
+	Octet msg[3*AES128_BLOCK_BYTES] = {'S', 'T', 'A', 'K', 'E', '-', 'R', 'E', 'S', 'U', 'M', 'E', 0, 0, 0, 0};
+	int i;
+
+	msg[AES128_BLOCK_BYTES - 1] = (Octet)label;
+
+	for (i = 0; i < RESUME_NONCE_BYTES; i++) {
+		msg[AES128_BLOCK_BYTES + i] = nonceC ? nonceC[i] : 0;
+		msg[2*AES128_BLOCK_BYTES + i] = nonceS ? nonceS[i] : 0;
+	}
+
+	aes128_cbc_mac(out, msg, sizeof(msg), ekey);
+}
+
+static void resume_nonce(Octet *nonce, void (*rng)(Digit *, int))
+{
+	Digit buf[RESUME_NONCE_BYTES / sizeof(Digit)];
+	int i;
+
+	if (rng) {
+		rng(buf, RESUME_NONCE_BYTES / sizeof(Digit));
+	} else {
+		rng_bits(buf, RESUME_NONCE_BYTES / sizeof(Digit));
+	}
+
+	for (i = 0; i < RESUME_NONCE_BYTES; i++) {
+		nonce[i] = ((Octet *)buf)[i];
+	}
+}
+
+static void resume_zeroize(Octet *dst, int n)
+{
+	volatile Octet *p = dst;
+
+	while (n--)
+		*p++ = 0;
+}
+
+void iotstake_resume_ticket(Octet *id, const Octet *secret)
+{
+	Octet ekey[AES128_EKEY_BYTES];
+
+	aes128_key_expansion(ekey, secret);
+	resume_prf(id, ekey, RESUME_LABEL_TICKET, 0, 0);
+	resume_zeroize(ekey, sizeof(ekey));
+}
+
+int iotstake_resume_init(ProtocolIoTResume *ctx, const Octet *secret, void (*rng)(Digit *, int))
+{
+	int i;
+
+	for (i = 0; i < RESUME_SECRET_BYTES; i++) {
+		ctx->secret[i] = secret[i];
+	}
+
+	resume_nonce(ctx->nonceC, rng);
+	resume_nonce(ctx->nonceS, rng);
+
+	return 0;
+}
+
+int iotstake_resume_q1(ProtocolIoTResume *ctx, Octet *id, Octet *nonceC)
+{
+	int i;
+
+	iotstake_resume_ticket(id, ctx->secret);
+
+	for (i = 0; i < RESUME_NONCE_BYTES; i++) {
+		nonceC[i] = ctx->nonceC[i];
+	}
+
+	return 0;
+}
+
+int iotstake_resume_q2(ProtocolIoTResume *ctx, const Octet *nonceC, Octet *nonceS, Octet *confirm)
+{
+	Octet ekey[AES128_EKEY_BYTES];
+	int i;
+
+	for (i = 0; i < RESUME_NONCE_BYTES; i++) {
+		ctx->nonceC[i] = nonceC[i];
+		nonceS[i] = ctx->nonceS[i];
+	}
+
+	aes128_key_expansion(ekey, ctx->secret);
+	resume_prf(confirm, ekey, RESUME_LABEL_CONFIRM, ctx->nonceC, ctx->nonceS);
+	resume_zeroize(ekey, sizeof(ekey));
+
+	return 0;
+}
+
+int iotstake_resume_q3(ProtocolIoTResume *ctx, const Octet *nonceS, const Octet *confirm)
+{
+	Octet ekey[AES128_EKEY_BYTES];
+	Octet expected[16];
+	Octet diff = 0;
+	int i;
+
+	for (i = 0; i < RESUME_NONCE_BYTES; i++) {
+		ctx->nonceS[i] = nonceS[i];
+	}
+
+	aes128_key_expansion(ekey, ctx->secret);
+	resume_prf(expected, ekey, RESUME_LABEL_CONFIRM, ctx->nonceC, ctx->nonceS);
+	resume_zeroize(ekey, sizeof(ekey));
+
+	/* Comparison in constant time. */
+	for (i = 0; i < 16; i++) {
+		diff |= expected[i] ^ confirm[i];
+	}
+
+	return diff != 0;
+}
+
+int iotstake_resume_hash(ProtocolIoTResume *ctx, Octet *hash, Octet *secret)
+{
+	Octet ekey[AES128_EKEY_BYTES];
+	int i;
+
+	aes128_key_expansion(ekey, ctx->secret);
+	resume_prf(ctx->hash, ekey, RESUME_LABEL_KEY, ctx->nonceC, ctx->nonceS);
+
+	if (secret)
+		resume_prf(secret, ekey, RESUME_LABEL_NEXT, ctx->nonceC, ctx->nonceS);
+
+	resume_zeroize(ekey, sizeof(ekey));
+	resume_zeroize(ctx->secret, RESUME_SECRET_BYTES);
+
+	if (hash) {
+		for (i = 0; i < 16; i++) {
+			hash[i] = ctx->hash[i];
+		}
+	}
+
+	return 0;
+}
@@ -1,27 +1,27 @@
 #include "crypto.h"
 
 const Digit secp192r1_prime[FP_DIGITS] = {
-	0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFE, 0xFFFFFFFF,
-	0xFFFFFFFF, 0xFFFFFFFF
+	ARTH_WORD_DIGITS(0xFFFFFFFF), ARTH_WORD_DIGITS(0xFFFFFFFF), ARTH_WORD_DIGITS(0xFFFFFFFE), ARTH_WORD_DIGITS(0xFFFFFFFF),
+	ARTH_WORD_DIGITS(0xFFFFFFFF), ARTH_WORD_DIGITS(0xFFFFFFFF)
 };
 
 const Digit secp192r1_invof2[FP_DIGITS] = {
-	0x00000000, 0x80000000, 0xFFFFFFFF, 0xFFFFFFFF,
-	0xFFFFFFFF, 0x7FFFFFFF
+	ARTH_WORD_DIGITS(0x00000000), ARTH_WORD_DIGITS(0x80000000), ARTH_WORD_DIGITS(0xFFFFFFFF), ARTH_WORD_DIGITS(0xFFFFFFFF),
+	ARTH_WORD_DIGITS(0xFFFFFFFF), ARTH_WORD_DIGITS(0x7FFFFFFF)
 };
 
 const Digit secp192r1_gen[2*FP_DIGITS] = {
 	/* X coordinate. */
-	0x82FF1012,	0xF4FF0AFD,	0x43A18800,	0x7CBF20EB,
-	0xB03090F6,	0x188DA80E,
+	ARTH_WORD_DIGITS(0x82FF1012),	ARTH_WORD_DIGITS(0xF4FF0AFD),	ARTH_WORD_DIGITS(0x43A18800),	ARTH_WORD_DIGITS(0x7CBF20EB),
+	ARTH_WORD_DIGITS(0xB03090F6),	ARTH_WORD_DIGITS(0x188DA80E),
 	/* Y coordinate. */
-	0x1E794811,	0x73F977A1,	0x6B24CDD5,	0x631011ED,
-	0xFFC8DA78,	0x07192B95
+	ARTH_WORD_DIGITS(0x1E794811),	ARTH_WORD_DIGITS(0x73F977A1),	ARTH_WORD_DIGITS(0x6B24CDD5),	ARTH_WORD_DIGITS(0x631011ED),
+	ARTH_WORD_DIGITS(0xFFC8DA78),	ARTH_WORD_DIGITS(0x07192B95)
 };
 
 const Digit secp192r1_gen_order[EC_GEN_ORDER_DIGITS] = {
-	0xB4D22831,	0x146BC9B1,	0x99DEF836,	0xFFFFFFFF,
-	0xFFFFFFFF,	0xFFFFFFFF
+	ARTH_WORD_DIGITS(0xB4D22831),	ARTH_WORD_DIGITS(0x146BC9B1),	ARTH_WORD_DIGITS(0x99DEF836),	ARTH_WORD_DIGITS(0xFFFFFFFF),
+	ARTH_WORD_DIGITS(0xFFFFFFFF),	ARTH_WORD_DIGITS(0xFFFFFFFF)
 };
 
 Void
@@ -72,19 +72,27 @@ secp192r1_fp_modred(Digit *dst)
 {
 	Digit *high = dst + FP_DIGITS;
 	Digit carry;
+	int i;
+
+	/*
+	 * With 64-bit words c0..c5 (L digits each) and p = 2^192 - 2^64 - 1:
+	 * c0..c2 + (c3, c4, c5) + (0, c3, c4) + (c5, c5, 0).
+	 */
+#	define L (FP_DIGITS/3)
 
 	carry = add(dst, high, FP_DIGITS);
-	carry += add(dst + 2, high, FP_DIGITS - 2);
+	carry += add(dst + L, high, FP_DIGITS - L);
 
-	high[0] = high[FP_DIGITS - 2];
-	high[1] = high[FP_DIGITS - 1];
-	high[2] = high[FP_DIGITS - 2];
-	high[3] = high[FP_DIGITS - 1];
-	high[4] = 0;
-	high[5] = 0;
+	for (i = 0; i < L; i++) {
+		high[i] = high[2*L + i];
+		high[L + i] = high[2*L + i];
+		high[2*L + i] = 0;
+	}
 
 	carry += add(dst, high, FP_DIGITS);
 
+#	undef L
+
 	while (carry > 0)
 		carry -= sub(dst, secp192r1_prime, FP_DIGITS);
 
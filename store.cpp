@@ -0,0 +1,430 @@
+#include <stdlib.h>
+
+#include "store.h"
+
+/* Octets of fields: public key, session private key, point, hash. */
+static const int field_octets[4] = {
+	2*FP_DIGITS*sizeof(Digit),
+	EC_GEN_ORDER_DIGITS*sizeof(Digit),
+	2*FP_DIGITS*sizeof(Digit),
+	16
+};
+
+#define STORE_ROUND(n) (((n) + STORE_ALIGN - 1) & ~(long)(STORE_ALIGN - 1))
+
+static long store_arena_octets(void)
+{
+	long octets = 0;
+	int f;
+
+	for (f = 0; f < 4; f++)
+		octets += STORE_ROUND((long)field_octets[f]*STORE_ARENA_SLOTS);
+
+	return octets + STORE_ROUND(STORE_ARENA_SLOTS);
+}
+
+static Octet *store_field(const StakeStore *st, int field, int slot)
+{
+	StakeStoreArena *a = st->arenas + slot / STORE_ARENA_SLOTS;
+	int i = slot % STORE_ARENA_SLOTS;
+
+	switch (field) {
+	case STORE_PUBKEY:
+		return (Octet *)(a->pubKeyB + 2*FP_DIGITS*i);
+	case STORE_EPHKEY:
+		return (Octet *)(a->ephPrvKeyA + EC_GEN_ORDER_DIGITS*i);
+	case STORE_POINT:
+		return (Octet *)(a->Q + 2*FP_DIGITS*i);
+	default:
+		return a->hash + 16*i;
+	}
+}
+
+static Octet *store_live(const StakeStore *st, int slot)
+{
+	return st->arenas[slot / STORE_ARENA_SLOTS].live + slot % STORE_ARENA_SLOTS;
+}
+
+static void store_zeroize(Octet *dst, int n)
+{
+	volatile Octet *p = dst;
+
+	while (n--)
+		*p++ = 0;
+}
+
+static void store_set(StakeStore *st, int slot, int fields)
+{
+	Octet *live = store_live(st, slot);
+	int f;
+
+	for (f = 0; f < 4; f++) {
+		if ((fields & (1 << f)) && !(*live & (1 << f)))
+			st->liveFields[f]++;
+	}
+
+	*live |= (Octet)fields;
+}
+
+static int store_grow(StakeStore *st)
+{
+	StakeStoreArena *arenas;
+	StakeStoreArena *a;
+	int *freeSlots;
+	Octet *mem;
+	int i;
+
+	arenas = (StakeStoreArena *)realloc(st->arenas, (st->arenaCount + 1)*sizeof(StakeStoreArena));
+
+	if (!arenas)
+		return 1;
+
+	st->arenas = arenas;
+
+	freeSlots = (int *)realloc(st->freeSlots, (st->arenaCount + 1)*STORE_ARENA_SLOTS*sizeof(int));
+
+	if (!freeSlots)
+		return 1;
+
+	st->freeSlots = freeSlots;
+
+	mem = (Octet *)aligned_alloc(STORE_ALIGN, store_arena_octets());
+
+	if (!mem)
+		return 1;
+
+	a = st->arenas + st->arenaCount;
+	a->mem = mem;
+	a->pubKeyB = (Digit *)mem;
+	mem += STORE_ROUND((long)field_octets[0]*STORE_ARENA_SLOTS);
+	a->ephPrvKeyA = (Digit *)mem;
+	mem += STORE_ROUND((long)field_octets[1]*STORE_ARENA_SLOTS);
+	a->Q = (Digit *)mem;
+	mem += STORE_ROUND((long)field_octets[2]*STORE_ARENA_SLOTS);
+	a->hash = mem;
+	mem += STORE_ROUND((long)field_octets[3]*STORE_ARENA_SLOTS);
+	a->live = mem;
+
+	store_zeroize(a->mem, (int)store_arena_octets());
+
+	/* Push slots in reverse order, so the lowest slots are used first. */
+	for (i = STORE_ARENA_SLOTS - 1; i >= 0; i--)
+		st->freeSlots[st->freeCount++] = st->arenaCount*STORE_ARENA_SLOTS + i;
+
+	st->arenaCount++;
+
+	return 0;
+}
+
+void stake_store_create(StakeStore *st, const Digit *prvA)
+{
+	int f;
+
+	assign(st->prvKeyA, prvA, EC_GEN_ORDER_DIGITS);
+	st->arenas = 0;
+	st->arenaCount = 0;
+	st->freeSlots = 0;
+	st->freeCount = 0;
+
+	for (f = 0; f < 4; f++)
+		st->liveFields[f] = 0;
+}
+
+void stake_store_destroy(StakeStore *st)
+{
+	int i;
+
+	for (i = 0; i < st->arenaCount; i++) {
+		store_zeroize(st->arenas[i].mem, (int)store_arena_octets());
+		free(st->arenas[i].mem);
+	}
+
+	free(st->arenas);
+	free(st->freeSlots);
+	store_zeroize((Octet *)st->prvKeyA, sizeof(st->prvKeyA));
+	stake_store_create(st, st->prvKeyA);
+}
+
+int stake_store_alloc(StakeStore *st)
+{
+	int slot;
+
+	if (st->freeCount == 0 && store_grow(st))
+		return -1;
+
+	slot = st->freeSlots[--st->freeCount];
+	*store_live(st, slot) = 0x80;
+
+	return slot;
+}
+
+void stake_store_free(StakeStore *st, int slot)
+{
+	stake_store_release(st, slot, STORE_ALL);
+	*store_live(st, slot) = 0;
+	st->freeSlots[st->freeCount++] = slot;
+}
+
+void stake_store_release(StakeStore *st, int slot, int fields)
+{
+	Octet *live = store_live(st, slot);
+	int f;
+
+	for (f = 0; f < 4; f++) {
+		if ((fields & (1 << f)) && (*live & (1 << f))) {
+			store_zeroize(store_field(st, 1 << f, slot), field_octets[f]);
+			st->liveFields[f]--;
+		}
+	}
+
+	*live &= (Octet)~fields;
+}
+
+const Octet *stake_store_key(const StakeStore *st, int slot)
+{
+	return store_field(st, STORE_HASH, slot);
+}
+
+void stake_store_init(StakeStore *st, const int *slot, const Digit *pubB, void (*rng)(Digit *, int), int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		assign((Digit *)store_field(st, STORE_PUBKEY, slot[i]), pubB + 2*FP_DIGITS*i, 2*FP_DIGITS);
+		/* Session public key is not used by IoT STAKE, so it is not computed. */
+		ecc_generate_private_key((Digit *)store_field(st, STORE_EPHKEY, slot[i]), rng);
+		store_set(st, slot[i], STORE_PUBKEY | STORE_EPHKEY);
+	}
+}
+
+/*
+ * Common part of protocol steps: point field of every session gets
+ * input point (in may be 0 if point is already there), then points
+ * are multiplied with single batch and results are copied to out.
+ */
+static int store_step(StakeStore *st, const int *slot, const Digit *in, int field, Digit *out, int *err, int n)
+{
+	Digit *P[ECC_BATCH_MAX];
+	const Digit *k[ECC_BATCH_MAX];
+	int chk[ECC_BATCH_MAX];
+	int errors = 0;
+	int m;
+	int i;
+
+	while (n > 0) {
+		m = (n < ECC_BATCH_MAX) ? n : ECC_BATCH_MAX;
+
+		for (i = 0; i < m; i++) {
+			P[i] = (Digit *)store_field(st, STORE_POINT, slot[i]);
+
+			if (in) {
+				assign(P[i], in + 2*FP_DIGITS*i, 2*FP_DIGITS);
+			} else {
+				assign(P[i], (Digit *)store_field(st, STORE_PUBKEY, slot[i]), 2*FP_DIGITS);
+			}
+
+			k[i] = field ? (Digit *)store_field(st, field, slot[i]) : st->prvKeyA;
+			store_set(st, slot[i], STORE_POINT);
+		}
+
+		errors += ecc_multiplication_batch(P, k, chk, m);
+
+		for (i = 0; i < m; i++) {
+			if (out && !chk[i])
+				assign(out + 2*FP_DIGITS*i, P[i], 2*FP_DIGITS);
+			if (err)
+				err[i] = chk[i];
+		}
+
+		slot += m;
+		n -= m;
+
+		if (in)
+			in += 2*FP_DIGITS*m;
+		if (out)
+			out += 2*FP_DIGITS*m;
+		if (err)
+			err += m;
+	}
+
+	return errors;
+}
+
+int stake_store_q1(StakeStore *st, const int *slot, Digit *Q1A, int *err, int n)
+{
+	int errors;
+	int i;
+
+	errors = store_step(st, slot, 0, STORE_EPHKEY, Q1A, err, n);
+
+	for (i = 0; i < n; i++)
+		stake_store_release(st, slot[i], STORE_PUBKEY | STORE_POINT);
+
+	return errors;
+}
+
+int stake_store_q2(StakeStore *st, const int *slot, const Digit *Q1B, Digit *Q2B, int *err, int n)
+{
+	int errors;
+	int i;
+
+	errors = store_step(st, slot, Q1B, STORE_EPHKEY, Q2B, err, n);
+
+	for (i = 0; i < n; i++)
+		stake_store_release(st, slot[i], STORE_EPHKEY | STORE_POINT);
+
+	return errors;
+}
+
+int stake_store_q3(StakeStore *st, const int *slot, const Digit *Q2A, int *err, int n)
+{
+	return store_step(st, slot, Q2A, 0, 0, err, n);
+}
+
+void stake_store_hash(StakeStore *st, const int *slot, Octet *secret, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		ecc_point_hash(store_field(st, STORE_HASH, slot[i]), (Digit *)store_field(st, STORE_POINT, slot[i]));
+
+		if (secret)
+			ecc_point_resumption(secret + RESUME_SECRET_BYTES*i, (Digit *)store_field(st, STORE_POINT, slot[i]));
+
+		store_set(st, slot[i], STORE_HASH);
+		stake_store_release(st, slot[i], STORE_POINT);
+	}
+}
+
+void stake_store_stats(const StakeStore *st, StakeStoreStats *stats)
+{
+	int f;
+
+	stats->capacity = st->arenaCount*STORE_ARENA_SLOTS;
+	stats->sessions = stats->capacity - st->freeCount;
+	stats->allocatedBytes = st->arenaCount*(store_arena_octets() + STORE_ARENA_SLOTS*(long)sizeof(int));
+	stats->liveBytes = 0;
+
+	for (f = 0; f < 4; f++) {
+		stats->fieldBytes[f] = st->liveFields[f]*field_octets[f];
+		stats->liveBytes += stats->fieldBytes[f];
+	}
+}
+
+int stake_tickets_create(StakeTickets *t, int slots)
+{
+	int n = TICKETS_PROBES;
+
+	while (n < slots)
+		n <<= 1;
+
+	t->id = (Octet *)calloc(n, RESUME_TICKET_BYTES);
+	t->secret = (Octet *)calloc(n, RESUME_SECRET_BYTES);
+	t->stamp = (unsigned long *)calloc(n, sizeof(unsigned long));
+	t->slots = n;
+	t->count = 0;
+	t->evicted = 0;
+	t->clock = 0;
+
+	if (!t->id || !t->secret || !t->stamp) {
+		stake_tickets_destroy(t);
+		return 1;
+	}
+
+	return 0;
+}
+
+void stake_tickets_destroy(StakeTickets *t)
+{
+	if (t->secret)
+		store_zeroize(t->secret, t->slots*RESUME_SECRET_BYTES);
+
+	free(t->id);
+	free(t->secret);
+	free(t->stamp);
+	t->id = 0;
+	t->secret = 0;
+	t->stamp = 0;
+	t->slots = 0;
+	t->count = 0;
+}
+
+/* First slot for ticket identifier (identifiers are uniformly random). */
+static int tickets_home(const StakeTickets *t, const Octet *id)
+{
+	return (int)((id[0] | (id[1] << 8) | (id[2] << 16) | ((unsigned)id[3] << 24)) & (unsigned)(t->slots - 1));
+}
+
+static int tickets_equal(const Octet *a, const Octet *b)
+{
+	Octet diff = 0;
+	int i;
+
+	for (i = 0; i < RESUME_TICKET_BYTES; i++)
+		diff |= a[i] ^ b[i];
+
+	return diff == 0;
+}
+
+void stake_tickets_put(StakeTickets *t, const Octet *secret)
+{
+	Octet id[RESUME_TICKET_BYTES];
+	int home;
+	int slot = -1;
+	int j;
+	int i;
+
+	iotstake_resume_ticket(id, secret);
+	home = tickets_home(t, id);
+
+	/* Free slot, the same ticket or the oldest ticket in probe window. */
+	for (j = 0; j < TICKETS_PROBES; j++) {
+		i = (home + j) & (t->slots - 1);
+
+		if (t->stamp[i] == 0 || tickets_equal(t->id + RESUME_TICKET_BYTES*i, id)) {
+			slot = i;
+			break;
+		}
+
+		if (slot < 0 || t->stamp[i] < t->stamp[slot])
+			slot = i;
+	}
+
+	if (t->stamp[slot] == 0) {
+		t->count++;
+	} else if (!tickets_equal(t->id + RESUME_TICKET_BYTES*slot, id)) {
+		t->evicted++;
+	}
+
+	for (i = 0; i < RESUME_TICKET_BYTES; i++)
+		t->id[RESUME_TICKET_BYTES*slot + i] = id[i];
+	for (i = 0; i < RESUME_SECRET_BYTES; i++)
+		t->secret[RESUME_SECRET_BYTES*slot + i] = secret[i];
+
+	t->stamp[slot] = ++t->clock;
+}
+
+int stake_tickets_take(StakeTickets *t, const Octet *id, Octet *secret)
+{
+	int home = tickets_home(t, id);
+	int j;
+	int i;
+	int k;
+
+	for (j = 0; j < TICKETS_PROBES; j++) {
+		i = (home + j) & (t->slots - 1);
+
+		if (t->stamp[i] != 0 && tickets_equal(t->id + RESUME_TICKET_BYTES*i, id)) {
+			for (k = 0; k < RESUME_SECRET_BYTES; k++)
+				secret[k] = t->secret[RESUME_SECRET_BYTES*i + k];
+
+			store_zeroize(t->secret + RESUME_SECRET_BYTES*i, RESUME_SECRET_BYTES);
+			t->stamp[i] = 0;
+			t->count--;
+
+			return 0;
+		}
+	}
+
+	return 1;
+}
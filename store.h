@@ -0,0 +1,334 @@
+#ifndef __STORE_H
+#define __STORE_H
+
+#include "crypto.h"
+
+/**
+ * \defgroup store_group IoT STAKE session store
+ * \brief Structure-of-arrays store for many IoT STAKE sessions.
+ *
+ * Sessions are kept in arenas of \ref STORE_ARENA_SLOTS sessions. Every
+ * field of session has its own table aligned to \ref STORE_ALIGN octets,
+ * so batch steps read and write one field of consecutive sessions.
+ * Static private key is common for all sessions of the store. Points
+ * Q1, Q2 and Q3 share single field, because each of them is dead after
+ * the step which produces it. Fields are zeroized as soon as they are not
+ * needed:
+ *   - public key of the other side after q1,
+ *   - session private key after q2,
+ *   - point Q3 after hash.
+ *
+ * \{
+ */
+
+/** \brief Number of sessions in single arena. */
+#define STORE_ARENA_SLOTS 1024
+
+/** \brief Alignment of field tables (cache line). */
+#define STORE_ALIGN 64
+
+/** \brief Field with public key of the other side. */
+#define STORE_PUBKEY 0x01
+/** \brief Field with session private key. */
+#define STORE_EPHKEY 0x02
+/** \brief Field with point Q1, Q2 or Q3. */
+#define STORE_POINT 0x04
+/** \brief Field with hash of point Q3. */
+#define STORE_HASH 0x08
+/** \brief All fields of session. */
+#define STORE_ALL 0x0F
+
+/** \brief Single arena of session store. */
+typedef struct StakeStoreArena_st {
+	/** \brief Public keys of the other sides. */
+	Digit *pubKeyB;
+	/** \brief Session private keys. */
+	Digit *ephPrvKeyA;
+	/** \brief Points Q1, Q2 or Q3 (depends on protocol step). */
+	Digit *Q;
+	/** \brief Hashes of points Q3. */
+	Octet *hash;
+	/** \brief Masks of live fields (0 - free slot). */
+	Octet *live;
+	/** \brief Memory of arena. */
+	Octet *mem;
+} StakeStoreArena;
+
+/** \brief Session store. */
+typedef struct StakeStore_st {
+	/** \brief User private key (common for all sessions). */
+	Digit prvKeyA[EC_GEN_ORDER_DIGITS];
+	/** \brief Table of arenas. */
+	StakeStoreArena *arenas;
+	/** \brief Number of arenas. */
+	int arenaCount;
+	/** \brief Stack of free slots. */
+	int *freeSlots;
+	/** \brief Number of free slots. */
+	int freeCount;
+	/** \brief Number of live fields of each kind. */
+	long liveFields[4];
+} StakeStore;
+
+/** \brief Memory usage of session store. */
+typedef struct StakeStoreStats_st {
+	/** \brief Number of allocated sessions. */
+	int sessions;
+	/** \brief Number of sessions which fits in arenas. */
+	int capacity;
+	/** \brief Number of octets allocated for arenas and free slot stack. */
+	long allocatedBytes;
+	/** \brief Number of octets of live fields. */
+	long liveBytes;
+	/** \brief Number of octets of live fields of each kind. */
+	long fieldBytes[4];
+} StakeStoreStats;
+
+/**
+ * \brief Session store initialization.
+ *
+ * \param[out] st -
+ *   session store.
+ * \param[in] prvA -
+ *   user private key.
+ */
+extern void stake_store_create(StakeStore *st, const Digit *prvA);
+
+/**
+ * \brief Release all memory of session store (all fields are zeroized).
+ *
+ * \param[in,out] st -
+ *   session store.
+ */
+extern void stake_store_destroy(StakeStore *st);
+
+/**
+ * \brief Allocate session.
+ *
+ * \param[in,out] st -
+ *   session store.
+ *
+ * \return Slot of session or -1 if memory allocation failed.
+ */
+extern int stake_store_alloc(StakeStore *st);
+
+/**
+ * \brief Release session (all fields are zeroized).
+ *
+ * \param[in,out] st -
+ *   session store.
+ * \param[in] slot -
+ *   slot of session.
+ */
+extern void stake_store_free(StakeStore *st, int slot);
+
+/**
+ * \brief Zeroize and release fields of session.
+ *
+ * \param[in,out] st -
+ *   session store.
+ * \param[in] slot -
+ *   slot of session.
+ * \param[in] fields -
+ *   mask of fields (e.g. \ref STORE_EPHKEY | \ref STORE_POINT).
+ */
+extern void stake_store_release(StakeStore *st, int slot, int fields);
+
+/**
+ * \brief Hash of session (valid after \ref stake_store_hash).
+ *
+ * \param[in] st -
+ *   session store.
+ * \param[in] slot -
+ *   slot of session.
+ *
+ * \return Pointer to 16 octets of hash.
+ */
+extern const Octet *stake_store_key(const StakeStore *st, int slot);
+
+/**
+ * \brief IoT STAKE protocol initialization of many sessions.
+ *
+ * \param[in,out] st -
+ *   session store.
+ * \param[in] slot -
+ *   table of \a n slots.
+ * \param[in] pubB -
+ *   table of \a n public keys of the other sides stored one after another.
+ * \param[in] rng -
+ *   pointer to function which generates random numbers (may be 0).
+ * \param[in] n -
+ *   number of sessions.
+ */
+extern void stake_store_init(StakeStore *st, const int *slot, const Digit *pubB, void (*rng)(Digit *, int), int n);
+
+/**
+ * \brief IoT STAKE protocol determine points Q1 of many sessions.
+ *
+ * \param[in,out] st -
+ *   session store.
+ * \param[in] slot -
+ *   table of \a n slots.
+ * \param[out] Q1A -
+ *   table of \a n user Q1 EC points stored one after another.
+ * \param[out] err -
+ *   table of \a n results (may be 0).
+ * \param[in] n -
+ *   number of sessions.
+ *
+ * \return Number of sessions for which error occurred.
+ */
+extern int stake_store_q1(StakeStore *st, const int *slot, Digit *Q1A, int *err, int n);
+
+/**
+ * \brief IoT STAKE protocol determine points Q2 of many sessions.
+ *
+ * \param[in,out] st -
+ *   session store.
+ * \param[in] slot -
+ *   table of \a n slots.
+ * \param[in] Q1B -
+ *   table of \a n Q1 points of the other sides.
+ * \param[out] Q2B -
+ *   table of \a n Q2 points for the other sides.
+ * \param[out] err -
+ *   table of \a n results (may be 0).
+ * \param[in] n -
+ *   number of sessions.
+ *
+ * \return Number of sessions for which error occurred.
+ */
+extern int stake_store_q2(StakeStore *st, const int *slot, const Digit *Q1B, Digit *Q2B, int *err, int n);
+
+/**
+ * \brief IoT STAKE protocol determine points Q3 of many sessions.
+ *
+ * \param[in,out] st -
+ *   session store.
+ * \param[in] slot -
+ *   table of \a n slots.
+ * \param[in] Q2A -
+ *   table of \a n user Q2 points received from the other sides.
+ * \param[out] err -
+ *   table of \a n results (may be 0).
+ * \param[in] n -
+ *   number of sessions.
+ *
+ * \return Number of sessions for which error occurred.
+ */
+extern int stake_store_q3(StakeStore *st, const int *slot, const Digit *Q2A, int *err, int n);
+
+/**
+ * \brief IoT STAKE protocol determine hashes of many sessions.
+ *
+ * \param[in,out] st -
+ *   session store.
+ * \param[in] slot -
+ *   table of \a n slots.
+ * \param[out] secret -
+ *   table of \a n resumption secrets stored one after another
+ *   (\ref RESUME_SECRET_BYTES octets each, may be 0).
+ * \param[in] n -
+ *   number of sessions.
+ */
+extern void stake_store_hash(StakeStore *st, const int *slot, Octet *secret, int n);
+
+/**
+ * \brief Memory usage of session store.
+ *
+ * \param[in] st -
+ *   session store.
+ * \param[out] stats -
+ *   memory usage.
+ */
+extern void stake_store_stats(const StakeStore *st, StakeStoreStats *stats);
+
+/** \} */
+
+/**
+ * \defgroup tickets_group Resumption ticket store
+ * \brief Bounded store of resumption secrets indexed by ticket identifiers.
+ *
+ * Ticket identifiers are outputs of pseudorandom function, so they are
+ * used directly as hash values. Every identifier may be placed in one of
+ * \ref TICKETS_PROBES consecutive slots. If all of them are used, then
+ * the oldest ticket is replaced, so memory of store never grows.
+ *
+ * \{
+ */
+
+/** \brief Number of slots checked for every ticket. */
+#define TICKETS_PROBES 8
+
+/** \brief Resumption ticket store. */
+typedef struct StakeTickets_st {
+	/** \brief Ticket identifiers. */
+	Octet *id;
+	/** \brief Resumption secrets. */
+	Octet *secret;
+	/** \brief Insertion time of tickets (0 - free slot). */
+	unsigned long *stamp;
+	/** \brief Number of slots (power of 2). */
+	int slots;
+	/** \brief Number of tickets in store. */
+	int count;
+	/** \brief Number of tickets replaced before use. */
+	long evicted;
+	/** \brief Insertion counter. */
+	unsigned long clock;
+} StakeTickets;
+
+/**
+ * \brief Ticket store initialization.
+ *
+ * \param[out] t -
+ *   ticket store.
+ * \param[in] slots -
+ *   maximum number of tickets (rounded up to power of 2).
+ *
+ * \return
+ *   - \ref 0 - if everything is OK.
+ *   - \ref 1 - if memory allocation failed.
+ */
+extern int stake_tickets_create(StakeTickets *t, int slots);
+
+/**
+ * \brief Release memory of ticket store (all secrets are zeroized).
+ *
+ * \param[in,out] t -
+ *   ticket store.
+ */
+extern void stake_tickets_destroy(StakeTickets *t);
+
+/**
+ * \brief Put resumption secret into ticket store.
+ *
+ * \param[in,out] t -
+ *   ticket store.
+ * \param[in] secret -
+ *   resumption secret (its ticket identifier is computed by
+ *   \ref iotstake_resume_ticket).
+ */
+extern void stake_tickets_put(StakeTickets *t, const Octet *secret);
+
+/**
+ * \brief Take resumption secret from ticket store.
+ *
+ * Ticket is removed from store, so every secret is used only once.
+ *
+ * \param[in,out] t -
+ *   ticket store.
+ * \param[in] id -
+ *   ticket identifier.
+ * \param[out] secret -
+ *   resumption secret.
+ *
+ * \return
+ *   - \ref 0 - if ticket was found.
+ *   - \ref 1 - if there is no such ticket.
+ */
+extern int stake_tickets_take(StakeTickets *t, const Octet *id, Octet *secret);
+
+/** \} */
+
+#endif /* __STORE_H */
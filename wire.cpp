@@ -0,0 +1,153 @@
+#include <string.h>
+
+#include "wire.h"
+
+/* SEC1 prefix of uncompressed point. */
+#define WIRE_POINT_UNCOMPRESSED 0x04
+
+/* Length of body of message without cookie (0 - unknown type). */
+static int wire_body_bytes(int type)
+{
+	switch (type) {
+	case WIRE_Q1:
+	case WIRE_Q2:
+		return WIRE_POINT_BYTES;
+	case WIRE_Q1Q2:
+		return 2*WIRE_POINT_BYTES;
+	case WIRE_Q1_SIGN:
+		return WIRE_POINT_BYTES + WIRE_SIGN_BYTES;
+	}
+
+	return 0;
+}
+
+static Octet *wire_put_point(Octet *dst, const Digit *P)
+{
+	dst[0] = WIRE_POINT_UNCOMPRESSED;
+	to_octets(dst + 1, P, FP_DIGITS);
+	to_octets(dst + 1 + FP_OCTETS, P + FP_DIGITS, FP_DIGITS);
+
+	return dst + WIRE_POINT_BYTES;
+}
+
+int wire_encode(Octet *buf, int size, int type, const Digit *P1, const Digit *P2,
+	const EcdsaSign *sign, const Octet *cookie)
+{
+	int body = wire_body_bytes(type);
+	Octet *p = buf + WIRE_HEADER_BYTES;
+
+	if (body == 0)
+		return -1;
+	if (cookie && type != WIRE_Q1 && type != WIRE_Q1Q2)
+		return -1;
+	if (cookie)
+		body += COOKIE_BYTES;
+	if (size < WIRE_HEADER_BYTES + body)
+		return -1;
+
+	buf[0] = WIRE_VERSION;
+	buf[1] = (Octet)type;
+	buf[2] = (Octet)(body >> 8);
+	buf[3] = (Octet)body;
+
+	p = wire_put_point(p, P1);
+
+	if (type == WIRE_Q1Q2)
+		p = wire_put_point(p, P2);
+
+	if (type == WIRE_Q1_SIGN) {
+		to_octets(p, sign->r, EC_GEN_ORDER_DIGITS);
+		to_octets(p + EC_GEN_ORDER_OCTETS, sign->s, EC_GEN_ORDER_DIGITS);
+		p += WIRE_SIGN_BYTES;
+	}
+
+	if (cookie)
+		memcpy(p, cookie, COOKIE_BYTES);
+
+	return WIRE_HEADER_BYTES + body;
+}
+
+/* Non-zero if big-endian coordinate is below prime of field (constant time). */
+static int wire_below_prime(const Octet *x)
+{
+	Octet p[FP_OCTETS];
+	int lt = 0;
+	int gt = 0;
+
+	to_octets(p, secp192r1_prime, FP_DIGITS);
+
+	/* The first differing octet decides. */
+	for (int i = 0; i < FP_OCTETS; i++) {
+		int decided = lt | gt;
+
+		lt |= (int)((unsigned)(x[i] - p[i]) >> 31) & ~decided;
+		gt |= (int)((unsigned)(p[i] - x[i]) >> 31) & ~decided;
+	}
+
+	return lt;
+}
+
+/* Non-zero if point is uncompressed and both coordinates are below prime. */
+static int wire_point_valid(const Octet *view)
+{
+	return (view[0] == WIRE_POINT_UNCOMPRESSED) & wire_below_prime(view + 1) &
+		wire_below_prime(view + 1 + FP_OCTETS);
+}
+
+int wire_decode(WireMessage *msg, const Octet *buf, int len)
+{
+	const Octet *p = buf + WIRE_HEADER_BYTES;
+	int expected;
+	int body;
+
+	if (len < WIRE_HEADER_BYTES)
+		return 0;
+
+	expected = wire_body_bytes(buf[1]);
+	body = (buf[2] << 8) | buf[3];
+
+	if (buf[0] != WIRE_VERSION || expected == 0)
+		return -1;
+
+	/* Cookie is allowed only after points of STAKE. */
+	if (body != expected && !(body == expected + COOKIE_BYTES && (buf[1] == WIRE_Q1 || buf[1] == WIRE_Q1Q2)))
+		return -1;
+
+	if (len < WIRE_HEADER_BYTES + body)
+		return 0;
+
+	msg->type = buf[1];
+	msg->P1 = p;
+	msg->P2 = 0;
+	msg->sign = 0;
+	msg->cookie = 0;
+	p += WIRE_POINT_BYTES;
+
+	if (msg->type == WIRE_Q1Q2) {
+		msg->P2 = p;
+		p += WIRE_POINT_BYTES;
+	} else if (msg->type == WIRE_Q1_SIGN) {
+		msg->sign = p;
+		p += WIRE_SIGN_BYTES;
+	}
+
+	if (body > expected)
+		msg->cookie = p;
+
+	if (!wire_point_valid(msg->P1) || (msg->P2 && !wire_point_valid(msg->P2)))
+		return -1;
+
+	return WIRE_HEADER_BYTES + body;
+}
+
+void wire_get_point(Digit *P, const Octet *view)
+{
+	from_octets(P, view + 1, FP_DIGITS);
+	from_octets(P + FP_DIGITS, view + 1 + FP_OCTETS, FP_DIGITS);
+}
+
+void wire_get_sign(EcdsaSign *sign, const Octet *view)
+{
+	from_octets(sign->r, view, EC_GEN_ORDER_DIGITS);
+	from_octets(sign->s, view + EC_GEN_ORDER_OCTETS, EC_GEN_ORDER_DIGITS);
+}
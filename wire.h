@@ -0,0 +1,171 @@
+#ifndef __WIRE_H
+#define __WIRE_H
+
+#include "crypto.h"
+
+/**
+ * \defgroup wire_group Wire format
+ * \brief Binary framing of IoT STAKE and IoT PKI protocol messages.
+ *
+ * Every message starts with 4 octets of header:
+ *   - version (\ref WIRE_VERSION),
+ *   - type (\ref WireType),
+ *   - length of body (2 octets, big-endian).
+ *
+ * Body consists of fixed fields, which depend on type of message:
+ *   - \ref WIRE_Q1 - point Q1 [cookie],
+ *   - \ref WIRE_Q1Q2 - points Q1 and Q2 [cookie],
+ *   - \ref WIRE_Q2 - point Q2,
+ *   - \ref WIRE_Q1_SIGN - point Q1 and signature under its X coordinate.
+ *
+ * Points are encoded as SEC1 uncompressed points (0x04, X, Y), signature
+ * as r and s, all numbers in big-endian order. Cookie
+ * (\ref COOKIE_BYTES octets) is present if length of body says so.
+ *
+ * \ref wire_decode does not copy anything: it checks the frame and
+ * returns views (pointers into input buffer) of its fields. Fields are
+ * converted to digits directly into protocol buffers by
+ * \ref wire_get_point and \ref wire_get_sign. Every check takes constant
+ * time, so any input is parsed in bounded time.
+ *
+ * \{
+ */
+
+/** \brief Version of wire format. */
+#define WIRE_VERSION 1
+
+/** \brief Number of octets of message header. */
+#define WIRE_HEADER_BYTES 4
+/** \brief Number of octets of encoded point. */
+#define WIRE_POINT_BYTES (1 + 2*FP_OCTETS)
+/** \brief Number of octets of encoded signature. */
+#define WIRE_SIGN_BYTES (2*EC_GEN_ORDER_OCTETS)
+/** \brief Maximum number of octets of message. */
+#define WIRE_MAX_BYTES (WIRE_HEADER_BYTES + 2*WIRE_POINT_BYTES + COOKIE_BYTES)
+
+/** \brief Types of protocol messages. */
+enum WireType {
+	/** \brief Point Q1 of server (STAKE), optionally with cookie. */
+	WIRE_Q1 = 1,
+	/** \brief Points Q1 and Q2 of sensor (STAKE), optionally with cookie. */
+	WIRE_Q1Q2 = 2,
+	/** \brief Point Q2 of server (STAKE). */
+	WIRE_Q2 = 3,
+	/** \brief Point Q1 and signature (PKI). */
+	WIRE_Q1_SIGN = 4
+};
+
+/** \brief View of decoded message (pointers into input buffer). */
+typedef struct WireMessage_st {
+	/** \brief Type of message (\ref WireType). */
+	int type;
+	/** \brief Encoded point Q1. */
+	const Octet *P1;
+	/** \brief Encoded point Q2 (may be 0). */
+	const Octet *P2;
+	/** \brief Encoded signature (may be 0). */
+	const Octet *sign;
+	/** \brief Cookie (may be 0). */
+	const Octet *cookie;
+} WireMessage;
+
+/**
+ * \brief Encode protocol message.
+ *
+ * \param[out] buf -
+ *   output buffer.
+ * \param[in] size -
+ *   size of output buffer.
+ * \param[in] type -
+ *   type of message (\ref WireType).
+ * \param[in] P1 -
+ *   point Q1 or Q2 (affine coordinates).
+ * \param[in] P2 -
+ *   point Q2 (\ref WIRE_Q1Q2 only).
+ * \param[in] sign -
+ *   signature (\ref WIRE_Q1_SIGN only).
+ * \param[in] cookie -
+ *   cookie (\ref WIRE_Q1 and \ref WIRE_Q1Q2 only, may be 0).
+ *
+ * \return Length of message or -1 if type is not known or buffer is too small.
+ */
+extern int wire_encode(Octet *buf, int size, int type, const Digit *P1, const Digit *P2,
+	const EcdsaSign *sign, const Octet *cookie);
+
+/**
+ * \brief Decode protocol message in place.
+ *
+ * \param[out] msg -
+ *   views of message fields.
+ * \param[in] buf -
+ *   received octets.
+ * \param[in] len -
+ *   number of received octets.
+ *
+ * \return
+ *   - length of message - if message is correct,
+ *   - 0 - if more octets are needed,
+ *   - -1 - if message is malformed (also if coordinate of point is not
+ *     below prime of field).
+ */
+extern int wire_decode(WireMessage *msg, const Octet *buf, int len);
+
+/**
+ * \brief Convert encoded point to affine coordinates.
+ *
+ * \param[out] P -
+ *   point (2*\ref FP_DIGITS digits).
+ * \param[in] view -
+ *   encoded point.
+ */
+extern void wire_get_point(Digit *P, const Octet *view);
+
+/**
+ * \brief Convert encoded signature.
+ *
+ * \param[out] sign -
+ *   signature.
+ * \param[in] view -
+ *   encoded signature.
+ */
+extern void wire_get_sign(EcdsaSign *sign, const Octet *view);
+
+/**
+ * \name Datagram transport
+ *
+ * Over datagram sockets every message is preceded by \ref WIRE_ID_BYTES
+ * octets of session identifier chosen by sensor (big-endian), so many
+ * sessions can share single socket. Besides protocol messages:
+ *   - empty message from sensor starts handshake,
+ *   - empty message from server confirms end of IoT PKI handshake,
+ *   - single octet \ref WIRE_ERROR from server reports failed session.
+ * \{
+ */
+
+/** \brief Number of octets of session identifier. */
+#define WIRE_ID_BYTES 4
+/** \brief Maximum number of octets of datagram. */
+#define WIRE_DATAGRAM_BYTES (WIRE_ID_BYTES + WIRE_MAX_BYTES)
+/** \brief Error report of server. */
+#define WIRE_ERROR 0xFF
+
+/** \brief Write session identifier. */
+static inline void wire_put_id(Octet *buf, uint32_t id)
+{
+	buf[0] = (Octet)(id >> 24);
+	buf[1] = (Octet)(id >> 16);
+	buf[2] = (Octet)(id >> 8);
+	buf[3] = (Octet)id;
+}
+
+/** \brief Read session identifier. */
+static inline uint32_t wire_get_id(const Octet *buf)
+{
+	return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) | ((uint32_t)buf[2] << 8) | buf[3];
+}
+
+/** \} */
+
+/** \} */
+
+#endif /* __WIRE_H */